@@ -19,10 +19,14 @@ GNU General Public License for more details.
 
 #include <OBForceField>
 #include <OBLogFile>
+#include <OBNbrList>
+#include <OBParameterDBRegistry>
 #include <GAFF>
 
 #include <openbabel/mol.h>
 
+#include <cstdlib>
+
 namespace OpenBabel {
   namespace OBFFs {
 
@@ -51,15 +55,16 @@ namespace OpenBabel {
       void ProcessOptions(std::vector<Option> &options);
       std::string GetDefaultOptions() const;
       
-      GAFFParameterDB *p_database;
+      const GAFFParameterDB *p_database;
       GAFFTypeRules *p_gaffTypeRules;
       GAFFType *p_gaffType;
       OBChargeMethod *p_charge;
-      bool m_HaveCreatedDB, m_HaveCreatedTypeRules, m_HaveCreatedType, m_HaveCreatedCharge; 
+      bool m_HaveAcquiredDB, m_HaveCreatedTypeRules, m_HaveCreatedType, m_HaveCreatedCharge; 
     };
 
     GAFFFunction::GAFFFunction() 
-      : m_HaveCreatedDB(false), m_HaveCreatedType(false), m_HaveCreatedCharge(false)
+      : p_database(0), p_gaffTypeRules(0), p_gaffType(0), p_charge(0),
+	m_HaveAcquiredDB(false), m_HaveCreatedTypeRules(false), m_HaveCreatedType(false), m_HaveCreatedCharge(false)
     {
       AddTerm(new BondHarmonic(this));
       AddTerm(new AngleHarmonic(this));
@@ -71,8 +76,8 @@ namespace OpenBabel {
     }
 
     GAFFFunction::~GAFFFunction(){
-      if (m_HaveCreatedDB)
-	delete p_database;
+      if (m_HaveAcquiredDB)
+	OBParameterDBRegistry::Release(p_database);
       if (m_HaveCreatedTypeRules){
 	delete p_gaffTypeRules;
       }
@@ -112,14 +117,15 @@ namespace OpenBabel {
 	  p_gaffType->SetGAFFTypeRules(p_gaffTypeRules);
 	}
       }	
-      p_database = (GAFFParameterDB *) GetParameterDB();
+      p_database = static_cast<const GAFFParameterDB*>(GetParameterDB());
       if (p_database==NULL){
+        // parsed once and shared by all GAFF functions
         std::string filename = std::string(DATADIR) + "gaff.dat";
-	p_database = new GAFFParameterDB(filename);;
+	p_database = static_cast<const GAFFParameterDB*>(OBParameterDBRegistry::Acquire("GAFF", filename, &GAFFParameterDB::Load));
 	if (p_database==NULL)
 	  return false;
 	else {
-	  m_HaveCreatedDB = true;
+	  m_HaveAcquiredDB = true;
 	  SetParameterDB(p_database);
 	}
       }
@@ -138,18 +144,21 @@ namespace OpenBabel {
       p_gaffType->ValidateTypes(p_database);
       p_charge->ComputeCharges(mol);
 
-      OBFunction::Setup(mol);
+      if (!OBFunction::Setup(mol))
+	return false;
+      // use the GAFF masses instead of the atomic masses
+      if (p_gaffType->GetMasses().size() == NumParticles())
+	SetMasses(p_gaffType->GetMasses());
+      return true;
     }
 
     void GAFFFunction::Compute(Computation computation)
     {
-      if (computation == OBFunction::Gradients)
-	for (unsigned int idx = 0; idx < m_gradients.size(); ++idx)
-	  m_gradients[idx] = Eigen::Vector3d::Zero();
+      BeginCompute(computation);
 
-      std::vector<OBFunctionTerm*>::iterator term;
-      for (term = m_terms.begin(); term != m_terms.end(); ++term)
-	(*term)->Compute(computation);
+      ComputeTerms(computation);
+
+      EndCompute(computation);
     }
   
     double GAFFFunction::GetValue() const
@@ -181,9 +190,63 @@ namespace OpenBabel {
       ss << "# Van der Waals Term #" << std::endl;
       ss << "######################" << std::endl;
       ss << std::endl;
-      ss << "# vdwterm = allpair | none" << std::endl;
+      ss << "# vdwterm = allpair | rvdw | none" << std::endl;
       ss << "vdwterm = allpair" << std::endl;
       ss << std::endl;
+      ss << "# rvdw = <double>" << std::endl;
+      ss << "rvdw = 8.0" << std::endl;
+      ss << std::endl;
+      ss << "# The energy is switched off between rvdwswitch and rvdw. If" << std::endl;
+      ss << "# rvdwswitch >= rvdw, the potential is shifted instead." << std::endl;
+      ss << "# rvdwswitch = <double>" << std::endl;
+      ss << "rvdwswitch = 7.0" << std::endl;
+      ss << std::endl;
+      ss << "######################" << std::endl;
+      ss << "# Electrostatic Term #" << std::endl;
+      ss << "######################" << std::endl;
+      ss << std::endl;
+      ss << "# electroterm = allpair | rele | none" << std::endl;
+      ss << "electroterm = allpair" << std::endl;
+      ss << std::endl;
+      ss << "# rele = <double>" << std::endl;
+      ss << "rele = 10.0" << std::endl;
+      ss << std::endl;
+      ss << "# Damping for electroterm = rele, reactionfield uses the dielectric" << std::endl;
+      ss << "# constant epsilonrf beyond rele." << std::endl;
+      ss << "# eledamping = shiftedforce | reactionfield" << std::endl;
+      ss << "eledamping = shiftedforce" << std::endl;
+      ss << std::endl;
+      ss << "# epsilonrf = <double>" << std::endl;
+      ss << "epsilonrf = 78.5" << std::endl;
+      ss << std::endl;
+      ss << "# Compute the Van der Waals and electrostatic terms separately or in a" << std::endl;
+      ss << "# single pair list (only when both terms are enabled and either both or" << std::endl;
+      ss << "# neither use a cut-off)." << std::endl;
+      ss << "# nonbonded = separate | fused" << std::endl;
+      ss << "nonbonded = separate" << std::endl;
+      ss << std::endl;
+      ss << "# Use the SIMD pair kernels for the non-bonded terms, auto selects the" << std::endl;
+      ss << "# best instruction set supported by the CPU." << std::endl;
+      ss << "# simd = auto | none" << std::endl;
+      ss << "simd = auto" << std::endl;
+      ss << std::endl;
+      ss << "#################" << std::endl;
+      ss << "# Neighbor List #" << std::endl;
+      ss << "#################" << std::endl;
+      ss << std::endl;
+      ss << "# Verlet skin for the cut-off terms, the neighbor list is rebuilt" << std::endl;
+      ss << "# once an atom moved more than skin / 2." << std::endl;
+      ss << "# skin = <double>" << std::endl;
+      ss << "skin = 1.0" << std::endl;
+      ss << std::endl;
+      ss << "###########" << std::endl;
+      ss << "# Threads #" << std::endl;
+      ss << "###########" << std::endl;
+      ss << std::endl;
+      ss << "# Number of threads used to compute the terms, 0 uses all cores." << std::endl;
+      ss << "# threads = <int>" << std::endl;
+      ss << "threads = 1" << std::endl;
+      ss << std::endl;
       return ss.str();
     }
      
@@ -200,15 +263,23 @@ namespace OpenBabel {
 
       enum VdWTerm {
 	VdWNone,
-	VdWAllPair
+	VdWAllPair,
+	VdWCutOff
       };
       int vdwterm = VdWAllPair;
+      double rvdw = 8.0, rvdwswitch = 7.0, skin = 1.0;
 
       enum ElectroTerm {
 	ElectroNone,
-	ElectroAllPair
+	ElectroAllPair,
+	ElectroCutOff
       };
       int electroterm = ElectroAllPair;
+      double rele = 10.0, epsilonrf = 78.5;
+      Coulomb::CutOffMode eledamping = Coulomb::shiftedforce;
+      bool fused = false;
+      PairKernels::InstructionSet instructionSet = PairKernels::GetBestInstructionSet();
+      int threads = 1;
 
       OBLogFile *logFile = GetLogFile();
       logFile->Write("Processing GAFF options...\n");
@@ -242,6 +313,8 @@ namespace OpenBabel {
 	if ((*option).name == "vdwterm") {
 	  if ((*option).value == "allpair") {
 	    vdwterm = VdWAllPair;
+	  } else if ((*option).value == "rvdw") {
+	    vdwterm = VdWCutOff;
 	  } else if ((*option).value == "none") {
 	    vdwterm = VdWNone;
 	  } else {
@@ -251,10 +324,26 @@ namespace OpenBabel {
 	  }
 	}
 
+	if ((*option).name == "rvdw")
+	  rvdw = atof((*option).value.c_str());
+	if ((*option).name == "rvdwswitch")
+	  rvdwswitch = atof((*option).value.c_str());
+	if ((*option).name == "skin") {
+	  skin = atof((*option).value.c_str());
+	  if (skin <= 0.0) {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	    skin = 1.0;
+	  }
+	}
+
 	if ((*option).name == "electroterm") {
-	  if ((*option).value == "allpair")
+	  if ((*option).value == "allpair") {
 	    electroterm = ElectroAllPair;
-	  if ((*option).value == "none") {
+	  } else if ((*option).value == "rele") {
+	    electroterm = ElectroCutOff;
+	  } else if ((*option).value == "none") {
 	    electroterm = ElectroNone;
 	  } else {
 	    std::stringstream ss;
@@ -262,13 +351,76 @@ namespace OpenBabel {
 	    logFile->Write(ss.str());
 	  }
 	}
+
+	if ((*option).name == "rele")
+	  rele = atof((*option).value.c_str());
+	if ((*option).name == "epsilonrf")
+	  epsilonrf = atof((*option).value.c_str());
+	if ((*option).name == "nonbonded") {
+	  if ((*option).value == "separate") {
+	    fused = false;
+	  } else if ((*option).value == "fused") {
+	    fused = true;
+	  } else {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	  }
+	}
+
+	if ((*option).name == "threads") {
+	  threads = atoi((*option).value.c_str());
+	  if (threads < 0) {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	    threads = 1;
+	  }
+	}
+
+	if ((*option).name == "simd") {
+	  if ((*option).value == "auto") {
+	    instructionSet = PairKernels::GetBestInstructionSet();
+	  } else if ((*option).value == "none") {
+	    instructionSet = PairKernels::Scalar;
+	  } else {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	  }
+	}
+
+	if ((*option).name == "eledamping") {
+	  if ((*option).value == "shiftedforce") {
+	    eledamping = Coulomb::shiftedforce;
+	  } else if ((*option).value == "reactionfield") {
+	    eledamping = Coulomb::reactionfield;
+	  } else {
+	    std::stringstream ss;
+	    ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+	    logFile->Write(ss.str());
+	  }
+	}
       }
       // use default if option for bonded interaction is not supplied
       isBondFound ? : bondedterm = BondedBond | BondedAngle | BondedTorsion | BondedOOP;
 
 
+      SetNumThreads(threads);
+
       // remove previous terms
       RemoveAllTerms();
+      SetSoAEnabled(false); // enabled again by the terms using the SIMD kernels
+      // the cut-off terms share one neighbor list
+      double rcut = 0.0;
+      if (vdwterm == VdWCutOff)
+	rcut = rvdw;
+      if ((electroterm == ElectroCutOff) && (rele > rcut))
+	rcut = rele;
+      if (rcut > 0.0)
+	SetNbrList(new OBNbrList(this, rcut, false, 1, skin));
+      else
+	SetNbrList(0);
       // add new bonded terms
       if (bondedterm & BondedBond){
 	AddTerm(new BondHarmonic(this));
@@ -286,15 +438,48 @@ namespace OpenBabel {
 	AddTerm(new TorsionHarmonic(this,"Torsion Harmonic OOP"));
 	logFile->Write("  Enabling out of plane term...\n");
       }
+      // fused van der waals and electrostatic term, the pairs come from the
+      // neighbor list if one of them uses a cut-off so both have to
+      if (fused && (vdwterm != VdWNone) && (electroterm != ElectroNone) &&
+          ((vdwterm == VdWCutOff) != (electroterm == ElectroCutOff))) {
+	fused = false;
+	logFile->Write("  The fused term needs a cut-off for both or neither term, using separate terms\n");
+      }
+      if (fused && (vdwterm != VdWNone) && (electroterm != ElectroNone)) {
+	LJ6_12Coulomb *nonbonded = new LJ6_12Coulomb(this, 0.5, 0.8333, LJ6_12::geometric);
+	if (vdwterm == VdWCutOff)
+	  nonbonded->SetVdWCutOff(rvdw, rvdwswitch);
+	if (electroterm == ElectroCutOff)
+	  nonbonded->SetElectroCutOff(rele, eledamping, epsilonrf);
+	nonbonded->SetInstructionSet(instructionSet);
+	AddTerm(nonbonded);
+	logFile->Write("  Using fused Van der Waals and electrostatic term\n");
+	return;
+      }
       // van der waals term
       switch (vdwterm) {
       case VdWNone:
 	logFile->Write("  Disabling Van der Waals term\n");
 	break;
+      case VdWCutOff:
+	{
+	  LJ6_12 *vdw = new LJ6_12(this, 0.5, LJ6_12::geometric);
+	  vdw->SetCutOff(rvdw, rvdwswitch);
+	  vdw->SetInstructionSet(instructionSet);
+	  AddTerm(vdw);
+	  std::stringstream ss;
+	  ss << "  Using cut-off Van der Waals term (rvdw = " << rvdw << ", rvdwswitch = " << rvdwswitch << ")" << std::endl;
+	  logFile->Write(ss.str());
+	}
+	break;
       case VdWAllPair:
       default:
-	AddTerm(new LJ6_12(this, 0.5, LJ6_12::geometric));
-	logFile->Write("  Using all-pairs Van der Waals term\n");
+	{
+	  LJ6_12 *vdw = new LJ6_12(this, 0.5, LJ6_12::geometric);
+	  vdw->SetInstructionSet(instructionSet);
+	  AddTerm(vdw);
+	  logFile->Write("  Using all-pairs Van der Waals term\n");
+	}
 	break;
       }
       // electrostatic term
@@ -302,10 +487,26 @@ namespace OpenBabel {
       case ElectroNone:
 	logFile->Write("  Disabling Van der electrostatic term\n");
 	break;
+      case ElectroCutOff:
+	{
+	  Coulomb *electro = new Coulomb(this, 0.8333);
+	  electro->SetCutOff(rele, eledamping, epsilonrf);
+	  electro->SetInstructionSet(instructionSet);
+	  AddTerm(electro);
+	  std::stringstream ss;
+	  ss << "  Using cut-off electrostatic term (rele = " << rele << ", "
+	     << (eledamping == Coulomb::reactionfield ? "reaction field" : "shifted force") << ")" << std::endl;
+	  logFile->Write(ss.str());
+	}
+	break;
       case ElectroAllPair:
       default:
-	logFile->Write("  Using all-pairs electrostatic term\n");
-	AddTerm(new Coulomb(this, 0.8333));
+	{
+	  logFile->Write("  Using all-pairs electrostatic term\n");
+	  Coulomb *electro = new Coulomb(this, 0.8333);
+	  electro->SetInstructionSet(instructionSet);
+	  AddTerm(electro);
+	}
 	break;
       }
     }
@@ -25,6 +25,10 @@ namespace OBFFs {
   {
     public:
       GAFFParameterDB(const std::string &filename);      
+      /**
+       * Loader for OBParameterDBRegistry::Acquire().
+       */
+      static OBParameterDB* Load(const std::string &filename) { return new GAFFParameterDB(filename); }
       bool IsInitialized() const { return _initialized; }
       void EnsureInit() { if (!_initialized) ParseParamFile(); }
     private:
@@ -316,7 +316,7 @@ namespace OpenBabel {
       return true;
     }
 
-    bool GAFFType::ValidateTypes(GAFFParameterDB * pdatabase)
+    bool GAFFType::ValidateTypes(const GAFFParameterDB * pdatabase)
     {
       vector<OBParameterDBTable::Query> query;
       std::vector<OBVariant> row;
@@ -562,6 +562,26 @@ namespace OpenBabel {
 	}
       }
       m_atoms=atoms_cleaned;
+      InitTypeIds();
+
+      // masses from the atom type properties, left empty if a type is missing
+      m_masses.clear();
+      pTable = (pdatabase->GetTable("Atom Properties"));
+      if (pTable) {
+	const vector<const vector<OBVariant>*> typeRows = pTable->FindTypeRows(0, m_typeNames);
+	vector<double> typeMasses(typeRows.size());
+	bool complete = true;
+	for (unsigned int t = 0; t < typeRows.size(); ++t) {
+	  if (typeRows[t]->size() < 2) {
+	    complete = false;
+	    break;
+	  }
+	  typeMasses[t] = typeRows[t]->at(1).AsDouble();
+	}
+	if (complete)
+	  for (unsigned int i = 0; i < m_typeIds.size(); ++i)
+	    m_masses.push_back(typeMasses[m_typeIds[i]]);
+      }
 
       return valid;
     }
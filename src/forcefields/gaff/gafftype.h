@@ -39,7 +39,12 @@ namespace OpenBabel {
       GAFFTypeRules * GetGAFFTypeRules() const {return p_typerules;}
       void SetGAFFTypeRules(GAFFTypeRules * ptyperules) {p_typerules=ptyperules;}
       bool SetTypes(const OBMol &mol);
-      bool ValidateTypes(GAFFParameterDB * pdatabase); //Check if types are in database. If not check for default patterns. If found change name. If still not found remove interaction from list.
+      bool ValidateTypes(const GAFFParameterDB * pdatabase); //Check if types are in database. If not check for default patterns. If found change name. If still not found remove interaction from list.
+      /**
+       * @return The atom masses from the "Atom Properties" table, set by
+       * ValidateTypes() (empty if a type has no mass).
+       */
+      const std::vector<double> & GetMasses() const { return m_masses; }
 //      const std::string & GetAtomType(unsigned int idx) const;
       //const std::vector<AtomIdentifier> & GetAtoms() const;
       //const std::vector<BondIdentifier> & GetBonds() const;
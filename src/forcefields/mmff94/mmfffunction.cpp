@@ -20,9 +20,12 @@ GNU General Public License for more details.
 #include <OBForceField>
 #include <OBLogFile>
 #include <OBParameterDB>
+#include <OBParameterDBRegistry>
 
 #include <openbabel/mol.h>
 
+#include <cstdlib>
+
 #include "mmffparameter.h"
 #include "mmfftype.h"
 
@@ -55,7 +58,7 @@ namespace OBFFs {
   {
     public:
       MMFF94Function();
-      //virtual ~MMFF94Function();
+      virtual ~MMFF94Function();
       
       std::string GetName() const
       {
@@ -78,11 +81,16 @@ namespace OBFFs {
     protected:
       void ProcessOptions(std::vector<Option> &options);
       std::string GetDefaultOptions() const;
+
+      const OBParameterDB *m_database; //!< acquired from OBParameterDBRegistry
   };
 
   MMFF94Function::MMFF94Function()
   {
-    SetParameterDB(new MMFF94ParameterDB(std::string(DATADIR) + std::string("mmff94.ff")));
+    // parsed once and shared by all MMFF94 functions
+    m_database = OBParameterDBRegistry::Acquire("MMFF94", std::string(DATADIR) + std::string("mmff94.ff"),
+        &MMFF94ParameterDB::Load);
+    SetParameterDB(m_database);
     SetOBFFType(new MMFF94Type);
     AddTerm(new BondCubicHarmonicTerm(this, 143.9325 / 2.0, -2.0, 7.0 / 3.0, "Bond Parameters", 4, 5));
     //AddTerm(new MMFF94AngleTerm(this, m_common));
@@ -93,6 +101,12 @@ namespace OBFFs {
     //AddTerm(new MMFF94ElectroTerm(this, m_common));
   }
 
+  MMFF94Function::~MMFF94Function()
+  {
+    delete static_cast<MMFF94Type*>(GetOBFFType());
+    OBParameterDBRegistry::Release(m_database);
+  }
+
   bool MMFF94Function::Setup(/*const*/ OBMol &mol)
   {
     MMFF94Type *type = static_cast<MMFF94Type*>(GetOBFFType());
@@ -107,18 +121,16 @@ namespace OBFFs {
     //type->PrintPartialCharges();
 
     // call setup for all terms
-    OBFunction::Setup(mol);
+    return OBFunction::Setup(mol);
   }
 
   void MMFF94Function::Compute(Computation computation)
   {
-    if (computation == OBFunction::Gradients)
-      for (unsigned int idx = 0; idx < m_gradients.size(); ++idx)
-        m_gradients[idx] = Eigen::Vector3d::Zero();
+    BeginCompute(computation);
 
-    std::vector<OBFunctionTerm*>::iterator term;
-    for (term = m_terms.begin(); term != m_terms.end(); ++term)
-      (*term)->Compute(computation);
+    ComputeTerms(computation);
+
+    EndCompute(computation);
   }
   
   double MMFF94Function::GetValue() const
@@ -157,6 +169,14 @@ namespace OBFFs {
     ss << "# rvdw = <double>" << std::endl;
     ss << "rvdw = 8.0" << std::endl;
     ss << std::endl;
+    ss << "###########" << std::endl;
+    ss << "# Threads #" << std::endl;
+    ss << "###########" << std::endl;
+    ss << std::endl;
+    ss << "# Number of threads used to compute the terms, 0 uses all cores." << std::endl;
+    ss << "# threads = <int>" << std::endl;
+    ss << "threads = 1" << std::endl;
+    ss << std::endl;
     return ss.str();
   }
      
@@ -186,6 +206,7 @@ namespace OBFFs {
       ElectroNone
     };
     int electroterm = ElectroAllPair;
+    int threads = 1;
 
     OBLogFile *logFile = GetLogFile();
     logFile->Write("Processing MMFF94 options...\n");
@@ -248,9 +269,21 @@ namespace OBFFs {
         if ((*option).value == "none")
           electroterm = ElectroNone;        
       }
+
+      if ((*option).name == "threads") {
+        threads = atoi((*option).value.c_str());
+        if (threads < 0) {
+          std::stringstream ss;
+          ss << "Invalid value for option: " << (*option).name << " = " << (*option).value << std::endl;
+          logFile->Write(ss.str());
+          threads = 1;
+        }
+      }
  
     }
 
+    SetNumThreads(threads);
+
     // remove previous terms
     RemoveAllTerms();
     // add new bonded terms
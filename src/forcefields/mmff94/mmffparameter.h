@@ -25,6 +25,10 @@ namespace OBFFs {
   {
     public:
       MMFF94ParameterDB(const std::string &filename);
+      /**
+       * Loader for OBParameterDBRegistry::Acquire().
+       */
+      static OBParameterDB* Load(const std::string &filename) { return new MMFF94ParameterDB(filename); }
       bool IsInitialized() const { return m_initialized; }
       void EnsureInit() { if (!m_initialized) ParseParamFile(); }
 
@@ -20,6 +20,8 @@ GNU General Public License for more details.
 #include "mmfftype.h"
 #include "mmffparameter.h"
 
+#include <OBParameterDBRegistry>
+
 #include <iomanip>
 #include <openbabel/mol.h>
 
@@ -30,12 +32,13 @@ namespace OBFFs {
 
   MMFF94Type::MMFF94Type()
   {
-    m_database = static_cast<OBParameterDB*>(new MMFF94ParameterDB("/home/timvdm/OBForceField/git_repo/data/mmff94.ff"));
+    // same instance as the one used by MMFF94Function
+    m_database = OBParameterDBRegistry::Acquire("MMFF94", std::string(DATADIR) + "mmff94.ff", &MMFF94ParameterDB::Load);
   }
   
   MMFF94Type::~MMFF94Type()
   {
-  
+    OBParameterDBRegistry::Release(m_database);
   }
 
   ////////////////////////////////////////////////////////////////////////////////
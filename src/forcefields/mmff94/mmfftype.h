@@ -138,7 +138,7 @@ namespace OBFFs {
       int GetCachedType(OBAtom *atom) const { return m_types.at(atom->GetIdx()-1); }
       int GetCachedType(unsigned int idx) const { return m_types.at(idx); }
       double GetPartialCharge(unsigned int idx) { return m_pCharges.at(idx); }
-      OBParameterDB *GetParameterDB() { return m_database; }
+      const OBParameterDB *GetParameterDB() { return m_database; }
 
       std::string MakeBondName(const OBMol &mol, unsigned int iA, unsigned int iB);
       std::string MakeAngleName(const OBMol &mol, unsigned int iA, unsigned int iB, unsigned int iC);
@@ -147,7 +147,7 @@ namespace OBFFs {
       std::string MakeOOPName(const OBMol &mol, unsigned int iA, unsigned int iB, unsigned int iC, unsigned int iD);
 
 
-      OBParameterDB             *m_database;
+      const OBParameterDB       *m_database;
       
       //OBMol m_mol;
       std::vector<int> m_types;
@@ -27,6 +27,9 @@ GNU General Public License for more details.
 
 #include <OBLogFile>
 #include <OBVectorMath>
+#include <OBNbrList>
+
+#include <limits>
 
 using namespace std;
 
@@ -36,7 +39,12 @@ namespace OpenBabel {
     const std::string Coulomb::m_name = "Coulomb";
 
     Coulomb::Coulomb(OBFunction *function, const double factorOneFour, const double relativePermittivity)
-      : OBFunctionTerm(function), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour), m_relativePermittivity(relativePermittivity) {}
+      : OBFunctionTerm(function), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour), m_relativePermittivity(relativePermittivity),
+        m_rcut(0.0), m_epsilonRF(78.5), m_cutOffMode(shiftedforce), m_buildCount(0),
+        m_instructionSet(PairKernels::GetBestInstructionSet()), m_kernel(NULL)
+    {
+      m_group = TermGroup::NonBonded;
+    }
 
     Coulomb::~Coulomb() 
     {
@@ -44,46 +52,277 @@ namespace OpenBabel {
       delete [] m_calcs;
     }
 
-    // Conventions taken from Lammps potentials
-    // E = 4*epsilon*( (sigma/r)^12 - (sigma/r)^6 )
-    // epsilon (energy)
-    // sigma (distance)
+    void Coulomb::SetCutOff(double rcut, CutOffMode mode, double epsilonRF)
+    {
+      m_rcut = rcut;
+      m_cutOffMode = mode;
+      m_epsilonRF = epsilonRF;
+    }
 
     void Coulomb::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      PrepareItems();
+
+      if (m_kernel && m_function->IsSoAEnabled()) {
+	if (computation == OBFunction::Gradients)
+	  m_value = ComputeKernel(0, m_numPairs, m_function->GetGradientsSoA(0), m_function->GetGradientsSoA(1),
+	      m_function->GetGradientsSoA(2), 1);
+	else
+	  m_value = ComputeKernel(0, m_numPairs, NULL, NULL, NULL, 1);
+	return;
+      }
+
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numPairs, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    unsigned int Coulomb::PrepareItems()
+    {
+      OBNbrList *nbrList = m_function->GetNbrList();
+      if ((m_rcut > 0.0) && nbrList && (nbrList->GetBuildCount() != m_buildCount))
+	SetupPairs();
+      return m_numPairs;
+    }
+
+    double Coulomb::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      // the SoA positions are only valid for the function's positions
+      if (m_kernel && m_function->IsSoAEnabled() && (positions == &m_function->GetPositions()[0])) {
+	if (computation == OBFunction::Gradients)
+	  return ComputeKernel(begin, end, gradients->data(), gradients->data() + 1, gradients->data() + 2, 3);
+	return ComputeKernel(begin, end, NULL, NULL, NULL, 3);
+      }
+
+      if (m_rcut > 0.0)
+	return ComputeCutOff(computation, begin, end, positions, gradients);
+
+      double value = 0.0;
       unsigned int ia, ib;
       double rab, term, e;
       Eigen::Vector3d Fa, Fb;
 
       if (computation == OBFunction::Gradients) {
 	double dE;
-	for (unsigned int i = 0; i < m_numPairs; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
 	  term = 1.0 / rab;
 	  e = m_calcs[i].qq * term;
 	  dE = - e * term;
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  m_value += e;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
+	  value += e;
 	}
       }      
       else {
-	for (unsigned int i = 0; i < m_numPairs; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
+	  const Eigen::Vector3d ab = positions[ia] - positions[ib];
 	  rab = ab.norm();
 	  e =  m_calcs[i].qq / rab;
-	  m_value +=  e;
+	  value +=  e;
 	}
       }
+      return value;
     }
   
+    // Shifted force:
+    //   E = qq * (1/r - 1/rc + (r - rc)/rc^2)
+    //   dE/dr = qq * (-1/r^2 + 1/rc^2)
+    //
+    // Reaction field:
+    //   E = qq * (1/r + k r^2 - c)
+    //   dE/dr = qq * (-1/r^2 + 2 k r)
+    //
+    //   k = (eps_rf - eps_r) / ((2 eps_rf + eps_r) rc^3)     c = 1/rc + k rc^2
+
+    double Coulomb::ComputeCutOff(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
+      const bool gradient = (computation == OBFunction::Gradients);
+      const double rc2 = m_rcut * m_rcut;
+      double k, c;
+      if (m_cutOffMode == reactionfield) {
+	k = (m_epsilonRF - m_relativePermittivity) / ((2.0 * m_epsilonRF + m_relativePermittivity) * rc2 * m_rcut);
+	c = 1.0 / m_rcut + k * rc2;
+      } else {
+	k = 1.0 / rc2;
+	c = 2.0 / m_rcut;
+      }
+      double r2, rab, e, dE;
+
+      for (unsigned int i = begin; i < end; ++i) {
+	const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	r2 = ab.squaredNorm();
+	if (r2 > rc2)
+	  continue;
+
+	rab = sqrt(r2);
+	// dE is (dE/dr) / r
+	if (m_cutOffMode == reactionfield) {
+	  e = m_calcs[i].qq * (1.0 / rab + k * r2 - c);
+	  dE = m_calcs[i].qq * (-1.0 / (r2 * rab) + 2.0 * k);
+	} else {
+	  e = m_calcs[i].qq * (1.0 / rab + k * rab - c);
+	  dE = m_calcs[i].qq * (-1.0 / (r2 * rab) + k / rab);
+	}
+
+	value += e;
+	if (gradient) {
+	  const Eigen::Vector3d F = ab * dE;
+	  gradients[m_i[i].iA] -= F;
+	  gradients[m_i[i].iB] += F;
+	}
+      }
+      return value;
+    }
+
+    // d2E/dr2 = 2 qq / r^3              (no cut-off, shifted force)
+    // d2E/dr2 = qq * (2 / r^3 + 2 k)    (reaction field)
+
+    void Coulomb::PairDerivatives(double qq, double r, bool cutOff, CutOffMode mode, double k,
+        double &dE, double &d2E)
+    {
+      const double r2 = r * r;
+      dE = - qq / r2;
+      d2E = 2.0 * qq / (r2 * r);
+      if (!cutOff)
+	return;
+      if (mode == reactionfield) {
+	dE += qq * 2.0 * k * r;
+	d2E += qq * 2.0 * k;
+      } else
+	dE += qq * k;
+    }
+
+    void Coulomb::ComputeHessian(OBHessian &hessian)
+    {
+      PrepareItems();
+
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      const bool cutOff = (m_rcut > 0.0);
+      const double rc2 = m_rcut * m_rcut;
+      double k = 0.0;
+      if (cutOff) {
+	if (m_cutOffMode == reactionfield)
+	  k = (m_epsilonRF - m_relativePermittivity) / ((2.0 * m_epsilonRF + m_relativePermittivity) * rc2 * m_rcut);
+	else
+	  k = 1.0 / rc2;
+      }
+      double dE, d2E;
+      for (unsigned int i = 0; i < m_numPairs; ++i) {
+	const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	const double r2 = ab.squaredNorm();
+	if (cutOff && (r2 > rc2))
+	  continue;
+	PairDerivatives(m_calcs[i].qq, sqrt(r2), cutOff, m_cutOffMode, k, dE, d2E);
+	hessian.AddDistance(m_i[i].iA, m_i[i].iB, ab, dE, d2E);
+      }
+    }
+
+    double Coulomb::ComputeKernel(unsigned int begin, unsigned int end, double *gx, double *gy, double *gz,
+        unsigned int gstride) const
+    {
+      PairKernels::Coordinates coords;
+      coords.x = m_function->GetPositionsSoA(0);
+      coords.y = m_function->GetPositionsSoA(1);
+      coords.z = m_function->GetPositionsSoA(2);
+      coords.gx = gx;
+      coords.gy = gy;
+      coords.gz = gz;
+      coords.gstride = gstride;
+
+      PairKernels::CoulombArgs args = m_kernelArgs;
+      args.numPairs = end - begin;
+      if (begin) {
+	args.index += 2 * begin;
+	args.qq += begin;
+      }
+      return m_kernel(args, coords);
+    }
+
+    void Coulomb::SetupKernel()
+    {
+      if (m_instructionSet == PairKernels::Scalar) {
+	m_kernel = NULL;
+	return;
+      }
+
+      m_kernelArgs.numPairs = m_numPairs;
+      m_kernelArgs.index = m_numPairs ? &m_i[0].iA : NULL;
+      m_kernelArgs.qq = m_numPairs ? &m_calcs[0].qq : NULL;
+      m_kernelArgs.rc2 = std::numeric_limits<double>::max();
+      m_kernelArgs.k1 = m_kernelArgs.k2 = m_kernelArgs.c = 0.0;
+      if (m_rcut > 0.0) {
+	const double rc2 = m_rcut * m_rcut;
+	m_kernelArgs.rc2 = rc2;
+	if (m_cutOffMode == reactionfield) {
+	  m_kernelArgs.k2 = (m_epsilonRF - m_relativePermittivity) / ((2.0 * m_epsilonRF + m_relativePermittivity) * rc2 * m_rcut);
+	  m_kernelArgs.c = 1.0 / m_rcut + m_kernelArgs.k2 * rc2;
+	} else {
+	  m_kernelArgs.k1 = 1.0 / rc2;
+	  m_kernelArgs.c = 2.0 / m_rcut;
+	}
+      }
+
+      m_kernel = PairKernels::GetCoulombKernel(m_instructionSet);
+      m_function->SetSoAEnabled(true);
+    }
+
+    bool Coulomb::SetupPairs()
+    {
+      OBNbrList *nbrList = m_function->GetNbrList();
+      OBFFType *pOBFFType = m_function->GetOBFFType();
+      if ( (nbrList==NULL) || (pOBFFType==NULL) || (nbrList->GetSkin() <= 0.0) ||
+           (m_charges.size() != m_function->NumParticles()) )
+	return false;
+
+      const double factor = 332.0716 / m_relativePermittivity; // energy scale: kcal/mol
+      Index i;
+      Parameter parameter;
+      vector <Index> v_i;
+      vector <Parameter> v_calcs;
+      for (unsigned int j = 0; j < m_charges.size(); ++j) {
+	if (m_charges[j] == 0.0)
+	  continue;
+	const vector<unsigned int> &nbrs = nbrList->GetVerletNbrs(j);
+	for (unsigned int n = 0; n < nbrs.size(); ++n) {
+	  i.iA = j;
+	  i.iB = nbrs[n];
+	  if (m_charges[i.iB] == 0.0)
+	    continue;
+	  const unsigned int relation = pOBFFType->GetRelation(i.iA, i.iB);
+	  if (relation & (OBFFType::OneTwo | OBFFType::OneThree))
+	    continue;
+	  parameter.qq = factor * m_charges[i.iA] * m_charges[i.iB];
+	  if (relation & OBFFType::OneFour)
+	    parameter.qq *= m_factorOneFour;
+	  v_i.push_back(i);
+	  v_calcs.push_back(parameter);
+	}
+      }
+
+      m_numPairs = v_i.size();
+      delete [] m_i;
+      delete [] m_calcs;
+      m_i = new Index [m_numPairs];
+      m_calcs = new Parameter [m_numPairs];
+      for (size_t i=0; i< m_numPairs; ++i){
+	m_i[i] = v_i[i];
+	m_calcs[i] = v_calcs[i];
+      }
+      m_buildCount = nbrList->GetBuildCount();
+      SetupKernel();
+      return true;
+    }
+
     bool Coulomb::Setup()
     {
       OBChargeMethod * pOBChargeMethod(m_function->GetOBChargeMethod());
@@ -99,16 +338,31 @@ namespace OpenBabel {
 
       const vector<double> & partialCharge = (pOBChargeMethod->GetPartialCharges());
 
+      if (m_rcut > 0.0) {
+	// cut-off: the pairs are taken from the Verlet lists in SetupPairs()
+	m_charges = partialCharge;
+	return SetupPairs();
+      }
+
+      const vector<unsigned int> &exclusionOffsets = pOBFFType->GetExclusionOffsets();
+      const vector<unsigned int> &exclusionAtoms = pOBFFType->GetExclusionAtoms();
+      const vector<unsigned char> &exclusionFlags = pOBFFType->GetExclusionFlags();
+      if (exclusionOffsets.size() != partialCharge.size() + 1)
+	return false;
       for(unsigned int j=0; j != partialCharge.size();++j){
+	// the exclusions for j are sorted, step through them while k increases
+	unsigned int x = exclusionOffsets[j];
+	const unsigned int xEnd = exclusionOffsets[j+1];
 	for(unsigned int k= j+1 ;k != partialCharge.size();++k){
+	  while (x < xEnd && exclusionAtoms[x] < k)
+	    ++x;
+	  const unsigned int relation = (x < xEnd && exclusionAtoms[x] == k) ? exclusionFlags[x] : 0;
+	  if (relation & (OBFFType::OneTwo | OBFFType::OneThree))
+	    continue;
 	  i.iA = j;
 	  i.iB = k;
-	  if (pOBFFType->IsConnected(i.iA, i.iB))
-	    continue;
-	  if (pOBFFType->IsOneThree(i.iA, i.iB))
-	    continue;
 	  parameter.qq = factor * partialCharge[j] * partialCharge[k];
-	  if (pOBFFType->IsOneFour(i.iA, i.iB))
+	  if (relation & OBFFType::OneFour)
 	    parameter.qq *= m_factorOneFour;
 	  v_i.push_back(i);
 	  v_calcs.push_back(parameter);
@@ -124,6 +378,7 @@ namespace OpenBabel {
 	m_i[i] = v_i[i];
 	m_calcs[i] = v_calcs[i];
       }
+      SetupKernel();
       return true;
     }
   }
@@ -1,12 +1,19 @@
+#ifndef OPENBABEL_COULOMB_H
+#define OPENBABEL_COULOMB_H
+
 #include <OBFunction>
 #include <OBFunctionTerm>
 
+#include "pairkernels.h"
+
 namespace OpenBabel {
   namespace OBFFs {
 
     class Coulomb : public OBFunctionTerm
     {
     public:
+      enum CutOffMode {shiftedforce, reactionfield};
+
       struct Index
       {
 	unsigned int iA, iB;
@@ -21,7 +28,47 @@ namespace OpenBabel {
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value; }
+      unsigned int PrepareItems();
+      bool HasFixedItems() const { return m_rcut <= 0.0; }
+      double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const
+      {
+        atoms[0] = m_i[item].iA;
+        atoms[1] = m_i[item].iB;
+        return 2;
+      }
+      void SetValue(double value) { m_value = value; }
+      bool HasAnalyticalHessian() const { return true; }
+      void ComputeHessian(OBHessian &hessian);
+      /**
+       * Only compute the pairs within @p rcut using the Verlet lists from the
+       * function's OBNbrList (see OBFunction::SetNbrList). The interaction is
+       * damped to go to zero at @p rcut using a shifted-force potential or a
+       * reaction field with dielectric constant @p epsilonRF beyond @p rcut.
+       * A @p rcut of 0.0 (the default) computes all pairs. Call before Setup().
+       */
+      void SetCutOff(double rcut, CutOffMode mode = shiftedforce, double epsilonRF = 78.5);
+      /**
+       * Set the instruction set for the pair loop (see LJ6_12::SetInstructionSet).
+       */
+      void SetInstructionSet(PairKernels::InstructionSet set) { m_instructionSet = set; }
+      /**
+       * Compute the first (@p dE) and second (@p d2E) derivative with respect
+       * to the distance @p r for a pair with charge product @p qq. If
+       * @p cutOff is true, the damping for @p mode is used with @p k = 1/rc^2
+       * (shifted force) or the reaction field constant k (see Coulomb.cpp).
+       */
+      static void PairDerivatives(double qq, double r, bool cutOff, CutOffMode mode, double k,
+          double &dE, double &d2E);
     private:
+      bool SetupPairs();
+      void SetupKernel();
+      double ComputeCutOff(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      double ComputeKernel(unsigned int begin, unsigned int end, double *gx, double *gy, double *gz,
+          unsigned int gstride) const;
+
       static const std::string m_name;
       unsigned int m_numPairs;
       Parameter *  m_calcs;
@@ -29,7 +76,16 @@ namespace OpenBabel {
       double m_value;
       const double m_relativePermittivity;
       const double m_factorOneFour;
+      double m_rcut, m_epsilonRF;
+      CutOffMode m_cutOffMode;
+      unsigned int m_buildCount; // OBNbrList build used for m_i & m_calcs
+      std::vector<double> m_charges;
+      PairKernels::InstructionSet m_instructionSet;
+      PairKernels::CoulombKernel m_kernel;
+      PairKernels::CoulombArgs m_kernelArgs;
     };
 
   } // OBFFs
 } // OpenBabel
+
+#endif
@@ -26,8 +26,10 @@ GNU General Public License for more details.
 
 #include <OBLogFile>
 #include <OBVectorMath>
+#include <OBNbrList>
 
 #include <map>
+#include <limits>
 
 using namespace std;
 
@@ -55,8 +57,11 @@ namespace OpenBabel {
     }
 
     LJ6_12::LJ6_12(OBFunction *function, const double factorOneFour, const LJ6_12::MixingRule rule, const std::string tableName)
-      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour) 
+      : OBFunctionTerm(function), m_tableName(tableName), m_value(999999.99), m_calcs(NULL), m_i(NULL), m_numPairs(0), m_factorOneFour(factorOneFour),
+        m_rcut(0.0), m_rswitch(0.0), m_buildCount(0), m_numTypes(0),
+        m_instructionSet(PairKernels::GetBestInstructionSet()), m_kernel(NULL)
     {
+      m_group = TermGroup::NonBonded;
       switch (rule)
 	{
 	case geometric: m_Mix = & LJ6_12::Mix<geometric>; break; 
@@ -71,6 +76,30 @@ namespace OpenBabel {
       delete [] m_calcs;
     }
 
+    void LJ6_12::MixTypeParameters(const OBParameterDBTable *table, const OBFFType *type, MixFunction mix,
+        vector<Parameter> &parameters)
+    {
+      const unsigned int numTypes = type->NumTypes();
+      const vector<const vector<OBVariant>*> rows = table->FindTypeRows(0, type->GetTypeNames());
+      vector<double> sigma(numTypes), epsilon(numTypes);
+      for (unsigned int t = 0; t < numTypes; ++t) {
+	sigma[t] = rows[t]->at(1).AsDouble();
+	epsilon[t] = rows[t]->at(2).AsDouble();
+      }
+
+      parameters.resize(numTypes * numTypes);
+      for (unsigned int a = 0; a < numTypes; ++a)
+	for (unsigned int b = 0; b < numTypes; ++b)
+	  (*mix)(parameters[a * numTypes + b].sigma, parameters[a * numTypes + b].epsilon,
+	      sigma[a], epsilon[a], sigma[b], epsilon[b]);
+    }
+
+    void LJ6_12::SetCutOff(double rcut, double rswitch)
+    {
+      m_rcut = rcut;
+      m_rswitch = rswitch;
+    }
+
     // Conventions taken from Lammps potentials
     // E = 4*epsilon*( (sigma/r)^12 - (sigma/r)^6 )
     // epsilon (energy)
@@ -78,17 +107,54 @@ namespace OpenBabel {
 
     void LJ6_12::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      PrepareItems();
+
+      if (m_kernel && m_function->IsSoAEnabled()) {
+	if (computation == OBFunction::Gradients)
+	  m_value = ComputeKernel(0, m_numPairs, m_function->GetGradientsSoA(0), m_function->GetGradientsSoA(1),
+	      m_function->GetGradientsSoA(2), 1);
+	else
+	  m_value = ComputeKernel(0, m_numPairs, NULL, NULL, NULL, 1);
+	return;
+      }
+
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numPairs, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    unsigned int LJ6_12::PrepareItems()
+    {
+      OBNbrList *nbrList = m_function->GetNbrList();
+      if ((m_rcut > 0.0) && nbrList && (nbrList->GetBuildCount() != m_buildCount))
+	SetupPairs();
+      return m_numPairs;
+    }
+
+    double LJ6_12::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      // the SoA positions are only valid for the function's positions
+      if (m_kernel && m_function->IsSoAEnabled() && (positions == &m_function->GetPositions()[0])) {
+	if (computation == OBFunction::Gradients)
+	  return ComputeKernel(begin, end, gradients->data(), gradients->data() + 1, gradients->data() + 2, 3);
+	return ComputeKernel(begin, end, NULL, NULL, NULL, 3);
+      }
+
+      if (m_rcut > 0.0)
+	return ComputeCutOff(computation, begin, end, positions, gradients);
+
+      double value = 0.0;
       double rab, term, term3, term6, term12, e;
       Eigen::Vector3d Fa, Fb;
 
       if (computation == OBFunction::Gradients) {
 	size_t ia, ib;
 	double dE;
-	for (unsigned int i = 0; i < m_numPairs; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
 	  term = m_calcs[i].sigma / rab;
 	  term3 = term * term * term;
 	  term6 = term3 * term3;
@@ -96,77 +162,274 @@ namespace OpenBabel {
 	  dE = 24.* m_calcs[i].epsilon * (-2.0*term12 + term6)/rab;
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
 	  e = 4.0 * m_calcs[i].epsilon * (term12-term6);
-	  m_value += e;
+	  value += e;
 	}
       }      
       else {
-	for (unsigned int i = 0; i < m_numPairs; ++i) {
-	  const Eigen::Vector3d ab = m_function->GetPositions()[m_i[i].iA] - m_function->GetPositions()[m_i[i].iB];
+	for (unsigned int i = begin; i < end; ++i) {
+	  const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
 	  rab = ab.norm();
 	  term = m_calcs[i].sigma / rab;
 	  term3 = term*term*term;
 	  term6 = term3*term3;
 	  term12 = term6*term6;
 	  e = 4.0 * m_calcs[i].epsilon * (term12-term6);
-	  m_value += e;      
+	  value += e;      
 	}
       }
+      return value;
     }
   
+    // Switching function (CHARMM) for rswitch < r < rcut:
+    //
+    //      (rc^2 - r^2)^2 (rc^2 + 2r^2 - 3rs^2)
+    // S = --------------------------------------
+    //               (rc^2 - rs^2)^3
+    //
+    // E' = S E   and   dE'/dr = S dE/dr + E dS/dr
+    //
+    // If rswitch >= rcut, E(rcut) is subtracted for all pairs instead.
+
+    double LJ6_12::ComputeCutOff(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
+      const bool gradient = (computation == OBFunction::Gradients);
+      const bool shift = (m_rswitch >= m_rcut);
+      const double rc2 = m_rcut * m_rcut;
+      const double rs2 = m_rswitch * m_rswitch;
+      const double switchDenom = shift ? 0.0 : 1.0 / ((rc2 - rs2) * (rc2 - rs2) * (rc2 - rs2));
+      double r2, term2, term6, term12, e, dE, sw, dSw;
+
+      for (unsigned int i = begin; i < end; ++i) {
+	const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	r2 = ab.squaredNorm();
+	if (r2 > rc2)
+	  continue;
+
+	term2 = m_calcs[i].sigma * m_calcs[i].sigma / r2;
+	term6 = term2 * term2 * term2;
+	term12 = term6 * term6;
+	e = 4.0 * m_calcs[i].epsilon * (term12 - term6);
+	// dE is (dE/dr) / r
+	dE = 24.0 * m_calcs[i].epsilon * (-2.0*term12 + term6) / r2;
+
+	if (shift) {
+	  term2 = m_calcs[i].sigma * m_calcs[i].sigma / rc2;
+	  term6 = term2 * term2 * term2;
+	  e -= 4.0 * m_calcs[i].epsilon * (term6 * term6 - term6);
+	} else if (r2 > rs2) {
+	  sw = (rc2 - r2) * (rc2 - r2) * (rc2 + 2.0*r2 - 3.0*rs2) * switchDenom;
+	  dSw = 12.0 * (rc2 - r2) * (rs2 - r2) * switchDenom;
+	  dE = dE * sw + e * dSw;
+	  e *= sw;
+	}
+
+	value += e;
+	if (gradient) {
+	  const Eigen::Vector3d F = ab * dE;
+	  gradients[m_i[i].iA] -= F;
+	  gradients[m_i[i].iB] += F;
+	}
+      }
+      return value;
+    }
+
+    // dE/dr = 4 epsilon (-12 (sigma/r)^12 + 6 (sigma/r)^6) / r
+    // d2E/dr2 = 4 epsilon (156 (sigma/r)^12 - 42 (sigma/r)^6) / r^2
+    //
+    // With the switching function: d2(S E)/dr2 = S E'' + 2 S' E' + S'' E
+
+    void LJ6_12::PairDerivatives(double epsilon, double sigma, double r2, double rc2, double rs2,
+        double &dE, double &d2E)
+    {
+      const double r = sqrt(r2);
+      const double term2 = sigma * sigma / r2;
+      const double term6 = term2 * term2 * term2;
+      const double term12 = term6 * term6;
+      dE = 4.0 * epsilon * (-12.0*term12 + 6.0*term6) / r;
+      d2E = 4.0 * epsilon * (156.0*term12 - 42.0*term6) / r2;
+
+      // the shifted potential has the same derivatives
+      if ((rc2 <= 0.0) || (rs2 >= rc2) || (r2 <= rs2))
+	return;
+
+      const double e = 4.0 * epsilon * (term12 - term6);
+      const double switchDenom = 1.0 / ((rc2 - rs2) * (rc2 - rs2) * (rc2 - rs2));
+      const double sw = (rc2 - r2) * (rc2 - r2) * (rc2 + 2.0*r2 - 3.0*rs2) * switchDenom;
+      const double dSw = 12.0 * r * (rc2 - r2) * (rs2 - r2) * switchDenom;
+      const double d2Sw = 12.0 * ((rc2 - r2) * (rs2 - r2) - 2.0*r2 * (rs2 - r2) - 2.0*r2 * (rc2 - r2)) * switchDenom;
+      d2E = sw * d2E + 2.0 * dSw * dE + d2Sw * e;
+      dE = sw * dE + dSw * e;
+    }
+
+    void LJ6_12::ComputeHessian(OBHessian &hessian)
+    {
+      PrepareItems();
+
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      const double rc2 = (m_rcut > 0.0) ? m_rcut * m_rcut : 0.0;
+      const double rs2 = m_rswitch * m_rswitch;
+      double dE, d2E;
+      for (unsigned int i = 0; i < m_numPairs; ++i) {
+	const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	const double r2 = ab.squaredNorm();
+	if ((rc2 > 0.0) && (r2 > rc2))
+	  continue;
+	PairDerivatives(m_calcs[i].epsilon, m_calcs[i].sigma, r2, rc2, rs2, dE, d2E);
+	hessian.AddDistance(m_i[i].iA, m_i[i].iB, ab, dE, d2E);
+      }
+    }
+
+    double LJ6_12::ComputeKernel(unsigned int begin, unsigned int end, double *gx, double *gy, double *gz,
+        unsigned int gstride) const
+    {
+      PairKernels::Coordinates coords;
+      coords.x = m_function->GetPositionsSoA(0);
+      coords.y = m_function->GetPositionsSoA(1);
+      coords.z = m_function->GetPositionsSoA(2);
+      coords.gx = gx;
+      coords.gy = gy;
+      coords.gz = gz;
+      coords.gstride = gstride;
+
+      PairKernels::LJ6_12Args args = m_kernelArgs;
+      args.numPairs = end - begin;
+      if (begin) {
+	args.index += 2 * begin;
+	args.A += begin;
+	args.B += begin;
+      }
+      return m_kernel(args, coords);
+    }
+
+    void LJ6_12::SetupKernel()
+    {
+      if (m_instructionSet == PairKernels::Scalar) {
+	m_kernel = NULL;
+	return;
+      }
+
+      m_A.resize(m_numPairs);
+      m_B.resize(m_numPairs);
+      for (unsigned int i = 0; i < m_numPairs; ++i) {
+	const double sigma6 = pow(m_calcs[i].sigma, 6.0);
+	m_B[i] = 4.0 * m_calcs[i].epsilon * sigma6;
+	m_A[i] = m_B[i] * sigma6;
+      }
+
+      m_kernelArgs.numPairs = m_numPairs;
+      m_kernelArgs.index = m_numPairs ? &m_i[0].iA : NULL;
+      m_kernelArgs.A = m_numPairs ? &m_A[0] : NULL;
+      m_kernelArgs.B = m_numPairs ? &m_B[0] : NULL;
+      m_kernelArgs.rc2 = m_kernelArgs.rs2 = std::numeric_limits<double>::max();
+      m_kernelArgs.switchDenom = m_kernelArgs.shiftA = m_kernelArgs.shiftB = 0.0;
+      if (m_rcut > 0.0) {
+	const double rc2 = m_rcut * m_rcut;
+	m_kernelArgs.rc2 = rc2;
+	if (m_rswitch >= m_rcut) {
+	  m_kernelArgs.shiftB = 1.0 / (rc2 * rc2 * rc2);
+	  m_kernelArgs.shiftA = m_kernelArgs.shiftB * m_kernelArgs.shiftB;
+	} else {
+	  const double rs2 = m_rswitch * m_rswitch;
+	  m_kernelArgs.rs2 = rs2;
+	  m_kernelArgs.switchDenom = 1.0 / ((rc2 - rs2) * (rc2 - rs2) * (rc2 - rs2));
+	}
+      }
+
+      m_kernel = PairKernels::GetLJ6_12Kernel(m_instructionSet);
+      m_function->SetSoAEnabled(true);
+    }
+
+    bool LJ6_12::SetupPairs()
+    {
+      OBNbrList *nbrList = m_function->GetNbrList();
+      OBFFType *pOBFFType = m_function->GetOBFFType();
+      if ( (nbrList==NULL) || (pOBFFType==NULL) || (nbrList->GetSkin() <= 0.0) ||
+           (m_typeIds.size() != m_function->NumParticles()) )
+	return false;
+
+      Index i;
+      Parameter parameter;
+      vector <Index> v_i;
+      vector <Parameter> v_calcs;
+      for (unsigned int j = 0; j < m_typeIds.size(); ++j) {
+	const vector<unsigned int> &nbrs = nbrList->GetVerletNbrs(j);
+	for (unsigned int n = 0; n < nbrs.size(); ++n) {
+	  i.iA = j;
+	  i.iB = nbrs[n];
+	  const unsigned int relation = pOBFFType->GetRelation(i.iA, i.iB);
+	  if (relation & (OBFFType::OneTwo | OBFFType::OneThree))
+	    continue;
+	  parameter = m_typeParameters[m_typeIds[i.iA] * m_numTypes + m_typeIds[i.iB]];
+	  if (relation & OBFFType::OneFour)
+	    parameter.epsilon *= m_factorOneFour;
+	  v_i.push_back(i);
+	  v_calcs.push_back(parameter);
+	}
+      }
+
+      m_numPairs = v_i.size();
+      delete [] m_i;
+      delete [] m_calcs;
+      m_i = new Index [m_numPairs];
+      m_calcs = new Parameter [m_numPairs];
+      for (size_t i=0; i< m_numPairs; ++i){
+	m_i[i] = v_i[i];
+	m_calcs[i] = v_calcs[i];
+      }
+      m_buildCount = nbrList->GetBuildCount();
+      SetupKernel();
+      return true;
+    }
+
     bool LJ6_12::Setup()
     {
       // combine the typing stored in obfftype with the parameters from the parameter database
       OBParameterDBTable * pTable = ((m_function->GetParameterDB())->GetTable(m_tableName));
       OBFFType * pOBFFType(m_function->GetOBFFType());
-      vector<OBFFType::AtomIdentifier> atoms(pOBFFType->GetAtoms());
-      vector<OBParameterDBTable::Query> query;
-      vector<OBVariant> row;
       Parameter parameter;
-      string name;
-      map<string,Parameter> parameters;
-      map<string,Parameter>::iterator itr;
       Index i;
       vector <Index> v_i;
       vector <Parameter> v_calcs;
-      OBAtom *a, *b;
 
       if ( (pTable==NULL) || (pOBFFType==NULL) )
 	return false;
 
-      double sigma_j, sigma_k, epsilon_j, epsilon_k;
-      for(unsigned int j=0; j != atoms.size(); ++j){
-	for(unsigned int k= j+1; k != atoms.size(); ++k){
-	  if (atoms[j]<atoms[k])
-	    name = atoms[j] + "-" + atoms[k];
-	  else
-	    name = atoms[k] + "-" + atoms[j];  
-	  itr=parameters.find(name);
-	  if (itr==parameters.end()){
-	    query.clear();
-	    query.push_back( OBParameterDBTable::Query(0, OBVariant(atoms[j])));
-	    row = pTable->FindRow(query);
-	    sigma_j = row.at(1).AsDouble();
-	    epsilon_j = row.at(2).AsDouble();
-	    query.clear();
-	    query.push_back( OBParameterDBTable::Query(0, OBVariant(atoms[k])));
-	    row = pTable->FindRow(query);
-	    sigma_k = row.at(1).AsDouble();
-	    epsilon_k = row.at(2).AsDouble();
-	    (*m_Mix)(parameter.sigma, parameter.epsilon, sigma_j, epsilon_j, sigma_k, epsilon_k);
-	    parameters.insert(pair<string,Parameter>(name,parameter));
-	  }
-	  else
-	    parameter=itr->second;
+      // the parameters are looked up once for each type, a pair of atoms only
+      // needs an array lookup
+      MixTypeParameters(pTable, pOBFFType, m_Mix, m_typeParameters);
+      m_typeIds = pOBFFType->GetTypeIds();
+      m_numTypes = pOBFFType->NumTypes();
+
+      // cut-off: the pairs are taken from the Verlet lists in SetupPairs()
+      if (m_rcut > 0.0)
+	return SetupPairs();
+
+      const unsigned int numAtoms = m_typeIds.size();
+      const vector<unsigned int> &exclusionOffsets = pOBFFType->GetExclusionOffsets();
+      const vector<unsigned int> &exclusionAtoms = pOBFFType->GetExclusionAtoms();
+      const vector<unsigned char> &exclusionFlags = pOBFFType->GetExclusionFlags();
+      if (exclusionOffsets.size() != numAtoms + 1)
+	return false;
+      for(unsigned int j=0; j != numAtoms; ++j){
+	const Parameter *typeParameters = &m_typeParameters[m_typeIds[j] * m_numTypes];
+	// the exclusions for j are sorted, step through them while k increases
+	unsigned int x = exclusionOffsets[j];
+	const unsigned int xEnd = exclusionOffsets[j+1];
+	for(unsigned int k= j+1; k != numAtoms; ++k){
+	  while (x < xEnd && exclusionAtoms[x] < k)
+	    ++x;
+	  const unsigned int relation = (x < xEnd && exclusionAtoms[x] == k) ? exclusionFlags[x] : 0;
+	  if (relation & (OBFFType::OneTwo | OBFFType::OneThree))
+	    continue;
 	  i.iA = j;
 	  i.iB = k;
-	  if (pOBFFType->IsConnected(i.iA, i.iB))
-	    continue;
-	  if (pOBFFType->IsOneThree(i.iA, i.iB))
-	    continue;
-	  if (pOBFFType->IsOneFour(i.iA, i.iB))
+	  parameter = typeParameters[m_typeIds[k]];
+	  if (relation & OBFFType::OneFour)
 	    parameter.epsilon *= m_factorOneFour;
 	  v_i.push_back(i);
 	  v_calcs.push_back(parameter);
@@ -182,6 +445,7 @@ namespace OpenBabel {
 	m_i[i] = v_i[i];
 	m_calcs[i] = v_calcs[i];
       }
+      SetupKernel();
       return true;
     }
   }
@@ -1,9 +1,17 @@
+#ifndef OPENBABEL_LJ6_12_H
+#define OPENBABEL_LJ6_12_H
+
 #include <OBFunction>
 #include <OBFunctionTerm>
 
+#include "pairkernels.h"
+
 namespace OpenBabel {
   namespace OBFFs {
 
+    class OBFFType;
+    class OBParameterDBTable;
+
     class LJ6_12 : public OBFunctionTerm
     {
     public:
@@ -17,25 +25,88 @@ namespace OpenBabel {
       {
 	double epsilon, sigma;
       };
+      typedef void (*MixFunction)(double &, double &, const double &,  const double &,  const double &,  const double &);
       LJ6_12(OBFunction *function, const double factorOneFour = 0.5, const LJ6_12::MixingRule rule = geometric, const std::string tableName="LJ6_12");
       ~LJ6_12();
       std::string GetName() const { return m_name; }
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value; }
-    protected:
+      unsigned int PrepareItems();
+      bool HasFixedItems() const { return m_rcut <= 0.0; }
+      double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const
+      {
+        atoms[0] = m_i[item].iA;
+        atoms[1] = m_i[item].iB;
+        return 2;
+      }
+      void SetValue(double value) { m_value = value; }
+      bool HasAnalyticalHessian() const { return true; }
+      void ComputeHessian(OBHessian &hessian);
+      /**
+       * Only compute the pairs within @p rcut using the Verlet lists from the
+       * function's OBNbrList (see OBFunction::SetNbrList). Between @p rswitch
+       * and @p rcut the energy is switched off smoothly, if @p rswitch >= @p rcut
+       * the potential is shifted to zero at @p rcut instead. A @p rcut of 0.0
+       * (the default) computes all pairs. Call before Setup().
+       */
+      void SetCutOff(double rcut, double rswitch);
+      /**
+       * Set the instruction set for the pair loop (default is
+       * PairKernels::GetBestInstructionSet()). The SIMD kernels use the
+       * function's SoA arrays (see OBFunction::SetSoAEnabled). Call before Setup().
+       */
+      void SetInstructionSet(PairKernels::InstructionSet set) { m_instructionSet = set; }
+
+      /**
+       * Compute the first (@p dE) and second (@p d2E) derivative with respect
+       * to the distance for a pair at squared distance @p r2. The squared
+       * cut-off @p rc2 and switch distance @p rs2 are used as in SetCutOff(),
+       * a @p rc2 of 0.0 means no cut-off. The pair should be within the cut-off.
+       */
+      static void PairDerivatives(double epsilon, double sigma, double r2, double rc2, double rs2,
+          double &dE, double &d2E);
+
       template <MixingRule rule>
       static void Mix(double & sigma, double & epsilon, const double & sigma_1,  const double & epsilon_1,  const double & sigma_2,  const double & epsilon_2);
+      /**
+       * Look up sigma (column 1) and epsilon (column 2) for each atom type of
+       * @p type in @p table and @p mix them for each pair of types. The
+       * parameters for atoms a and b are
+       * @p parameters[type->GetTypeId(a) * type->NumTypes() + type->GetTypeId(b)].
+       */
+      static void MixTypeParameters(const OBParameterDBTable *table, const OBFFType *type, MixFunction mix,
+          std::vector<Parameter> &parameters);
     private:
+      bool SetupPairs();
+      void SetupKernel();
+      double ComputeCutOff(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      double ComputeKernel(unsigned int begin, unsigned int end, double *gx, double *gy, double *gz,
+          unsigned int gstride) const;
+
       static const std::string m_name;
       const std::string m_tableName;
       unsigned int m_numPairs;
       Parameter *  m_calcs;
       Index * m_i;
       double m_value;
-      void (*m_Mix)(double &, double &, const double &,  const double &,  const double &,  const double &);
+      MixFunction m_Mix;
       const double m_factorOneFour;
+      double m_rcut, m_rswitch;
+      unsigned int m_buildCount; // OBNbrList build used for m_i & m_calcs
+      std::vector<unsigned int> m_typeIds;
+      unsigned int m_numTypes;
+      std::vector<Parameter> m_typeParameters; // mixed parameters for each pair of types
+      PairKernels::InstructionSet m_instructionSet;
+      PairKernels::LJ6_12Kernel m_kernel;
+      PairKernels::LJ6_12Args m_kernelArgs;
+      std::vector<double> m_A, m_B; // 4 epsilon sigma^12 & 4 epsilon sigma^6 for the kernels
     };
 
   } // OBFFs
 } // OpenBabel
+
+#endif
@@ -0,0 +1,408 @@
+/*********************************************************************
+Non-bonded Lennard-Jones + Coulomb Term
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include "LJ6_12Coulomb.h"
+#include <OBFFType>
+#include <OBParameterDB>
+#include <OBChargeMethod>
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBNbrList>
+
+#include <map>
+#include <limits>
+#include <cmath>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    const std::string LJ6_12Coulomb::m_name = "Lennard-Jones 6-12 + Coulomb";
+
+    LJ6_12Coulomb::LJ6_12Coulomb(OBFunction *function, const double factorOneFourVdW, const double factorOneFourElectro,
+        const LJ6_12::MixingRule rule, const double relativePermittivity, const std::string tableName)
+      : OBFunctionTerm(function), m_tableName(tableName), m_numPairs(0), m_calcs(NULL), m_i(NULL),
+        m_value(0.0), m_vdwValue(0.0), m_electroValue(0.0), m_factorOneFourVdW(factorOneFourVdW),
+        m_factorOneFourElectro(factorOneFourElectro), m_relativePermittivity(relativePermittivity),
+        m_rvdw(0.0), m_rswitch(0.0), m_rele(0.0), m_epsilonRF(78.5), m_cutOffMode(Coulomb::shiftedforce),
+        m_buildCount(0), m_numTypes(0), m_instructionSet(PairKernels::GetBestInstructionSet()),
+        m_vdwKernel(NULL), m_electroKernel(NULL)
+    {
+      m_group = TermGroup::NonBonded;
+      switch (rule)
+	{
+	case LJ6_12::geometric: m_Mix = & LJ6_12::Mix<LJ6_12::geometric>; break;
+	case LJ6_12::arithmetic: m_Mix = & LJ6_12::Mix<LJ6_12::arithmetic>; break;
+	case LJ6_12::sixthpower: m_Mix = & LJ6_12::Mix<LJ6_12::sixthpower>; break;
+	}
+    }
+
+    LJ6_12Coulomb::~LJ6_12Coulomb()
+    {
+      delete [] m_i;
+      delete [] m_calcs;
+    }
+
+    void LJ6_12Coulomb::SetVdWCutOff(double rcut, double rswitch)
+    {
+      m_rvdw = rcut;
+      m_rswitch = rswitch;
+    }
+
+    void LJ6_12Coulomb::SetElectroCutOff(double rcut, Coulomb::CutOffMode mode, double epsilonRF)
+    {
+      m_rele = rcut;
+      m_cutOffMode = mode;
+      m_epsilonRF = epsilonRF;
+    }
+
+    // See LJ6_12.cpp and Coulomb.cpp for the functional forms, switching and
+    // damping functions.
+
+    void LJ6_12Coulomb::Compute(OBFunction::Computation computation)
+    {
+      PrepareItems();
+
+      if (m_vdwKernel && m_function->IsSoAEnabled()) {
+	if (computation == OBFunction::Gradients)
+	  ComputeKernels(0, m_numPairs, m_function->GetGradientsSoA(0), m_function->GetGradientsSoA(1),
+	      m_function->GetGradientsSoA(2), 1, m_vdwValue, m_electroValue);
+	else
+	  ComputeKernels(0, m_numPairs, NULL, NULL, NULL, 1, m_vdwValue, m_electroValue);
+      } else {
+	std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+	ComputePairs(computation, 0, m_numPairs, &m_function->GetPositions()[0],
+	    gradients.empty() ? NULL : &gradients[0], m_vdwValue, m_electroValue);
+      }
+      m_value = m_vdwValue + m_electroValue;
+    }
+
+    unsigned int LJ6_12Coulomb::PrepareItems()
+    {
+      OBNbrList *nbrList = m_function->GetNbrList();
+      if (UseNbrList() && nbrList && (nbrList->GetBuildCount() != m_buildCount))
+	SetupPairs();
+      return m_numPairs;
+    }
+
+    double LJ6_12Coulomb::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double vdwValue, electroValue;
+      // the SoA positions are only valid for the function's positions
+      if (m_vdwKernel && m_function->IsSoAEnabled() && (positions == &m_function->GetPositions()[0])) {
+	if (computation == OBFunction::Gradients)
+	  ComputeKernels(begin, end, gradients->data(), gradients->data() + 1, gradients->data() + 2, 3,
+	      vdwValue, electroValue);
+	else
+	  ComputeKernels(begin, end, NULL, NULL, NULL, 3, vdwValue, electroValue);
+      } else
+	ComputePairs(computation, begin, end, positions, gradients, vdwValue, electroValue);
+      return vdwValue + electroValue;
+    }
+
+    void LJ6_12Coulomb::ComputePairs(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients, double &vdwValue, double &electroValue) const
+    {
+      vdwValue = 0.0;
+      electroValue = 0.0;
+      const bool gradient = (computation == OBFunction::Gradients);
+
+      // a cut-off of 0.0 means no cut-off
+      const double rvdw2 = (m_rvdw > 0.0) ? m_rvdw * m_rvdw : std::numeric_limits<double>::max();
+      const double rele2 = (m_rele > 0.0) ? m_rele * m_rele : std::numeric_limits<double>::max();
+      const double rs2 = m_rswitch * m_rswitch;
+      const bool vdwSwitch = (m_rvdw > 0.0) && (m_rswitch < m_rvdw);
+      const bool vdwShift = (m_rvdw > 0.0) && !vdwSwitch;
+      const double switchDenom = vdwSwitch ? 1.0 / ((rvdw2 - rs2) * (rvdw2 - rs2) * (rvdw2 - rs2)) : 0.0;
+      double k = 0.0, c = 0.0;
+      if (m_rele > 0.0) {
+	if (m_cutOffMode == Coulomb::reactionfield) {
+	  k = (m_epsilonRF - m_relativePermittivity) / ((2.0 * m_epsilonRF + m_relativePermittivity) * rele2 * m_rele);
+	  c = 1.0 / m_rele + k * rele2;
+	} else {
+	  k = 1.0 / rele2;
+	  c = 2.0 / m_rele;
+	}
+      }
+      double r2, rab, term2, term6, term12, e, dE, dEpair, sw, dSw;
+
+      for (unsigned int i = begin; i < end; ++i) {
+	const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	r2 = ab.squaredNorm();
+	// dEpair is (dE/dr) / r for both contributions
+	dEpair = 0.0;
+
+	if (r2 <= rvdw2) {
+	  term2 = m_calcs[i].sigma * m_calcs[i].sigma / r2;
+	  term6 = term2 * term2 * term2;
+	  term12 = term6 * term6;
+	  e = 4.0 * m_calcs[i].epsilon * (term12 - term6);
+	  dE = 24.0 * m_calcs[i].epsilon * (-2.0*term12 + term6) / r2;
+	  if (vdwShift) {
+	    term2 = m_calcs[i].sigma * m_calcs[i].sigma / rvdw2;
+	    term6 = term2 * term2 * term2;
+	    e -= 4.0 * m_calcs[i].epsilon * (term6 * term6 - term6);
+	  } else if (vdwSwitch && (r2 > rs2)) {
+	    sw = (rvdw2 - r2) * (rvdw2 - r2) * (rvdw2 + 2.0*r2 - 3.0*rs2) * switchDenom;
+	    dSw = 12.0 * (rvdw2 - r2) * (rs2 - r2) * switchDenom;
+	    dE = dE * sw + e * dSw;
+	    e *= sw;
+	  }
+	  vdwValue += e;
+	  dEpair += dE;
+	}
+
+	if ((m_calcs[i].qq != 0.0) && (r2 <= rele2)) {
+	  rab = sqrt(r2);
+	  if (m_rele <= 0.0) {
+	    e = m_calcs[i].qq / rab;
+	    dE = - e / r2;
+	  } else if (m_cutOffMode == Coulomb::reactionfield) {
+	    e = m_calcs[i].qq * (1.0 / rab + k * r2 - c);
+	    dE = m_calcs[i].qq * (-1.0 / (r2 * rab) + 2.0 * k);
+	  } else {
+	    e = m_calcs[i].qq * (1.0 / rab + k * rab - c);
+	    dE = m_calcs[i].qq * (-1.0 / (r2 * rab) + k / rab);
+	  }
+	  electroValue += e;
+	  dEpair += dE;
+	}
+
+	if (gradient) {
+	  const Eigen::Vector3d F = ab * dEpair;
+	  gradients[m_i[i].iA] -= F;
+	  gradients[m_i[i].iB] += F;
+	}
+      }
+    }
+
+    void LJ6_12Coulomb::ComputeHessian(OBHessian &hessian)
+    {
+      PrepareItems();
+
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      const double rvdw2 = (m_rvdw > 0.0) ? m_rvdw * m_rvdw : 0.0;
+      const double rele2 = m_rele * m_rele;
+      const double rs2 = m_rswitch * m_rswitch;
+      double k = 0.0;
+      if (m_rele > 0.0) {
+	if (m_cutOffMode == Coulomb::reactionfield)
+	  k = (m_epsilonRF - m_relativePermittivity) / ((2.0 * m_epsilonRF + m_relativePermittivity) * rele2 * m_rele);
+	else
+	  k = 1.0 / rele2;
+      }
+      double dE, d2E, dEpair, d2Epair;
+
+      for (unsigned int i = 0; i < m_numPairs; ++i) {
+	const Eigen::Vector3d ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	const double r2 = ab.squaredNorm();
+	dEpair = d2Epair = 0.0;
+	if ((m_rvdw <= 0.0) || (r2 <= rvdw2)) {
+	  LJ6_12::PairDerivatives(m_calcs[i].epsilon, m_calcs[i].sigma, r2, rvdw2, rs2, dE, d2E);
+	  dEpair += dE;
+	  d2Epair += d2E;
+	}
+	if ((m_calcs[i].qq != 0.0) && ((m_rele <= 0.0) || (r2 <= rele2))) {
+	  Coulomb::PairDerivatives(m_calcs[i].qq, sqrt(r2), m_rele > 0.0, m_cutOffMode, k, dE, d2E);
+	  dEpair += dE;
+	  d2Epair += d2E;
+	}
+	hessian.AddDistance(m_i[i].iA, m_i[i].iB, ab, dEpair, d2Epair);
+      }
+    }
+
+    void LJ6_12Coulomb::ComputeKernels(unsigned int begin, unsigned int end, double *gx, double *gy, double *gz,
+        unsigned int gstride, double &vdwValue, double &electroValue) const
+    {
+      PairKernels::Coordinates coords;
+      coords.x = m_function->GetPositionsSoA(0);
+      coords.y = m_function->GetPositionsSoA(1);
+      coords.z = m_function->GetPositionsSoA(2);
+      coords.gx = gx;
+      coords.gy = gy;
+      coords.gz = gz;
+      coords.gstride = gstride;
+
+      PairKernels::LJ6_12Args vdwArgs = m_vdwKernelArgs;
+      PairKernels::CoulombArgs electroArgs = m_electroKernelArgs;
+      vdwArgs.numPairs = electroArgs.numPairs = end - begin;
+      if (begin) {
+	vdwArgs.index += 2 * begin;
+	vdwArgs.A += begin;
+	vdwArgs.B += begin;
+	electroArgs.index += 2 * begin;
+	electroArgs.qq += begin;
+      }
+      vdwValue = m_vdwKernel(vdwArgs, coords);
+      electroValue = m_electroKernel(electroArgs, coords);
+    }
+
+    // The kernel arguments are set up as in LJ6_12::SetupKernel() and
+    // Coulomb::SetupKernel(), both kernels use m_i as pair index.
+    void LJ6_12Coulomb::SetupKernels()
+    {
+      if (m_instructionSet == PairKernels::Scalar) {
+	m_vdwKernel = NULL;
+	m_electroKernel = NULL;
+	return;
+      }
+
+      m_A.resize(m_numPairs);
+      m_B.resize(m_numPairs);
+      m_qq.resize(m_numPairs);
+      for (unsigned int i = 0; i < m_numPairs; ++i) {
+	const double sigma6 = pow(m_calcs[i].sigma, 6.0);
+	m_B[i] = 4.0 * m_calcs[i].epsilon * sigma6;
+	m_A[i] = m_B[i] * sigma6;
+	m_qq[i] = m_calcs[i].qq;
+      }
+
+      m_vdwKernelArgs.numPairs = m_numPairs;
+      m_vdwKernelArgs.index = m_numPairs ? &m_i[0].iA : NULL;
+      m_vdwKernelArgs.A = m_numPairs ? &m_A[0] : NULL;
+      m_vdwKernelArgs.B = m_numPairs ? &m_B[0] : NULL;
+      m_vdwKernelArgs.rc2 = m_vdwKernelArgs.rs2 = std::numeric_limits<double>::max();
+      m_vdwKernelArgs.switchDenom = m_vdwKernelArgs.shiftA = m_vdwKernelArgs.shiftB = 0.0;
+      if (m_rvdw > 0.0) {
+	const double rc2 = m_rvdw * m_rvdw;
+	m_vdwKernelArgs.rc2 = rc2;
+	if (m_rswitch >= m_rvdw) {
+	  m_vdwKernelArgs.shiftB = 1.0 / (rc2 * rc2 * rc2);
+	  m_vdwKernelArgs.shiftA = m_vdwKernelArgs.shiftB * m_vdwKernelArgs.shiftB;
+	} else {
+	  const double rs2 = m_rswitch * m_rswitch;
+	  m_vdwKernelArgs.rs2 = rs2;
+	  m_vdwKernelArgs.switchDenom = 1.0 / ((rc2 - rs2) * (rc2 - rs2) * (rc2 - rs2));
+	}
+      }
+
+      m_electroKernelArgs.numPairs = m_numPairs;
+      m_electroKernelArgs.index = m_vdwKernelArgs.index;
+      m_electroKernelArgs.qq = m_numPairs ? &m_qq[0] : NULL;
+      m_electroKernelArgs.rc2 = std::numeric_limits<double>::max();
+      m_electroKernelArgs.k1 = m_electroKernelArgs.k2 = m_electroKernelArgs.c = 0.0;
+      if (m_rele > 0.0) {
+	const double rc2 = m_rele * m_rele;
+	m_electroKernelArgs.rc2 = rc2;
+	if (m_cutOffMode == Coulomb::reactionfield) {
+	  m_electroKernelArgs.k2 = (m_epsilonRF - m_relativePermittivity) / ((2.0 * m_epsilonRF + m_relativePermittivity) * rc2 * m_rele);
+	  m_electroKernelArgs.c = 1.0 / m_rele + m_electroKernelArgs.k2 * rc2;
+	} else {
+	  m_electroKernelArgs.k1 = 1.0 / rc2;
+	  m_electroKernelArgs.c = 2.0 / m_rele;
+	}
+      }
+
+      m_vdwKernel = PairKernels::GetLJ6_12Kernel(m_instructionSet);
+      m_electroKernel = PairKernels::GetCoulombKernel(m_instructionSet);
+      m_function->SetSoAEnabled(true);
+    }
+
+    void LJ6_12Coulomb::AddPair(unsigned int iA, unsigned int iB, unsigned int relation, vector<Index> &v_i,
+        vector<Parameter> &v_calcs)
+    {
+      if (relation & (OBFFType::OneTwo | OBFFType::OneThree))
+	return;
+
+      Index i;
+      Parameter parameter;
+      i.iA = iA;
+      i.iB = iB;
+      const LJ6_12::Parameter &typeParameter = m_typeParameters[m_typeIds[iA] * m_numTypes + m_typeIds[iB]];
+      parameter.sigma = typeParameter.sigma;
+      parameter.epsilon = typeParameter.epsilon;
+      parameter.qq = 332.0716 / m_relativePermittivity * m_charges[iA] * m_charges[iB]; // energy scale: kcal/mol
+      if (relation & OBFFType::OneFour) {
+	parameter.epsilon *= m_factorOneFourVdW;
+	parameter.qq *= m_factorOneFourElectro;
+      }
+      v_i.push_back(i);
+      v_calcs.push_back(parameter);
+    }
+
+    bool LJ6_12Coulomb::SetupPairs()
+    {
+      OBNbrList *nbrList = m_function->GetNbrList();
+      OBFFType *pOBFFType = m_function->GetOBFFType();
+      const unsigned int numAtoms = m_typeIds.size();
+      vector <Index> v_i;
+      vector <Parameter> v_calcs;
+
+      if (UseNbrList()) {
+	// take the pairs from the Verlet lists
+	if ( (nbrList==NULL) || (nbrList->GetSkin() <= 0.0) )
+	  return false;
+	for (unsigned int j = 0; j < numAtoms; ++j) {
+	  const vector<unsigned int> &nbrs = nbrList->GetVerletNbrs(j);
+	  for (unsigned int n = 0; n < nbrs.size(); ++n)
+	    AddPair(j, nbrs[n], pOBFFType->GetRelation(j, nbrs[n]), v_i, v_calcs);
+	}
+	m_buildCount = nbrList->GetBuildCount();
+      } else {
+	const vector<unsigned int> &exclusionOffsets = pOBFFType->GetExclusionOffsets();
+	const vector<unsigned int> &exclusionAtoms = pOBFFType->GetExclusionAtoms();
+	const vector<unsigned char> &exclusionFlags = pOBFFType->GetExclusionFlags();
+	if (exclusionOffsets.size() != numAtoms + 1)
+	  return false;
+	for (unsigned int j = 0; j < numAtoms; ++j) {
+	  // the exclusions for j are sorted, step through them while k increases
+	  unsigned int x = exclusionOffsets[j];
+	  const unsigned int xEnd = exclusionOffsets[j+1];
+	  for (unsigned int k = j + 1; k < numAtoms; ++k) {
+	    while (x < xEnd && exclusionAtoms[x] < k)
+	      ++x;
+	    AddPair(j, k, (x < xEnd && exclusionAtoms[x] == k) ? exclusionFlags[x] : 0, v_i, v_calcs);
+	  }
+	}
+      }
+
+      m_numPairs = v_i.size();
+      delete [] m_i;
+      delete [] m_calcs;
+      m_i = new Index [m_numPairs];
+      m_calcs = new Parameter [m_numPairs];
+      for (size_t i=0; i< m_numPairs; ++i){
+	m_i[i] = v_i[i];
+	m_calcs[i] = v_calcs[i];
+      }
+      SetupKernels();
+      return true;
+    }
+
+    bool LJ6_12Coulomb::Setup()
+    {
+      OBParameterDBTable * pTable = ((m_function->GetParameterDB())->GetTable(m_tableName));
+      OBFFType * pOBFFType(m_function->GetOBFFType());
+      OBChargeMethod * pOBChargeMethod(m_function->GetOBChargeMethod());
+      if ( (pTable==NULL) || (pOBFFType==NULL) || (pOBChargeMethod==NULL) )
+	return false;
+
+      // combine the typing stored in obfftype with the parameters from the parameter database
+      LJ6_12::MixTypeParameters(pTable, pOBFFType, m_Mix, m_typeParameters);
+      m_typeIds = pOBFFType->GetTypeIds();
+      m_numTypes = pOBFFType->NumTypes();
+
+      m_charges = pOBChargeMethod->GetPartialCharges();
+      if (m_charges.size() != m_typeIds.size())
+	return false;
+
+      return SetupPairs();
+    }
+
+  }
+} // end namespace OpenBabel
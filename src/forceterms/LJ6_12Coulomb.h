@@ -0,0 +1,118 @@
+#ifndef OPENBABEL_LJ6_12COULOMB_H
+#define OPENBABEL_LJ6_12COULOMB_H
+
+#include <OBFunction>
+#include <OBFunctionTerm>
+
+#include "LJ6_12.h"
+#include "Coulomb.h"
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * Combined Lennard-Jones 6-12 and Coulomb term. Gives the same result as
+     * using the LJ6_12 and Coulomb terms but the distance, energy and force are
+     * computed in a single loop over the pairs. With the SIMD kernels (see
+     * SetInstructionSet()) the LJ6_12 and Coulomb kernels are run over the
+     * same pair list instead.
+     *
+     * If one of the parts uses a cut-off, the pairs for both parts are taken
+     * from the Verlet lists of the function's OBNbrList. A part without a
+     * cut-off then includes all pairs in the lists, use the separate terms to
+     * combine a cut-off for one part with all pairs for the other.
+     */
+    class LJ6_12Coulomb : public OBFunctionTerm
+    {
+    public:
+      struct Index
+      {
+	unsigned int iA, iB;
+      };
+      struct Parameter
+      {
+	double epsilon, sigma, qq;
+      };
+      LJ6_12Coulomb(OBFunction *function, const double factorOneFourVdW = 0.5, const double factorOneFourElectro = 0.8333,
+          const LJ6_12::MixingRule rule = LJ6_12::geometric, const double relativePermittivity = 1.0,
+          const std::string tableName="LJ6_12");
+      ~LJ6_12Coulomb();
+      std::string GetName() const { return m_name; }
+      bool Setup();
+      void Compute(OBFunction::Computation computation = OBFunction::Value);
+      double GetValue() const { return m_value; }
+      unsigned int PrepareItems();
+      bool HasFixedItems() const { return !UseNbrList(); }
+      double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const
+      {
+        atoms[0] = m_i[item].iA;
+        atoms[1] = m_i[item].iB;
+        return 2;
+      }
+      void SetValue(double value) { m_value = value; }
+      bool HasAnalyticalHessian() const { return true; }
+      void ComputeHessian(OBHessian &hessian);
+      /**
+       * @return The Lennard-Jones part of the energy from the last Compute()
+       * call. The threaded and incremental computations (see
+       * OBFunctionTerm::ComputeItems()) only update GetValue().
+       */
+      double GetVdWValue() const { return m_vdwValue; }
+      /**
+       * @return The Coulomb part of the energy from the last Compute() call.
+       */
+      double GetElectroValue() const { return m_electroValue; }
+      /**
+       * Use a cut-off for the Lennard-Jones part (see LJ6_12::SetCutOff). Call before Setup().
+       */
+      void SetVdWCutOff(double rcut, double rswitch);
+      /**
+       * Use a cut-off for the Coulomb part (see Coulomb::SetCutOff). Call before Setup().
+       */
+      void SetElectroCutOff(double rcut, Coulomb::CutOffMode mode = Coulomb::shiftedforce, double epsilonRF = 78.5);
+      /**
+       * Set the instruction set for the pair loops (see LJ6_12::SetInstructionSet()).
+       * Call before Setup().
+       */
+      void SetInstructionSet(PairKernels::InstructionSet set) { m_instructionSet = set; }
+    private:
+      bool UseNbrList() const { return (m_rvdw > 0.0) || (m_rele > 0.0); }
+      bool SetupPairs();
+      void SetupKernels();
+      void ComputePairs(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients, double &vdwValue, double &electroValue) const;
+      void ComputeKernels(unsigned int begin, unsigned int end, double *gx, double *gy, double *gz,
+          unsigned int gstride, double &vdwValue, double &electroValue) const;
+      void AddPair(unsigned int iA, unsigned int iB, unsigned int relation, std::vector<Index> &v_i,
+          std::vector<Parameter> &v_calcs);
+
+      static const std::string m_name;
+      const std::string m_tableName;
+      unsigned int m_numPairs;
+      Parameter *  m_calcs;
+      Index * m_i;
+      double m_value, m_vdwValue, m_electroValue;
+      LJ6_12::MixFunction m_Mix;
+      const double m_factorOneFourVdW, m_factorOneFourElectro;
+      const double m_relativePermittivity;
+      double m_rvdw, m_rswitch, m_rele, m_epsilonRF;
+      Coulomb::CutOffMode m_cutOffMode;
+      unsigned int m_buildCount; // OBNbrList build used for m_i & m_calcs
+      std::vector<unsigned int> m_typeIds;
+      unsigned int m_numTypes;
+      std::vector<LJ6_12::Parameter> m_typeParameters; // mixed parameters for each pair of types
+      std::vector<double> m_charges;
+      PairKernels::InstructionSet m_instructionSet;
+      PairKernels::LJ6_12Kernel m_vdwKernel;
+      PairKernels::CoulombKernel m_electroKernel;
+      PairKernels::LJ6_12Args m_vdwKernelArgs;
+      PairKernels::CoulombArgs m_electroKernelArgs;
+      std::vector<double> m_A, m_B, m_qq; // LJ6_12 & Coulomb parameters for the kernels
+    };
+
+  } // OBFFs
+} // OpenBabel
+
+#endif
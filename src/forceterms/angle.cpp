@@ -57,18 +57,26 @@ namespace OpenBabel {
 
     void AngleHarmonic::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numAngles, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    double AngleHarmonic::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
       double theta, delta, delta2, e;
 	
       if (computation == OBFunction::Gradients) {
 	size_t ia, ib, ic;
 	Eigen::Vector3d Fa, Fb, Fc;
 	double dE;
-	for (unsigned int i = 0; i < m_numAngles; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
 	  ic = m_i[i].iC;
-	  theta = VectorAngleDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], m_function->GetPositions()[ic], Fa, Fb, Fc); 
+	  theta = VectorAngleDerivative(positions[ia], positions[ib], positions[ic], Fa, Fb, Fc); 
 	  delta = DEG_TO_RAD * (theta - m_calcs[i].theta0);
 	  if (!isfinite(theta))
 	    theta = 0.0;
@@ -76,27 +84,43 @@ namespace OpenBabel {
 	  Fa *= dE;
 	  Fb *= dE;
 	  Fc *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  m_function->GetGradients()[ic] += Fc;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
+	  gradients[ic] += Fc;
 	  delta2 = delta * delta;
 	  e = m_calcs[i].K * delta2;
-	  m_value += e;
+	  value += e;
 	}
       } else {
 	Eigen::Vector3d ab, bc;
-	for (unsigned int i = 0; i < m_numAngles; ++i) {
-	  ab = m_function->GetPositions()[m_i[i].iA] - m_function->GetPositions()[m_i[i].iB];
-	  bc = m_function->GetPositions()[m_i[i].iC] - m_function->GetPositions()[m_i[i].iB];
+	for (unsigned int i = begin; i < end; ++i) {
+	  ab = positions[m_i[i].iA] - positions[m_i[i].iB];
+	  bc = positions[m_i[i].iC] - positions[m_i[i].iB];
 	  theta = VectorAngle(ab, bc);
 	  if (!isfinite(theta))
 	    theta = 0.0;
 	  delta = DEG_TO_RAD * (theta - m_calcs[i].theta0);
 	  delta2 = delta * delta;
 	  e = m_calcs[i].K * delta2;
-	  m_value += e;
+	  value += e;
 	}
       }
+      return value;
+    }
+  
+    // dE/dtheta = 2 * K * (theta-theta0)
+    // d2E/dtheta2 = 2 * K
+    void AngleHarmonic::ComputeHessian(OBHessian &hessian)
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      Eigen::Vector3d grad[3];
+      Eigen::Matrix3d hess[9];
+      for (unsigned int i = 0; i < m_numAngles; ++i) {
+	const unsigned int atoms[3] = { m_i[i].iA, m_i[i].iB, m_i[i].iC };
+	const double theta = VectorAngleHessian(positions[atoms[0]], positions[atoms[1]], positions[atoms[2]], grad, hess);
+	const double delta = theta - DEG_TO_RAD * m_calcs[i].theta0;
+	hessian.AddCoordinate(3, atoms, grad, hess, 2.0 * m_calcs[i].K * delta, 2.0 * m_calcs[i].K);
+      }
     }
   
     bool AngleHarmonic::Setup()
@@ -54,40 +54,63 @@ namespace OpenBabel {
 
     void BondHarmonic::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numBonds, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    double BondHarmonic::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
       unsigned int ia, ib;
       double rab, delta, delta2, e;
       Eigen::Vector3d Fa, Fb;
 
       if (computation == OBFunction::Gradients) {
 	double dE;
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
 	  delta = rab - m_calcs[i].r0;
 	  delta2 = delta * delta;
 	  dE = 2.0 * m_calcs[i].K * delta;
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
 	  e = m_calcs[i].K * delta2;
-	  m_value += e;
+	  value += e;
 	}
       }      
       else {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
+	  const Eigen::Vector3d ab = positions[ia] - positions[ib];
 	  rab = ab.norm();
 	  delta = rab - m_calcs[i].r0;
 	  delta2 = delta * delta;
 	  e = m_calcs[i].K * delta2;
-	  m_value += e;      
+	  value += e;      
 	}
       }
+      return value;
+    }
+  
+    // dE/dr = 2 * K * (r-r0)
+    // d2E/dr2 = 2 * K
+    void BondHarmonic::ComputeHessian(OBHessian &hessian)
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      for (unsigned int i = 0; i < m_numBonds; ++i) {
+	const unsigned int ia = m_i[i].iA;
+	const unsigned int ib = m_i[i].iB;
+	const Eigen::Vector3d ab = positions[ia] - positions[ib];
+	const double delta = ab.norm() - m_calcs[i].r0;
+	hessian.AddDistance(ia, ib, ab, 2.0 * m_calcs[i].K * delta, 2.0 * m_calcs[i].K);
+      }
     }
   
     bool BondHarmonic::Setup()
@@ -149,38 +172,63 @@ namespace OpenBabel {
 
     void BondClass2::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numBonds, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    double BondClass2::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
       unsigned int ia, ib;
       double rab, delta, delta2, e, dE;
       Eigen::Vector3d Fa, Fb;
 
       if (computation == OBFunction::Gradients) {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
 	  delta = rab - m_calcs[i].r0;
 	  delta2 = delta * delta;
 	  dE = delta * (2.0 * m_calcs[i].K2 + 3.0 * m_calcs[i].K3 * delta + 4.0 * m_calcs[i].K4 * delta2);
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
 	  e = delta2 * (m_calcs[i].K2 + m_calcs[i].K3 * delta + m_calcs[i].K4 * delta2);
-	  m_value += e;
+	  value += e;
 	}      
       } else {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
+	  const Eigen::Vector3d ab = positions[ia] - positions[ib];
 	  rab = ab.norm();
 	  delta = rab - m_calcs[i].r0;
 	  delta2 = delta * delta;
 	  e = delta2 * (m_calcs[i].K2 + m_calcs[i].K3 * delta + m_calcs[i].K4 * delta2);
-	  m_value += e;      
+	  value += e;      
 	}
       }
+      return value;
+    }
+  
+    // dE/dr = 2 * K2 * (r-r0) + 3 * K3 * (r-r0)^2 + 4 * K4 * (r-r0)^3
+    // d2E/dr2 = 2 * K2 + 6 * K3 * (r-r0) + 12 * K4 * (r-r0)^2
+    void BondClass2::ComputeHessian(OBHessian &hessian)
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      for (unsigned int i = 0; i < m_numBonds; ++i) {
+	const unsigned int ia = m_i[i].iA;
+	const unsigned int ib = m_i[i].iB;
+	const Eigen::Vector3d ab = positions[ia] - positions[ib];
+	const double delta = ab.norm() - m_calcs[i].r0;
+	const double dE = delta * (2.0 * m_calcs[i].K2 + 3.0 * m_calcs[i].K3 * delta + 4.0 * m_calcs[i].K4 * delta * delta);
+	const double d2E = 2.0 * m_calcs[i].K2 + 6.0 * m_calcs[i].K3 * delta + 12.0 * m_calcs[i].K4 * delta * delta;
+	hessian.AddDistance(ia, ib, ab, dE, d2E);
+      }
     }
   
     bool BondClass2::Setup()
@@ -20,6 +20,19 @@ namespace OpenBabel {
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value; }
+      unsigned int PrepareItems() { return m_numBonds; }
+      bool HasFixedItems() const { return true; }
+      double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const
+      {
+        atoms[0] = m_i[item].iA;
+        atoms[1] = m_i[item].iB;
+        return 2;
+      }
+      void SetValue(double value) { m_value = value; }
+      bool HasAnalyticalHessian() const { return true; }
+      void ComputeHessian(OBHessian &hessian);
     private:
       static const std::string m_name;
       const std::string m_tableName;
@@ -46,6 +59,19 @@ namespace OpenBabel {
       bool Setup();
       void Compute(OBFunction::Computation computation = OBFunction::Value);
       double GetValue() const { return m_value; }
+      unsigned int PrepareItems() { return m_numBonds; }
+      bool HasFixedItems() const { return true; }
+      double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const
+      {
+        atoms[0] = m_i[item].iA;
+        atoms[1] = m_i[item].iB;
+        return 2;
+      }
+      void SetValue(double value) { m_value = value; }
+      bool HasAnalyticalHessian() const { return true; }
+      void ComputeHessian(OBHessian &hessian);
     private:
       static const std::string m_name;
       const std::string m_tableName;
@@ -50,39 +50,66 @@ namespace OpenBabel {
 
     void BondCubicHarmonicTerm::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numBonds, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    double BondCubicHarmonicTerm::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
       unsigned int ia, ib;
       double rab, delta, delta2, e;
       Eigen::Vector3d Fa, Fb;
 
       if (computation == OBFunction::Gradients) {
 	double dE;
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  rab = VectorBondDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], Fa, Fb);
+	  rab = VectorBondDerivative(positions[ia], positions[ib], Fa, Fb);
 	  delta = rab - m_calcs[i].r0;
 	  delta2 = delta * delta;
-	  dE = m_prefactor * m_calcs[i].K * delta * (1.0 + 3.0 * m_cs * delta + 4.0 * m_cs2 * delta2);
+	  dE = m_prefactor * m_calcs[i].K * delta * (2.0 + 3.0 * m_cs * delta + 4.0 * m_cs2 * delta2);
 	  Fa *= dE;
 	  Fb *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
 	  e = m_prefactor * m_calcs[i].K * delta2 * (1.0 + m_cs * delta + m_cs2 * delta2);
-	  m_value += e;
+	  value += e;
 	}
       } else {
-	for (unsigned int i = 0; i < m_numBonds; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
-	  const Eigen::Vector3d ab = m_function->GetPositions()[ia] - m_function->GetPositions()[ib];
+	  const Eigen::Vector3d ab = positions[ia] - positions[ib];
 	  rab = ab.norm();
 	  delta = rab - m_calcs[i].r0;
 	  delta2 = delta * delta;
 	  e = m_prefactor * m_calcs[i].K * delta2 * (1.0 + m_cs * delta + m_cs2 * delta2);
-	  m_value += e;      
+	  value += e;      
 	}
       }
+      return value;
+    }
+ 
+    // dE/dr = prefactor * K * (r-r0) * (2 + 3 * cs * (r-r0) + 4 * cs2 * (r-r0)^2)
+    // d2E/dr2 = prefactor * K * (2 + 6 * cs * (r-r0) + 12 * cs2 * (r-r0)^2)
+    void BondCubicHarmonicTerm::ComputeHessian(OBHessian &hessian)
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      for (unsigned int i = 0; i < m_numBonds; ++i) {
+	const unsigned int ia = m_i[i].iA;
+	const unsigned int ib = m_i[i].iB;
+	const Eigen::Vector3d ab = positions[ia] - positions[ib];
+	const double delta = ab.norm() - m_calcs[i].r0;
+	const double delta2 = delta * delta;
+	const double K = m_prefactor * m_calcs[i].K;
+	const double dE = K * delta * (2.0 + 3.0 * m_cs * delta + 4.0 * m_cs2 * delta2);
+	const double d2E = K * (2.0 + 6.0 * m_cs * delta + 12.0 * m_cs2 * delta2);
+	hessian.AddDistance(ia, ib, ab, dE, d2E);
+      }
     }
  
     bool BondCubicHarmonicTerm::Setup()
@@ -61,6 +61,52 @@ namespace OpenBabel {
       { 
         return m_value; 
       }
+      /**
+       * Get the number of bonds (see OBFunctionTerm::PrepareItems()).
+       */
+      unsigned int PrepareItems() 
+      { 
+        return m_numBonds; 
+      }
+      /**
+       * The bonds do not depend on the positions.
+       */
+      bool HasFixedItems() const 
+      { 
+        return true; 
+      }
+      /**
+       * Compute the bonds [begin, end) (see OBFunctionTerm::ComputeItems()).
+       */
+      double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const;
+      /**
+       * Get the atoms for a bond (see OBFunctionTerm::GetItemAtoms()).
+       */
+      unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const
+      {
+        atoms[0] = m_i[item].iA;
+        atoms[1] = m_i[item].iB;
+        return 2;
+      }
+      /**
+       * Set the value after a parallel computation.
+       */
+      void SetValue(double value) 
+      { 
+        m_value = value; 
+      }
+      /**
+       * The bonds have analytical second derivatives.
+       */
+      bool HasAnalyticalHessian() const 
+      { 
+        return true; 
+      }
+      /**
+       * Add the second derivatives for all bonds (see OBFunctionTerm::ComputeHessian()).
+       */
+      void ComputeHessian(OBHessian &hessian);
     private:
       const std::string m_tableName; //!< The database table name (e.g. "Bond Parameters")
       const int m_forceConstantColumn; //!< The database table column containing \f$kb_{ij}\f$
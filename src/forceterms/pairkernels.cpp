@@ -0,0 +1,233 @@
+/*********************************************************************
+pairkernels.cpp - Vectorized pair loops for the non-bonded terms
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include "pairkernels.h"
+
+#include <cmath>
+
+namespace OpenBabel {
+  namespace OBFFs {
+    namespace PairKernels {
+
+      static bool CPUSupports(InstructionSet set)
+      {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        switch (set) {
+          case SSE2:
+            return __builtin_cpu_supports("sse2");
+          case AVX2:
+            return __builtin_cpu_supports("avx2");
+          case AVX512:
+            return __builtin_cpu_supports("avx512f");
+          default:
+            return true;
+        }
+#else
+        return set == Scalar;
+#endif
+      }
+
+      bool IsSupported(InstructionSet set)
+      {
+        switch (set) {
+          case Scalar:
+            return true;
+#ifdef OBFF_HAVE_SSE2_KERNELS
+          case SSE2:
+            return CPUSupports(SSE2);
+#endif
+#ifdef OBFF_HAVE_AVX2_KERNELS
+          case AVX2:
+            return CPUSupports(AVX2);
+#endif
+#ifdef OBFF_HAVE_AVX512_KERNELS
+          case AVX512:
+            return CPUSupports(AVX512);
+#endif
+          default:
+            return false;
+        }
+      }
+
+      static InstructionSet DetectBestInstructionSet()
+      {
+        if (IsSupported(AVX512))
+          return AVX512;
+        if (IsSupported(AVX2))
+          return AVX2;
+        if (IsSupported(SSE2))
+          return SSE2;
+        return Scalar;
+      }
+
+      InstructionSet GetBestInstructionSet()
+      {
+        // detected once, the initialization of a function-local static is
+        // guarded by the compiler (-fthreadsafe-statics, the GCC and Clang
+        // default) so terms can be set up from several threads
+        static const InstructionSet best = DetectBestInstructionSet();
+        return best;
+      }
+
+      const char* GetName(InstructionSet set)
+      {
+        switch (set) {
+          case SSE2:
+            return "sse2";
+          case AVX2:
+            return "avx2";
+          case AVX512:
+            return "avx512";
+          default:
+            return "scalar";
+        }
+      }
+
+      static double ScalarLJ6_12Kernel(const LJ6_12Args &args, const Coordinates &coords)
+      {
+        return ScalarLJ6_12(args, coords, 0, args.numPairs);
+      }
+
+      static double ScalarCoulombKernel(const CoulombArgs &args, const Coordinates &coords)
+      {
+        return ScalarCoulomb(args, coords, 0, args.numPairs);
+      }
+
+      LJ6_12Kernel GetLJ6_12Kernel(InstructionSet set)
+      {
+        if (!IsSupported(set))
+          return &ScalarLJ6_12Kernel;
+
+        switch (set) {
+#ifdef OBFF_HAVE_SSE2_KERNELS
+          case SSE2:
+            return &SSE2LJ6_12;
+#endif
+#ifdef OBFF_HAVE_AVX2_KERNELS
+          case AVX2:
+            return &AVX2LJ6_12;
+#endif
+#ifdef OBFF_HAVE_AVX512_KERNELS
+          case AVX512:
+            return &AVX512LJ6_12;
+#endif
+          default:
+            return &ScalarLJ6_12Kernel;
+        }
+      }
+
+      CoulombKernel GetCoulombKernel(InstructionSet set)
+      {
+        if (!IsSupported(set))
+          return &ScalarCoulombKernel;
+
+        switch (set) {
+#ifdef OBFF_HAVE_SSE2_KERNELS
+          case SSE2:
+            return &SSE2Coulomb;
+#endif
+#ifdef OBFF_HAVE_AVX2_KERNELS
+          case AVX2:
+            return &AVX2Coulomb;
+#endif
+#ifdef OBFF_HAVE_AVX512_KERNELS
+          case AVX512:
+            return &AVX512Coulomb;
+#endif
+          default:
+            return &ScalarCoulombKernel;
+        }
+      }
+
+      double ScalarLJ6_12(const LJ6_12Args &args, const Coordinates &coords, unsigned int begin, unsigned int end)
+      {
+        double energy = 0.0;
+        for (unsigned int i = begin; i < end; ++i) {
+          const unsigned int a = args.index[2*i];
+          const unsigned int b = args.index[2*i+1];
+          const double dx = coords.x[a] - coords.x[b];
+          const double dy = coords.y[a] - coords.y[b];
+          const double dz = coords.z[a] - coords.z[b];
+          const double r2 = dx*dx + dy*dy + dz*dz;
+          if (r2 > args.rc2)
+            continue;
+
+          const double ir2 = 1.0 / r2;
+          const double ir6 = ir2 * ir2 * ir2;
+          const double ir12 = ir6 * ir6;
+          double e = args.A[i] * ir12 - args.B[i] * ir6 - (args.A[i] * args.shiftA - args.B[i] * args.shiftB);
+          // (dE/dr) / r
+          double dE = (6.0 * args.B[i] * ir6 - 12.0 * args.A[i] * ir12) * ir2;
+          if (r2 > args.rs2) {
+            const double sw = (args.rc2 - r2) * (args.rc2 - r2) * (args.rc2 + 2.0*r2 - 3.0*args.rs2) * args.switchDenom;
+            const double dSw = 12.0 * (args.rc2 - r2) * (args.rs2 - r2) * args.switchDenom;
+            dE = dE * sw + e * dSw;
+            e *= sw;
+          }
+          energy += e;
+
+          if (coords.gx) {
+            const unsigned int ga = a * coords.gstride;
+            const unsigned int gb = b * coords.gstride;
+            coords.gx[ga] -= dx * dE;
+            coords.gy[ga] -= dy * dE;
+            coords.gz[ga] -= dz * dE;
+            coords.gx[gb] += dx * dE;
+            coords.gy[gb] += dy * dE;
+            coords.gz[gb] += dz * dE;
+          }
+        }
+        return energy;
+      }
+
+      double ScalarCoulomb(const CoulombArgs &args, const Coordinates &coords, unsigned int begin, unsigned int end)
+      {
+        double energy = 0.0;
+        for (unsigned int i = begin; i < end; ++i) {
+          const unsigned int a = args.index[2*i];
+          const unsigned int b = args.index[2*i+1];
+          const double dx = coords.x[a] - coords.x[b];
+          const double dy = coords.y[a] - coords.y[b];
+          const double dz = coords.z[a] - coords.z[b];
+          const double r2 = dx*dx + dy*dy + dz*dz;
+          if (r2 > args.rc2)
+            continue;
+
+          const double r = sqrt(r2);
+          const double ir = 1.0 / r;
+          const double e = args.qq[i] * (ir + args.k1 * r + args.k2 * r2 - args.c);
+          // (dE/dr) / r
+          const double dE = args.qq[i] * (args.k1 * ir + 2.0 * args.k2 - ir * ir * ir);
+          energy += e;
+
+          if (coords.gx) {
+            const unsigned int ga = a * coords.gstride;
+            const unsigned int gb = b * coords.gstride;
+            coords.gx[ga] -= dx * dE;
+            coords.gy[ga] -= dy * dE;
+            coords.gz[ga] -= dz * dE;
+            coords.gx[gb] += dx * dE;
+            coords.gy[gb] += dy * dE;
+            coords.gz[gb] += dz * dE;
+          }
+        }
+        return energy;
+      }
+
+    } // PairKernels
+  } // OBFFs
+} // OpenBabel
@@ -0,0 +1,131 @@
+/*********************************************************************
+pairkernels.h - Vectorized pair loops for the non-bonded terms
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OPENBABEL_PAIRKERNELS_H
+#define OPENBABEL_PAIRKERNELS_H
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * Pair kernels for the LJ6_12 and Coulomb terms. Every kernel computes
+     * the same thing as the Scalar version. The SIMD versions process 2 (SSE2),
+     * 4 (AVX2) or 8 (AVX-512) pairs per iteration using gathered coordinates.
+     * The pair forces are added to the gradients one lane at a time, so pairs
+     * in one iteration can share atoms.
+     *
+     * The SIMD kernels are only available if the compiler supports them (see
+     * CMakeLists.txt) and are selected at runtime using CPU feature detection.
+     */
+    namespace PairKernels {
+
+      enum InstructionSet {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512
+      };
+
+      /**
+       * SoA coordinates (see OBFunction::GetPositionsSoA) and gradients. If
+       * gx is 0, only the energy is computed. The gradient for atom i is stored
+       * at gx[i * gstride], gstride is 1 for SoA gradients and 3 for
+       * Eigen::Vector3d arrays (gx = data(), gy = gx + 1, gz = gx + 2).
+       */
+      struct Coordinates
+      {
+        const double *x, *y, *z;
+        double *gx, *gy, *gz;
+        unsigned int gstride;
+      };
+
+      /**
+       * E = A / r^12 - B / r^6 - (A * shiftA - B * shiftB)
+       *
+       * with A = 4 epsilon sigma^12 and B = 4 epsilon sigma^6. For rs2 < r^2 <= rc2,
+       * the energy is switched off (see LJ6_12.cpp). Pairs with r^2 > rc2 are skipped.
+       */
+      struct LJ6_12Args
+      {
+        unsigned int numPairs;
+        const unsigned int *index; //!< iA, iB for each pair (i.e. an LJ6_12::Index array)
+        const double *A, *B;
+        double rc2, rs2, switchDenom;
+        double shiftA, shiftB;
+      };
+
+      /**
+       * E = qq * (1/r + k1 r + k2 r^2 - c)
+       *
+       * Covers the plain, shifted-force and reaction-field forms (see Coulomb.cpp).
+       * Pairs with r^2 > rc2 are skipped.
+       */
+      struct CoulombArgs
+      {
+        unsigned int numPairs;
+        const unsigned int *index; //!< iA, iB for each pair (i.e. a Coulomb::Index array)
+        const double *qq;
+        double rc2, k1, k2, c;
+      };
+
+      typedef double (*LJ6_12Kernel)(const LJ6_12Args &args, const Coordinates &coords);
+      typedef double (*CoulombKernel)(const CoulombArgs &args, const Coordinates &coords);
+
+      /**
+       * @return The best instruction set supported by both the compiled
+       * library and the CPU.
+       */
+      InstructionSet GetBestInstructionSet();
+      /**
+       * @return True if @p set is supported by both the compiled library and the CPU.
+       */
+      bool IsSupported(InstructionSet set);
+      /**
+       * @return The name for @p set ("scalar", "sse2", "avx2", "avx512").
+       */
+      const char* GetName(InstructionSet set);
+      /**
+       * @return The kernel for @p set or the scalar kernel if @p set is not supported.
+       */
+      LJ6_12Kernel GetLJ6_12Kernel(InstructionSet set);
+      CoulombKernel GetCoulombKernel(InstructionSet set);
+
+      /**
+       * The scalar kernels for pairs [begin, end). Used by the SIMD kernels for
+       * the remaining pairs.
+       */
+      double ScalarLJ6_12(const LJ6_12Args &args, const Coordinates &coords, unsigned int begin, unsigned int end);
+      double ScalarCoulomb(const CoulombArgs &args, const Coordinates &coords, unsigned int begin, unsigned int end);
+
+#ifdef OBFF_HAVE_SSE2_KERNELS
+      double SSE2LJ6_12(const LJ6_12Args &args, const Coordinates &coords);
+      double SSE2Coulomb(const CoulombArgs &args, const Coordinates &coords);
+#endif
+#ifdef OBFF_HAVE_AVX2_KERNELS
+      double AVX2LJ6_12(const LJ6_12Args &args, const Coordinates &coords);
+      double AVX2Coulomb(const CoulombArgs &args, const Coordinates &coords);
+#endif
+#ifdef OBFF_HAVE_AVX512_KERNELS
+      double AVX512LJ6_12(const LJ6_12Args &args, const Coordinates &coords);
+      double AVX512Coulomb(const CoulombArgs &args, const Coordinates &coords);
+#endif
+
+    } // PairKernels
+
+  } // OBFFs
+} // OpenBabel
+
+#endif
@@ -0,0 +1,166 @@
+/*********************************************************************
+pairkernels_avx2.cpp - AVX2 pair loops for the non-bonded terms
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+// This file is compiled with -mavx2, the functions are only called when
+// the CPU supports AVX2 (see pairkernels.cpp).
+
+#include "pairkernels.h"
+
+#include <immintrin.h>
+
+namespace OpenBabel {
+  namespace OBFFs {
+    namespace PairKernels {
+
+      // Load the iA and iB indexes for 4 pairs from the interleaved index array.
+      static inline void LoadIndexes(const unsigned int *index, __m128i &ia, __m128i &ib)
+      {
+        const __m256i perm = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        const __m256i idx = _mm256_permutevar8x32_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)), perm);
+        ia = _mm256_castsi256_si128(idx);
+        ib = _mm256_extracti128_si256(idx, 1);
+      }
+
+      // Gather 4 coordinates. The masked gather with a zeroed source is used
+      // because GCC warns about the undefined source of _mm256_i32gather_pd().
+      static inline __m256d Gather(const double *base, __m128i index)
+      {
+        const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, all, 8);
+      }
+
+      // Add the pair forces to the gradients one lane at a time.
+      static inline void Scatter(const unsigned int *index, __m256d fx, __m256d fy, __m256d fz, const Coordinates &coords)
+      {
+        double x[4], y[4], z[4];
+        _mm256_storeu_pd(x, fx);
+        _mm256_storeu_pd(y, fy);
+        _mm256_storeu_pd(z, fz);
+        for (int l = 0; l < 4; ++l) {
+          const unsigned int a = index[2*l] * coords.gstride;
+          const unsigned int b = index[2*l+1] * coords.gstride;
+          coords.gx[a] -= x[l];
+          coords.gy[a] -= y[l];
+          coords.gz[a] -= z[l];
+          coords.gx[b] += x[l];
+          coords.gy[b] += y[l];
+          coords.gz[b] += z[l];
+        }
+      }
+
+      static inline double HorizontalSum(__m256d v)
+      {
+        double e[4];
+        _mm256_storeu_pd(e, v);
+        return (e[0] + e[1]) + (e[2] + e[3]);
+      }
+
+      double AVX2LJ6_12(const LJ6_12Args &args, const Coordinates &coords)
+      {
+        const unsigned int n = args.numPairs & ~3u;
+        const __m256d rc2 = _mm256_set1_pd(args.rc2);
+        const __m256d rs2 = _mm256_set1_pd(args.rs2);
+        const __m256d switchDenom = _mm256_set1_pd(args.switchDenom);
+        const __m256d shiftA = _mm256_set1_pd(args.shiftA);
+        const __m256d shiftB = _mm256_set1_pd(args.shiftB);
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d two = _mm256_set1_pd(2.0);
+        const __m256d three = _mm256_set1_pd(3.0);
+        const __m256d six = _mm256_set1_pd(6.0);
+        const __m256d twelve = _mm256_set1_pd(12.0);
+        const bool switching = args.rs2 < args.rc2;
+        __m256d energy = _mm256_setzero_pd();
+
+        for (unsigned int i = 0; i < n; i += 4) {
+          __m128i ia, ib;
+          LoadIndexes(args.index + 2*i, ia, ib);
+          const __m256d dx = _mm256_sub_pd(Gather(coords.x, ia), Gather(coords.x, ib));
+          const __m256d dy = _mm256_sub_pd(Gather(coords.y, ia), Gather(coords.y, ib));
+          const __m256d dz = _mm256_sub_pd(Gather(coords.z, ia), Gather(coords.z, ib));
+          const __m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+          const __m256d inside = _mm256_cmp_pd(r2, rc2, _CMP_LE_OQ);
+
+          const __m256d A = _mm256_loadu_pd(args.A + i);
+          const __m256d B = _mm256_loadu_pd(args.B + i);
+          const __m256d ir2 = _mm256_div_pd(one, r2);
+          const __m256d ir6 = _mm256_mul_pd(_mm256_mul_pd(ir2, ir2), ir2);
+          const __m256d ir12 = _mm256_mul_pd(ir6, ir6);
+          __m256d e = _mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(A, ir12), _mm256_mul_pd(B, ir6)),
+              _mm256_sub_pd(_mm256_mul_pd(A, shiftA), _mm256_mul_pd(B, shiftB)));
+          __m256d dE = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(six, _mm256_mul_pd(B, ir6)),
+                _mm256_mul_pd(twelve, _mm256_mul_pd(A, ir12))), ir2);
+
+          if (switching) {
+            const __m256d d = _mm256_sub_pd(rc2, r2);
+            const __m256d sw = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(d, d),
+                  _mm256_sub_pd(_mm256_add_pd(rc2, _mm256_mul_pd(two, r2)), _mm256_mul_pd(three, rs2))), switchDenom);
+            const __m256d dSw = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(twelve, d), _mm256_sub_pd(rs2, r2)), switchDenom);
+            const __m256d outer = _mm256_cmp_pd(r2, rs2, _CMP_GT_OQ);
+            dE = _mm256_blendv_pd(dE, _mm256_add_pd(_mm256_mul_pd(dE, sw), _mm256_mul_pd(e, dSw)), outer);
+            e = _mm256_blendv_pd(e, _mm256_mul_pd(e, sw), outer);
+          }
+
+          energy = _mm256_add_pd(energy, _mm256_and_pd(e, inside));
+          if (coords.gx) {
+            dE = _mm256_and_pd(dE, inside);
+            Scatter(args.index + 2*i, _mm256_mul_pd(dx, dE), _mm256_mul_pd(dy, dE), _mm256_mul_pd(dz, dE), coords);
+          }
+        }
+
+        return HorizontalSum(energy) + ScalarLJ6_12(args, coords, n, args.numPairs);
+      }
+
+      double AVX2Coulomb(const CoulombArgs &args, const Coordinates &coords)
+      {
+        const unsigned int n = args.numPairs & ~3u;
+        const __m256d rc2 = _mm256_set1_pd(args.rc2);
+        const __m256d k1 = _mm256_set1_pd(args.k1);
+        const __m256d k2 = _mm256_set1_pd(args.k2);
+        const __m256d twok2 = _mm256_set1_pd(2.0 * args.k2);
+        const __m256d c = _mm256_set1_pd(args.c);
+        const __m256d one = _mm256_set1_pd(1.0);
+        __m256d energy = _mm256_setzero_pd();
+
+        for (unsigned int i = 0; i < n; i += 4) {
+          __m128i ia, ib;
+          LoadIndexes(args.index + 2*i, ia, ib);
+          const __m256d dx = _mm256_sub_pd(Gather(coords.x, ia), Gather(coords.x, ib));
+          const __m256d dy = _mm256_sub_pd(Gather(coords.y, ia), Gather(coords.y, ib));
+          const __m256d dz = _mm256_sub_pd(Gather(coords.z, ia), Gather(coords.z, ib));
+          const __m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+          const __m256d inside = _mm256_cmp_pd(r2, rc2, _CMP_LE_OQ);
+
+          const __m256d qq = _mm256_loadu_pd(args.qq + i);
+          const __m256d r = _mm256_sqrt_pd(r2);
+          const __m256d ir = _mm256_div_pd(one, r);
+          const __m256d e = _mm256_mul_pd(qq, _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(ir, _mm256_mul_pd(k1, r)),
+                  _mm256_mul_pd(k2, r2)), c));
+          energy = _mm256_add_pd(energy, _mm256_and_pd(e, inside));
+
+          if (coords.gx) {
+            const __m256d dE = _mm256_and_pd(_mm256_mul_pd(qq, _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(k1, ir), twok2),
+                    _mm256_mul_pd(_mm256_mul_pd(ir, ir), ir))), inside);
+            Scatter(args.index + 2*i, _mm256_mul_pd(dx, dE), _mm256_mul_pd(dy, dE), _mm256_mul_pd(dz, dE), coords);
+          }
+        }
+
+        return HorizontalSum(energy) + ScalarCoulomb(args, coords, n, args.numPairs);
+      }
+
+    } // PairKernels
+  } // OBFFs
+} // OpenBabel
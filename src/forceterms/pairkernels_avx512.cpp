@@ -0,0 +1,168 @@
+/*********************************************************************
+pairkernels_avx512.cpp - AVX-512 pair loops for the non-bonded terms
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+// This file is compiled with -mavx512f, the functions are only called when
+// the CPU supports AVX-512F (see pairkernels.cpp).
+
+// The unmasked gather, sqrt, permute, extract and cast intrinsics start
+// from an undefined vector which GCC 12 reports as uninitialized (GCC bug
+// 105593), the zero-masked forms with all lanes set are used instead.
+
+#include "pairkernels.h"
+
+#include <immintrin.h>
+
+namespace OpenBabel {
+  namespace OBFFs {
+    namespace PairKernels {
+
+      // Load the iA and iB indexes for 8 pairs from the interleaved index array.
+      static inline void LoadIndexes(const unsigned int *index, __m256i &ia, __m256i &ib)
+      {
+        const __m512i perm = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+        const __m512i idx = _mm512_maskz_permutexvar_epi32(0xFFFF, perm, _mm512_loadu_si512(index));
+        ia = _mm512_maskz_extracti64x4_epi64(0xFF, idx, 0);
+        ib = _mm512_maskz_extracti64x4_epi64(0xFF, idx, 1);
+      }
+
+      // Load the coordinates of 8 particles.
+      static inline __m512d Gather(__m256i index, const double *base)
+      {
+        return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, index, base, 8);
+      }
+
+      // Sum the 8 lanes.
+      static inline double Sum(__m512d v)
+      {
+        double x[8];
+        _mm512_storeu_pd(x, v);
+        return ((x[0] + x[1]) + (x[2] + x[3])) + ((x[4] + x[5]) + (x[6] + x[7]));
+      }
+
+      // Add the pair forces to the gradients one lane at a time.
+      static inline void Scatter(const unsigned int *index, __m512d fx, __m512d fy, __m512d fz, const Coordinates &coords)
+      {
+        double x[8], y[8], z[8];
+        _mm512_storeu_pd(x, fx);
+        _mm512_storeu_pd(y, fy);
+        _mm512_storeu_pd(z, fz);
+        for (int l = 0; l < 8; ++l) {
+          const unsigned int a = index[2*l] * coords.gstride;
+          const unsigned int b = index[2*l+1] * coords.gstride;
+          coords.gx[a] -= x[l];
+          coords.gy[a] -= y[l];
+          coords.gz[a] -= z[l];
+          coords.gx[b] += x[l];
+          coords.gy[b] += y[l];
+          coords.gz[b] += z[l];
+        }
+      }
+
+      double AVX512LJ6_12(const LJ6_12Args &args, const Coordinates &coords)
+      {
+        const unsigned int n = args.numPairs & ~7u;
+        const __m512d rc2 = _mm512_set1_pd(args.rc2);
+        const __m512d rs2 = _mm512_set1_pd(args.rs2);
+        const __m512d switchDenom = _mm512_set1_pd(args.switchDenom);
+        const __m512d shiftA = _mm512_set1_pd(args.shiftA);
+        const __m512d shiftB = _mm512_set1_pd(args.shiftB);
+        const __m512d one = _mm512_set1_pd(1.0);
+        const __m512d two = _mm512_set1_pd(2.0);
+        const __m512d three = _mm512_set1_pd(3.0);
+        const __m512d six = _mm512_set1_pd(6.0);
+        const __m512d twelve = _mm512_set1_pd(12.0);
+        const bool switching = args.rs2 < args.rc2;
+        __m512d energy = _mm512_setzero_pd();
+
+        for (unsigned int i = 0; i < n; i += 8) {
+          __m256i ia, ib;
+          LoadIndexes(args.index + 2*i, ia, ib);
+          const __m512d dx = _mm512_sub_pd(Gather(ia, coords.x), Gather(ib, coords.x));
+          const __m512d dy = _mm512_sub_pd(Gather(ia, coords.y), Gather(ib, coords.y));
+          const __m512d dz = _mm512_sub_pd(Gather(ia, coords.z), Gather(ib, coords.z));
+          const __m512d r2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)), _mm512_mul_pd(dz, dz));
+          const __mmask8 inside = _mm512_cmp_pd_mask(r2, rc2, _CMP_LE_OQ);
+
+          const __m512d A = _mm512_loadu_pd(args.A + i);
+          const __m512d B = _mm512_loadu_pd(args.B + i);
+          const __m512d ir2 = _mm512_div_pd(one, r2);
+          const __m512d ir6 = _mm512_mul_pd(_mm512_mul_pd(ir2, ir2), ir2);
+          const __m512d ir12 = _mm512_mul_pd(ir6, ir6);
+          __m512d e = _mm512_sub_pd(_mm512_sub_pd(_mm512_mul_pd(A, ir12), _mm512_mul_pd(B, ir6)),
+              _mm512_sub_pd(_mm512_mul_pd(A, shiftA), _mm512_mul_pd(B, shiftB)));
+          __m512d dE = _mm512_mul_pd(_mm512_sub_pd(_mm512_mul_pd(six, _mm512_mul_pd(B, ir6)),
+                _mm512_mul_pd(twelve, _mm512_mul_pd(A, ir12))), ir2);
+
+          if (switching) {
+            const __m512d d = _mm512_sub_pd(rc2, r2);
+            const __m512d sw = _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(d, d),
+                  _mm512_sub_pd(_mm512_add_pd(rc2, _mm512_mul_pd(two, r2)), _mm512_mul_pd(three, rs2))), switchDenom);
+            const __m512d dSw = _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(twelve, d), _mm512_sub_pd(rs2, r2)), switchDenom);
+            const __mmask8 outer = _mm512_cmp_pd_mask(r2, rs2, _CMP_GT_OQ);
+            dE = _mm512_mask_mov_pd(dE, outer, _mm512_add_pd(_mm512_mul_pd(dE, sw), _mm512_mul_pd(e, dSw)));
+            e = _mm512_mask_mov_pd(e, outer, _mm512_mul_pd(e, sw));
+          }
+
+          energy = _mm512_mask_add_pd(energy, inside, energy, e);
+          if (coords.gx) {
+            dE = _mm512_maskz_mov_pd(inside, dE);
+            Scatter(args.index + 2*i, _mm512_mul_pd(dx, dE), _mm512_mul_pd(dy, dE), _mm512_mul_pd(dz, dE), coords);
+          }
+        }
+
+        return Sum(energy) + ScalarLJ6_12(args, coords, n, args.numPairs);
+      }
+
+      double AVX512Coulomb(const CoulombArgs &args, const Coordinates &coords)
+      {
+        const unsigned int n = args.numPairs & ~7u;
+        const __m512d rc2 = _mm512_set1_pd(args.rc2);
+        const __m512d k1 = _mm512_set1_pd(args.k1);
+        const __m512d k2 = _mm512_set1_pd(args.k2);
+        const __m512d twok2 = _mm512_set1_pd(2.0 * args.k2);
+        const __m512d c = _mm512_set1_pd(args.c);
+        const __m512d one = _mm512_set1_pd(1.0);
+        __m512d energy = _mm512_setzero_pd();
+
+        for (unsigned int i = 0; i < n; i += 8) {
+          __m256i ia, ib;
+          LoadIndexes(args.index + 2*i, ia, ib);
+          const __m512d dx = _mm512_sub_pd(Gather(ia, coords.x), Gather(ib, coords.x));
+          const __m512d dy = _mm512_sub_pd(Gather(ia, coords.y), Gather(ib, coords.y));
+          const __m512d dz = _mm512_sub_pd(Gather(ia, coords.z), Gather(ib, coords.z));
+          const __m512d r2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)), _mm512_mul_pd(dz, dz));
+          const __mmask8 inside = _mm512_cmp_pd_mask(r2, rc2, _CMP_LE_OQ);
+
+          const __m512d qq = _mm512_loadu_pd(args.qq + i);
+          const __m512d r = _mm512_maskz_sqrt_pd(0xFF, r2);
+          const __m512d ir = _mm512_div_pd(one, r);
+          const __m512d e = _mm512_mul_pd(qq, _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(ir, _mm512_mul_pd(k1, r)),
+                  _mm512_mul_pd(k2, r2)), c));
+          energy = _mm512_mask_add_pd(energy, inside, energy, e);
+
+          if (coords.gx) {
+            const __m512d dE = _mm512_maskz_mov_pd(inside, _mm512_mul_pd(qq, _mm512_sub_pd(_mm512_add_pd(_mm512_mul_pd(k1, ir), twok2),
+                    _mm512_mul_pd(_mm512_mul_pd(ir, ir), ir))));
+            Scatter(args.index + 2*i, _mm512_mul_pd(dx, dE), _mm512_mul_pd(dy, dE), _mm512_mul_pd(dz, dE), coords);
+          }
+        }
+
+        return Sum(energy) + ScalarCoulomb(args, coords, n, args.numPairs);
+      }
+
+    } // PairKernels
+  } // OBFFs
+} // OpenBabel
@@ -0,0 +1,157 @@
+/*********************************************************************
+pairkernels_sse2.cpp - SSE2 pair loops for the non-bonded terms
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+// This file is compiled with -msse2, the functions are only called when
+// the CPU supports SSE2 (see pairkernels.cpp).
+
+#include "pairkernels.h"
+
+#include <emmintrin.h>
+
+namespace OpenBabel {
+  namespace OBFFs {
+    namespace PairKernels {
+
+      // SSE2 has no gather instructions, load the 2 lanes separately.
+      static inline __m128d Gather(const double *p, const unsigned int *index, int offset)
+      {
+        return _mm_set_pd(p[index[2 + offset]], p[index[offset]]);
+      }
+
+      static inline __m128d Select(__m128d mask, __m128d a, __m128d b)
+      {
+        return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+      }
+
+      // Add the pair forces to the gradients one lane at a time.
+      static inline void Scatter(const unsigned int *index, __m128d fx, __m128d fy, __m128d fz, const Coordinates &coords)
+      {
+        double x[2], y[2], z[2];
+        _mm_storeu_pd(x, fx);
+        _mm_storeu_pd(y, fy);
+        _mm_storeu_pd(z, fz);
+        for (int l = 0; l < 2; ++l) {
+          const unsigned int a = index[2*l] * coords.gstride;
+          const unsigned int b = index[2*l+1] * coords.gstride;
+          coords.gx[a] -= x[l];
+          coords.gy[a] -= y[l];
+          coords.gz[a] -= z[l];
+          coords.gx[b] += x[l];
+          coords.gy[b] += y[l];
+          coords.gz[b] += z[l];
+        }
+      }
+
+      static inline double HorizontalSum(__m128d v)
+      {
+        double e[2];
+        _mm_storeu_pd(e, v);
+        return e[0] + e[1];
+      }
+
+      double SSE2LJ6_12(const LJ6_12Args &args, const Coordinates &coords)
+      {
+        const unsigned int n = args.numPairs & ~1u;
+        const __m128d rc2 = _mm_set1_pd(args.rc2);
+        const __m128d rs2 = _mm_set1_pd(args.rs2);
+        const __m128d switchDenom = _mm_set1_pd(args.switchDenom);
+        const __m128d shiftA = _mm_set1_pd(args.shiftA);
+        const __m128d shiftB = _mm_set1_pd(args.shiftB);
+        const __m128d one = _mm_set1_pd(1.0);
+        const __m128d two = _mm_set1_pd(2.0);
+        const __m128d three = _mm_set1_pd(3.0);
+        const __m128d six = _mm_set1_pd(6.0);
+        const __m128d twelve = _mm_set1_pd(12.0);
+        const bool switching = args.rs2 < args.rc2;
+        __m128d energy = _mm_setzero_pd();
+
+        for (unsigned int i = 0; i < n; i += 2) {
+          const unsigned int *index = args.index + 2*i;
+          const __m128d dx = _mm_sub_pd(Gather(coords.x, index, 0), Gather(coords.x, index, 1));
+          const __m128d dy = _mm_sub_pd(Gather(coords.y, index, 0), Gather(coords.y, index, 1));
+          const __m128d dz = _mm_sub_pd(Gather(coords.z, index, 0), Gather(coords.z, index, 1));
+          const __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+          const __m128d inside = _mm_cmple_pd(r2, rc2);
+
+          const __m128d A = _mm_loadu_pd(args.A + i);
+          const __m128d B = _mm_loadu_pd(args.B + i);
+          const __m128d ir2 = _mm_div_pd(one, r2);
+          const __m128d ir6 = _mm_mul_pd(_mm_mul_pd(ir2, ir2), ir2);
+          const __m128d ir12 = _mm_mul_pd(ir6, ir6);
+          __m128d e = _mm_sub_pd(_mm_sub_pd(_mm_mul_pd(A, ir12), _mm_mul_pd(B, ir6)),
+              _mm_sub_pd(_mm_mul_pd(A, shiftA), _mm_mul_pd(B, shiftB)));
+          __m128d dE = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(six, _mm_mul_pd(B, ir6)),
+                _mm_mul_pd(twelve, _mm_mul_pd(A, ir12))), ir2);
+
+          if (switching) {
+            const __m128d d = _mm_sub_pd(rc2, r2);
+            const __m128d sw = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(d, d),
+                  _mm_sub_pd(_mm_add_pd(rc2, _mm_mul_pd(two, r2)), _mm_mul_pd(three, rs2))), switchDenom);
+            const __m128d dSw = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(twelve, d), _mm_sub_pd(rs2, r2)), switchDenom);
+            const __m128d outer = _mm_cmpgt_pd(r2, rs2);
+            dE = Select(outer, _mm_add_pd(_mm_mul_pd(dE, sw), _mm_mul_pd(e, dSw)), dE);
+            e = Select(outer, _mm_mul_pd(e, sw), e);
+          }
+
+          energy = _mm_add_pd(energy, _mm_and_pd(e, inside));
+          if (coords.gx) {
+            dE = _mm_and_pd(dE, inside);
+            Scatter(index, _mm_mul_pd(dx, dE), _mm_mul_pd(dy, dE), _mm_mul_pd(dz, dE), coords);
+          }
+        }
+
+        return HorizontalSum(energy) + ScalarLJ6_12(args, coords, n, args.numPairs);
+      }
+
+      double SSE2Coulomb(const CoulombArgs &args, const Coordinates &coords)
+      {
+        const unsigned int n = args.numPairs & ~1u;
+        const __m128d rc2 = _mm_set1_pd(args.rc2);
+        const __m128d k1 = _mm_set1_pd(args.k1);
+        const __m128d k2 = _mm_set1_pd(args.k2);
+        const __m128d twok2 = _mm_set1_pd(2.0 * args.k2);
+        const __m128d c = _mm_set1_pd(args.c);
+        const __m128d one = _mm_set1_pd(1.0);
+        __m128d energy = _mm_setzero_pd();
+
+        for (unsigned int i = 0; i < n; i += 2) {
+          const unsigned int *index = args.index + 2*i;
+          const __m128d dx = _mm_sub_pd(Gather(coords.x, index, 0), Gather(coords.x, index, 1));
+          const __m128d dy = _mm_sub_pd(Gather(coords.y, index, 0), Gather(coords.y, index, 1));
+          const __m128d dz = _mm_sub_pd(Gather(coords.z, index, 0), Gather(coords.z, index, 1));
+          const __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+          const __m128d inside = _mm_cmple_pd(r2, rc2);
+
+          const __m128d qq = _mm_loadu_pd(args.qq + i);
+          const __m128d r = _mm_sqrt_pd(r2);
+          const __m128d ir = _mm_div_pd(one, r);
+          const __m128d e = _mm_mul_pd(qq, _mm_sub_pd(_mm_add_pd(_mm_add_pd(ir, _mm_mul_pd(k1, r)),
+                  _mm_mul_pd(k2, r2)), c));
+          energy = _mm_add_pd(energy, _mm_and_pd(e, inside));
+
+          if (coords.gx) {
+            const __m128d dE = _mm_and_pd(_mm_mul_pd(qq, _mm_sub_pd(_mm_add_pd(_mm_mul_pd(k1, ir), twok2),
+                    _mm_mul_pd(_mm_mul_pd(ir, ir), ir))), inside);
+            Scatter(index, _mm_mul_pd(dx, dE), _mm_mul_pd(dy, dE), _mm_mul_pd(dz, dE), coords);
+          }
+        }
+
+        return HorizontalSum(energy) + ScalarCoulomb(args, coords, n, args.numPairs);
+      }
+
+    } // PairKernels
+  } // OBFFs
+} // OpenBabel
@@ -52,19 +52,27 @@ namespace OpenBabel {
 
     void TorsionHarmonic::Compute(OBFunction::Computation computation)
     {
-      m_value = 0.0;
+      std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      m_value = ComputeItems(computation, 0, m_numTorsions, &m_function->GetPositions()[0],
+          gradients.empty() ? NULL : &gradients[0]);
+    }
+
+    double TorsionHarmonic::ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+        const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const
+    {
+      double value = 0.0;
       double phi, delta, delta2, e, cosine;
 	
       if (computation == OBFunction::Gradients) {
 	size_t ia, ib, ic, id;
 	Eigen::Vector3d Fa, Fb, Fc, Fd;
 	double dE, sine;
-	for (unsigned int i = 0; i < m_numTorsions; ++i) {
+	for (unsigned int i = begin; i < end; ++i) {
 	  ia = m_i[i].iA;
 	  ib = m_i[i].iB;
 	  ic = m_i[i].iC;
 	  id = m_i[i].iD;
-	  phi = VectorTorsionDerivative(m_function->GetPositions()[ia], m_function->GetPositions()[ib], m_function->GetPositions()[ic], m_function->GetPositions()[id], Fa, Fb, Fc, Fd); 
+	  phi = VectorTorsionDerivative(positions[ia], positions[ib], positions[ic], positions[id], Fa, Fb, Fc, Fd); 
 	  if (!isfinite(phi))
 	    phi = 0.0;
 	  sine = sin(DEG_TO_RAD* m_calcs[i].n * phi);	  
@@ -73,27 +81,45 @@ namespace OpenBabel {
 	  Fb *= dE;
 	  Fc *= dE;
 	  Fd *= dE;
-	  m_function->GetGradients()[ia] += Fa;
-	  m_function->GetGradients()[ib] += Fb;
-	  m_function->GetGradients()[ic] += Fc;
-	  m_function->GetGradients()[id] += Fd;
+	  gradients[ia] += Fa;
+	  gradients[ib] += Fb;
+	  gradients[ic] += Fc;
+	  gradients[id] += Fd;
 
 	  cosine = cos(DEG_TO_RAD * m_calcs[i].n * phi);
 	  e = m_calcs[i].K * (1.0 + m_calcs[i].d * cosine);
-	  m_value += e;
+	  value += e;
 	}
       } else {
-	for (unsigned int i = 0; i < m_numTorsions; ++i) {
-	  phi = VectorTorsion(m_function->GetPositions()[m_i[i].iA], m_function->GetPositions()[m_i[i].iB],
-			    m_function->GetPositions()[m_i[i].iC], m_function->GetPositions()[m_i[i].iD]);
+	for (unsigned int i = begin; i < end; ++i) {
+	  phi = VectorTorsion(positions[m_i[i].iA], positions[m_i[i].iB],
+			    positions[m_i[i].iC], positions[m_i[i].iD]);
 	  if (!isfinite(phi))
 	    phi = 0.0;
 
 	  cosine = cos(DEG_TO_RAD * m_calcs[i].n * phi);
 	  e = m_calcs[i].K * (1.0 + m_calcs[i].d * cosine);
-	  m_value += e;
+	  value += e;
 	}
       }
+      return value;
+    }
+  
+    // dE/dphi = -K * d * n * sin(n * phi)
+    // d2E/dphi2 = -K * d * n^2 * cos(n * phi)
+    void TorsionHarmonic::ComputeHessian(OBHessian &hessian)
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      Eigen::Vector3d grad[4];
+      Eigen::Matrix3d hess[16];
+      for (unsigned int i = 0; i < m_numTorsions; ++i) {
+	const unsigned int atoms[4] = { m_i[i].iA, m_i[i].iB, m_i[i].iC, m_i[i].iD };
+	const double phi = VectorTorsionHessian(positions[atoms[0]], positions[atoms[1]], positions[atoms[2]],
+	    positions[atoms[3]], grad, hess);
+	const double Kdn = m_calcs[i].K * m_calcs[i].d * m_calcs[i].n;
+	hessian.AddCoordinate(4, atoms, grad, hess, -Kdn * sin(m_calcs[i].n * phi),
+	    -Kdn * m_calcs[i].n * cos(m_calcs[i].n * phi));
+      }
     }
   
     bool TorsionHarmonic::Setup()
@@ -0,0 +1,229 @@
+/**********************************************************************
+obbatchminimize.cpp - Minimize all molecules from a multi-record file.
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+***********************************************************************/
+
+#include <OBBatchMinimize>
+#include <OBFunction>
+#include <OBMinimize>
+#include <OBLogFile>
+
+#include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/generic.h>
+#include <openbabel/obconversion.h>
+
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace OpenBabel {
+namespace OBFFs {
+
+  OBBatchMinimize::OBBatchMinimize(const std::string &functionName) : m_functionName(functionName),
+      m_parameterDB(0), m_numThreads(1), m_algorithm(ConjugateGradients), m_steps(2500), m_econv(1e-6),
+      m_criteria(ConvergenceCriteria::Energy), m_rmsGradient(0.01), m_maxGradient(0.05),
+      m_maxDisplacement(1e-3), m_stallSteps(0), m_stallDecrease(0.0), m_blockSize(0)
+  {
+  }
+
+  OBFunction* OBBatchMinimize::NewFunction() const
+  {
+    OBFunctionFactory *factory = OBFunctionFactory::GetFactory(m_functionName);
+    if (!factory)
+      return 0;
+    OBFunction *function = factory->NewInstance();
+    if (!function)
+      return 0;
+
+    // the log would interleave the output from all threads
+    function->GetLogFile()->SetLogLevel(OBLogFile::None);
+    if (m_parameterDB)
+      function->SetParameterDB(m_parameterDB);
+    if (!m_options.empty())
+      function->SetOptions(m_options);
+    // the molecules are minimized in parallel, not the terms
+    function->SetNumThreads(1);
+    return function;
+  }
+
+  static void SetPairData(OBMol &mol, const std::string &attribute, const std::string &value)
+  {
+    OBPairData *data = static_cast<OBPairData*>(mol.GetData(attribute));
+    if (!data) {
+      data = new OBPairData;
+      data->SetAttribute(attribute);
+      mol.SetData(data);
+    }
+    data->SetValue(value);
+  }
+
+  static std::string StopReasonString(int stopReason)
+  {
+    switch (stopReason) {
+      case StopReason::Converged:
+        return "converged";
+      case StopReason::MaxSteps:
+        return "maximum number of steps";
+      case StopReason::Stalled:
+        return "stalled";
+      case StopReason::LineSearchFailed:
+        return "line search failed";
+      default:
+        return "running";
+    }
+  }
+
+  void OBBatchMinimize::Minimize(OBFunction *function, OBMol &mol, Result &result) const
+  {
+    result.title = mol.GetTitle();
+    result.setup = function->Setup(mol);
+    if (!result.setup) {
+      SetPairData(mol, "OBFF_STATUS", "setup failed");
+      return;
+    }
+
+    function->Compute(OBFunction::Value);
+    result.initialValue = function->GetValue();
+
+    OBMinimize minimize(function);
+    minimize.SetConvergenceCriteria(m_criteria);
+    minimize.SetGradientConvergence(m_rmsGradient, m_maxGradient);
+    minimize.SetDisplacementConvergence(m_maxDisplacement);
+    minimize.SetStallDetection(m_stallSteps, m_stallDecrease);
+    if (m_algorithm == SteepestDescent) {
+      minimize.SteepestDescentInitialize(m_steps, m_econv);
+      minimize.SteepestDescentTakeNSteps(m_steps);
+    } else if (m_algorithm == LBFGS) {
+      minimize.LBFGSInitialize(m_steps, m_econv);
+      minimize.LBFGSTakeNSteps(m_steps);
+    } else if (m_algorithm == FIRE) {
+      minimize.FIREInitialize(m_steps, m_econv);
+      minimize.FIRETakeNSteps(m_steps);
+    } else if (m_algorithm == TruncatedNewton) {
+      minimize.TruncatedNewtonInitialize(m_steps, m_econv);
+      minimize.TruncatedNewtonTakeNSteps(m_steps);
+    } else {
+      minimize.ConjugateGradientsInitialize(m_steps, m_econv);
+      minimize.ConjugateGradientsTakeNSteps(m_steps);
+    }
+
+    result.value = function->GetValue();
+    result.converged = minimize.HasConverged();
+    result.steps = minimize.GetCurrentStep();
+    result.stopReason = minimize.GetStopReason();
+    function->CopyPositionsToMol(mol);
+
+    std::stringstream ss;
+    ss << result.value;
+    SetPairData(mol, "OBFF_ENERGY", ss.str());
+    SetPairData(mol, "OBFF_STATUS", result.converged ? "converged" :
+        "not converged (" + StopReasonString(result.stopReason) + ")");
+  }
+
+  /**
+   * The atom typer and aromaticity typer in OpenBabel are global objects with
+   * internal state. Do the lazy perception on the reading thread, before the
+   * molecule is passed to a worker thread.
+   */
+  static void PerceiveMolecule(OBMol &mol)
+  {
+    mol.GetSSSR();
+    FOR_ATOMS_OF_MOL (atom, mol) {
+      atom->GetHyb();
+      atom->GetImplicitValence();
+      atom->IsAromatic();
+    }
+  }
+
+  bool OBBatchMinimize::Run(OBConversion &conv, std::istream *input, std::ostream *output)
+  {
+    m_results.clear();
+
+#ifdef _OPENMP
+    const int numThreads = (m_numThreads > 0) ? m_numThreads : omp_get_num_procs();
+#else
+    const int numThreads = 1;
+#endif
+    const unsigned int blockSize = m_blockSize ? m_blockSize : 8 * numThreads;
+
+    std::vector<OBFunction*> functions(numThreads, static_cast<OBFunction*>(0));
+    for (int t = 0; t < numThreads; ++t)
+      if (!(functions[t] = NewFunction()))
+        break;
+    if (!functions.back()) {
+      for (int t = 0; t < numThreads; ++t)
+        delete functions[t];
+      return false;
+    }
+
+    conv.SetInStream(input);
+    if (output)
+      conv.SetOutStream(output);
+
+    std::vector<OBMol> mols(blockSize);
+    std::vector<Result> results(blockSize);
+    while (true) {
+      unsigned int n = 0;
+      for (; n < blockSize; ++n) {
+        mols[n].Clear();
+        if (!conv.Read(&mols[n]))
+          break;
+        PerceiveMolecule(mols[n]);
+        results[n] = Result();
+        results[n].index = m_results.size() + n;
+      }
+      if (!n)
+        break;
+
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads)
+#endif
+      for (int i = 0; i < static_cast<int>(n); ++i) {
+#ifdef _OPENMP
+        const int thread = omp_get_thread_num();
+#else
+        const int thread = 0;
+#endif
+        Minimize(functions[thread], mols[i], results[i]);
+      }
+
+      for (unsigned int i = 0; i < n; ++i) {
+        m_results.push_back(results[i]);
+        if (output)
+          conv.Write(&mols[i]);
+      }
+
+      if (n < blockSize)
+        break;
+    }
+
+    for (int t = 0; t < numThreads; ++t)
+      delete functions[t];
+
+    return true;
+  }
+
+}
+} // end namespace OpenBabel
+
+//! \file obbatchminimize.cpp
+//! \brief Minimize all molecules from a multi-record file.
@@ -0,0 +1,184 @@
+/**********************************************************************
+obbatchminimize.h - Minimize all molecules from a multi-record file.
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OB_BATCHMINIMIZE_H
+#define OB_BATCHMINIMIZE_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace OpenBabel {
+
+  class OBMol;
+  class OBConversion;
+
+namespace OBFFs {
+
+  class OBFunction;
+  class OBParameterDB;
+
+  /**
+   * @class OBBatchMinimize
+   * @brief Minimize the molecules from a multi-record file using several threads.
+   *
+   * The molecules are read in blocks on the calling thread. The molecules in
+   * a block are minimized in parallel and written in input order before the
+   * next block is read, so only one block is kept in memory. Each thread has
+   * its own OBFunction instance (created using the OBFunctionFactory) which is
+   * reused for all molecules. The parameter database is loaded once and shared
+   * by these instances (see OBParameterDBRegistry).
+   *
+   * @code
+   * OBConversion conv;
+   * conv.SetInAndOutFormats("sdf", "sdf");
+   * OBBatchMinimize batch("GAFF");
+   * batch.SetNumThreads(0);
+   * batch.Run(conv, &ifs, &ofs);
+   * @endcode
+   */
+  class OBBatchMinimize
+  {
+    public:
+      enum Algorithm {
+        SteepestDescent,
+        ConjugateGradients,
+        LBFGS,
+        FIRE,
+        TruncatedNewton
+      };
+
+      /**
+       * The outcome of the minimization for a single molecule.
+       */
+      struct Result
+      {
+        Result() : index(0), setup(false), converged(false), steps(0),
+            stopReason(0), initialValue(0.0), value(0.0) {}
+        unsigned int index; //!< index of the molecule in the input (0 based)
+        std::string title; //!< molecule title
+        bool setup; //!< false if OBFunction::Setup() failed, the molecule is written unchanged
+        bool converged; //!< true if the convergence criteria were met
+        int steps; //!< number of minimization steps taken
+        int stopReason; //!< StopReason of the minimization
+        double initialValue; //!< value before minimization
+        double value; //!< value after minimization
+      };
+
+      /**
+       * Constructor.
+       *
+       * @param functionName The OBFunctionFactory name (e.g. "GAFF", "MMFF94").
+       */
+      OBBatchMinimize(const std::string &functionName);
+      /**
+       * Set the options for all OBFunction instances (see OBFunction::SetOptions()).
+       * The "threads" option is ignored, each instance uses a single thread.
+       */
+      void SetOptions(const std::string &options) { m_options = options; }
+      /**
+       * Set the parameter database for all OBFunction instances. The database
+       * is not deleted. By default, the functions use their shared database
+       * from the OBParameterDBRegistry.
+       */
+      void SetParameterDB(const OBParameterDB *database) { m_parameterDB = database; }
+      /**
+       * Set the number of threads, 0 uses all available cores. The default is
+       * 1. Without OpenMP support, the molecules are always minimized sequentially.
+       */
+      void SetNumThreads(int numThreads) { m_numThreads = numThreads; }
+      /**
+       * Set the minimization algorithm, the default is ConjugateGradients.
+       */
+      void SetAlgorithm(Algorithm algorithm) { m_algorithm = algorithm; }
+      /**
+       * Set the maximum number of steps (default 2500) and the energy convergence
+       * criteria (default 1e-6).
+       */
+      void SetConvergence(int steps, double econv = 1e-6) { m_steps = steps; m_econv = econv; }
+      /**
+       * Set the ConvergenceCriteria flags and limits (see
+       * OBMinimize::SetConvergenceCriteria()). The default is
+       * ConvergenceCriteria::Energy.
+       */
+      void SetConvergenceCriteria(int criteria, double rmsGradient = 0.01, double maxGradient = 0.05,
+          double maxDisplacement = 1e-3)
+      {
+        m_criteria = criteria;
+        m_rmsGradient = rmsGradient;
+        m_maxGradient = maxGradient;
+        m_maxDisplacement = maxDisplacement;
+      }
+      /**
+       * Set the stall detection (see OBMinimize::SetStallDetection()).
+       */
+      void SetStallDetection(int steps, double minDecrease) { m_stallSteps = steps; m_stallDecrease = minDecrease; }
+      /**
+       * Set the number of molecules in a block. The default 0 uses 8 molecules
+       * for each thread.
+       */
+      void SetBlockSize(unsigned int blockSize) { m_blockSize = blockSize; }
+      /**
+       * Minimize all molecules from @p input. If @p output is not 0, the minimized
+       * molecules are written to it in input order. The energy and status are
+       * stored as OBPairData ("OBFF_ENERGY" and "OBFF_STATUS") in the written
+       * molecules. The status is "converged" or "not converged" followed by the
+       * stop reason in parentheses.
+       *
+       * @param conv The OBConversion with the input and output formats set.
+       *
+       * @return False if the OBFunction could not be created.
+       */
+      bool Run(OBConversion &conv, std::istream *input, std::ostream *output);
+      /**
+       * Get the results for all molecules from the last Run(), in input order.
+       */
+      const std::vector<Result>& GetResults() const { return m_results; }
+
+    protected:
+      /**
+       * Create a new OBFunction with the options and database set.
+       */
+      OBFunction* NewFunction() const;
+      /**
+       * Minimize @p mol using @p function and copy the positions back to @p mol.
+       */
+      void Minimize(OBFunction *function, OBMol &mol, Result &result) const;
+
+      std::string m_functionName;
+      std::string m_options;
+      const OBParameterDB *m_parameterDB;
+      int m_numThreads;
+      Algorithm m_algorithm;
+      int m_steps;
+      double m_econv;
+      int m_criteria;
+      double m_rmsGradient, m_maxGradient, m_maxDisplacement;
+      int m_stallSteps;
+      double m_stallDecrease;
+      unsigned int m_blockSize;
+      std::vector<Result> m_results;
+  };
+
+}
+} // namespace OpenBabel
+
+#endif
+
+//! @file obbatchminimize.h
+//! @brief Minimize all molecules from a multi-record file.
@@ -0,0 +1,384 @@
+/*********************************************************************
+Molecular dynamics
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBDynamics>
+#include <OBFunction>
+#include <OBNbrList>
+#include <OBLogFile>
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    OBDynamics::OBDynamics(OBFunction *function) : m_function(function), m_timeStep(1.0),
+        m_thermostat(None), m_targetTemperature(300.0), m_couplingTime(100.0), m_nbrListSkin(1.0),
+        m_respaInterval(1), m_fastGroups(TermGroup::Bonded),
+        m_step(0), m_numSteps(0), m_degreesOfFreedom(0), m_boltzmann(0.0), m_forceToAcceleration(0.0),
+        m_kineticEnergy(0.0), m_thermostatEnergy(0.0), m_noseHooverXi(0.0)
+    {
+      SetSeed(5489);
+    }
+
+    void OBDynamics::SetThermostat(Thermostat thermostat, double temperature, double couplingTime)
+    {
+      m_thermostat = thermostat;
+      m_targetTemperature = temperature;
+      m_couplingTime = couplingTime;
+    }
+
+    void OBDynamics::SetRESPA(int interval, unsigned int fastGroups)
+    {
+      m_respaInterval = std::max(interval, 1);
+      m_fastGroups = fastGroups;
+    }
+
+    void OBDynamics::SetSeed(unsigned long seed)
+    {
+      // the state can not be all zero
+      m_randomState[0] = 123456789u ^ static_cast<unsigned int>(seed);
+      m_randomState[1] = 362436069u;
+      m_randomState[2] = 521288629u;
+      m_randomState[3] = 88675123u;
+      m_hasGaussian = false;
+    }
+
+    //
+    // Marsaglia, "Xorshift RNGs", J. Stat. Softw. 8 (2003), with the
+    // Box-Muller transform
+    //
+    double OBDynamics::Gaussian()
+    {
+      if (m_hasGaussian) {
+        m_hasGaussian = false;
+        return m_gaussian;
+      }
+
+      double u[2];
+      for (int k = 0; k < 2; ++k) {
+        unsigned int t = m_randomState[0] ^ (m_randomState[0] << 11);
+        m_randomState[0] = m_randomState[1];
+        m_randomState[1] = m_randomState[2];
+        m_randomState[2] = m_randomState[3];
+        m_randomState[3] = m_randomState[3] ^ (m_randomState[3] >> 19) ^ t ^ (t >> 8);
+        // (0, 1]
+        u[k] = (m_randomState[3] + 1.0) / 4294967296.0;
+      }
+      const double r = sqrt(-2.0 * log(u[0]));
+      m_gaussian = r * sin(2.0 * M_PI * u[1]);
+      m_hasGaussian = true;
+      return r * cos(2.0 * M_PI * u[1]);
+    }
+
+    double OBDynamics::GetPotentialEnergy() const
+    {
+      return m_function->GetValue();
+    }
+
+    double OBDynamics::GetKineticEnergy() const
+    {
+      double mv2 = 0.0;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        mv2 += m_velocities[i].squaredNorm() / m_invMasses[i];
+      // amu Angstrom^2 / fs^2 to the energy unit
+      return 0.5 * mv2 / m_forceToAcceleration;
+    }
+
+    double OBDynamics::GetTemperature() const
+    {
+      if (!m_degreesOfFreedom)
+        return 0.0;
+      return 2.0 * GetKineticEnergy() / (m_degreesOfFreedom * m_boltzmann);
+    }
+
+    double OBDynamics::GetConservedEnergy() const
+    {
+      return GetPotentialEnergy() + GetKineticEnergy() - m_thermostatEnergy;
+    }
+
+    void OBDynamics::RemoveCenterOfMassMotion()
+    {
+      double totalMass = 0.0;
+      Eigen::Vector3d momentum = Eigen::Vector3d::Zero();
+      for (unsigned int i = 0; i < m_velocities.size(); ++i) {
+        momentum += m_velocities[i] / m_invMasses[i];
+        totalMass += 1.0 / m_invMasses[i];
+      }
+      if (totalMass == 0.0)
+        return;
+      const Eigen::Vector3d velocity = momentum / totalMass;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        m_velocities[i] -= velocity;
+    }
+
+    void OBDynamics::RandomizeVelocities(double temperature)
+    {
+      // sigma^2 = kT / m
+      const double kT = m_boltzmann * temperature * m_forceToAcceleration;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i) {
+        const double sigma = sqrt(kT * m_invMasses[i]);
+        for (unsigned int k = 0; k < 3; ++k)
+          m_velocities[i][k] = sigma * Gaussian();
+      }
+      if (m_thermostat != Langevin)
+        RemoveCenterOfMassMotion();
+
+      // exact initial temperature
+      const double current = GetTemperature();
+      if (current > 0.0)
+        for (unsigned int i = 0; i < m_velocities.size(); ++i)
+          m_velocities[i] *= sqrt(temperature / current);
+    }
+
+    void OBDynamics::ScaleVelocities(double scale)
+    {
+      const double before = m_kineticEnergy;
+      for (unsigned int i = 0; i < m_velocities.size(); ++i)
+        m_velocities[i] *= scale;
+      m_kineticEnergy = before * scale * scale;
+      m_thermostatEnergy += m_kineticEnergy - before;
+    }
+
+    void OBDynamics::Initialize(int steps, double temperature)
+    {
+      const unsigned int numParticles = m_function->NumParticles();
+      m_step = 0;
+      m_numSteps = steps;
+      m_thermostatEnergy = 0.0;
+      m_noseHooverXi = 0.0;
+
+      if (m_function->GetUnit() == "kJ/mol") {
+        m_boltzmann = 8.314472e-3;
+        m_forceToAcceleration = 1.0e-4;
+      } else {
+        m_boltzmann = 1.9872041e-3;
+        m_forceToAcceleration = 4.184e-4;
+      }
+
+      // unit masses if the function has none
+      const std::vector<double> &masses = m_function->GetMasses();
+      m_invMasses.resize(numParticles);
+      for (unsigned int i = 0; i < numParticles; ++i)
+        m_invMasses[i] = (masses.size() == numParticles && masses[i] > 0.0) ? 1.0 / masses[i] : 1.0;
+
+      // the Langevin thermostat does not conserve the momentum
+      m_degreesOfFreedom = 3 * numParticles;
+      if (m_thermostat != Langevin && numParticles > 1)
+        m_degreesOfFreedom -= 3;
+
+      OBNbrList *nbrList = m_function->GetNbrList();
+      if (nbrList && nbrList->GetSkin() <= 0.0 && m_nbrListSkin > 0.0)
+        nbrList->SetSkin(m_nbrListSkin);
+
+      if (temperature >= 0.0) {
+        m_velocities.resize(numParticles);
+        RandomizeVelocities(temperature);
+      } else
+        m_velocities.resize(numParticles, Eigen::Vector3d::Zero());
+
+      if (m_respaInterval > 1) {
+        std::vector<Eigen::Vector3d> &forces = m_function->GetGradients();
+        m_function->ComputeGroups(OBFunction::Gradients, m_fastGroups);
+        m_fastForces = forces;
+        m_function->ComputeGroups(OBFunction::Gradients, TermGroup::All & ~m_fastGroups);
+        m_slowForces = forces;
+        for (unsigned int c = 0; c < numParticles; ++c)
+          forces[c] += m_fastForces[c];
+      } else
+        m_function->Compute(OBFunction::Gradients);
+      m_kineticEnergy = GetKineticEnergy();
+
+      OBLogFile *logfile = m_function->GetLogFile();
+      if (logfile->IsLow()) {
+        char logbuf[128];
+        logfile->Write("\nM O L E C U L A R   D Y N A M I C S\n\n");
+        snprintf(logbuf, sizeof(logbuf), "STEPS = %d    TIME STEP = %.3f fs\n\n", steps, m_timeStep);
+        logfile->Write(logbuf);
+        logfile->Write("STEP n   TIME (fs)      E(pot)      E(kin)    T (K)\n");
+        logfile->Write("----------------------------------------------------\n");
+        snprintf(logbuf, sizeof(logbuf), " %6d  %10.1f  %10.3f  %10.3f  %7.1f\n", m_step, GetTime(),
+            GetPotentialEnergy(), m_kineticEnergy, GetTemperature());
+        logfile->Write(logbuf);
+      }
+    }
+
+    //
+    // One Nose-Hoover thermostat, dt/2 of the Liouville operator:
+    //
+    //   xi += G dt/4     v *= exp(-xi dt/2)     xi += G dt/4
+    //
+    // with G = (2 Ekin - Ndf kT) / Q and Q = Ndf kT tau^2.
+    //
+    void OBDynamics::NoseHooverHalfStep(double dt)
+    {
+      const double NkT = m_degreesOfFreedom * m_boltzmann * m_targetTemperature;
+      if (NkT <= 0.0 || m_couplingTime <= 0.0)
+        return;
+      const double Q = NkT * m_couplingTime * m_couplingTime;
+      const double quarter = 0.25 * dt;
+      m_noseHooverXi += quarter * (2.0 * m_kineticEnergy - NkT) / Q;
+      ScaleVelocities(exp(-m_noseHooverXi * 0.5 * dt));
+      m_noseHooverXi += quarter * (2.0 * m_kineticEnergy - NkT) / Q;
+    }
+
+    //
+    // v = c1 v + sqrt((1 - c1^2) kT / m) R      c1 = exp(-dt / tau)
+    //
+    void OBDynamics::LangevinStep(double dt)
+    {
+      if (m_couplingTime <= 0.0)
+        return;
+      const double c1 = exp(-dt / m_couplingTime);
+      const double kT = m_boltzmann * m_targetTemperature * m_forceToAcceleration;
+      const double before = GetKineticEnergy();
+      for (unsigned int c = 0; c < m_velocities.size(); ++c) {
+        const double sigma = sqrt((1.0 - c1 * c1) * kT * m_invMasses[c]);
+        for (unsigned int k = 0; k < 3; ++k)
+          m_velocities[c][k] = c1 * m_velocities[c][k] + sigma * Gaussian();
+      }
+      m_kineticEnergy = GetKineticEnergy();
+      m_thermostatEnergy += m_kineticEnergy - before;
+    }
+
+    void OBDynamics::Kick(const std::vector<Eigen::Vector3d> &forces, double dt)
+    {
+      const double scale = dt * m_forceToAcceleration;
+      for (unsigned int c = 0; c < m_velocities.size(); ++c)
+        m_velocities[c] += (scale * m_invMasses[c]) * forces[c];
+    }
+
+    void OBDynamics::Drift(double dt)
+    {
+      std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      for (unsigned int c = 0; c < m_velocities.size(); ++c)
+        positions[c] += dt * m_velocities[c];
+    }
+
+    void OBDynamics::EndStep(double dt)
+    {
+      m_kineticEnergy = GetKineticEnergy();
+      if (m_thermostat == NoseHoover)
+        NoseHooverHalfStep(dt);
+      else if (m_thermostat == Berendsen && m_couplingTime > 0.0 && m_kineticEnergy > 0.0) {
+        // lambda^2 = 1 + dt / tau (T0 / T - 1), limited as in GROMACS
+        const double ratio = m_targetTemperature / GetTemperature();
+        const double lambda2 = 1.0 + dt / m_couplingTime * (ratio - 1.0);
+        ScaleVelocities(std::min(std::max(sqrt(std::max(lambda2, 0.0)), 0.8), 1.25));
+      }
+    }
+
+    // The gradients are forces.
+    void OBDynamics::VerletStep()
+    {
+      const std::vector<Eigen::Vector3d> &forces = m_function->GetGradients();
+      const double dt = m_timeStep;
+
+      if (m_thermostat == NoseHoover)
+        NoseHooverHalfStep(dt);
+
+      Kick(forces, 0.5 * dt);
+      if (m_thermostat == Langevin) {
+        // B A O A B
+        Drift(0.5 * dt);
+        LangevinStep(dt);
+        Drift(0.5 * dt);
+      } else
+        Drift(dt);
+
+      m_function->Compute(OBFunction::Gradients);
+      Kick(forces, 0.5 * dt);
+
+      EndStep(dt);
+    }
+
+    //
+    // Tuckerman, Berne & Martyna, J. Chem. Phys. 97, 1990 (1992): the slow
+    // forces are applied as half kicks around the inner velocity Verlet
+    // steps with the fast forces. The Langevin thermostat uses the O B A B O
+    // splitting for the outer step.
+    //
+    void OBDynamics::RESPAStep()
+    {
+      std::vector<Eigen::Vector3d> &forces = m_function->GetGradients();
+      const double dt = m_timeStep;
+      const double outer = m_respaInterval * dt;
+      const unsigned int slowGroups = TermGroup::All & ~m_fastGroups;
+
+      if (m_thermostat == NoseHoover)
+        NoseHooverHalfStep(outer);
+      else if (m_thermostat == Langevin)
+        LangevinStep(0.5 * outer);
+
+      Kick(m_slowForces, 0.5 * outer);
+      for (int i = 0; i < m_respaInterval; ++i) {
+        Kick(m_fastForces, 0.5 * dt);
+        Drift(dt);
+        m_function->ComputeGroups(OBFunction::Gradients, m_fastGroups);
+        m_fastForces = forces;
+        Kick(m_fastForces, 0.5 * dt);
+      }
+      m_function->ComputeGroups(OBFunction::Gradients, slowGroups);
+      m_slowForces = forces;
+      Kick(m_slowForces, 0.5 * outer);
+
+      // leave the total forces in the function
+      for (unsigned int c = 0; c < forces.size(); ++c)
+        forces[c] += m_fastForces[c];
+
+      if (m_thermostat == Langevin)
+        LangevinStep(0.5 * outer);
+      EndStep(outer);
+    }
+
+    bool OBDynamics::TakeNSteps(int n)
+    {
+      OBLogFile *logfile = m_function->GetLogFile();
+
+      for (int i = 1; i <= n; i++) {
+        if (m_step >= m_numSteps)
+          return false;
+        m_step++;
+
+        if (m_respaInterval > 1)
+          RESPAStep();
+        else
+          VerletStep();
+
+        if (logfile->IsLow() && (m_step % 10 == 0)) {
+          char logbuf[128];
+          snprintf(logbuf, sizeof(logbuf), " %6d  %10.1f  %10.3f  %10.3f  %7.1f\n", m_step, GetTime(),
+              GetPotentialEnergy(), m_kineticEnergy, GetTemperature());
+          logfile->Write(logbuf);
+        }
+      }
+
+      return m_step < m_numSteps;
+    }
+
+    void OBDynamics::Run(int steps, double temperature)
+    {
+      Initialize(steps, temperature);
+      TakeNSteps(steps);
+    }
+
+  }
+}
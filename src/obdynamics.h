@@ -0,0 +1,256 @@
+/*********************************************************************
+Molecular dynamics
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFFS_DYNAMICS_H
+#define OBFFS_DYNAMICS_H
+
+#include <vector>
+#include <Eigen/Core>
+
+#include <OBFunction>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * @class OBDynamics
+     * @brief Velocity Verlet molecular dynamics for an OBFunction.
+     *
+     * The positions are in Angstrom, the time in fs and the masses in amu
+     * (see OBFunction::GetMasses()). The function's energy unit (kcal/mol or
+     * kJ/mol, see OBFunction::GetUnit()) is used for the energies. Each step
+     * takes a single gradient evaluation (see SetRESPA() for multiple time
+     * steps).
+     *
+     * The thermostats:
+     * - None: microcanonical (NVE) dynamics.
+     * - Berendsen: the velocities are scaled after each step so the
+     *   temperature relaxes to the target with the coupling time. Does not
+     *   sample the canonical ensemble, but is useful for heating and annealing.
+     * - Langevin: friction and random forces (BAOAB splitting, Leimkuhler &
+     *   Matthews, Appl. Math. Res. Express 2013, 34), the friction
+     *   coefficient is 1 / coupling time. Samples the canonical ensemble.
+     * - NoseHoover: a single Nose-Hoover thermostat with the coupling time as
+     *   period, integrated with the time-reversible splitting from Martyna,
+     *   Tuckerman & Klein (Mol. Phys. 87, 1117 (1996)).
+     *
+     * The cut-off terms use the function's OBNbrList, which is updated in
+     * each OBFunction::Compute(). The counter based update of a list without
+     * Verlet skin can miss pairs when atoms move every step, Initialize()
+     * sets a skin (see SetNbrListSkin()) if the list has none. The list is
+     * then only rebuilt when an atom moved more than half the skin.
+     *
+     * @code
+     * OBDynamics md(function);
+     * md.SetTimeStep(1.0);
+     * md.SetThermostat(OBDynamics::Langevin, 300.0);
+     * md.Initialize(10000, 300.0);
+     * while (md.TakeNSteps(100))
+     *   cout << md.GetTemperature() << endl;
+     * @endcode
+     */
+    class OBDynamics
+    {
+    public:
+      enum Thermostat {
+        None, //!< constant energy
+        Berendsen, //!< velocity rescaling towards the target temperature
+        Langevin, //!< stochastic dynamics
+        NoseHoover //!< deterministic canonical sampling
+      };
+      /**
+       * Constructor.
+       */
+      OBDynamics(OBFunction *function);
+      /**
+       * Set the time step in fs (default 1.0).
+       */
+      void SetTimeStep(double timeStep) { m_timeStep = timeStep; }
+      double GetTimeStep() const { return m_timeStep; }
+      /**
+       * Set the thermostat, the target temperature (K) and the coupling time
+       * (fs, default 100). Can be changed between TakeNSteps() calls (e.g. for
+       * simulated annealing).
+       */
+      void SetThermostat(Thermostat thermostat, double temperature = 300.0, double couplingTime = 100.0);
+      Thermostat GetThermostat() const { return m_thermostat; }
+      double GetTargetTemperature() const { return m_targetTemperature; }
+      /**
+       * Use r-RESPA multiple time step integration (Tuckerman, Berne &
+       * Martyna, J. Chem. Phys. 97, 1990 (1992)). The terms in @p fastGroups
+       * (TermGroup flags, see OBFunction::ComputeGroups()) are integrated
+       * with the time step, the other terms (e.g. the expensive pair terms)
+       * are computed once every @p interval time steps. Each step from
+       * TakeNSteps() is then an outer step of @p interval time steps. An
+       * interval of 1 (the default) disables RESPA.
+       *
+       * The outer step is limited by the fastest motion driven by the slow
+       * forces, 2-4 fs (an interval of 4 with a 0.5-1 fs time step) is
+       * usually stable.
+       */
+      void SetRESPA(int interval, unsigned int fastGroups = TermGroup::Bonded);
+      int GetRESPAInterval() const { return m_respaInterval; }
+      /**
+       * Set the seed for the random initial velocities and the Langevin
+       * thermostat. Runs with the same seed are reproducible.
+       */
+      void SetSeed(unsigned long seed);
+      /**
+       * Set the Verlet skin used by Initialize() when the function's
+       * OBNbrList has none (default 1.0 Angstrom, 0.0 leaves the list as it is).
+       */
+      void SetNbrListSkin(double skin) { m_nbrListSkin = skin; }
+      /**
+       * Initialize the dynamics and compute the forces for the current
+       * positions.
+       *
+       * @param steps The number of steps.
+       * @param temperature Initial temperature (K), the velocities are taken
+       * from the Maxwell-Boltzmann distribution. A negative value keeps the
+       * current velocities (see SetVelocities()).
+       */
+      void Initialize(int steps = 1000, double temperature = 300.0);
+      /**
+       * Take @p n steps of the dynamics initialized with Initialize(). The
+       * function's gradients are the total forces for the new positions
+       * afterwards.
+       *
+       * @return False if the number of steps given by Initialize() has been
+       * reached.
+       */
+      bool TakeNSteps(int n);
+      /**
+       * Initialize() and take all steps.
+       */
+      void Run(int steps, double temperature = 300.0);
+      /**
+       * @return The number of steps taken since Initialize().
+       */
+      int GetCurrentStep() const { return m_step; }
+      /**
+       * @return The simulated time since Initialize() in fs.
+       */
+      double GetTime() const { return m_step * m_respaInterval * m_timeStep; }
+      /**
+       * @return The velocities in Angstrom/fs.
+       */
+      const std::vector<Eigen::Vector3d>& GetVelocities() const { return m_velocities; }
+      /**
+       * Set the velocities (Angstrom/fs), used by Initialize() with a
+       * negative temperature.
+       */
+      void SetVelocities(const std::vector<Eigen::Vector3d> &velocities) { m_velocities = velocities; }
+      /**
+       * @return The potential energy for the current positions.
+       */
+      double GetPotentialEnergy() const;
+      /**
+       * @return The kinetic energy.
+       */
+      double GetKineticEnergy() const;
+      /**
+       * @return The instantaneous temperature (K).
+       */
+      double GetTemperature() const;
+      /**
+       * @return The potential and kinetic energy minus the energy added by
+       * the thermostat since Initialize(). This is (nearly) constant for all
+       * thermostats, the drift is a measure for the integration error.
+       */
+      double GetConservedEnergy() const;
+      /**
+       * @return The number of degrees of freedom used for the temperature.
+       */
+      unsigned int GetDegreesOfFreedom() const { return m_degreesOfFreedom; }
+
+    protected:
+      /**
+       * Take a velocity Verlet step.
+       */
+      void VerletStep();
+      /**
+       * Take an outer r-RESPA step.
+       */
+      void RESPAStep();
+      /**
+       * Add the acceleration from @p forces times @p dt to the velocities.
+       */
+      void Kick(const std::vector<Eigen::Vector3d> &forces, double dt);
+      /**
+       * Move the positions along the velocities for @p dt.
+       */
+      void Drift(double dt);
+      /**
+       * Update the kinetic energy and apply the thermostat at the end of a
+       * step of length @p dt.
+       */
+      void EndStep(double dt);
+      /**
+       * Apply the Nose-Hoover thermostat for half of @p dt.
+       */
+      void NoseHooverHalfStep(double dt);
+      /**
+       * Apply the Langevin friction and random forces for @p dt.
+       */
+      void LangevinStep(double dt);
+      /**
+       * Scale the velocities, the kinetic energy change is added to the
+       * thermostat energy.
+       */
+      void ScaleVelocities(double scale);
+      /**
+       * Take the velocities from the Maxwell-Boltzmann distribution at
+       * @p temperature without center of mass motion.
+       */
+      void RandomizeVelocities(double temperature);
+      /**
+       * Remove the center of mass velocity.
+       */
+      void RemoveCenterOfMassMotion();
+      /**
+       * @return A random number from the standard normal distribution.
+       */
+      double Gaussian();
+
+      OBFunction *m_function;
+      double m_timeStep;
+      Thermostat m_thermostat;
+      double m_targetTemperature;
+      double m_couplingTime;
+      double m_nbrListSkin;
+      int m_respaInterval;
+      unsigned int m_fastGroups;
+      int m_step, m_numSteps;
+      unsigned int m_degreesOfFreedom;
+      double m_boltzmann; //!< R in the function's energy unit per K
+      double m_forceToAcceleration; //!< energy unit / (Angstrom amu) to Angstrom / fs^2
+      std::vector<double> m_invMasses;
+      std::vector<Eigen::Vector3d> m_velocities;
+      std::vector<Eigen::Vector3d> m_fastForces, m_slowForces; //!< r-RESPA forces
+      double m_kineticEnergy; //!< kinetic energy after the last step
+      double m_thermostatEnergy; //!< energy added by the thermostat
+      double m_noseHooverXi; //!< Nose-Hoover friction (1/fs)
+      unsigned int m_randomState[4]; //!< xorshift128 state
+      bool m_hasGaussian; //!< Gaussian() has a second value
+      double m_gaussian;
+    };
+
+  }
+}
+
+#endif
@@ -20,6 +20,7 @@ GNU General Public License for more details.
 
 #include <string>
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -90,172 +91,191 @@ namespace OpenBabel {
 	_numColumns = values.size();
       }
       _rows.push_back(values);
+      _indexes.clear();
       return true;
     }
 
-    const vector<OBVariant>& OBFFTable::FindRow(const vector<Query> &query, bool *swapped) const
+    static unsigned long CombineHash(unsigned long hash, unsigned long value)
     {
-      unsigned int numRows = NumRows();
+      return hash ^ (value + 0x9e3779b9UL + (hash << 6) + (hash >> 2));
+    }
 
+    static bool MatchQuery(const vector<OBVariant> &row, const vector<OBParameterDBTable::Query> &query)
+    {
+      for (unsigned int j = 0; j < query.size(); ++j)
+	if (row[query[j].column] != query[j].value)
+	  return false;
+      return true;
+    }
+
+    // returns false if the query contains invalid columns, swapped_query is
+    // left empty if there are no columns to swap
+    static bool MakeSwappedQuery(const vector<OBParameterDBTable::Query> &query, unsigned int numColumns,
+        vector<OBParameterDBTable::Query> &swapped_query)
+    {
       unsigned int swapCount = 0;
       // make sure the query contains valid columns
       for (unsigned int i = 0; i < query.size(); ++i) {
-	if (query.at(i).column >= _numColumns)
-	  return _emptyRow;
+	if (query.at(i).column < 0 || static_cast<unsigned int>(query.at(i).column) >= numColumns)
+	  return false;
 	if (query.at(i).swap)
 	  swapCount++;
       }
-      
-      if (!swapCount) {
-	for (unsigned int i = 0; i < numRows; ++i) {
-	  bool match = true;
-	  // check each query entry
-	  for (unsigned int j = 0; j < query.size(); ++j) {
-	    if (_rows[i].at(query.at(j).column) != query.at(j).value) {
-	      match = false;
-	      break;
-	    }
-	  }
-
-	  if (match)
-	    return _rows[i];
-	}
-      } else {
-	// construct swapped_query
-	vector<Query> swapped_query = query;
-	for (unsigned int i = 0; i < query.size(); ++i) {
-	  if (query.at(i).swap) {
-	    if (swapCount == 4) {
-	      swapped_query[i  ].column = query[i+3].column;
-	      swapped_query[i+1].column = query[i+2].column;
-	      swapped_query[i+2].column = query[i+1].column;
-	      swapped_query[i+3].column = query[i  ].column;
-	    } else {
-	      swapped_query[i].column = query[i+swapCount-1].column;
-	      swapped_query[i+swapCount-1].column = query[i].column;
-	    }
-	    break;
-	  }
-	}
 
-	for (unsigned int i = 0; i < numRows; ++i) {
-	  bool match = true;
-	  // check query
-	  for (unsigned int j = 0; j < query.size(); ++j) {
-	    if (_rows[i].at(query.at(j).column) != query.at(j).value) {
-	      match = false;
-	      break;
-	    }
-	  }
+      if (!swapCount)
+	return true;
 
-	  if (match) {
-	    if (swapped)
-	      *swapped = false;
-	    return _rows[i];
-	  }
- 
-	  match = true;
-	  // check swapped query
-	  for (unsigned int j = 0; j < swapped_query.size(); ++j) {
-	    if (_rows[i].at(swapped_query.at(j).column) != swapped_query.at(j).value) {
-	      match = false;
-	      break;
-	    }
-	  }
- 
-	  if (match) {
-	    if (swapped)
-	      *swapped = true;
-	    return _rows[i];
+      // construct swapped_query
+      swapped_query = query;
+      for (unsigned int i = 0; i < query.size(); ++i) {
+	if (query.at(i).swap) {
+	  if (swapCount == 4) {
+	    swapped_query[i  ].column = query[i+3].column;
+	    swapped_query[i+1].column = query[i+2].column;
+	    swapped_query[i+2].column = query[i+1].column;
+	    swapped_query[i+3].column = query[i  ].column;
+	  } else {
+	    swapped_query[i].column = query[i+swapCount-1].column;
+	    swapped_query[i+swapCount-1].column = query[i].column;
 	  }
+	  break;
 	}
       }
-     
-      return _emptyRow;
+      return true;
     }
 
-    vector< vector<OBVariant> > OBFFTable::FindRows(const vector<Query> &query, bool *swapped) const
+    const OBFFTable::Index* OBFFTable::GetIndex(const vector<int> &columns) const
     {
-      unsigned int numRows = NumRows();
-      vector< vector<OBVariant> > rows;
-
-      unsigned int swapCount = 0;
-      // make sure the query contains valid columns
-      for (unsigned int i = 0; i < query.size(); ++i) {
-	if (query.at(i).column >= _numColumns)
-	  return rows;
-	if (query.at(i).swap)
-	  swapCount++;
+      const Index *index = 0;
+#ifdef _OPENMP
+      #pragma omp critical (obff_table_index)
+#endif
+      {
+        map<vector<int>, Index>::const_iterator i = _indexes.find(columns);
+        if (i == _indexes.end()) {
+          // std::map nodes are never moved, the pointer stays valid until AddRow()
+          Index &newIndex = _indexes[columns];
+          newIndex.columns = columns;
+          unsigned int numBuckets = 1;
+          while (numBuckets < _rows.size())
+            numBuckets <<= 1;
+          newIndex.buckets.resize(numBuckets);
+          for (unsigned int row = 0; row < _rows.size(); ++row) {
+            unsigned long hash = 0;
+            for (unsigned int j = 0; j < columns.size(); ++j)
+              hash = CombineHash(hash, _rows[row][columns[j]].Hash());
+            newIndex.buckets[hash & (numBuckets - 1)].push_back(row);
+          }
+          index = &newIndex;
+        } else
+          index = &i->second;
       }
-      
-      if (!swapCount) {
-	for (unsigned int i = 0; i < numRows; ++i) {
-	  bool match = true;
-	  // check each query entry
-	  for (unsigned int j = 0; j < query.size(); ++j) {
-	    if (_rows[i].at(query.at(j).column) != query.at(j).value) {
-	      match = false;
-	      break;
-	    }
-	  }
+      return index;
+    }
 
-	  if (match)
-	    rows.push_back(_rows[i]);
-	}
+    void OBFFTable::Match(const vector<Query> &query, const vector<Query> &swapped_query,
+        bool firstOnly, vector<pair<unsigned int, bool> > &matches) const
+    {
+      // the index uses the sorted query columns as key, the query values are
+      // hashed in the same order
+      vector<int> columns;
+      for (unsigned int i = 0; i < query.size(); ++i)
+        columns.push_back(query[i].column);
+      sort(columns.begin(), columns.end());
+
+      static const vector<unsigned int> noRows;
+      const vector<unsigned int> *candidates = &noRows, *swappedCandidates = &noRows;
+      vector<unsigned int> allRows;
+      if (!columns.empty() && adjacent_find(columns.begin(), columns.end()) == columns.end()) {
+        const Index *index = GetIndex(columns);
+        const unsigned long mask = index->buckets.size() - 1;
+        unsigned long hash = 0, swappedHash = 0;
+        for (unsigned int i = 0; i < columns.size(); ++i) {
+          for (unsigned int j = 0; j < query.size(); ++j)
+            if (query[j].column == columns[i])
+              hash = CombineHash(hash, query[j].value.Hash());
+          for (unsigned int j = 0; j < swapped_query.size(); ++j)
+            if (swapped_query[j].column == columns[i])
+              swappedHash = CombineHash(swappedHash, swapped_query[j].value.Hash());
+        }
+        candidates = &index->buckets[hash & mask];
+        // rows are only stored in one bucket
+        if (!swapped_query.empty() && (swappedHash & mask) != (hash & mask))
+          swappedCandidates = &index->buckets[swappedHash & mask];
       } else {
-	// construct swapped_query
-	vector<Query> swapped_query = query;
-	for (unsigned int i = 0; i < query.size(); ++i) {
-	  if (query.at(i).swap) {
-	    if (swapCount == 4) {
-	      swapped_query[i  ].column = query[i+3].column;
-	      swapped_query[i+1].column = query[i+2].column;
-	      swapped_query[i+2].column = query[i+1].column;
-	      swapped_query[i+3].column = query[i  ].column;
-	    } else {
-	      swapped_query[i].column = query[i+swapCount-1].column;
-	      swapped_query[i+swapCount-1].column = query[i].column;
-	    }
-	    break;
-	  }
-	}
+        // empty query or the same column used twice
+        for (unsigned int row = 0; row < _rows.size(); ++row)
+          allRows.push_back(row);
+        candidates = &allRows;
+      }
 
-	for (unsigned int i = 0; i < numRows; ++i) {
-	  bool match = true;
-	  // check query
-	  for (unsigned int j = 0; j < query.size(); ++j) {
-	    if (_rows[i].at(query.at(j).column) != query.at(j).value) {
-	      match = false;
-	      break;
-	    }
-	  }
+      // merge both buckets to check the rows in the original order
+      unsigned int i = 0, j = 0;
+      while (i < candidates->size() || j < swappedCandidates->size()) {
+        unsigned int row;
+        if (j == swappedCandidates->size() || (i < candidates->size() && (*candidates)[i] < (*swappedCandidates)[j]))
+          row = (*candidates)[i++];
+        else
+          row = (*swappedCandidates)[j++];
 
-	  if (match) {
-	    if (swapped)
-	      *swapped = false;
-	    rows.push_back(_rows[i]);
-	  }
- 
-	  match = true;
-	  // check swapped query
-	  for (unsigned int j = 0; j < swapped_query.size(); ++j) {
-	    if (_rows[i].at(swapped_query.at(j).column) != swapped_query.at(j).value) {
-	      match = false;
-	      break;
-	    }
-	  }
- 
-	  if (match) {
-	    if (swapped)
-	      *swapped = true;
-	    rows.push_back(_rows[i]);
-	  }
+	if (MatchQuery(_rows[row], query)) {
+	  matches.push_back(make_pair(row, false));
+	  if (firstOnly)
+	    return;
+	}
+	if (!swapped_query.empty() && MatchQuery(_rows[row], swapped_query)) {
+	  matches.push_back(make_pair(row, true));
+	  if (firstOnly)
+	    return;
 	}
       }
-     
+    }
+
+    const vector<OBVariant>& OBFFTable::FindRow(const vector<Query> &query, bool *swapped) const
+    {
+      vector<Query> swapped_query;
+      if (!MakeSwappedQuery(query, _numColumns, swapped_query))
+	return _emptyRow;
+
+      vector<pair<unsigned int, bool> > matches;
+      Match(query, swapped_query, true, matches);
+      if (matches.empty())
+	return _emptyRow;
+
+      if (swapped && !swapped_query.empty())
+	*swapped = matches.front().second;
+      return _rows[matches.front().first];
+    }
+
+    vector< vector<OBVariant> > OBFFTable::FindRows(const vector<Query> &query, bool *swapped) const
+    {
+      vector< vector<OBVariant> > rows;
+      vector<Query> swapped_query;
+      if (!MakeSwappedQuery(query, _numColumns, swapped_query))
+	return rows;
+
+      vector<pair<unsigned int, bool> > matches;
+      Match(query, swapped_query, false, matches);
+      for (unsigned int i = 0; i < matches.size(); ++i)
+	rows.push_back(_rows[matches[i].first]);
+
+      if (swapped && !swapped_query.empty() && !matches.empty())
+	*swapped = matches.back().second;
       return rows;
     }
       
+    vector<const vector<OBVariant>*> OBFFTable::FindTypeRows(int column, const vector<string> &types) const
+    {
+      vector<const vector<OBVariant>*> rows(types.size(), &_emptyRow);
+      vector<Query> query;
+      for (unsigned int i = 0; i < types.size(); ++i) {
+	query.clear();
+	query.push_back(Query(column, OBVariant(types[i])));
+	rows[i] = &FindRow(query);
+      }
+      return rows;
+    }
+
     const vector<vector<OBVariant> >& OBFFTable::GetAllRows() const
     {
       return _rows;
@@ -18,6 +18,8 @@ GNU General Public License for more details.
 
 #include <OBParameterDB>
 
+#include <map>
+
 namespace OpenBabel {
   namespace OBFFs {
 
@@ -63,6 +65,11 @@ namespace OpenBabel {
       /**
        * Find a row that matches the specified @p query. If the query was matched in
        * reverse order (e.g. 1-2-3 vs. 3-2-1), the swapped flag will be set when non-zero.
+       *
+       * The first lookup for a combination of columns builds a hash index for
+       * these columns, later lookups only compare the rows in the matching
+       * bucket. The index is shared by the query and swapped query since both
+       * use the same columns.
        * @return A constant reference to the row.
        */
       const std::vector<OBVariant>& FindRow(const std::vector<Query> &query, bool *swapped = 0) const;
@@ -72,18 +79,44 @@ namespace OpenBabel {
        * @return A copy of the row.
        */
       std::vector< std::vector<OBVariant> > FindRows(const std::vector<Query> &query, bool *swapped = 0) const;
+      /**
+       * Find the row for each of the @p types in @p column.
+       * @return Pointers to the rows, indexed by type ID.
+       */
+      std::vector<const std::vector<OBVariant>*> FindTypeRows(int column, const std::vector<std::string> &types) const;
       /**
        * Get a constant reference to all rows in this table. This function can 
        * be used in graphical user interfaces to quickly access all data for display.
        */
       const std::vector<std::vector<OBVariant> >& GetAllRows() const;
     private:
+      /**
+       * Hash index for a combination of columns.
+       */
+      struct Index
+      {
+        std::vector<int> columns; //!< the sorted columns
+        std::vector< std::vector<unsigned int> > buckets; //!< row indexes, in ascending order
+      };
+      /**
+       * Get the index for the (sorted) @p columns, the index is created when needed.
+       */
+      const Index* GetIndex(const std::vector<int> &columns) const;
+      /**
+       * Find the rows matching @p query (and @p swapped_query if not empty).
+       * Each match is stored as row index and swapped flag, in the order of
+       * the rows. If @p firstOnly is true, only the first match is stored.
+       */
+      void Match(const std::vector<Query> &query, const std::vector<Query> &swapped_query,
+          bool firstOnly, std::vector<std::pair<unsigned int, bool> > &matches) const;
+
       std::string _name; 
       std::vector<std::string> _header;
       std::vector<OBVariant::Type> _types;
       std::vector< std::vector<OBVariant> > _rows;
       unsigned int _numColumns;
       const std::vector<OBVariant> _emptyRow;
+      mutable std::map<std::vector<int>, Index> _indexes;
       friend class OBFFParameterDB;
     };
     
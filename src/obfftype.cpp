@@ -20,6 +20,9 @@ GNU General Public License for more details.
 
 #include <openbabel/mol.h>
 
+#include <map>
+#include <algorithm>
+
 using namespace std;
 
 namespace OpenBabel {
@@ -30,6 +33,7 @@ namespace OpenBabel {
       cout << "OBFFType::Setup()" << endl;
       if (!SetTypes(mol))
         return false;
+      InitTypeIds();
       InitIdentifiers(mol);
       InitOneX(mol);
       return true;
@@ -95,24 +99,46 @@ namespace OpenBabel {
      
     }
 
+    void OBFFType::InitTypeIds()
+    {
+      const vector<AtomIdentifier> &atoms = GetAtoms();
+      map<string, unsigned int> ids;
+      map<string, unsigned int>::iterator itr;
+      m_typeIds.resize(atoms.size());
+      m_typeNames.clear();
+      for (unsigned int i = 0; i < atoms.size(); ++i) {
+	itr = ids.find(atoms[i]);
+	if (itr == ids.end()) {
+	  itr = ids.insert(pair<string, unsigned int>(atoms[i], m_typeNames.size())).first;
+	  m_typeNames.push_back(atoms[i]);
+	}
+	m_typeIds[i] = itr->second;
+      }
+    }
 
     void OBFFType::InitOneX(const OBMol &mol)
     {
       m_numAtoms = mol.NumAtoms();
-      unsigned int ia, ib, ic, id;
+      m_exclusionOffsets.assign(1, 0);
+      m_exclusionAtoms.clear();
+      m_exclusionFlags.clear();
+
+      unsigned int ib, ic, id;
       OBAtom *a, *b, *c, *d;
       OBBond *bond1, *bond2, *bond3;
       OBBondIterator itr3, itr4, itr5;
-      FOR_ATOMS_OF_MOL(atom, const_cast<OBMol&>(mol)) {
-	a = (OBAtom*) &*atom;
-	ia = a->GetIdx() - 1;
+      vector<pair<unsigned int, unsigned char> > related;
+      // atoms are visited in index order, the list for atom i starts at m_exclusionOffsets[i]
+      for (unsigned int ia = 0; ia < m_numAtoms; ++ia) {
+	a = const_cast<OBMol&>(mol).GetAtom(ia + 1);
+	related.clear();
 	for (bond1 = a->BeginBond(itr3);bond1;bond1 = a->NextBond(itr3)){
 	  if (bond1->GetBeginAtom() == a)
 	    b = bond1->GetEndAtom();
 	  else
 	    b = bond1->GetBeginAtom();
 	  ib = b->GetIdx() - 1;
-	  m_Connected.insert(ia+ib*m_numAtoms);
+	  related.push_back(pair<unsigned int, unsigned char>(ib, OneTwo));
 	  for (bond2 = b->BeginBond(itr4);bond2;bond2 = b->NextBond(itr4)){
 	    if (bond2->GetBeginAtom() == b)
 	      c = bond2->GetEndAtom();
@@ -120,7 +146,7 @@ namespace OpenBabel {
 	      c = bond2->GetBeginAtom();
 	    if (c==a) continue;
 	    ic = c->GetIdx() - 1;
-	    m_OneThree.insert(ia+ic*m_numAtoms);
+	    related.push_back(pair<unsigned int, unsigned char>(ic, OneThree));
 	    for (bond3 = c->BeginBond(itr5);bond3;bond3 = c->NextBond(itr5)){
 	      if (bond3->GetBeginAtom() == c)
 		d = bond3->GetEndAtom();
@@ -128,27 +154,50 @@ namespace OpenBabel {
 		d = bond3->GetBeginAtom();
 	      if (d==b||d==a) continue;
 	      id = d->GetIdx() - 1;
-	      m_OneFour.insert(ia+id*m_numAtoms);
+	      related.push_back(pair<unsigned int, unsigned char>(id, OneFour));
 	    }
 	  }
 	}
+
+	// sort by atom index and combine the flags for atoms found more than once
+	sort(related.begin(), related.end());
+	for (unsigned int i = 0; i < related.size(); ++i) {
+	  if (i && related[i].first == related[i-1].first)
+	    m_exclusionFlags.back() |= related[i].second;
+	  else {
+	    m_exclusionAtoms.push_back(related[i].first);
+	    m_exclusionFlags.push_back(related[i].second);
+	  }
+	}
+	m_exclusionOffsets.push_back(m_exclusionAtoms.size());
       }
+    }
 
+    unsigned int OBFFType::GetRelation(unsigned int idxA, unsigned int idxB) const
+    {
+      if (idxA + 1 >= m_exclusionOffsets.size())
+	return 0;
+      const vector<unsigned int>::const_iterator begin = m_exclusionAtoms.begin() + m_exclusionOffsets[idxA];
+      const vector<unsigned int>::const_iterator end = m_exclusionAtoms.begin() + m_exclusionOffsets[idxA+1];
+      const vector<unsigned int>::const_iterator itr = lower_bound(begin, end, idxB);
+      if (itr == end || *itr != idxB)
+	return 0;
+      return m_exclusionFlags[itr - m_exclusionAtoms.begin()];
     }
 
     bool OBFFType::IsConnected(unsigned int idxA, unsigned int idxB) const
     {
-      return (m_Connected.find((idxA)+m_numAtoms*(idxB)) != m_Connected.end());
+      return (GetRelation(idxA, idxB) & OneTwo) != 0;
     }
 
     bool OBFFType::IsOneThree(unsigned int idxA, unsigned int idxB) const
     {
-      return (m_OneThree.find((idxA)+m_numAtoms*(idxB)) != m_OneThree.end());
+      return (GetRelation(idxA, idxB) & OneThree) != 0;
     }
 
     bool OBFFType::IsOneFour(unsigned int idxA, unsigned int idxB) const
     {
-      return (m_OneFour.find((idxA)+m_numAtoms*(idxB))!=m_OneFour.end());
+      return (GetRelation(idxA, idxB) & OneFour) != 0;
     }
 
 
@@ -18,7 +18,6 @@ GNU General Public License for more details.
 
 #include <vector>
 #include <string>
-#include <set>
 
 namespace OpenBabel {
 
@@ -33,6 +32,17 @@ namespace OpenBabel {
     public:
       typedef std::string AtomIdentifier;
 
+      /**
+       * Bonded relations between two atoms. GetRelation() returns a combination
+       * of these flags (e.g. two atoms in a 5-ring can be both 1-3 and 1-4).
+       */
+      enum Relation
+      {
+        OneTwo = 1,
+        OneThree = 2,
+        OneFour = 4
+      };
+
       /**
        * Bond identifier
        */
@@ -97,6 +107,38 @@ namespace OpenBabel {
       {
         return m_atoms;
       }
+      /**
+       * Get the type ID for atom with index @p index. The distinct atom types
+       * in GetAtoms() are numbered from 0 to NumTypes()-1 in order of their first
+       * occurrence. The type IDs can be used to index per-type parameter tables
+       * (see OBParameterDBTable::FindTypeRows()).
+       */
+      unsigned int GetTypeId(unsigned int index) const
+      {
+        return m_typeIds.at(index);
+      }
+      /**
+       * Get the type ID for each atom.
+       * @sa GetTypeId()
+       */
+      const std::vector<unsigned int> & GetTypeIds() const
+      {
+        return m_typeIds;
+      }
+      /**
+       * @return The number of distinct atom types.
+       */
+      unsigned int NumTypes() const
+      {
+        return m_typeNames.size();
+      }
+      /**
+       * Get the atom type for each type ID.
+       */
+      const std::vector<std::string> & GetTypeNames() const
+      {
+        return m_typeNames;
+      }
       /**
        * Get the bonds. These are BondIdentifier structs containing the name 
        * (e.g. "2-5", "C-O", "C-X") for the bond and the atom I's.
@@ -150,6 +192,40 @@ namespace OpenBabel {
        * @return True if atoms with index iA & iB are in a 1-4 relation.
        */
       virtual bool IsOneFour(unsigned int iA, unsigned int iB) const;
+      /**
+       * @return The Relation flags for atoms with index iA & iB, 0 if the atoms
+       * are not in a 1-2, 1-3 or 1-4 relation.
+       */
+      unsigned int GetRelation(unsigned int iA, unsigned int iB) const;
+      /**
+       * The 1-2, 1-3 and 1-4 relations are stored as a sorted list for each
+       * atom (compressed sparse row format). The atoms related to atom i are
+       * GetExclusionAtoms()[GetExclusionOffsets()[i]] up to (not including)
+       * GetExclusionAtoms()[GetExclusionOffsets()[i+1]], the Relation flags
+       * are stored in GetExclusionFlags() at the same positions. A pair loop
+       * over increasing atom indices can step through these lists to skip or
+       * scale the excluded pairs without lookups.
+       *
+       * @return The offsets, NumAtoms() + 1 elements.
+       */
+      const std::vector<unsigned int> & GetExclusionOffsets() const
+      {
+        return m_exclusionOffsets;
+      }
+      /**
+       * @sa GetExclusionOffsets()
+       */
+      const std::vector<unsigned int> & GetExclusionAtoms() const
+      {
+        return m_exclusionAtoms;
+      }
+      /**
+       * @sa GetExclusionOffsets()
+       */
+      const std::vector<unsigned char> & GetExclusionFlags() const
+      {
+        return m_exclusionFlags;
+      }
     protected:
       /**
        * Find atom types and initialize atom identifiers. 
@@ -157,9 +233,15 @@ namespace OpenBabel {
       virtual bool SetTypes(const OBMol & mol) = 0;
 
       /**
-       * Initialize m_connected, m_oneThree and m_oneFour
+       * Initialize the exclusion lists (m_exclusionOffsets, m_exclusionAtoms
+       * and m_exclusionFlags).
        */
       void InitOneX(const OBMol &mol);
+      /**
+       * Initialize m_typeIds and m_typeNames from GetAtoms(). Subclasses that
+       * change the atom types after Setup() should call this again.
+       */
+      void InitTypeIds();
       
      
       /**
@@ -250,11 +332,13 @@ namespace OpenBabel {
       std::vector<TorsionIdentifier> m_torsions;
       std::vector<OOPIdentifier> m_oops;
       std::string m_nullType;
+      std::vector<unsigned int> m_typeIds;
+      std::vector<std::string> m_typeNames;
 
       unsigned int m_numAtoms;
-      std::set<unsigned long int> m_Connected;
-      std::set<unsigned long int> m_OneThree;
-      std::set<unsigned long int> m_OneFour;
+      std::vector<unsigned int> m_exclusionOffsets;
+      std::vector<unsigned int> m_exclusionAtoms;
+      std::vector<unsigned char> m_exclusionFlags;
     }; 
   }
 }// namespace OpenBabel
@@ -21,17 +21,28 @@ GNU General Public License for more details.
 #include <OBFunction>
 #include <OBFunctionTerm>
 #include <OBLogFile>
+#include <OBNbrList>
+#include <OBHessian>
 
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
 #include <iostream>
 #include <iterator>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace std;
 
 namespace OpenBabel {
 namespace OBFFs {
 
-  OBFunction::OBFunction() : m_logfile(new OBLogFile), m_parameterDB(0)
+  OBFunction::OBFunction() : m_logfile(new OBLogFile), m_parameterDB(0), m_obffType(0), m_obChargeMethod(0), m_nbrList(0),
+      m_soaEnabled(false), m_soaStride(0), m_soaPositions(0), m_soaGradients(0), m_numThreads(1),
+      m_computeGroups(TermGroup::All), m_computeMask(0), m_hessian(0), m_hessianValid(false),
+      m_incrementalValid(false)
   {
   }
 
@@ -39,17 +50,26 @@ namespace OBFFs {
   {
     std::vector<OBFunctionTerm*>::iterator term;
     for (term = m_terms.begin(); term != m_terms.end(); ++term)
-      delete &*term;
+      delete *term;
+    delete m_nbrList;
     delete m_logfile;
+    delete m_hessian;
   }
 
   bool OBFunction::Setup(/*const*/ OBMol &mol)
   {
     m_positions.resize(mol.NumAtoms());
-    FOR_ATOMS_OF_MOL (atom, mol)
+    m_masses.resize(mol.NumAtoms());
+    FOR_ATOMS_OF_MOL (atom, mol) {
       m_positions[atom->GetIdx()-1] = Eigen::Vector3d(atom->GetVector().AsArray());
+      m_masses[atom->GetIdx()-1] = atom->GetAtomicMass();
+    }
 
     m_gradients.resize(mol.NumAtoms(), Eigen::Vector3d::Zero());
+    m_incrementalValid = false;
+
+    if (m_nbrList)
+      m_nbrList->Rebuild();
 
     std::vector<OBFunctionTerm*>::iterator term;
     for (term = m_terms.begin(); term != m_terms.end(); ++term)
@@ -71,7 +91,7 @@ namespace OBFFs {
     return true;
   }
 
-  void OBFunction::SetParameterDB(OBParameterDB *db) 
+  void OBFunction::SetParameterDB(const OBParameterDB *db) 
   { 
     m_parameterDB = db; 
   }
@@ -86,6 +106,345 @@ namespace OBFFs {
     m_obChargeMethod = obChargeMethod; 
   }
 
+  void OBFunction::SetNbrList(OBNbrList *nbrList)
+  {
+    if (m_nbrList == nbrList)
+      return;
+    delete m_nbrList;
+    m_nbrList = nbrList;
+  }
+
+  void OBFunction::SetSoAEnabled(bool enabled)
+  {
+    m_soaEnabled = enabled;
+    if (!enabled) {
+      m_soaBuffer.clear();
+      m_soaStride = 0;
+      m_soaPositions = m_soaGradients = 0;
+    }
+  }
+
+  void OBFunction::BeginCompute(Computation computation)
+  {
+    m_hessianValid = false;
+    m_incrementalValid = false;
+
+    if (computation == OBFunction::Gradients)
+      for (unsigned int idx = 0; idx < m_gradients.size(); ++idx)
+        m_gradients[idx] = Eigen::Vector3d::Zero();
+
+    if (m_nbrList)
+      m_nbrList->Update();
+
+    if (!m_soaEnabled)
+      return;
+
+    const unsigned int numParticles = m_positions.size();
+    const unsigned int stride = (numParticles + SoAPadding - 1) / SoAPadding * SoAPadding;
+    if (stride != m_soaStride || m_soaBuffer.empty()) {
+      // 3 position + 3 gradient components, with room for the alignment
+      m_soaStride = stride;
+      m_soaBuffer.assign(6 * stride + SoAAlignment / sizeof(double), 0.0);
+      size_t offset = reinterpret_cast<size_t>(&m_soaBuffer[0]) % SoAAlignment;
+      offset = offset ? (SoAAlignment - offset) / sizeof(double) : 0;
+      m_soaPositions = &m_soaBuffer[0] + offset;
+      m_soaGradients = m_soaPositions + 3 * stride;
+    }
+
+    double *x = m_soaPositions;
+    double *y = x + stride;
+    double *z = y + stride;
+    for (unsigned int i = 0; i < numParticles; ++i) {
+      x[i] = m_positions[i].x();
+      y[i] = m_positions[i].y();
+      z[i] = m_positions[i].z();
+    }
+
+    if (computation == OBFunction::Gradients)
+      std::fill(m_soaGradients, m_soaGradients + 3 * stride, 0.0);
+  }
+
+  void OBFunction::EndCompute(Computation computation)
+  {
+    if (!m_soaEnabled || (computation != OBFunction::Gradients))
+      return;
+
+    const double *x = m_soaGradients;
+    const double *y = x + m_soaStride;
+    const double *z = y + m_soaStride;
+    for (unsigned int i = 0; i < m_gradients.size(); ++i)
+      m_gradients[i] += Eigen::Vector3d(x[i], y[i], z[i]);
+  }
+
+#ifdef _OPENMP
+  namespace {
+    // A range of items from one term for OBFunction::ComputeTerms()
+    struct ComputeTask
+    {
+      ComputeTask(unsigned int _term, unsigned int _begin, unsigned int _end)
+          : term(_term), begin(_begin), end(_end), value(0.0)
+      {
+      }
+      unsigned int term, begin, end;
+      double value;
+    };
+  }
+#endif
+
+  bool OBFunction::IsComputed(const OBFunctionTerm *term) const
+  {
+    const unsigned int groups = term->GetGroup() & m_computeGroups;
+    if (m_computeMask)
+      return groups == m_computeMask;
+    return groups != 0;
+  }
+
+  void OBFunction::ComputeTerms(Computation computation)
+  {
+#ifdef _OPENMP
+    const int numThreads = (m_numThreads > 0) ? m_numThreads : omp_get_num_procs();
+#else
+    const int numThreads = 1;
+#endif
+
+    if (numThreads <= 1) {
+      std::vector<OBFunctionTerm*>::iterator term;
+      for (term = m_terms.begin(); term != m_terms.end(); ++term)
+        if (IsComputed(*term))
+          (*term)->Compute(computation);
+      return;
+    }
+
+#ifdef _OPENMP
+    // Split the terms in about 4 chunks per thread (but not smaller than
+    // minItems) for load balancing. The other terms are computed here.
+    const unsigned int minItems = 32;
+    std::vector<ComputeTask> tasks;
+    for (unsigned int t = 0; t < m_terms.size(); ++t) {
+      if (!IsComputed(m_terms[t]))
+        continue;
+      const unsigned int numItems = m_terms[t]->PrepareItems();
+      if (!numItems) {
+        m_terms[t]->Compute(computation);
+        continue;
+      }
+      const unsigned int chunk = std::max(minItems, (numItems + 4 * numThreads - 1) / (4 * numThreads));
+      for (unsigned int begin = 0; begin < numItems; begin += chunk)
+        tasks.push_back(ComputeTask(t, begin, std::min(numItems, begin + chunk)));
+    }
+    if (tasks.empty())
+      return;
+
+    const bool gradients = (computation == OBFunction::Gradients);
+    const int numParticles = m_positions.size();
+    const int numTasks = tasks.size();
+    if (gradients) {
+      m_threadGradients.resize(numThreads);
+      for (int i = 0; i < numThreads; ++i)
+        m_threadGradients[i].resize(numParticles);
+    }
+
+    #pragma omp parallel num_threads(numThreads)
+    {
+      const int thread = omp_get_thread_num();
+      const int threadCount = omp_get_num_threads();
+      Eigen::Vector3d *buffer = 0;
+      if (gradients && numParticles) {
+        buffer = &m_threadGradients[thread][0];
+        std::fill(buffer, buffer + numParticles, Eigen::Vector3d::Zero());
+      }
+
+      // static round-robin assignment: each thread gets the same tasks every time
+      for (int i = thread; i < numTasks; i += threadCount)
+        tasks[i].value = m_terms[tasks[i].term]->ComputeItems(computation, tasks[i].begin, tasks[i].end,
+            &m_positions[0], buffer);
+
+      if (gradients) {
+        #pragma omp barrier
+        #pragma omp for schedule(static)
+        for (int j = 0; j < numParticles; ++j)
+          for (int k = 0; k < threadCount; ++k)
+            m_gradients[j] += m_threadGradients[k][j];
+      }
+    }
+
+    // sum the values in task order
+    unsigned int task = 0;
+    while (task < tasks.size()) {
+      const unsigned int t = tasks[task].term;
+      double value = 0.0;
+      for (; (task < tasks.size()) && (tasks[task].term == t); ++task)
+        value += tasks[task].value;
+      m_terms[t]->SetValue(value);
+    }
+#endif
+  }
+
+  void OBFunction::ComputeGroups(Computation computation, unsigned int groups, bool separateGradients)
+  {
+    if (!separateGradients) {
+      m_computeGroups = groups;
+      Compute(computation);
+      m_computeGroups = TermGroup::All;
+      return;
+    }
+
+    // one pass for each distinct group mask used by the terms, a term in
+    // several groups is computed once and added to the buffer of each group
+    std::vector<unsigned int> masks;
+    for (unsigned int t = 0; t < m_terms.size(); ++t) {
+      const unsigned int mask = m_terms[t]->GetGroup() & groups;
+      if (mask && std::find(masks.begin(), masks.end(), mask) == masks.end())
+        masks.push_back(mask);
+    }
+
+    const unsigned int numBits = 8 * sizeof(unsigned int);
+    if (m_groupGradients.size() < numBits)
+      m_groupGradients.resize(numBits);
+    std::vector<Eigen::Vector3d> total(m_positions.size(), Eigen::Vector3d::Zero());
+    if (computation == OBFunction::Gradients)
+      for (unsigned int bit = 0; bit < numBits; ++bit)
+        for (unsigned int m = 0; m < masks.size(); ++m)
+          if (masks[m] & (1u << bit)) {
+            m_groupGradients[bit].assign(m_positions.size(), Eigen::Vector3d::Zero());
+            break;
+          }
+
+    m_computeGroups = groups;
+    for (unsigned int m = 0; m < masks.size(); ++m) {
+      m_computeMask = masks[m];
+      Compute(computation);
+      if (computation != OBFunction::Gradients)
+        continue;
+      for (unsigned int i = 0; i < total.size(); ++i)
+        total[i] += m_gradients[i];
+      for (unsigned int bit = 0; bit < numBits; ++bit)
+        if (masks[m] & (1u << bit))
+          for (unsigned int i = 0; i < total.size(); ++i)
+            m_groupGradients[bit][i] += m_gradients[i];
+    }
+    m_computeGroups = TermGroup::All;
+    m_computeMask = 0;
+
+    if (computation == OBFunction::Gradients)
+      m_gradients.swap(total);
+  }
+
+  const std::vector<Eigen::Vector3d>& OBFunction::GetGroupGradients(unsigned int group) const
+  {
+    static const std::vector<Eigen::Vector3d> empty;
+    for (unsigned int bit = 0; bit < m_groupGradients.size(); ++bit)
+      if (group & (1u << bit))
+        return m_groupGradients[bit];
+    return empty;
+  }
+
+  double OBFunction::GetGroupValue(unsigned int groups) const
+  {
+    double value = 0.0;
+    for (unsigned int t = 0; t < m_terms.size(); ++t)
+      if (m_terms[t]->GetGroup() & groups)
+        value += m_terms[t]->GetValue();
+    return value;
+  }
+
+  void OBFunction::ComputeBatch(const std::vector<Eigen::Vector3d> &positions, std::vector<double> &values,
+      std::vector<Eigen::Vector3d> *gradients)
+  {
+    if (&positions == &m_positions) {
+      const std::vector<Eigen::Vector3d> copy(positions);
+      ComputeBatch(copy, values, gradients);
+      return;
+    }
+
+    const int numParticles = m_positions.size();
+    const int numConformers = numParticles ? positions.size() / numParticles : 0;
+    const Computation computation = gradients ? OBFunction::Gradients : OBFunction::Value;
+    values.assign(numConformers, 0.0);
+    if (gradients)
+      gradients->assign(numConformers * numParticles, Eigen::Vector3d::Zero());
+    if (!numConformers)
+      return;
+
+    // terms with fixed items are computed for all conformers in parallel
+    std::vector<OBFunctionTerm*> fixedTerms, otherTerms;
+    std::vector<unsigned int> numItems;
+    for (unsigned int t = 0; t < m_terms.size(); ++t) {
+      if (m_terms[t]->HasFixedItems()) {
+        fixedTerms.push_back(m_terms[t]);
+        numItems.push_back(m_terms[t]->PrepareItems());
+      } else
+        otherTerms.push_back(m_terms[t]);
+    }
+
+#ifdef _OPENMP
+    const int numThreads = (m_numThreads > 0) ? m_numThreads : omp_get_num_procs();
+    #pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+    for (int k = 0; k < numConformers; ++k) {
+      const Eigen::Vector3d *conformer = &positions[k * numParticles];
+      Eigen::Vector3d *conformerGradients = gradients ? &(*gradients)[k * numParticles] : 0;
+      for (unsigned int t = 0; t < fixedTerms.size(); ++t)
+        values[k] += fixedTerms[t]->ComputeItems(computation, 0, numItems[t], conformer, conformerGradients);
+    }
+
+    if (otherTerms.empty())
+      return;
+
+    // the other terms (e.g. using the neighbor list) are computed one
+    // conformer at a time using the function's positions
+    const std::vector<Eigen::Vector3d> original = m_positions;
+    for (int k = 0; k < numConformers; ++k) {
+      std::copy(positions.begin() + k * numParticles, positions.begin() + (k + 1) * numParticles, m_positions.begin());
+      BeginCompute(computation);
+      for (unsigned int t = 0; t < otherTerms.size(); ++t) {
+        otherTerms[t]->Compute(computation);
+        values[k] += otherTerms[t]->GetValue();
+      }
+      EndCompute(computation);
+      if (gradients)
+        for (int i = 0; i < numParticles; ++i)
+          (*gradients)[k * numParticles + i] += m_gradients[i];
+    }
+    m_positions = original;
+  }
+
+  void OBFunction::ComputeIncremental(const std::vector<unsigned int> &movedAtoms)
+  {
+    // the cut-off terms have new pairs after a rebuild
+    if (m_incrementalValid && m_nbrList && m_nbrList->Update())
+      m_incrementalValid = false;
+
+    if (!m_incrementalValid || (m_incrementalTerms.size() != m_terms.size())) {
+      BeginCompute(OBFunction::Value);
+      m_incrementalTerms.assign(m_terms.size(), false);
+      for (unsigned int t = 0; t < m_terms.size(); ++t) {
+        m_incrementalTerms[t] = m_terms[t]->SetupIncremental();
+        if (!m_incrementalTerms[t])
+          m_terms[t]->Compute(OBFunction::Value);
+      }
+      EndCompute(OBFunction::Value);
+      m_incrementalValid = true;
+      return;
+    }
+
+    m_hessianValid = false;
+    if (m_soaEnabled && m_soaPositions)
+      for (unsigned int k = 0; k < movedAtoms.size(); ++k) {
+        const unsigned int i = movedAtoms[k];
+        m_soaPositions[i] = m_positions[i].x();
+        m_soaPositions[m_soaStride + i] = m_positions[i].y();
+        m_soaPositions[2 * m_soaStride + i] = m_positions[i].z();
+      }
+
+    for (unsigned int t = 0; t < m_terms.size(); ++t) {
+      if (m_incrementalTerms[t])
+        m_terms[t]->ComputeIncremental(movedAtoms);
+      else
+        m_terms[t]->Compute(OBFunction::Value);
+    }
+  }
+
   void OBFunction::AddTerm(OBFunctionTerm *term)
   {
     if (term)
@@ -105,38 +464,117 @@ namespace OBFFs {
     return m_terms;
   }
 
+  bool OBFunction::HasAnalyticalHessian() const
+  {
+    if (m_terms.empty())
+      return false;
+    for (unsigned int i = 0; i < m_terms.size(); ++i)
+      if (!m_terms[i]->HasAnalyticalHessian())
+        return false;
+    return true;
+  }
+
+  bool OBFunction::ComputeHessian(OBHessian &hessian)
+  {
+    if (!HasAnalyticalHessian())
+      return false;
+    if (hessian.NumParticles() != m_positions.size())
+      hessian.Resize(m_positions.size());
+    else
+      hessian.SetZero();
+    if (m_nbrList)
+      m_nbrList->Update();
+    for (unsigned int i = 0; i < m_terms.size(); ++i)
+      m_terms[i]->ComputeHessian(hessian);
+    return true;
+  }
+
+  //
+  //         g(x + h v) - g(x)
+  // H v  =  -----------------      g = -F (the gradients are forces)
+  //                 h
+  //
+  void OBFunction::ComputeHessianVectorProduct(const std::vector<Eigen::Vector3d> &v, std::vector<Eigen::Vector3d> &Hv)
+  {
+    if (HasAnalyticalHessian()) {
+      if (!m_hessian)
+        m_hessian = new OBHessian;
+      if (!m_hessianValid)
+        m_hessianValid = ComputeHessian(*m_hessian);
+      m_hessian->Multiply(v, Hv);
+      return;
+    }
+
+    const unsigned int numParticles = m_positions.size();
+    Hv.resize(numParticles);
+
+    double maxNorm2 = 0.0;
+    for (unsigned int i = 0; i < numParticles; ++i)
+      maxNorm2 = std::max(maxNorm2, v[i].squaredNorm());
+    if (maxNorm2 == 0.0) {
+      for (unsigned int i = 0; i < numParticles; ++i)
+        Hv[i] = Eigen::Vector3d::Zero();
+      return;
+    }
+    // don't move any atom further than 1e-5 Angstroms
+    const double h = 1.0e-5 / sqrt(maxNorm2);
+
+    const double value = GetValue();
+    m_hvValues.resize(m_terms.size());
+    for (unsigned int t = 0; t < m_terms.size(); ++t)
+      m_hvValues[t] = m_terms[t]->GetValue();
+    m_hvPositions = m_positions;
+    m_hvGradients = m_gradients;
+    for (unsigned int i = 0; i < numParticles; ++i)
+      m_positions[i] += h * v[i];
+    Compute(OBFunction::Gradients);
+    for (unsigned int i = 0; i < numParticles; ++i)
+      Hv[i] = (m_hvGradients[i] - m_gradients[i]) / h;
+
+    m_positions = m_hvPositions;
+    m_gradients = m_hvGradients;
+    // restore the values for x, if a term or the function keeps a value
+    // that can not be set it is computed again
+    for (unsigned int t = 0; t < m_terms.size(); ++t)
+      m_terms[t]->SetValue(m_hvValues[t]);
+    if (GetValue() != value)
+      Compute(OBFunction::Value);
+  }
+
   //  
   //         f(1) - f(0)
   // f'(0) = -----------      f(1) = f(0+h)
   //              h
   //
-  Eigen::Vector3d OBFunction::NumericalDerivative(unsigned int index)
+  Eigen::Vector3d OBFunction::NumericalDerivative(unsigned int index, unsigned int groups)
   {
     double e_orig, e_plus_delta, delta, dx, dy, dz;
     delta = 1.0e-5;
 
+    // GetValue() may include more than the terms (e.g. for functions without terms)
+    const bool all = (groups == TermGroup::All);
     const Eigen::Vector3d va = m_positions.at(index);
-    Compute(OBFunction::Value);
-    e_orig = GetValue();
+    ComputeGroups(OBFunction::Value, groups);
+    e_orig = all ? GetValue() : GetGroupValue(groups);
     
     // X direction
     m_positions[index].x() += delta;
-    Compute(OBFunction::Value);
-    e_plus_delta = GetValue();
+    ComputeGroups(OBFunction::Value, groups);
+    e_plus_delta = all ? GetValue() : GetGroupValue(groups);
     dx = (e_plus_delta - e_orig) / delta;
     
     // Y direction
     m_positions[index].x() = va.x();
     m_positions[index].y() += delta;
-    Compute(OBFunction::Value);
-    e_plus_delta = GetValue();
+    ComputeGroups(OBFunction::Value, groups);
+    e_plus_delta = all ? GetValue() : GetGroupValue(groups);
     dy = (e_plus_delta - e_orig) / delta;
     
     // Z direction
     m_positions[index].y() = va.y();
     m_positions[index].z() += delta;
-    Compute(OBFunction::Value);
-    e_plus_delta = GetValue();
+    ComputeGroups(OBFunction::Value, groups);
+    e_plus_delta = all ? GetValue() : GetGroupValue(groups);
     dz = (e_plus_delta - e_orig) / delta;
 
     // reset coordinates to original
@@ -35,6 +35,22 @@ namespace OBFFs {
   class OBParameterDB;
   class OBFFType;
   class OBChargeMethod;
+  class OBNbrList;
+  class OBHessian;
+
+  /**
+   * Groups of terms for OBFunction::ComputeGroups(), combine them using the
+   * | operator. Each term belongs to one or more groups (see
+   * OBFunctionTerm::GetGroup()).
+   */
+  namespace TermGroup
+  {
+    enum {
+      Bonded = 1, //!< bonds, angles, torsions, out-of-plane (the default)
+      NonBonded = 2, //!< van der Waals and electrostatic pair terms
+      All = 0x7fffffff //!< all groups
+    };
+  };
 
   /** @class OBFunction
    *  @brief Base class for functions (e.g. force fields, ...) of 3D variables (e.g. atom coordinates, ...).
@@ -71,6 +87,90 @@ namespace OBFFs {
        * Perform the specified OBFunction::Computation. 
        */
       virtual void Compute(Computation computation = Value) = 0;
+      /**
+       * Perform the specified OBFunction::Computation for the terms in
+       * @p groups only (TermGroup flags). The gradients are set to the
+       * gradients of these terms, the values of the other terms are not
+       * changed (use GetGroupValue()). The terms are selected by
+       * ComputeTerms(), subclasses computing their terms in another way
+       * compute all terms.
+       *
+       * If @p separateGradients is true, the gradients for each group are
+       * also stored in a separate buffer (see GetGroupGradients()). Each term
+       * is still computed once, the gradients of a term in several groups are
+       * added to the buffer of each of these groups (and once to the total).
+       *
+       * @code
+       * // bonded and pair forces for the same positions
+       * function->ComputeGroups(OBFunction::Gradients, TermGroup::All, true);
+       * const std::vector<Eigen::Vector3d> &bonded = function->GetGroupGradients(TermGroup::Bonded);
+       * const std::vector<Eigen::Vector3d> &pairs = function->GetGroupGradients(TermGroup::NonBonded);
+       * double pairEnergy = function->GetGroupValue(TermGroup::NonBonded);
+       * @endcode
+       */
+      void ComputeGroups(Computation computation, unsigned int groups, bool separateGradients = false);
+      /**
+       * @return The sum of the values of the terms in @p groups from the last
+       * Compute() or ComputeGroups() that included them.
+       */
+      double GetGroupValue(unsigned int groups) const;
+      /**
+       * @return The gradients for @p group (a single TermGroup flag) from the
+       * last ComputeGroups() with separate gradients that included it, this
+       * includes the terms that are also in other groups. If @p group has
+       * more than one bit set, the buffer for the lowest bit is returned. The
+       * buffer is empty if the group was never computed separately.
+       */
+      const std::vector<Eigen::Vector3d>& GetGroupGradients(unsigned int group) const;
+      /**
+       * Compute the value, and the gradients if @p gradients is not 0, for a
+       * block of conformers. The terms must be set up (see Setup()) and are
+       * reused for all conformers. The conformers are computed in parallel
+       * using the threads from SetNumThreads().
+       *
+       * @param positions The positions for K conformers, conformer k starts at
+       * element k * NumParticles().
+       * @param values Set to the K values.
+       * @param gradients If not 0, set to the K gradient sets (same layout as
+       * @p positions).
+       *
+       * GetPositions() is not changed, GetValue() and GetGradients() are
+       * undefined afterwards. Terms using the neighbor list (see
+       * OBFunctionTerm::HasFixedItems()) are computed one conformer at a time.
+       */
+      void ComputeBatch(const std::vector<Eigen::Vector3d> &positions, std::vector<double> &values,
+          std::vector<Eigen::Vector3d> *gradients = 0);
+      /**
+       * Compute the value after only the particles in @p movedAtoms were
+       * moved since the last ComputeIncremental(). Terms supporting it (see
+       * OBFunctionTerm::GetItemAtoms()) cache the value of each bond, angle,
+       * torsion or pair and only compute the ones using a moved particle, the
+       * other terms are computed completely. The result is the same as
+       * Compute(OBFunction::Value) (up to rounding).
+       *
+       * The first call after Setup() or Compute(), and after a rebuild of the
+       * neighbor list, computes and caches all items. Positions changed
+       * without declaring them are not noticed, call Compute() to reset.
+       * Rejecting a Monte Carlo move is done by restoring the positions and
+       * calling ComputeIncremental() with the same particles again. The
+       * gradients are not computed and the terms are computed on the calling
+       * thread.
+       *
+       * @code
+       * function->ComputeIncremental(moved); // computes all items
+       * double E = function->GetValue();
+       * for (...) {
+       *   // move the particles in moved
+       *   function->ComputeIncremental(moved);
+       *   if (!Accept(function->GetValue() - E)) {
+       *     // restore the particles in moved
+       *     function->ComputeIncremental(moved);
+       *   }
+       *   E = function->GetValue();
+       * }
+       * @endcode
+       */
+      void ComputeIncremental(const std::vector<unsigned int> &movedAtoms);
       /**
        * Implemented by subclasses to return the current value (i.e. OBFunctionImpl).
        * Call Compute() before GetValue().
@@ -98,10 +198,102 @@ namespace OBFFs {
        */
       std::vector<Eigen::Vector3d>&  GetGradients() { return m_gradients; } 
       const std::vector<Eigen::Vector3d>&  GetGradients() const { return m_gradients; } 
+      /**
+       * Get the particle masses (amu). Setup() sets them to the atomic masses,
+       * functions can replace them with their own parameters.
+       */
+      const std::vector<double>& GetMasses() const { return m_masses; }
+      /**
+       * Set the particle masses (amu), NumParticles() elements.
+       */
+      void SetMasses(const std::vector<double> &masses) { m_masses = masses; }
+      /**
+       * Enable or disable the structure-of-arrays (SoA) copy of the positions
+       * and gradients. The x, y and z components are stored in separate arrays
+       * which are aligned and padded to a multiple of SoAPadding elements.
+       *
+       * GetPositions() and GetGradients() remain the reference storage: the
+       * SoA positions are refreshed from GetPositions() at the start of each
+       * Compute() and the SoA gradients are added to GetGradients() at the end
+       * (see BeginCompute() and EndCompute()). Terms can use either storage.
+       */
+      void SetSoAEnabled(bool enabled);
+      /**
+       * @return True if the SoA arrays are enabled.
+       */
+      bool IsSoAEnabled() const { return m_soaEnabled; }
+      /**
+       * @return The number of elements in each SoA component array (NumParticles()
+       * rounded up to a multiple of SoAPadding).
+       */
+      unsigned int GetSoAStride() const { return m_soaStride; }
+      /**
+       * Get the contiguous SoA span for the x (0), y (1) or z (2) component of
+       * the positions. The span is aligned to SoAAlignment bytes, the padding
+       * elements are 0.0.
+       */
+      const double* GetPositionsSoA(int component) const { return m_soaPositions + component * m_soaStride; }
+      /**
+       * Get the contiguous SoA span for the x (0), y (1) or z (2) component of
+       * the gradients. Only valid during Compute(OBFunction::Gradients).
+       */
+      double* GetGradientsSoA(int component) { return m_soaGradients + component * m_soaStride; }
+
+      enum {
+        SoAPadding = 8, //!< The SoA arrays are padded to a multiple of this number of elements
+        SoAAlignment = 64 //!< The alignment of the SoA arrays in bytes
+      };
+      /**
+       * Set the number of threads used to compute the terms (see ComputeTerms()).
+       * The default 1 computes the terms sequentially, 0 uses all available
+       * cores. Without OpenMP support, the terms are always computed sequentially.
+       */
+      void SetNumThreads(int numThreads) { m_numThreads = numThreads; }
+      /**
+       * @return The number of threads set using SetNumThreads().
+       */
+      int GetNumThreads() const { return m_numThreads; }
       /**
        * @return True if this function has analytical gradients. 
        */
       virtual bool HasAnalyticalGradients() const { return false; }
+      /**
+       * @return True if all terms provide analytical second derivatives (see
+       * OBFunctionTerm::HasAnalyticalHessian()).
+       */
+      bool HasAnalyticalHessian() const;
+      /**
+       * Compute the sparse Hessian at the current positions by adding the
+       * second derivatives from all terms to @p hessian. The blocks already
+       * in @p hessian are set to zero first, so the same instance can be
+       * reused for new positions without allocating.
+       *
+       * @return False if a term has no analytical second derivatives.
+       */
+      bool ComputeHessian(OBHessian &hessian);
+      /**
+       * @return True if ComputeHessianVectorProduct() is analytical. The
+       * default implementation returns HasAnalyticalHessian().
+       */
+      virtual bool HasAnalyticalHessianVectorProduct() const { return HasAnalyticalHessian(); }
+      /**
+       * Compute the product of the Hessian (the second derivatives of the
+       * value) at the current positions with @p v. The gradients have to be
+       * computed for the current positions.
+       *
+       * If HasAnalyticalHessian() is true, the default implementation
+       * multiplies with the sparse Hessian, which is computed once for the
+       * current positions and reused until the next Compute(). Otherwise it
+       * uses forward differences of the analytical gradients, which costs one
+       * Compute(OBFunction::Gradients). GetPositions(), GetGradients() and
+       * the values of the function and its terms are restored afterwards
+       * (terms which do not implement OBFunctionTerm::SetValue() are computed
+       * again).
+       *
+       * @param v The vector (NumParticles() elements).
+       * @param Hv Set to the product (NumParticles() elements).
+       */
+      virtual void ComputeHessianVectorProduct(const std::vector<Eigen::Vector3d> &v, std::vector<Eigen::Vector3d> &Hv);
       /**
        * Get the OBLogFile for this function.
        */
@@ -109,11 +301,12 @@ namespace OBFFs {
       /**
        * Get the OBParameterDB for this function.
        */
-      OBParameterDB* GetParameterDB() { return m_parameterDB; }
+      const OBParameterDB* GetParameterDB() const { return m_parameterDB; }
       /**
-       * Set the OBParamterDB for this function.
+       * Set the OBParamterDB for this function. The database is not modified
+       * or deleted by the function, it can be shared (see OBParameterDBRegistry).
        */
-      void SetParameterDB(OBParameterDB *database);
+      void SetParameterDB(const OBParameterDB *database);
       /**
        * Get the OBFFType for this function.
        */
@@ -130,6 +323,16 @@ namespace OBFFs {
        * Set the OBChargeMethod for this function.
        */
       void SetOBChargeMethod(OBChargeMethod *obChargeMethod);
+      /**
+       * Get the OBNbrList shared by the cut-off terms for this function (may be 0).
+       */
+      OBNbrList* GetNbrList() { return m_nbrList; }
+      /**
+       * Set the OBNbrList for this function. The function takes ownership and
+       * deletes the previous list. The list is rebuilt in Setup() and updated
+       * in BeginCompute().
+       */
+      void SetNbrList(OBNbrList *nbrList);
       /**
        * Add a term to this function.
        */
@@ -149,12 +352,11 @@ namespace OBFFs {
       /*! Calculate the potential energy function derivative numerically with 
        *  repect to the coordinates of atom with index a (this vector is the gradient)
        *
-       * \param a  provides coordinates
-       * \param terms OBFF_ENERGY, OBFF_EBOND, OBFF_EANGLE, OBFF_ESTRBND, OBFF_ETORSION, 
-       * OBFF_EOOP, OBFF_EVDW, OBFF_ELECTROSTATIC
+       * \param index  provides coordinates
+       * \param groups the TermGroup flags of the terms to include (see ComputeGroups())
        * \return the negative gradient of atom a
        */
-      Eigen::Vector3d NumericalDerivative(unsigned int index);
+      Eigen::Vector3d NumericalDerivative(unsigned int index, unsigned int groups = TermGroup::All);
       //! OB 3.0
       Eigen::Vector3d NumericalSecondDerivative(unsigned int index);
  
@@ -171,15 +373,62 @@ namespace OBFFs {
       };
       virtual void ProcessOptions(std::vector<Option> &options) = 0;
       virtual std::string GetDefaultOptions() const = 0;
+      /**
+       * Subclasses should call this at the start of Compute(). Clears the
+       * gradients, updates the neighbor list and refreshes the SoA arrays.
+       */
+      void BeginCompute(Computation computation);
+      /**
+       * Subclasses should call this at the end of Compute(). Adds the SoA
+       * gradients to GetGradients().
+       */
+      void EndCompute(Computation computation);
+      /**
+       * Subclasses can call this from Compute() to compute all terms, between
+       * BeginCompute() and EndCompute(). With more than one thread, the items
+       * of the terms which can be split (see OBFunctionTerm::PrepareItems())
+       * are divided into chunks and the chunks of all terms are distributed
+       * over the threads. Each thread adds its gradients to its own buffer and
+       * the buffers and values are summed in a fixed order afterwards, so the
+       * result only depends on the number of threads. Terms which can not be
+       * split are computed first, on the calling thread. Only the terms in
+       * the groups passed to ComputeGroups() are computed.
+       */
+      void ComputeTerms(Computation computation);
+      /**
+       * @return True if ComputeTerms() computes @p term for the current
+       * ComputeGroups() call.
+       */
+      bool IsComputed(const OBFunctionTerm *term) const;
 
       OBLogFile *m_logfile;
-      OBParameterDB *m_parameterDB;
+      const OBParameterDB *m_parameterDB;
       OBFFType *m_obffType;
       OBChargeMethod *m_obChargeMethod;
+      OBNbrList *m_nbrList;
       std::string m_options;
       std::vector<OBFunctionTerm*> m_terms;
       std::vector<Eigen::Vector3d> m_positions;
       std::vector<Eigen::Vector3d> m_gradients;
+      std::vector<double> m_masses;
+
+      bool m_soaEnabled;
+      unsigned int m_soaStride;
+      std::vector<double> m_soaBuffer; //!< storage for m_soaPositions & m_soaGradients
+      double *m_soaPositions; //!< aligned pointer into m_soaBuffer
+      double *m_soaGradients; //!< aligned pointer into m_soaBuffer
+
+      int m_numThreads;
+      unsigned int m_computeGroups; //!< TermGroup flags for ComputeTerms()
+      unsigned int m_computeMask; //!< if not 0, ComputeTerms() only computes terms with exactly these groups (from m_computeGroups)
+      std::vector<std::vector<Eigen::Vector3d> > m_groupGradients; //!< gradients for each group bit
+      std::vector<std::vector<Eigen::Vector3d> > m_threadGradients; //!< gradient buffer for each thread
+      std::vector<Eigen::Vector3d> m_hvPositions, m_hvGradients; //!< ComputeHessianVectorProduct() buffers
+      std::vector<double> m_hvValues; //!< ComputeHessianVectorProduct() term values
+      OBHessian *m_hessian; //!< ComputeHessianVectorProduct() Hessian
+      bool m_hessianValid; //!< m_hessian is computed for the current positions
+      bool m_incrementalValid; //!< the term caches for ComputeIncremental() are up to date
+      std::vector<bool> m_incrementalTerms; //!< the terms using OBFunctionTerm::ComputeIncremental()
   };
 
   class OBFunctionFactory
@@ -20,16 +20,103 @@ GNU General Public License for more details.
 #include <OBFunctionTerm>
 #include <OBFunction>
 
+#include <algorithm>
+#include <cmath>
+
 namespace OpenBabel {
 namespace OBFFs {
+
+  // Neumaier's compensated summation: sum + compensation is the sum of the
+  // added values with an error independent of their number and size
+  static inline void CompensatedAdd(double &sum, double &compensation, double x)
+  {
+    const double t = sum + x;
+    if (fabs(sum) >= fabs(x))
+      compensation += (sum - t) + x;
+    else
+      compensation += (x - t) + sum;
+    sum = t;
+  }
  
-  OBFunctionTerm::OBFunctionTerm(OBFunction *func) : m_function(func)
+  OBFunctionTerm::OBFunctionTerm(OBFunction *func) : m_function(func), m_group(TermGroup::Bonded),
+      m_incrementalSum(0.0), m_incrementalCompensation(0.0), m_stamp(0)
   {
   }
 
   OBFunctionTerm::~OBFunctionTerm()
   {}
 
+  bool OBFunctionTerm::SetupIncremental()
+  {
+    m_itemValues.clear();
+    m_atomItemsBegin.clear();
+    m_atomItems.clear();
+
+    unsigned int atoms[4];
+    const unsigned int numItems = PrepareItems();
+    if (!numItems || !GetItemAtoms(0, atoms))
+      return false;
+
+    // the items for each particle (compressed rows)
+    const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+    const unsigned int numParticles = positions.size();
+    m_atomItemsBegin.assign(numParticles + 1, 0);
+    for (unsigned int i = 0; i < numItems; ++i) {
+      const unsigned int n = GetItemAtoms(i, atoms);
+      for (unsigned int j = 0; j < n; ++j)
+        m_atomItemsBegin[atoms[j] + 1]++;
+    }
+    for (unsigned int a = 0; a < numParticles; ++a)
+      m_atomItemsBegin[a + 1] += m_atomItemsBegin[a];
+    m_atomItems.resize(m_atomItemsBegin.back());
+    std::vector<unsigned int> next(m_atomItemsBegin.begin(), m_atomItemsBegin.end() - 1);
+    for (unsigned int i = 0; i < numItems; ++i) {
+      const unsigned int n = GetItemAtoms(i, atoms);
+      for (unsigned int j = 0; j < n; ++j)
+        m_atomItems[next[atoms[j]]++] = i;
+    }
+
+    m_incrementalSum = 0.0;
+    m_incrementalCompensation = 0.0;
+    m_itemValues.resize(numItems);
+    for (unsigned int i = 0; i < numItems; ++i) {
+      m_itemValues[i] = ComputeItems(OBFunction::Value, i, i + 1, &positions[0], 0);
+      CompensatedAdd(m_incrementalSum, m_incrementalCompensation, m_itemValues[i]);
+    }
+    SetValue(m_incrementalSum + m_incrementalCompensation);
+
+    m_itemStamps.assign(numItems, 0);
+    m_stamp = 0;
+    return true;
+  }
+
+  void OBFunctionTerm::ComputeIncremental(const std::vector<unsigned int> &movedAtoms)
+  {
+    if (++m_stamp == 0) {
+      std::fill(m_itemStamps.begin(), m_itemStamps.end(), 0);
+      m_stamp = 1;
+    }
+
+    // items with more than one moved particle are only computed once, the
+    // old and new values are added separately so a large value (e.g. a clash)
+    // leaves no rounding error in the sum once the item is back to normal
+    const Eigen::Vector3d *positions = &m_function->GetPositions()[0];
+    for (unsigned int k = 0; k < movedAtoms.size(); ++k) {
+      const unsigned int a = movedAtoms[k];
+      for (unsigned int j = m_atomItemsBegin[a]; j < m_atomItemsBegin[a + 1]; ++j) {
+        const unsigned int i = m_atomItems[j];
+        if (m_itemStamps[i] == m_stamp)
+          continue;
+        m_itemStamps[i] = m_stamp;
+        const double value = ComputeItems(OBFunction::Value, i, i + 1, positions, 0);
+        CompensatedAdd(m_incrementalSum, m_incrementalCompensation, -m_itemValues[i]);
+        CompensatedAdd(m_incrementalSum, m_incrementalCompensation, value);
+        m_itemValues[i] = value;
+      }
+    }
+    SetValue(m_incrementalSum + m_incrementalCompensation);
+  }
+
 }
 } // end namespace OpenBabel
 
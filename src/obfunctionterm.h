@@ -5,6 +5,7 @@
 
 #include <OBVariant>
 #include <OBFunction>
+#include <OBHessian>
 
 namespace OpenBabel {
 namespace OBFFs {
@@ -42,7 +43,80 @@ namespace OBFFs {
        * Call Compute() before GetValue().
        */
       virtual double GetValue() const = 0;
- 
+      /**
+       * Get the number of independent items (bonds, angles, pairs, ...) for
+       * ComputeItems(). Called once at the start of a parallel Compute() before
+       * any ComputeItems() call, terms can update their pair lists here. The
+       * default 0 means the term can not be split and Compute() is used instead.
+       */
+      virtual unsigned int PrepareItems() { return 0; }
+      /**
+       * @return True if the items from PrepareItems() do not depend on the
+       * positions (i.e. no neighbor list is used). ComputeItems() can then be
+       * called for any set of positions (see OBFunction::ComputeBatch()).
+       */
+      virtual bool HasFixedItems() const { return false; }
+      /**
+       * Compute the items [@p begin, @p end) using @p positions and add their
+       * gradients to @p gradients (NumParticles() elements each). This is called
+       * concurrently for disjoint ranges, so it should only write to @p gradients.
+       *
+       * @return The value for these items.
+       */
+      virtual double ComputeItems(OBFunction::Computation computation, unsigned int begin, unsigned int end,
+          const Eigen::Vector3d *positions, Eigen::Vector3d *gradients) const { return 0.0; }
+      /**
+       * Set the value after a parallel Compute() (i.e. the sum of the ComputeItems() values).
+       */
+      virtual void SetValue(double value) {}
+      /**
+       * Get the particle indexes used by @p item (see ComputeItems()) in
+       * @p atoms (room for 4 indexes). Terms implementing this can be
+       * computed incrementally (see OBFunction::ComputeIncremental()).
+       *
+       * @return The number of particles for the item, the default 0 means the
+       * term does not support incremental computation.
+       */
+      virtual unsigned int GetItemAtoms(unsigned int item, unsigned int *atoms) const { return 0; }
+      /**
+       * Compute the value for each item from PrepareItems() at the current
+       * positions and cache them together with the items for each particle.
+       * The term's value is set to their sum.
+       *
+       * @return False if the term can not be computed incrementally (see
+       * GetItemAtoms()), nothing is computed in that case.
+       */
+      bool SetupIncremental();
+      /**
+       * Update the value after the particles in @p movedAtoms were moved.
+       * Only the items using one of these particles are computed, the value
+       * changes by the difference with their cached values. The cached values
+       * are summed using compensated summation, so the value does not drift
+       * from a full Compute() over many updates. Call SetupIncremental()
+       * first, the items should not have changed since.
+       */
+      void ComputeIncremental(const std::vector<unsigned int> &movedAtoms);
+      /**
+       * @return True if ComputeHessian() is implemented for this term.
+       */
+      virtual bool HasAnalyticalHessian() const { return false; }
+      /**
+       * Add the second derivatives of this term's value at the current
+       * positions to @p hessian. The neighbor list (if any) is up to date.
+       */
+      virtual void ComputeHessian(OBHessian &hessian) {}
+      /**
+       * @return The TermGroup of this term (see OBFunction::ComputeGroups()).
+       * The default is TermGroup::Bonded, the pair terms use
+       * TermGroup::NonBonded.
+       */
+      unsigned int GetGroup() const { return m_group; }
+      /**
+       * Set the group of this term, a single TermGroup flag or a user
+       * defined bit.
+       */
+      void SetGroup(unsigned int group) { m_group = group; }
+
       /**
        * Get the the parameter data base for this term.
        */
@@ -50,6 +124,15 @@ namespace OBFFs {
 
     protected:
       OBFunction *m_function;
+      unsigned int m_group;
+
+    private:
+      std::vector<double> m_itemValues; //!< cached value for each item
+      double m_incrementalSum, m_incrementalCompensation; //!< compensated sum of m_itemValues
+      std::vector<unsigned int> m_atomItemsBegin; //!< first m_atomItems element for each particle
+      std::vector<unsigned int> m_atomItems; //!< the items for each particle
+      std::vector<unsigned int> m_itemStamps; //!< last ComputeIncremental() that computed each item
+      unsigned int m_stamp;
   };
 
 } // OBFFs
@@ -0,0 +1,136 @@
+/*********************************************************************
+Sparse Hessian
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBHessian>
+
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    OBHessian::OBHessian(unsigned int numParticles)
+    {
+      Resize(numParticles);
+    }
+
+    void OBHessian::Resize(unsigned int numParticles)
+    {
+      m_columns.clear();
+      m_blocks.clear();
+      m_columns.resize(numParticles);
+      m_blocks.resize(numParticles);
+    }
+
+    unsigned int OBHessian::NumBlocks() const
+    {
+      unsigned int numBlocks = 0;
+      for (unsigned int i = 0; i < m_columns.size(); ++i)
+        numBlocks += m_columns[i].size();
+      return numBlocks;
+    }
+
+    void OBHessian::SetZero()
+    {
+      for (unsigned int i = 0; i < m_blocks.size(); ++i)
+        for (unsigned int b = 0; b < m_blocks[i].size(); ++b)
+          m_blocks[i][b].setZero();
+    }
+
+    Eigen::Matrix3d& OBHessian::Block(unsigned int i, unsigned int j)
+    {
+      vector<unsigned int> &columns = m_columns[i];
+      vector<unsigned int>::iterator column = std::lower_bound(columns.begin(), columns.end(), j);
+      const unsigned int b = column - columns.begin();
+      if (column == columns.end() || *column != j) {
+        columns.insert(column, j);
+        m_blocks[i].insert(m_blocks[i].begin() + b, Eigen::Matrix3d::Zero());
+      }
+      return m_blocks[i][b];
+    }
+
+    void OBHessian::Add(unsigned int i, unsigned int j, const Eigen::Matrix3d &block)
+    {
+      if (i <= j)
+        Block(i, j) += block;
+      else
+        Block(j, i) += block.transpose();
+    }
+
+    //
+    // d2E/dxi dxi = E'' u u^T + E'/r (I - u u^T)      u = ij / r
+    // d2E/dxi dxj = - d2E/dxi dxi
+    //
+    void OBHessian::AddDistance(unsigned int i, unsigned int j, const Eigen::Vector3d &ij, double dE, double d2E)
+    {
+      const double r = ij.norm();
+      if (r == 0.0)
+        return;
+      const Eigen::Vector3d u = ij / r;
+      const Eigen::Matrix3d uu = u * u.transpose();
+      const Eigen::Matrix3d block = d2E * uu + (dE / r) * (Eigen::Matrix3d::Identity() - uu);
+      Block(i, i) += block;
+      Block(j, j) += block;
+      if (i < j)
+        Block(i, j) -= block;
+      else
+        Block(j, i) -= block;
+    }
+
+    void OBHessian::AddCoordinate(unsigned int numAtoms, const unsigned int *atoms, const Eigen::Vector3d *grad,
+        const Eigen::Matrix3d *hess, double dE, double d2E)
+    {
+      for (unsigned int p = 0; p < numAtoms; ++p)
+        for (unsigned int q = p; q < numAtoms; ++q)
+          Add(atoms[p], atoms[q], d2E * grad[p] * grad[q].transpose() + dE * hess[numAtoms * p + q]);
+    }
+
+    Eigen::Matrix3d OBHessian::GetBlock(unsigned int i, unsigned int j) const
+    {
+      const unsigned int row = std::min(i, j), col = std::max(i, j);
+      const vector<unsigned int> &columns = m_columns[row];
+      vector<unsigned int>::const_iterator column = std::lower_bound(columns.begin(), columns.end(), col);
+      if (column == columns.end() || *column != col)
+        return Eigen::Matrix3d::Zero();
+      const Eigen::Matrix3d &block = m_blocks[row][column - columns.begin()];
+      if (i <= j)
+        return block;
+      return block.transpose();
+    }
+
+    void OBHessian::Multiply(const std::vector<Eigen::Vector3d> &v, std::vector<Eigen::Vector3d> &Hv) const
+    {
+      const unsigned int numParticles = m_columns.size();
+      Hv.resize(numParticles);
+      for (unsigned int i = 0; i < numParticles; ++i)
+        Hv[i] = Eigen::Vector3d::Zero();
+      for (unsigned int i = 0; i < numParticles; ++i) {
+        const vector<unsigned int> &columns = m_columns[i];
+        const vector<Eigen::Matrix3d> &blocks = m_blocks[i];
+        for (unsigned int b = 0; b < columns.size(); ++b) {
+          const unsigned int j = columns[b];
+          Hv[i] += blocks[b] * v[j];
+          if (j != i)
+            Hv[j] += blocks[b].transpose() * v[i];
+        }
+      }
+    }
+
+  }
+}
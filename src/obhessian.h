@@ -0,0 +1,122 @@
+/*********************************************************************
+Sparse Hessian
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFFS_HESSIAN_H
+#define OBFFS_HESSIAN_H
+
+#include <vector>
+#include <Eigen/Core>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    /**
+     * @class OBHessian
+     * @brief Sparse symmetric matrix of 3x3 blocks for the second derivatives.
+     *
+     * Block (i, j) contains the second derivatives of the value with respect
+     * to the coordinates of particles i and j. Only the blocks with i <= j are
+     * stored, for each row the blocks are sorted by column. The blocks are
+     * created when they are first used, SetZero() keeps them so the same
+     * pattern is reused for the next positions.
+     *
+     * @code
+     * OBHessian hessian;
+     * if (function->ComputeHessian(hessian))
+     *   hessian.Multiply(v, Hv);
+     * @endcode
+     */
+    class OBHessian
+    {
+    public:
+      /**
+       * Constructor.
+       */
+      OBHessian(unsigned int numParticles = 0);
+      /**
+       * Remove all blocks and set the number of particles.
+       */
+      void Resize(unsigned int numParticles);
+      /**
+       * @return The number of particles.
+       */
+      unsigned int NumParticles() const { return m_columns.size(); }
+      /**
+       * @return The number of stored blocks (i <= j).
+       */
+      unsigned int NumBlocks() const;
+      /**
+       * Set all stored blocks to zero, the blocks are not removed.
+       */
+      void SetZero();
+      /**
+       * Add @p block to the second derivatives with respect to particles @p i
+       * and @p j. For i > j, the transpose is added to block (j, i).
+       */
+      void Add(unsigned int i, unsigned int j, const Eigen::Matrix3d &block);
+      /**
+       * Add the second derivatives of a function of the distance between
+       * particles @p i and @p j.
+       *
+       * @param ij The vector from j to i.
+       * @param dE The first derivative with respect to the distance.
+       * @param d2E The second derivative with respect to the distance.
+       */
+      void AddDistance(unsigned int i, unsigned int j, const Eigen::Vector3d &ij, double dE, double d2E);
+      /**
+       * Add the second derivatives of a function of an internal coordinate
+       * q (angle, torsion, ...) that depends on @p numAtoms particles.
+       *
+       * H = d2E/dq2 dq/dx dq/dx^T + dE/dq d2q/dx2
+       *
+       * @param atoms The particle indexes.
+       * @param grad The first derivatives of q for each particle.
+       * @param hess The second derivatives of q, hess[numAtoms*p+q] is the block for atoms[p] and atoms[q].
+       * @param dE The first derivative with respect to q.
+       * @param d2E The second derivative with respect to q.
+       */
+      void AddCoordinate(unsigned int numAtoms, const unsigned int *atoms, const Eigen::Vector3d *grad,
+          const Eigen::Matrix3d *hess, double dE, double d2E);
+      /**
+       * @return Block (i, j), the zero matrix if there is no such block.
+       */
+      Eigen::Matrix3d GetBlock(unsigned int i, unsigned int j) const;
+      /**
+       * @return The columns of the stored blocks in row @p i (all >= i).
+       */
+      const std::vector<unsigned int>& GetColumns(unsigned int i) const { return m_columns[i]; }
+      /**
+       * @return The stored blocks in row @p i, in the same order as GetColumns().
+       */
+      const std::vector<Eigen::Matrix3d>& GetBlocks(unsigned int i) const { return m_blocks[i]; }
+      /**
+       * Compute @p Hv = H * @p v.
+       */
+      void Multiply(const std::vector<Eigen::Vector3d> &v, std::vector<Eigen::Vector3d> &Hv) const;
+
+    private:
+      Eigen::Matrix3d& Block(unsigned int i, unsigned int j);
+
+      std::vector<std::vector<unsigned int> > m_columns;
+      std::vector<std::vector<Eigen::Matrix3d> > m_blocks;
+    };
+
+  }
+}
+
+#endif
@@ -97,7 +97,7 @@ namespace OBFFs {
        * }
        * @endcode
        */
-      bool SetLogLevel(LogLevel level) { m_loglvl = level; }
+      bool SetLogLevel(LogLevel level) { m_loglvl = level; return true; }
       /** 
        * @return The log level.
        */ 
@@ -39,9 +39,39 @@ namespace OBFFs {
     // minimization variables
     double 	econv, e_n1; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
     int 	cstep, nsteps; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
-    std::vector<Eigen::Vector3d> grad1; //!< Used for conjugate gradients and steepest descent(Initialize and TakeNSteps)
+    std::vector<Eigen::Vector3d> grad1; //!< Gradients from the previous conjugate gradients step
     unsigned int nAtoms; //!< Number of atoms
     int         linesearch; //!< LineSearch type
+    bool        converged; //!< Set when the convergence criteria are met
+    int         stopReason; //!< StopReason for the last run
+    // convergence criteria
+    int         criteria; //!< ConvergenceCriteria flags
+    double      rmsGradient, maxGradient, maxDisplacement; //!< Limits for the criteria
+    int         stallSteps; //!< Stall detection window, 0 to disable
+    double      stallDecrease; //!< Minimum energy decrease in the stall detection window
+    int         stallStep; //!< Start of the current stall detection window
+    double      stallEnergy; //!< Energy at stallStep
+    std::vector<Eigen::Vector3d> lastPositions; //!< Positions before the current step (MaxDisplacement only)
+    // L-BFGS variables, allocated in LBFGSInitialize()
+    unsigned int lbfgsHistory; //!< Maximum number of correction pairs
+    unsigned int lbfgsCount; //!< Number of stored correction pairs
+    unsigned int lbfgsNewest; //!< Index of the newest correction pair
+    std::vector<std::vector<Eigen::Vector3d> > lbfgsS, lbfgsY; //!< Position and gradient differences
+    std::vector<double> lbfgsRho, lbfgsAlpha;
+    std::vector<Eigen::Vector3d> direction; //!< Search direction (also used by SD and CG)
+    std::vector<Eigen::Vector3d> origCoords, origGrad; //!< Start of the line search
+    double lsAlpha, lsSlope; //!< Step and directional derivative of the last MoreThuenteLineSearch()
+    // FIRE variables
+    double fireDtStart, fireDtMax, fireAlphaStart, fireFInc, fireFDec, fireFAlpha; //!< Parameters
+    int fireNMin; //!< Parameter
+    double fireDt, fireAlpha; //!< Current time step and mixing factor
+    double fireLastDt; //!< Time step used for the last move
+    int fireNPos; //!< Number of steps since the last uphill step
+    std::vector<Eigen::Vector3d> velocities; //!< FIRE velocities
+    // truncated Newton variables
+    int tnMaxInner; //!< Maximum number of inner iterations
+    double tnForcing; //!< Maximum relative residual of the inner loop
+    std::vector<Eigen::Vector3d> tnResidual, tnConjugate, tnProduct; //!< Inner conjugate gradients vectors
 
     char        logbuf[BUFF_SIZE];
   };
@@ -49,6 +79,23 @@ namespace OBFFs {
   OBMinimize::OBMinimize(OBFunction *function) : d(new OBMinimizePrivate)
   {
     m_function = function;
+    d->linesearch = LineSearchType::MoreThuente;
+    d->lsAlpha = 0.0;
+    d->lsSlope = 0.0;
+    d->cstep = 0;
+    d->converged = false;
+    d->stopReason = StopReason::Running;
+    d->criteria = ConvergenceCriteria::Energy;
+    d->rmsGradient = 0.01;
+    d->maxGradient = 0.05;
+    d->maxDisplacement = 1.0e-3;
+    d->stallSteps = 0;
+    d->stallDecrease = 0.0;
+    d->lbfgsHistory = 7;
+    d->lbfgsCount = 0;
+    d->lbfgsNewest = 0;
+    SetFIREParameters(0.05, 0.5);
+    SetTruncatedNewtonParameters();
   }
   
   OBMinimize::~OBMinimize()
@@ -71,7 +118,127 @@ namespace OBFFs {
   {
     return d->linesearch;
   }
+
+  bool OBMinimize::HasConverged() const
+  {
+    return d->converged;
+  }
+
+  int OBMinimize::GetCurrentStep() const
+  {
+    return d->cstep;
+  }
+
+  void OBMinimize::SetConvergenceCriteria(int criteria)
+  {
+    d->criteria = criteria;
+  }
+
+  int OBMinimize::GetConvergenceCriteria() const
+  {
+    return d->criteria;
+  }
+
+  void OBMinimize::SetGradientConvergence(double rms, double max)
+  {
+    d->rmsGradient = rms;
+    d->maxGradient = max;
+  }
+
+  void OBMinimize::SetDisplacementConvergence(double max)
+  {
+    d->maxDisplacement = max;
+  }
+
+  void OBMinimize::SetStallDetection(int steps, double minDecrease)
+  {
+    d->stallSteps = steps;
+    d->stallDecrease = minDecrease;
+  }
+
+  int OBMinimize::GetStopReason() const
+  {
+    return d->stopReason;
+  }
+
+  double OBMinimize::GetRMSGradient() const
+  {
+    const std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+    if (gradients.empty())
+      return 0.0;
+    double sum = 0.0;
+    for (unsigned int c = 0; c < gradients.size(); ++c)
+      sum += gradients[c].squaredNorm();
+    return sqrt(sum / gradients.size());
+  }
+
+  double OBMinimize::GetMaxGradient() const
+  {
+    const std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+    double max = 0.0;
+    for (unsigned int c = 0; c < gradients.size(); ++c)
+      max = std::max(max, gradients[c].squaredNorm());
+    return sqrt(max);
+  }
+
+  void OBMinimize::ResetConvergence()
+  {
+    d->converged = false;
+    d->stopReason = StopReason::Running;
+    d->stallStep = d->cstep;
+    d->stallEnergy = d->e_n1;
+  }
+
+  void OBMinimize::BeginStep()
+  {
+    d->cstep++;
+    if (d->criteria & ConvergenceCriteria::MaxDisplacement)
+      d->lastPositions = m_function->GetPositions();
+  }
+
+  bool OBMinimize::CheckConvergence(double energy, bool energyValid)
+  {
+    // all selected criteria have to be met
+    bool converged = (d->criteria != 0);
+    if (d->criteria & ConvergenceCriteria::Energy)
+      converged = energyValid && IsNear(energy, d->e_n1, d->econv);
+    if (converged && (d->criteria & ConvergenceCriteria::RMSGradient))
+      converged = GetRMSGradient() < d->rmsGradient;
+    if (converged && (d->criteria & ConvergenceCriteria::MaxGradient))
+      converged = GetMaxGradient() < d->maxGradient;
+    if (converged && (d->criteria & ConvergenceCriteria::MaxDisplacement)) {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      const double max2 = d->maxDisplacement * d->maxDisplacement;
+      for (unsigned int c = 0; c < positions.size() && converged; ++c)
+        converged = (positions[c] - d->lastPositions[c]).squaredNorm() < max2;
+    }
+
+    if (converged) {
+      d->converged = true;
+      d->stopReason = StopReason::Converged;
+      return true;
+    }
+
+    if ((d->stallSteps > 0) && (d->cstep - d->stallStep >= d->stallSteps)) {
+      if (d->stallEnergy - energy < d->stallDecrease) {
+        d->stopReason = StopReason::Stalled;
+        return true;
+      }
+      d->stallStep = d->cstep;
+      d->stallEnergy = energy;
+    }
+
+    return false;
+  }
  
+  static double Dot(const std::vector<Eigen::Vector3d> &a, const std::vector<Eigen::Vector3d> &b)
+  {
+    double sum = 0.0;
+    for (unsigned int c = 0; c < a.size(); ++c)
+      sum += a[c].dot(b[c]);
+    return sum;
+  }
+
   // LineSearch 
   //
   // Based on the ghemical code (conjgrad.cpp)
@@ -85,7 +252,7 @@ namespace OBFFs {
   double OBMinimize::Newton2NumLineSearch(std::vector<Eigen::Vector3d> &direction)
   {
     double e_n1, e_n2, e_n3;
-    vector<Eigen::Vector3d> origCoords;
+    std::vector<Eigen::Vector3d> &origCoords = d->origCoords;
 
     double opt_step = 0.0;
     double opt_e = d->e_n1; // get energy calculated by sd or cg
@@ -187,14 +354,13 @@ namespace OBFFs {
   {
     double e_n1, e_n2, step, alpha;//, tempStep;
     Eigen::Vector3d tempStep;
-    vector<Eigen::Vector3d> lastStep;
+    std::vector<Eigen::Vector3d> &lastStep = d->origCoords;
 
     alpha = 0.0; // Scale factor along direction vector
     step = 0.2;
     double trustRadius = 0.3; // don't move further than 0.3 Angstroms
     double trustRadius2 = 0.9; // use norm2() instead of norm() to avoid sqrt() calls
     
-    m_function->Compute(OBFunction::Value);
     e_n1 = m_function->GetValue();
     
     unsigned int i;
@@ -241,8 +407,241 @@ namespace OBFFs {
     }
     //cout << "LineSearch steps: " << i << endl;
 
-    //delete [] lastStep;
+    return alpha;
+  }
+
+  // Step selection of the More-Thuente line search (dcstep from MINPACK-2).
+  // The interval [stx, sty] contains a minimizer, stp is the current step.
+  // The interval is updated and stp is set to the next trial step.
+  static void MoreThuenteStep(double &stx, double &fx, double &dx, double &sty, double &fy, double &dy,
+      double &stp, double fp, double dp, bool &brackt, double stpmin, double stpmax)
+  {
+    const double sgnd = dp * (dx / fabs(dx));
+    double theta, s, gamma, p, q, r, stpc, stpq, stpf;
+
+    if (fp > fx) {
+      // higher function value, the minimum is bracketed
+      theta = 3.0 * (fx - fp) / (stp - stx) + dx + dp;
+      s = std::max(fabs(theta), std::max(fabs(dx), fabs(dp)));
+      gamma = s * sqrt(std::max(0.0, (theta / s) * (theta / s) - (dx / s) * (dp / s)));
+      if (stp < stx)
+        gamma = -gamma;
+      p = (gamma - dx) + theta;
+      q = ((gamma - dx) + gamma) + dp;
+      r = p / q;
+      stpc = stx + r * (stp - stx);
+      stpq = stx + ((dx / ((fx - fp) / (stp - stx) + dx)) / 2.0) * (stp - stx);
+      if (fabs(stpc - stx) < fabs(stpq - stx))
+        stpf = stpc;
+      else
+        stpf = stpc + (stpq - stpc) / 2.0;
+      brackt = true;
+    } else if (sgnd < 0.0) {
+      // lower function value and derivatives of opposite sign, the minimum is bracketed
+      theta = 3.0 * (fx - fp) / (stp - stx) + dx + dp;
+      s = std::max(fabs(theta), std::max(fabs(dx), fabs(dp)));
+      gamma = s * sqrt(std::max(0.0, (theta / s) * (theta / s) - (dx / s) * (dp / s)));
+      if (stp > stx)
+        gamma = -gamma;
+      p = (gamma - dp) + theta;
+      q = ((gamma - dp) + gamma) + dx;
+      r = p / q;
+      stpc = stp + r * (stx - stp);
+      stpq = stp + (dp / (dp - dx)) * (stx - stp);
+      if (fabs(stpc - stp) > fabs(stpq - stp))
+        stpf = stpc;
+      else
+        stpf = stpq;
+      brackt = true;
+    } else if (fabs(dp) < fabs(dx)) {
+      // lower function value, same sign and decreasing magnitude of the derivative
+      theta = 3.0 * (fx - fp) / (stp - stx) + dx + dp;
+      s = std::max(fabs(theta), std::max(fabs(dx), fabs(dp)));
+      gamma = s * sqrt(std::max(0.0, (theta / s) * (theta / s) - (dx / s) * (dp / s)));
+      if (stp > stx)
+        gamma = -gamma;
+      p = (gamma - dp) + theta;
+      q = (gamma + (dx - dp)) + gamma;
+      r = p / q;
+      if (r < 0.0 && gamma != 0.0)
+        stpc = stp + r * (stx - stp);
+      else if (stp > stx)
+        stpc = stpmax;
+      else
+        stpc = stpmin;
+      stpq = stp + (dp / (dp - dx)) * (stx - stp);
+      if (brackt) {
+        stpf = (fabs(stpc - stp) < fabs(stpq - stp)) ? stpc : stpq;
+        if (stp > stx)
+          stpf = std::min(stp + 0.66 * (sty - stp), stpf);
+        else
+          stpf = std::max(stp + 0.66 * (sty - stp), stpf);
+      } else {
+        stpf = (fabs(stpc - stp) > fabs(stpq - stp)) ? stpc : stpq;
+        stpf = std::max(stpmin, std::min(stpmax, stpf));
+      }
+    } else {
+      // lower function value, same sign and no decrease in magnitude of the derivative
+      if (brackt) {
+        theta = 3.0 * (fp - fy) / (sty - stp) + dy + dp;
+        s = std::max(fabs(theta), std::max(fabs(dy), fabs(dp)));
+        gamma = s * sqrt(std::max(0.0, (theta / s) * (theta / s) - (dy / s) * (dp / s)));
+        if (stp > sty)
+          gamma = -gamma;
+        p = (gamma - dp) + theta;
+        q = ((gamma - dp) + gamma) + dy;
+        r = p / q;
+        stpf = stp + r * (sty - stp);
+      } else if (stp > stx)
+        stpf = stpmax;
+      else
+        stpf = stpmin;
+    }
+
+    // update the interval
+    if (fp > fx) {
+      sty = stp; fy = fp; dy = dp;
+    } else {
+      if (sgnd < 0.0) {
+        sty = stx; fy = fx; dy = dx;
+      }
+      stx = stp; fx = fp; dx = dp;
+    }
+    stp = stpf;
+  }
+
+  // More-Thuente line search (dcsrch from MINPACK-2). The gradients are
+  // forces, the directional derivative is -F.p
+  double OBMinimize::MoreThuenteLineSearch(std::vector<Eigen::Vector3d> &direction, double step, double gtol)
+  {
+    const double ftol = 1.0e-4;
+    const double xtol = 1.0e-10;
+    const double xtrapl = 1.1, xtrapu = 4.0;
+    const double trustRadius = 0.3; // don't move any atom further than 0.3 Angstroms
+    const int maxEvaluations = 20;
+
+    // reuses the storage from the previous call
+    d->origCoords = m_function->GetPositions();
+    const double finit = m_function->GetValue();
+    const double ginit = -Dot(m_function->GetGradients(), direction);
+    if (!(ginit < 0.0))
+      return 0.0; // not a descent direction
+
+    double maxNorm2 = 0.0;
+    for (unsigned int c = 0; c < direction.size(); ++c)
+      maxNorm2 = std::max(maxNorm2, direction[c].squaredNorm());
+    const double stpmin = 0.0;
+    const double stpmax = trustRadius / sqrt(maxNorm2);
+
+    if (step <= 0.0) {
+      if (d->lsAlpha > 0.0)
+        step = d->lsAlpha * d->lsSlope / ginit; // same first order change as the last step
+      else
+        step = 0.1 / sqrt(maxNorm2); // move the atoms up to 0.1 Angstroms
+    }
+
+    double stp = std::min(step, stpmax);
+    const double gtest = ftol * ginit;
+    double width = stpmax - stpmin, width1 = 2.0 * width;
+    double stx = 0.0, fx = finit, gx = ginit;
+    double sty = 0.0, fy = finit, gy = ginit;
+    double stmin = 0.0, stmax = stp + xtrapu * stp;
+    double f = finit, g = ginit;
+    double stpf = 0.0; // step of the current positions
+    bool brackt = false, stage1 = true, found = false;
+
+    for (int i = 0; i < maxEvaluations; ++i) {
+      LineSearchTakeStep(d->origCoords, direction, stp);
+      m_function->Compute(OBFunction::Gradients);
+      stpf = stp;
+      f = m_function->GetValue();
+      g = -Dot(m_function->GetGradients(), direction);
+
+      if (!isfinite(f) || !isfinite(g)) {
+        // clash, move back towards the best point
+        stmax = stp;
+        stp = stx + 0.5 * (stp - stx);
+        continue;
+      }
+
+      const double ftest = finit + stp * gtest;
+      if (stage1 && f <= ftest && g >= 0.0)
+        stage1 = false;
+      if (f <= ftest && fabs(g) <= -gtol * ginit) {
+        found = true;
+        break;
+      }
+      if (stp == stpmax && f <= ftest && g <= gtest) {
+        found = true; // can't go any further, accept the sufficient decrease
+        break;
+      }
+      if (brackt && (stp <= stmin || stp >= stmax || stmax - stmin <= xtol * stmax))
+        break; // no further progress possible
+
+      if (stage1 && f <= fx && f > ftest) {
+        // use the modified function f - stp * gtest until a step with
+        // sufficient decrease and a non-negative derivative is found
+        double fm = f - stp * gtest, fxm = fx - stx * gtest, fym = fy - sty * gtest;
+        double gm = g - gtest, gxm = gx - gtest, gym = gy - gtest;
+        MoreThuenteStep(stx, fxm, gxm, sty, fym, gym, stp, fm, gm, brackt, stmin, stmax);
+        fx = fxm + stx * gtest; fy = fym + sty * gtest;
+        gx = gxm + gtest; gy = gym + gtest;
+      } else
+        MoreThuenteStep(stx, fx, gx, sty, fy, gy, stp, f, g, brackt, stmin, stmax);
+
+      // force a sufficient decrease in the size of the interval
+      if (brackt) {
+        if (fabs(sty - stx) >= 0.66 * width1)
+          stp = stx + 0.5 * (sty - stx);
+        width1 = width;
+        width = fabs(sty - stx);
+        stmin = std::min(stx, sty);
+        stmax = std::max(stx, sty);
+      } else {
+        stmin = stp + xtrapl * (stp - stx);
+        stmax = stp + xtrapu * (stp - stx);
+      }
+
+      stp = std::max(stpmin, std::min(stpmax, stp));
+      if (brackt && (stp <= stmin || stp >= stmax || stmax - stmin <= xtol * stmax))
+        stp = stx; // no further progress possible, use the best step
+    }
+
+    if (!found) {
+      // use the lowest energy found, the current point if it is the best (stp
+      // may already be the next trial step when the evaluation limit is hit)
+      if (isfinite(f) && f < finit && f <= fx)
+        stp = stpf;
+      else {
+        stp = (fx < finit) ? stx : 0.0;
+        LineSearchTakeStep(d->origCoords, direction, stp);
+        m_function->Compute(OBFunction::Gradients);
+      }
+    }
 
+    d->lsAlpha = stp;
+    d->lsSlope = ginit;
+    return stp;
+  }
+
+  double OBMinimize::PerformLineSearch(std::vector<Eigen::Vector3d> &direction)
+  {
+    double alpha;
+    switch (d->linesearch) {
+      case LineSearchType::Newton2Num:
+        alpha = Newton2NumLineSearch(direction);
+        m_function->Compute(OBFunction::Gradients);
+        break;
+      case LineSearchType::Simple:
+        alpha = LineSearch(m_function->GetPositions(), direction);
+        m_function->Compute(OBFunction::Gradients);
+        break;
+      default:
+      case LineSearchType::MoreThuente:
+        // the value and gradients are computed for the accepted step
+        alpha = MoreThuenteLineSearch(direction);
+        break;
+    }
     return alpha;
   }
   
@@ -251,9 +650,12 @@ namespace OBFFs {
     d->nsteps = steps;
     d->cstep = 0;
     d->econv = econv;
+    d->converged = false;
+    d->lsAlpha = 0.0;
 
     m_function->Compute(OBFunction::Gradients);
     d->e_n1 = m_function->GetValue();
+    ResetConvergence();
     
     OBLogFile *logfile = m_function->GetLogFile();
     if (logfile->IsLow()) {
@@ -273,7 +675,7 @@ namespace OBFFs {
     OBLogFile *logfile = m_function->GetLogFile();
     double e_n2, alpha;
     for (int i = 1; i <= n; i++) {
-      d->cstep++;
+      BeginStep();
 
       if (!(m_function->HasAnalyticalGradients())) {
         // use numerical gradients
@@ -282,17 +684,15 @@ namespace OBFFs {
         } 
       }
       
-      // perform a linesearch
-      switch (d->linesearch) {
-        case LineSearchType::Newton2Num:
-          alpha = Newton2NumLineSearch(m_function->GetGradients());
-          break;
-        default:
-        case LineSearchType::Simple:
-          alpha = LineSearch(m_function->GetPositions(), m_function->GetGradients());
-          break;
+      // perform a linesearch along the forces, the gradients are overwritten
+      d->direction = m_function->GetGradients();
+      alpha = PerformLineSearch(d->direction);
+
+      // the positions are not changed, this is not convergence
+      if (alpha == 0.0) {
+        d->stopReason = StopReason::LineSearchFailed;
+        return false;
       }
-      m_function->Compute(OBFunction::Gradients);
       e_n2 = m_function->GetValue();
      
       if (logfile->IsLow()) {
@@ -302,13 +702,14 @@ namespace OBFFs {
         }
       }
 
-      if (IsNear(e_n2, d->e_n1, d->econv)) {
-        if (logfile->IsLow())
+      if (CheckConvergence(e_n2)) {
+        if (d->converged && logfile->IsLow())
           logfile->Write("    STEEPEST DESCENT HAS CONVERGED\n");
         return false;
       }
       
       if (d->nsteps == d->cstep) {
+        d->stopReason = StopReason::MaxSteps;
         return false;
       }
 
@@ -331,9 +732,11 @@ namespace OBFFs {
     d->cstep = 0;
     d->nsteps = steps;
     d->econv = econv;
+    d->converged = false;
 
     m_function->Compute(OBFunction::Gradients);
     d->e_n1 = m_function->GetValue();
+    ResetConvergence();
     
     OBLogFile *logfile = m_function->GetLogFile();
     if (logfile->IsLow()) {
@@ -344,11 +747,6 @@ namespace OBFFs {
       logfile->Write("--------------------------------\n");
     }
 
-    d->grad1.clear();
-    d->grad1.resize(m_function->GetPositions().size());
-    for (unsigned int idx = 0; idx < m_function->GetPositions().size(); ++idx)
-      d->grad1[idx] = Eigen::Vector3d::Zero();
- 
     // Take the first step (same as steepest descent because there is no 
     // gradient from the previous step.
     if (!(m_function->HasAnalyticalGradients())) {
@@ -358,17 +756,11 @@ namespace OBFFs {
       }
     }
     
-    // perform a linesearch
-    switch (d->linesearch) {
-      case LineSearchType::Newton2Num:
-        alpha = Newton2NumLineSearch(m_function->GetGradients());
-        break;
-      default:
-      case LineSearchType::Simple:
-        alpha = LineSearch(m_function->GetPositions(), m_function->GetGradients());
-        break;
-    }
-    m_function->Compute(OBFunction::Gradients);
+    // save the gradient and direction, perform a linesearch
+    d->lsAlpha = 0.0;
+    d->grad1 = m_function->GetGradients();
+    d->direction = m_function->GetGradients();
+    alpha = PerformLineSearch(d->direction);
     e_n2 = m_function->GetValue();
       
     if (logfile->IsLow()) {
@@ -376,8 +768,7 @@ namespace OBFFs {
       logfile->Write(d->logbuf);
     }
  
-    // save the direction and energy
-    d->grad1 = m_function->GetGradients();
+    // save the energy
     d->e_n1 = e_n2;
   }
   
@@ -385,59 +776,56 @@ namespace OBFFs {
   {
     OBLogFile *logfile = m_function->GetLogFile();
     double e_n2;
-    double g2g2, g1g1, beta, alpha;
-    Eigen::Vector3d grad2, dir2;
-    Eigen::Vector3d grad1, dir1; // temporaries to perform dot product, etc.
+    double beta, alpha;
     
     e_n2 = 0.0;
     
     for (int i = 1; i <= n; i++) {
-      d->cstep++;
+      BeginStep();
      
-      for (unsigned int idx = 0; idx < m_function->GetPositions().size(); ++idx) {
-          if (!(m_function->HasAnalyticalGradients())) {
-            // use numerical gradients
-            //grad2 = m_function->NumericalDerivative(idx);
-          } else {
-            // use analytical gradients
-            grad2 = m_function->GetGradients()[idx];
-          }
- 
-          // Fletcher-Reeves formula for Beta
-          // http://en.wikipedia.org/wiki/Nonlinear_conjugate_gradient_method
-          // NOTE: We make sure to reset and use the steepest descent direction
-          //   after NumAtoms steps
-          if (d->cstep % m_function->GetPositions().size() != 0) {
-            g2g2 = grad2.dot(grad2);
-            grad1 = d->grad1[idx];
-            g1g1 = grad1.dot(grad1);
-            beta = g2g2 / g1g1;
-            grad2 += beta * grad1;
-          } 
- 
-          d->grad1[idx] = grad2;
+      const std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+      const unsigned int numAtoms = gradients.size();
+
+      // Fletcher-Reeves formula for Beta
+      // http://en.wikipedia.org/wiki/Nonlinear_conjugate_gradient_method
+      // NOTE: We make sure to reset and use the steepest descent direction
+      //   after NumAtoms steps
+      beta = 0.0;
+      if (d->cstep % numAtoms != 0) {
+        const double g1g1 = Dot(d->grad1, d->grad1);
+        if (g1g1 > 0.0)
+          beta = Dot(gradients, gradients) / g1g1;
       }
-      // perform a linesearch
-      switch (d->linesearch) {
-        case LineSearchType::Newton2Num:
-          alpha = Newton2NumLineSearch(d->grad1);
-          break;
-        default:
-        case LineSearchType::Simple:
-          alpha = LineSearch(m_function->GetPositions(), d->grad1);
-          break;
+      for (unsigned int idx = 0; idx < numAtoms; ++idx)
+        d->direction[idx] = gradients[idx] + beta * d->direction[idx];
+      if (beta != 0.0 && Dot(gradients, d->direction) <= 0.0) {
+        // not a descent direction, restart
+        beta = 0.0;
+        d->direction = gradients;
+      }
+      // save the gradient, the line search leaves the new gradients computed
+      d->grad1 = gradients;
+
+      alpha = PerformLineSearch(d->direction);
+      if (alpha == 0.0 && beta != 0.0) {
+        // retry along the steepest descent direction
+        d->direction = d->grad1;
+        alpha = PerformLineSearch(d->direction);
+      }
+
+      // the positions are not changed, this is not convergence
+      if (alpha == 0.0) {
+        d->stopReason = StopReason::LineSearchFailed;
+        return false;
       }
-      // save the direction
-      d->grad1 = m_function->GetGradients();
- 
-      m_function->Compute(OBFunction::Gradients);
       e_n2 = m_function->GetValue();
 	
-      if (IsNear(e_n2, d->e_n1, d->econv)) {
+      if (CheckConvergence(e_n2)) {
         if (logfile->IsLow()) {
           snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", d->cstep, e_n2, d->e_n1);
           logfile->Write(d->logbuf);
-          logfile->Write("    CONJUGATE GRADIENTS HAS CONVERGED\n");
+          if (d->converged)
+            logfile->Write("    CONJUGATE GRADIENTS HAS CONVERGED\n");
         }
         return false;
       }
@@ -449,8 +837,10 @@ namespace OBFFs {
         }
       }
  
-      if (d->nsteps == d->cstep)
+      if (d->nsteps == d->cstep) {
+        d->stopReason = StopReason::MaxSteps;
         return false;
+      }
 
       d->e_n1 = e_n2;
     }
@@ -464,6 +854,435 @@ namespace OBFFs {
     ConjugateGradientsTakeNSteps(steps); // ConjugateGradientsInitialize takes the first step
   }
 
+  void OBMinimize::SetLBFGSHistorySize(unsigned int m)
+  {
+    d->lbfgsHistory = std::max(m, 1u);
+  }
+
+  unsigned int OBMinimize::GetLBFGSHistorySize() const
+  {
+    return d->lbfgsHistory;
+  }
+
+  unsigned int OBMinimize::GetLBFGSNumCorrections() const
+  {
+    return d->lbfgsCount;
+  }
+
+  void OBMinimize::LBFGSInitialize(int steps, double econv)
+  {
+    d->cstep = 0;
+    d->nsteps = steps;
+    d->econv = econv;
+    d->converged = false;
+
+    const unsigned int numParticles = m_function->GetPositions().size();
+    d->lbfgsCount = 0;
+    d->lbfgsNewest = 0;
+    d->lbfgsS.assign(d->lbfgsHistory, std::vector<Eigen::Vector3d>(numParticles, Eigen::Vector3d::Zero()));
+    d->lbfgsY.assign(d->lbfgsHistory, std::vector<Eigen::Vector3d>(numParticles, Eigen::Vector3d::Zero()));
+    d->lbfgsRho.assign(d->lbfgsHistory, 0.0);
+    d->lbfgsAlpha.assign(d->lbfgsHistory, 0.0);
+    d->direction.resize(numParticles);
+    d->origCoords.resize(numParticles);
+    d->origGrad.resize(numParticles);
+
+    m_function->Compute(OBFunction::Gradients);
+    d->e_n1 = m_function->GetValue();
+    ResetConvergence();
+
+    OBLogFile *logfile = m_function->GetLogFile();
+    if (logfile->IsLow()) {
+      logfile->Write("\nL - B F G S\n\n");
+      snprintf(d->logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
+      logfile->Write(d->logbuf);
+      logfile->Write("STEP n     E(n)       E(n-1)    \n");
+      logfile->Write("--------------------------------\n");
+      snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f      ----\n", d->cstep, d->e_n1);
+      logfile->Write(d->logbuf);
+    }
+  }
+
+  bool OBMinimize::LBFGSTakeNSteps(int n)
+  {
+    OBLogFile *logfile = m_function->GetLogFile();
+    std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+    std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+    const unsigned int numParticles = positions.size();
+    const unsigned int m = d->lbfgsHistory;
+    double e_n2, alpha;
+
+    for (int i = 1; i <= n; i++) {
+      BeginStep();
+
+      // two-loop recursion: direction = H * F, the gradients are forces and
+      // lbfgsY contains the differences of -F
+      for (unsigned int c = 0; c < numParticles; ++c)
+        d->direction[c] = gradients[c];
+      for (unsigned int k = 0; k < d->lbfgsCount; ++k) {
+        const unsigned int j = (d->lbfgsNewest + m - k) % m;
+        d->lbfgsAlpha[j] = d->lbfgsRho[j] * Dot(d->lbfgsS[j], d->direction);
+        for (unsigned int c = 0; c < numParticles; ++c)
+          d->direction[c] -= d->lbfgsAlpha[j] * d->lbfgsY[j][c];
+      }
+      double step = 1.0;
+      if (d->lbfgsCount) {
+        const std::vector<Eigen::Vector3d> &y = d->lbfgsY[d->lbfgsNewest];
+        const double gamma = 1.0 / (d->lbfgsRho[d->lbfgsNewest] * Dot(y, y));
+        for (unsigned int c = 0; c < numParticles; ++c)
+          d->direction[c] *= gamma;
+      } else {
+        // no curvature information yet: steepest descent moving the atoms ~0.1 Angstrom
+        step = 0.1 / std::max(sqrt(Dot(gradients, gradients) / numParticles), 1.0e-10);
+      }
+      for (unsigned int k = d->lbfgsCount; k > 0; --k) {
+        const unsigned int j = (d->lbfgsNewest + m - k + 1) % m;
+        const double beta = d->lbfgsRho[j] * Dot(d->lbfgsY[j], d->direction);
+        for (unsigned int c = 0; c < numParticles; ++c)
+          d->direction[c] += (d->lbfgsAlpha[j] - beta) * d->lbfgsS[j][c];
+      }
+
+      // the forces at the start of the step for the correction pair
+      d->origGrad = gradients;
+      alpha = MoreThuenteLineSearch(d->direction, step, 0.9);
+      if ((alpha == 0.0) && d->lbfgsCount) {
+        // the history may be outdated, restart from steepest descent
+        d->lbfgsCount = 0;
+        d->direction = gradients;
+        step = 0.1 / std::max(sqrt(Dot(gradients, gradients) / numParticles), 1.0e-10);
+        alpha = MoreThuenteLineSearch(d->direction, step, 0.9);
+      }
+
+      // the positions are not changed, this is not convergence
+      if (alpha == 0.0) {
+        d->stopReason = StopReason::LineSearchFailed;
+        return false;
+      }
+      e_n2 = m_function->GetValue();
+
+      // store the new correction pair: s = x(n+1) - x(n), y = g(n+1) - g(n) = F(n) - F(n+1)
+      double sy = 0.0;
+      for (unsigned int c = 0; c < numParticles; ++c)
+        sy += (positions[c] - d->origCoords[c]).dot(d->origGrad[c] - gradients[c]);
+      // skip the update if the curvature condition does not hold, the
+      // slot may still hold the oldest pair
+      if (sy > 1.0e-10) {
+        const unsigned int j = d->lbfgsCount ? (d->lbfgsNewest + 1) % m : 0;
+        for (unsigned int c = 0; c < numParticles; ++c) {
+          d->lbfgsS[j][c] = positions[c] - d->origCoords[c];
+          d->lbfgsY[j][c] = d->origGrad[c] - gradients[c];
+        }
+        d->lbfgsRho[j] = 1.0 / sy;
+        d->lbfgsNewest = j;
+        d->lbfgsCount = std::min(d->lbfgsCount + 1, m);
+      }
+
+      if (CheckConvergence(e_n2)) {
+        if (logfile->IsLow()) {
+          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", d->cstep, e_n2, d->e_n1);
+          logfile->Write(d->logbuf);
+          if (d->converged)
+            logfile->Write("    L-BFGS HAS CONVERGED\n");
+        }
+        return false;
+      }
+
+      if (logfile->IsLow()) {
+        if (d->cstep % 10 == 0) {
+          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f\n", d->cstep, e_n2, d->e_n1);
+          logfile->Write(d->logbuf);
+        }
+      }
+
+      if (d->nsteps == d->cstep) {
+        d->stopReason = StopReason::MaxSteps;
+        return false;
+      }
+
+      d->e_n1 = e_n2;
+    }
+
+    return true; // no convergence reached
+  }
+
+  void OBMinimize::LBFGS(int steps, double econv)
+  {
+    LBFGSInitialize(steps, econv);
+    LBFGSTakeNSteps(steps);
+  }
+
+  void OBMinimize::SetFIREParameters(double dtStart, double dtMax, double alphaStart, int nMin,
+      double fInc, double fDec, double fAlpha)
+  {
+    d->fireDtStart = dtStart;
+    d->fireDtMax = dtMax;
+    d->fireAlphaStart = alphaStart;
+    d->fireNMin = nMin;
+    d->fireFInc = fInc;
+    d->fireFDec = fDec;
+    d->fireFAlpha = fAlpha;
+  }
+
+  void OBMinimize::FIREInitialize(int steps, double econv)
+  {
+    d->cstep = 0;
+    d->nsteps = steps;
+    d->econv = econv;
+    d->converged = false;
+
+    d->fireDt = d->fireDtStart;
+    d->fireLastDt = 0.0;
+    d->fireAlpha = d->fireAlphaStart;
+    d->fireNPos = 0;
+    d->velocities.assign(m_function->GetPositions().size(), Eigen::Vector3d::Zero());
+
+    m_function->Compute(OBFunction::Gradients);
+    d->e_n1 = m_function->GetValue();
+    ResetConvergence();
+
+    OBLogFile *logfile = m_function->GetLogFile();
+    if (logfile->IsLow()) {
+      logfile->Write("\nF I R E\n\n");
+      snprintf(d->logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
+      logfile->Write(d->logbuf);
+      logfile->Write("STEP n     E(n)       E(n-1)      dt   \n");
+      logfile->Write("---------------------------------------\n");
+      snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f      ----\n", d->cstep, d->e_n1);
+      logfile->Write(d->logbuf);
+    }
+  }
+
+  // FIRE with the semi-implicit Euler integration and the uphill correction
+  // from Guenole et al., Comput. Mater. Sci. 175, 109584 (2020). The gradients
+  // are forces.
+  bool OBMinimize::FIRETakeNSteps(int n)
+  {
+    OBLogFile *logfile = m_function->GetLogFile();
+    std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+    const std::vector<Eigen::Vector3d> &forces = m_function->GetGradients();
+    std::vector<Eigen::Vector3d> &velocities = d->velocities;
+    const unsigned int numParticles = positions.size();
+    const double maxMove = 0.2; // don't move any atom further than 0.2 Angstroms
+    double e_n2;
+
+    for (int i = 1; i <= n; i++) {
+      BeginStep();
+
+      // P = F.v is 0 while the atoms are at rest (first step and after an
+      // uphill step), this is neither downhill nor uphill
+      bool uphill = false;
+      const double power = Dot(forces, velocities);
+      if (power > 0.0) {
+        d->fireNPos++;
+        if (d->fireNPos > d->fireNMin) {
+          d->fireDt = std::min(d->fireDt * d->fireFInc, d->fireDtMax);
+          d->fireAlpha *= d->fireFAlpha;
+        }
+      } else if (power < 0.0) {
+        // moving uphill: go back half of the last move and stop
+        uphill = true;
+        d->fireNPos = 0;
+        d->fireDt *= d->fireFDec;
+        d->fireAlpha = d->fireAlphaStart;
+        for (unsigned int c = 0; c < numParticles; ++c) {
+          positions[c] -= 0.5 * d->fireLastDt * velocities[c];
+          velocities[c] = Eigen::Vector3d::Zero();
+        }
+      }
+
+      // v = (1 - alpha) v + alpha |v| F / |F| with v = v + dt F
+      for (unsigned int c = 0; c < numParticles; ++c)
+        velocities[c] += d->fireDt * forces[c];
+      const double vNorm = sqrt(Dot(velocities, velocities));
+      const double fNorm = sqrt(Dot(forces, forces));
+      const double mix = (fNorm > 0.0) ? d->fireAlpha * vNorm / fNorm : 0.0;
+      double maxNorm2 = 0.0;
+      for (unsigned int c = 0; c < numParticles; ++c) {
+        velocities[c] = (1.0 - d->fireAlpha) * velocities[c] + mix * forces[c];
+        maxNorm2 = std::max(maxNorm2, velocities[c].squaredNorm());
+      }
+
+      // limit the step by scaling the velocities, large forces from clashes
+      // would otherwise build up velocities that keep pushing the atoms apart
+      if (maxNorm2 * d->fireDt * d->fireDt > maxMove * maxMove) {
+        const double scale = maxMove / (d->fireDt * sqrt(maxNorm2));
+        for (unsigned int c = 0; c < numParticles; ++c)
+          velocities[c] *= scale;
+      }
+      for (unsigned int c = 0; c < numParticles; ++c)
+        positions[c] += d->fireDt * velocities[c];
+      d->fireLastDt = d->fireDt;
+
+      m_function->Compute(OBFunction::Gradients);
+      e_n2 = m_function->GetValue();
+
+      if (logfile->IsLow()) {
+        if (d->cstep % 10 == 0) {
+          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f    %6.4f\n", d->cstep, e_n2, d->e_n1, d->fireDt);
+          logfile->Write(d->logbuf);
+        }
+      }
+
+      // after an uphill step the atoms start again from rest, the small energy
+      // change is not convergence
+      if (CheckConvergence(e_n2, !uphill)) {
+        if (d->converged && logfile->IsLow())
+          logfile->Write("    FIRE HAS CONVERGED\n");
+        return false;
+      }
+
+      if (d->nsteps == d->cstep) {
+        d->stopReason = StopReason::MaxSteps;
+        return false;
+      }
+
+      d->e_n1 = e_n2;
+    }
+
+    return true; // no convergence reached
+  }
+
+  void OBMinimize::FIRE(int steps, double econv)
+  {
+    FIREInitialize(steps, econv);
+    FIRETakeNSteps(steps);
+  }
+
+  void OBMinimize::SetTruncatedNewtonParameters(int maxInnerIterations, double forcing)
+  {
+    d->tnMaxInner = std::max(maxInnerIterations, 1);
+    d->tnForcing = forcing;
+  }
+
+  void OBMinimize::TruncatedNewtonInitialize(int steps, double econv)
+  {
+    d->cstep = 0;
+    d->nsteps = steps;
+    d->econv = econv;
+    d->converged = false;
+
+    const unsigned int numParticles = m_function->GetPositions().size();
+    d->direction.resize(numParticles);
+    d->tnResidual.resize(numParticles);
+    d->tnConjugate.resize(numParticles);
+    d->tnProduct.resize(numParticles);
+    d->origCoords.resize(numParticles);
+    d->origGrad.resize(numParticles);
+
+    m_function->Compute(OBFunction::Gradients);
+    d->e_n1 = m_function->GetValue();
+    ResetConvergence();
+
+    OBLogFile *logfile = m_function->GetLogFile();
+    if (logfile->IsLow()) {
+      logfile->Write("\nT R U N C A T E D   N E W T O N\n\n");
+      snprintf(d->logbuf, BUFF_SIZE, "STEPS = %d\n\n",  steps);
+      logfile->Write(d->logbuf);
+      logfile->Write("STEP n     E(n)       E(n-1)    INNER\n");
+      logfile->Write("-------------------------------------\n");
+      snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f      ----\n", d->cstep, d->e_n1);
+      logfile->Write(d->logbuf);
+    }
+  }
+
+  bool OBMinimize::TruncatedNewtonTakeNSteps(int n)
+  {
+    OBLogFile *logfile = m_function->GetLogFile();
+    std::vector<Eigen::Vector3d> &gradients = m_function->GetGradients();
+    std::vector<Eigen::Vector3d> &z = d->direction;
+    std::vector<Eigen::Vector3d> &r = d->tnResidual;
+    std::vector<Eigen::Vector3d> &p = d->tnConjugate;
+    std::vector<Eigen::Vector3d> &Hp = d->tnProduct;
+    const unsigned int numParticles = gradients.size();
+    double e_n2, alpha;
+
+    for (int i = 1; i <= n; i++) {
+      BeginStep();
+
+      // inner conjugate gradients loop solving H z = F, the gradients are
+      // forces (i.e. minus the gradient of the value)
+      double rr = Dot(gradients, gradients);
+      const double tolerance = std::min(d->tnForcing, sqrt(rr)) * sqrt(rr);
+      for (unsigned int c = 0; c < numParticles; ++c) {
+        z[c] = Eigen::Vector3d::Zero();
+        r[c] = gradients[c];
+        p[c] = gradients[c];
+      }
+      int inner = 0;
+      bool steepest = false;
+      while (inner < d->tnMaxInner) {
+        m_function->ComputeHessianVectorProduct(p, Hp);
+        ++inner;
+        const double pHp = Dot(p, Hp);
+        if (pHp <= 1.0e-10 * Dot(p, p)) {
+          // negative curvature, use the last iterate (or steepest descent)
+          if (inner == 1) {
+            z = gradients;
+            steepest = true;
+          }
+          break;
+        }
+        const double a = rr / pHp;
+        for (unsigned int c = 0; c < numParticles; ++c) {
+          z[c] += a * p[c];
+          r[c] -= a * Hp[c];
+        }
+        const double rrNew = Dot(r, r);
+        if (sqrt(rrNew) <= tolerance)
+          break;
+        const double beta = rrNew / rr;
+        for (unsigned int c = 0; c < numParticles; ++c)
+          p[c] = r[c] + beta * p[c];
+        rr = rrNew;
+      }
+
+      // the Newton step has length 1, steepest descent moves the atoms ~0.1 Angstrom
+      const double steepestStep = 0.1 / std::max(sqrt(Dot(gradients, gradients) / numParticles), 1.0e-10);
+      alpha = MoreThuenteLineSearch(z, steepest ? steepestStep : 1.0, 0.9);
+      if ((alpha == 0.0) && !steepest) {
+        z = gradients;
+        alpha = MoreThuenteLineSearch(z, steepestStep, 0.9);
+      }
+
+      // the positions are not changed, this is not convergence
+      if (alpha == 0.0) {
+        d->stopReason = StopReason::LineSearchFailed;
+        return false;
+      }
+      e_n2 = m_function->GetValue();
+
+      if (CheckConvergence(e_n2)) {
+        if (logfile->IsLow()) {
+          snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f    %4d\n", d->cstep, e_n2, d->e_n1, inner);
+          logfile->Write(d->logbuf);
+          if (d->converged)
+            logfile->Write("    TRUNCATED NEWTON HAS CONVERGED\n");
+        }
+        return false;
+      }
+
+      if (logfile->IsLow()) {
+        snprintf(d->logbuf, BUFF_SIZE, " %4d    %8.3f    %8.3f    %4d\n", d->cstep, e_n2, d->e_n1, inner);
+        logfile->Write(d->logbuf);
+      }
+
+      if (d->nsteps == d->cstep) {
+        d->stopReason = StopReason::MaxSteps;
+        return false;
+      }
+
+      d->e_n1 = e_n2;
+    }
+
+    return true; // no convergence reached
+  }
+
+  void OBMinimize::TruncatedNewton(int steps, double econv)
+  {
+    TruncatedNewtonInitialize(steps, econv);
+    TruncatedNewtonTakeNSteps(steps);
+  }
+
 }  
 } // end namespace OpenBabel
 
@@ -40,7 +40,36 @@ namespace OBFFs {
   namespace LineSearchType 
   {
     enum {
-      Simple, Newton2Num 
+      Simple, Newton2Num, MoreThuente
+    };
+  };
+
+  /**
+   * Convergence tests for the minimizers, combine them using the | operator.
+   * All selected tests have to be met. Forces are in the units of the
+   * OBFunction per Angstrom, displacements in Angstrom.
+   */
+  namespace ConvergenceCriteria
+  {
+    enum {
+      Energy = 1, //!< energy change between steps below econv
+      RMSGradient = 2, //!< RMS of the forces below the RMS gradient limit
+      MaxGradient = 4, //!< largest atomic force below the max gradient limit
+      MaxDisplacement = 8 //!< largest atomic displacement in the last step below the limit
+    };
+  };
+
+  /**
+   * Why the last minimization run stopped (see OBMinimize::GetStopReason()).
+   */
+  namespace StopReason
+  {
+    enum {
+      Running, //!< not stopped yet
+      Converged, //!< the convergence criteria are met
+      MaxSteps, //!< the number of steps given to *Initialize() was taken
+      Stalled, //!< the energy decrease in the stall detection window was too small
+      LineSearchFailed //!< no lower energy could be found along the search direction
     };
   };
   
@@ -65,7 +94,7 @@ namespace OBFFs {
     //! \name Methods for energy minimization
     //@{
     /** 
-     * @brief Set the LineSearchType. The default type is LineSearchType::Simple.
+     * @brief Set the LineSearchType. The default type is LineSearchType::MoreThuente.
      * 
      * @param type The LineSearchType to be used in SteepestDescent and ConjugateGradients.
      */ 
@@ -78,7 +107,8 @@ namespace OBFFs {
     int GetLineSearchType();
     /** 
      * @brief Perform a linesearch for the entire molecule in direction p direction. 
-     * This function is called when using LineSearchType::Simple.
+     * This function is called when using LineSearchType::Simple. The value
+     * has to be computed for the current positions.
      * 
      * @param currentCoords Start coordinates.
      * @param direction The search direction.
@@ -116,6 +146,29 @@ namespace OBFFs {
      */
     void   LineSearchTakeStep(std::vector<Eigen::Vector3d> &origCoords, 
         std::vector<Eigen::Vector3d> &direction, double step);
+    /**
+     * @brief Perform a More-Thuente line search along @p direction that
+     * satisfies the strong Wolfe conditions. This function is called when
+     * using LineSearchType::MoreThuente and by LBFGS() and TruncatedNewton().
+     *
+     * Each trial point is evaluated with OBFunction::Gradients and the value
+     * and gradients of the accepted point are left in the function, the
+     * minimization loops use them for the next step. If no point satisfies the
+     * conditions within 20 evaluations, the lowest energy found is used. No
+     * memory is allocated after the first call. The current positions, value
+     * and gradients have to be valid when this function is called. The step
+     * is limited so that no atom moves more than 0.3 Angstroms.
+     *
+     * @param direction The search direction (a descent direction).
+     * @param step The first step to try, 0.0 to estimate it from the last
+     * accepted step.
+     * @param gtol The curvature condition parameter (0.9 for quasi-Newton
+     * directions).
+     *
+     * @return alpha, The scale of the step we moved along the direction vector,
+     * 0.0 if no lower energy was found (the positions are not changed).
+     */
+    double MoreThuenteLineSearch(std::vector<Eigen::Vector3d> &direction, double step = 0.0, double gtol = 0.1);
     /** 
      * @brief Perform steepest descent optimalization for steps steps or until convergence criteria is reached.
      * 
@@ -238,7 +291,239 @@ namespace OBFFs {
      *  OBFF_LOGLVL_HIGH:   see note above \n
     */
     bool ConjugateGradientsTakeNSteps(int n);
+    /**
+     * @brief Set the number of correction pairs stored by LBFGS(). The
+     * default is 7, larger values rarely help for molecules. Call before
+     * LBFGSInitialize().
+     */
+    void SetLBFGSHistorySize(unsigned int m);
+    /**
+     * @return The number of correction pairs stored by LBFGS().
+     */
+    unsigned int GetLBFGSHistorySize() const;
+    /**
+     * @return The number of correction pairs currently stored by LBFGS(), at
+     * most GetLBFGSHistorySize(). Steps that do not satisfy the curvature
+     * condition (s.y > 0) are not stored.
+     */
+    unsigned int GetLBFGSNumCorrections() const;
+    /** 
+     * @brief Perform limited-memory BFGS optimalization for steps steps or until
+     * convergence criteria is reached. The line search (MoreThuenteLineSearch()) uses
+     * one gradient evaluation for each trial point, the LineSearchType is not
+     * used.
+     * 
+     * @param steps The number of steps. 
+     * @param econv Energy convergence criteria. (defualt is 1e-6)
+     *
+     * @par Output to log:
+     *  OBFF_LOGLVL_NONE:   none \n
+     *  OBFF_LOGLVL_LOW:    information about the progress of the minimization \n
+     *  OBFF_LOGLVL_MEDIUM: see note above \n
+     *  OBFF_LOGLVL_HIGH:   see note above \n
+     */
+    void LBFGS(int steps, double econv = 1e-6f);
+    /**
+     * @brief Initialize L-BFGS optimalization, to be used in combination with
+     * LBFGSTakeNSteps().
+     * 
+     * example:
+     * @code
+     * minimize.LBFGSInitialize(100, 1e-5f);
+     * while (minimize.LBFGSTakeNSteps(5)) {
+     *   // do some updating in your program (redraw structure, ...)
+     * }
+     * @endcode
+     * 
+     * @param steps The number of steps.
+     * @param econv Energy convergence criteria. (defualt is 1e-6)
+     */
+    void LBFGSInitialize(int steps = 1000, double econv = 1e-6f);
+    /** 
+     * @brief Take n steps in a L-BFGS optimalization that was previously 
+     * initialized with LBFGSInitialize().
+     *
+     * @param n The number of steps to take.
+     * @return False if convergence or the number of steps given by LBFGSInitialize() has been reached.
+     */
+    bool LBFGSTakeNSteps(int n);
+    /**
+     * @brief Set the FIRE parameters. The defaults are the values recommended
+     * by Bitzek et al. (Phys. Rev. Lett. 97, 170201 (2006)), with the time
+     * step in units where all masses are 1 (positions in Angstrom). Call
+     * before FIREInitialize().
+     *
+     * @param dtStart Initial time step (default 0.05).
+     * @param dtMax Maximum time step (default 0.5).
+     * @param alphaStart Initial mixing factor (default 0.1).
+     * @param nMin Number of downhill steps before the time step is increased (default 5).
+     * @param fInc Time step increase factor (default 1.1).
+     * @param fDec Time step decrease factor after an uphill step (default 0.5).
+     * @param fAlpha Mixing factor decrease factor (default 0.99).
+     */
+    void SetFIREParameters(double dtStart, double dtMax, double alphaStart = 0.1, int nMin = 5,
+        double fInc = 1.1, double fDec = 0.5, double fAlpha = 0.99);
+    /** 
+     * @brief Perform FIRE (fast inertial relaxation engine) optimalization for
+     * steps steps or until convergence criteria is reached. Each step takes a
+     * single gradient evaluation and there is no line search, this makes FIRE
+     * robust for rough starting geometries (e.g. clashes).
+     * 
+     * @param steps The number of steps. 
+     * @param econv Energy convergence criteria. (defualt is 1e-6)
+     */
+    void FIRE(int steps, double econv = 1e-6f);
+    /**
+     * @brief Initialize FIRE optimalization, to be used in combination with
+     * FIRETakeNSteps().
+     *
+     * @param steps The number of steps.
+     * @param econv Energy convergence criteria. (defualt is 1e-6)
+     */
+    void FIREInitialize(int steps = 1000, double econv = 1e-6f);
+    /** 
+     * @brief Take n steps in a FIRE optimalization that was previously 
+     * initialized with FIREInitialize().
+     *
+     * @param n The number of steps to take.
+     * @return False if convergence or the number of steps given by FIREInitialize() has been reached.
+     */
+    bool FIRETakeNSteps(int n);
+    /**
+     * @brief Set the parameters for TruncatedNewton(). Call before
+     * TruncatedNewtonInitialize().
+     *
+     * The inner conjugate gradients loop stops when the residual is below
+     * min(@p forcing, |F|) * |F| (F are the current forces), this gives
+     * quadratic convergence near the minimum.
+     *
+     * @param maxInnerIterations Maximum number of Hessian-vector products
+     * for each step (default 100).
+     * @param forcing Maximum relative residual of the inner loop (default 0.5).
+     */
+    void SetTruncatedNewtonParameters(int maxInnerIterations = 100, double forcing = 0.5);
+    /** 
+     * @brief Perform truncated Newton (Newton-CG) optimalization for steps
+     * steps or until convergence criteria is reached. The Newton equations are
+     * solved approximately using conjugate gradients with the Hessian-vector
+     * products from OBFunction::ComputeHessianVectorProduct(). The step is
+     * taken using MoreThuenteLineSearch(). Suited for tight convergence of
+     * structures that are already close to a minimum.
+     * 
+     * @param steps The number of steps. 
+     * @param econv Energy convergence criteria. (defualt is 1e-6)
+     */
+    void TruncatedNewton(int steps, double econv = 1e-6f);
+    /**
+     * @brief Initialize truncated Newton optimalization, to be used in
+     * combination with TruncatedNewtonTakeNSteps().
+     *
+     * @param steps The number of steps.
+     * @param econv Energy convergence criteria. (defualt is 1e-6)
+     */
+    void TruncatedNewtonInitialize(int steps = 1000, double econv = 1e-6f);
+    /** 
+     * @brief Take n steps in a truncated Newton optimalization that was
+     * previously initialized with TruncatedNewtonInitialize().
+     *
+     * @param n The number of steps to take.
+     * @return False if convergence or the number of steps given by TruncatedNewtonInitialize() has been reached.
+     */
+    bool TruncatedNewtonTakeNSteps(int n);
+    /**
+     * @return True if the last SteepestDescent(), ConjugateGradients(), LBFGS(), FIRE()
+     * or TruncatedNewton() run
+     * stopped because the convergence criteria were met (i.e. not because the
+     * number of steps was reached).
+     */
+    bool HasConverged() const;
+    /**
+     * @return The number of steps taken since the last *Initialize() call.
+     */
+    int GetCurrentStep() const;
+    /**
+     * @return The StopReason for the last run, StopReason::Running if the
+     * run has not stopped yet.
+     */
+    int GetStopReason() const;
     //@}
+
+    /**
+     * @name Convergence criteria
+     * The settings are used by all algorithms and take effect at the next
+     * *Initialize() call.
+     */
+    //@{
+    /**
+     * Set the convergence tests, a combination of ConvergenceCriteria flags.
+     * The default is ConvergenceCriteria::Energy, using the econv passed to
+     * *Initialize().
+     *
+     * @code
+     * minimize.SetConvergenceCriteria(ConvergenceCriteria::RMSGradient | ConvergenceCriteria::MaxGradient);
+     * minimize.SetGradientConvergence(0.01, 0.05);
+     * @endcode
+     */
+    void SetConvergenceCriteria(int criteria);
+    /**
+     * @return The ConvergenceCriteria flags.
+     */
+    int GetConvergenceCriteria() const;
+    /**
+     * Set the limits for ConvergenceCriteria::RMSGradient and
+     * ConvergenceCriteria::MaxGradient.
+     */
+    void SetGradientConvergence(double rms = 0.01, double max = 0.05);
+    /**
+     * Set the limit for ConvergenceCriteria::MaxDisplacement.
+     */
+    void SetDisplacementConvergence(double max = 1e-3);
+    /**
+     * Stop with StopReason::Stalled when the energy decreased less than
+     * @p minDecrease over the last @p steps steps. Stall detection is
+     * disabled by default (@p steps = 0).
+     */
+    void SetStallDetection(int steps, double minDecrease);
+    /**
+     * @return The RMS of the current gradients.
+     */
+    double GetRMSGradient() const;
+    /**
+     * @return The length of the largest atomic gradient.
+     */
+    double GetMaxGradient() const;
+    //@}
+
+  protected:
+    /**
+     * Perform a line search along @p direction using the LineSearchType. The
+     * value and gradients are computed for the new positions afterwards.
+     *
+     * @return alpha, 0.0 if no lower energy was found.
+     */
+    double PerformLineSearch(std::vector<Eigen::Vector3d> &direction);
+    /**
+     * Start a new convergence test sequence, called by the *Initialize()
+     * methods after computing the initial energy.
+     */
+    void ResetConvergence();
+    /**
+     * Increment the step counter and remember the positions for the
+     * ConvergenceCriteria::MaxDisplacement test.
+     */
+    void BeginStep();
+    /**
+     * Run the convergence tests and stall detection after an accepted step,
+     * a failed line search stops with StopReason::LineSearchFailed without
+     * calling this. The gradients have to be computed for the current
+     * positions.
+     *
+     * @param energy The energy after the step.
+     * @param energyValid False if the energy change should not count as
+     * converged (e.g. FIRE uphill steps).
+     * @return True if the run should stop (see GetStopReason()).
+     */
+    bool CheckConvergence(double energy, bool energyValid = true);
     
   }; // class OBMinimize
 
@@ -25,25 +25,65 @@
 #include <OBNbrList>
 #include <OBFunction>
 
+#include <algorithm>
+
 using namespace std;
 
 namespace OpenBabel {
   namespace OBFFs {
 
-    OBNbrList::OBNbrList(OBFunction *function, double rcut, bool periodic, int boxSize)
+    OBNbrList::OBNbrList(OBFunction *function, double rcut, bool periodic, int boxSize, double skin)
     {
       m_function = function;
       for (unsigned int i = 0; i < function->NumParticles(); ++i)
         m_atoms.push_back(i);
       m_rcut = rcut;
-      m_rcut2 = rcut*rcut;
+      m_skin = skin;
       m_boxSize = boxSize;
-      m_edgeLength = m_rcut / m_boxSize;
       m_updateCounter = 0;
+      m_periodic = periodic;
+      m_buildCount = 0;
+      m_dirty = true;
+
+      Rebuild();
+    }
+
+    void OBNbrList::SetCutOff(double rcut)
+    {
+      m_rcut = rcut;
+      m_dirty = true;
+    }
+
+    void OBNbrList::SetSkin(double skin)
+    {
+      m_skin = skin;
+      m_dirty = true;
+    }
+
+    void OBNbrList::Rebuild()
+    {
+      if (m_dirty) {
+        // the cells are built using the list cut-off (rcut + skin)
+        const double rlist = m_rcut + m_skin;
+        m_rcut2 = rlist * rlist;
+        m_edgeLength = rlist / m_boxSize;
+        initOffsetMap();
+        m_dirty = false;
+      }
+
+      if (m_atoms.size() != m_function->NumParticles()) {
+        m_atoms.clear();
+        for (unsigned int i = 0; i < m_function->NumParticles(); ++i)
+          m_atoms.push_back(i);
+      }
 
-      initOffsetMap();
       initCells();
-      initGhostMap(periodic);
+      initGhostMap(m_periodic);
+      if (m_skin > 0.0)
+        initVerletNbrs();
+
+      m_updateCounter = 0;
+      m_buildCount++;
     }
 
     std::vector<unsigned int> OBNbrList::GetNbrs(unsigned int index, bool uniqueOnly)
@@ -82,24 +122,54 @@ namespace OpenBabel {
       return atoms;
     }
 
-    void OBNbrList::Update()
+    bool OBNbrList::Update()
     {
+      if (m_dirty || m_atoms.size() != m_function->NumParticles()) {
+        Rebuild();
+        return true;
+      }
+
+      if (m_skin > 0.0) {
+        // rebuild once any atom moved more than half the skin, pairs within
+        // rcut can not be missed before that
+        const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+        const double maxDisp2 = 0.25 * m_skin * m_skin;
+        for (unsigned int i = 0; i < m_verletPositions.size(); ++i)
+          if ((positions[i] - m_verletPositions[i]).squaredNorm() > maxDisp2) {
+            Rebuild();
+            return true;
+          }
+        return false;
+      }
+
       m_updateCounter++;
 
       if (m_updateCounter > 10) {
-        initCells();
-        updateCells();
-        m_updateCounter = 0;
+        Rebuild();
+        return true;
+      }
+
+      return false;
+    }
+
+    void OBNbrList::initVerletNbrs()
+    {
+      m_verletNbrs.resize(m_atoms.size());
+      for (unsigned int i = 0; i < m_atoms.size(); ++i) {
+        m_verletNbrs[i] = GetNbrs(i, true);
+        std::sort(m_verletNbrs[i].begin(), m_verletNbrs[i].end());
       }
+      m_verletPositions = m_function->GetPositions();
     }
 
     void OBNbrList::initCells()
     {
+      m_min = m_max = Eigen::Vector3d::Zero();
       // find min & max
       for (atom_iter a = m_atoms.begin(); a != m_atoms.end(); ++a) {
         Eigen::Vector3d pos = m_function->GetPositions()[*a];
 
-        if (!*a) {
+        if (a == m_atoms.begin()) {
           m_min = m_max = pos;
         } else {
           if (pos.x() > m_max.x())
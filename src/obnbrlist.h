@@ -48,6 +48,11 @@ namespace OpenBabel {
      *
      * http://dx.doi.org/10.1016/S0010-4655%2898%2900203-3
      *
+     * When a skin is set (see SetSkin()), the cells are built using
+     * rcut + skin and a Verlet list is kept for every atom (see
+     * GetVerletNbrs()). Update() will then only rebuild the cells and the
+     * Verlet lists once some atom has moved more than half the skin since
+     * the last build.
      */
     class OBNbrList
     {
@@ -60,18 +65,75 @@ namespace OpenBabel {
          * @param mol The molecule containing the atoms
          * @param rcut The cut-off distance.
          * @param boxSize The number of cells per rcut distance.
+         * @param skin The Verlet skin (0.0 disables the Verlet lists).
          */
-        OBNbrList(OBFunction *function, double rcut, bool periodic = false, int boxSize = 1);
+        OBNbrList(OBFunction *function, double rcut, bool periodic = false, int boxSize = 1, double skin = 0.0);
         /**
          * Update the cells. While minimizing or running MD simulations,
          * atoms move and can go from on cell into the next. This function
          * should be called every 10-20 iterations to make sure the cells
          * stay accurate.
+         *
+         * If a skin is set, this function can be called every iteration.
+         * The cells and Verlet lists are only rebuilt when the largest
+         * displacement since the last build exceeds skin / 2.
+         *
+         * @return True if the cells were rebuilt.
+         */
+        bool Update();
+        /**
+         * Rebuild the cells (and Verlet lists if a skin is set) using the
+         * current positions. This also picks up changes in the number of
+         * particles and is called from OBFunction::Setup().
          */
-        void Update();
+        void Rebuild();
+        /**
+         * Set the cut-off distance. The cells are rebuilt on the next call
+         * to Update().
+         */
+        void SetCutOff(double rcut);
+        /**
+         * @return The cut-off distance.
+         */
+        double GetCutOff() const
+        {
+          return m_rcut;
+        }
+        /**
+         * Set the Verlet skin. The cells are rebuilt on the next call to
+         * Update().
+         */
+        void SetSkin(double skin);
+        /**
+         * @return The Verlet skin.
+         */
+        double GetSkin() const
+        {
+          return m_skin;
+        }
+        /**
+         * Get the number of times the cells have been rebuilt. Terms keeping
+         * their own pair lists can compare this with the value from their
+         * last Compute() call to find out if the Verlet lists changed.
+         */
+        unsigned int GetBuildCount() const
+        {
+          return m_buildCount;
+        }
+        /**
+         * Get the Verlet list for atom @p index. Only the atoms with a
+         * higher index within rcut + skin (at the time of the last build)
+         * are stored, in ascending order. The list is only valid when a
+         * skin is set.
+         */
+        const std::vector<unsigned int>& GetVerletNbrs(unsigned int index) const
+        {
+          return m_verletNbrs[index];
+        }
         /**
          * Get the near-neighbor atoms for @p atom. The squared distance is
-         * checked and is cached for later use (see GetDist2() function).
+         * checked against (rcut + skin)^2 and is cached for later use (see
+         * GetDist2() function).
          *
          * Note: Atoms in relative 1-2 and 1-3 positions are not returned.
          * The @p atom itself isn't added to the list.
@@ -136,14 +198,19 @@ namespace OpenBabel {
         void updateCells();
         void initOffsetMap();
         void initGhostMap(bool periodic = false);
+        void initVerletNbrs();
         bool insideShpere(const Eigen::Vector3i &index);
 
         OBFunction                         *m_function;
         std::vector<unsigned int>           m_atoms;
         double                              m_rcut, m_rcut2;
+        double                              m_skin;
         double                              m_edgeLength;
         int                                 m_boxSize;
         int                                 m_updateCounter;
+        bool                                m_periodic;
+        bool                                m_dirty;
+        unsigned int                        m_buildCount;
 
         Eigen::Vector3d                     m_min, m_max;
         Eigen::Vector3i                     m_dim;
@@ -156,6 +223,9 @@ namespace OpenBabel {
         int                                 m_ghostXY;
 
         std::vector<double>                 m_r2;
+
+        std::vector<std::vector<unsigned int> > m_verletNbrs;
+        std::vector<Eigen::Vector3d>        m_verletPositions;
     };
   
   } // end namespace OBFFs
@@ -0,0 +1,429 @@
+/*********************************************************************
+Normal mode analysis
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBNormalModes>
+#include <OBFunction>
+
+#include <Eigen/QR> // SelfAdjointEigenSolver
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    namespace {
+      // sort the eigenvalues from a SelfAdjointEigenSolver
+      struct EigenvalueLess
+      {
+        EigenvalueLess(const Eigen::VectorXd &_values) : values(_values) {}
+        bool operator()(int a, int b) const { return values[a] < values[b]; }
+        const Eigen::VectorXd &values;
+      };
+
+      std::vector<int> SortedEigenvalues(const Eigen::VectorXd &values)
+      {
+        std::vector<int> order(values.size());
+        for (unsigned int i = 0; i < order.size(); ++i)
+          order[i] = i;
+        std::sort(order.begin(), order.end(), EigenvalueLess(values));
+        return order;
+      }
+
+      // Orthonormalize basis[begin, end) against all previous vectors (modified
+      // Gram-Schmidt, two passes). The same operations are applied to Abasis
+      // if it has the same size. Vectors that lose more than 1 - minNorm of
+      // their norm are removed, this limits the amplification of the errors
+      // in Abasis.
+      void Orthonormalize(std::vector<Eigen::VectorXd> &basis, std::vector<Eigen::VectorXd> &Abasis,
+          unsigned int begin, double minNorm = 1.0e-8)
+      {
+        const bool paired = (Abasis.size() == basis.size());
+        unsigned int kept = begin;
+        for (unsigned int i = begin; i < basis.size(); ++i) {
+          Eigen::VectorXd v = basis[i];
+          Eigen::VectorXd Av;
+          if (paired)
+            Av = Abasis[i];
+          const double norm0 = v.norm();
+          if (norm0 == 0.0)
+            continue;
+          for (int pass = 0; pass < 2; ++pass)
+            for (unsigned int j = 0; j < kept; ++j) {
+              const double c = basis[j].dot(v);
+              v -= c * basis[j];
+              if (paired)
+                Av -= c * Abasis[j];
+            }
+          const double norm = v.norm();
+          if (norm < minNorm * norm0)
+            continue;
+          basis[kept] = v / norm;
+          if (paired)
+            Abasis[kept] = Av / norm;
+          kept++;
+        }
+        basis.resize(kept);
+        if (paired)
+          Abasis.resize(kept);
+      }
+    }
+
+    OBNormalModes::OBNormalModes(OBFunction *function) : m_function(function), m_method(Auto),
+        m_denseLimit(150), m_tolerance(1e-5), m_maxIterations(1000), m_iterations(0), m_analytical(false)
+    {
+    }
+
+    void OBNormalModes::Setup()
+    {
+      const unsigned int numParticles = m_function->NumParticles();
+      const std::vector<double> &masses = m_function->GetMasses();
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+
+      // unit masses if the function has none
+      m_invSqrtMasses.resize(numParticles);
+      for (unsigned int i = 0; i < numParticles; ++i)
+        m_invSqrtMasses[i] = (masses.size() == numParticles && masses[i] > 0.0) ? 1.0 / sqrt(masses[i]) : 1.0;
+
+      m_analytical = m_function->ComputeHessian(m_hessian);
+      m_v.resize(numParticles);
+      m_Hv.resize(numParticles);
+      m_Hv2.resize(numParticles);
+
+      // translations and rotations around the center of mass in mass-weighted coordinates
+      double totalMass = 0.0;
+      Eigen::Vector3d center = Eigen::Vector3d::Zero();
+      for (unsigned int i = 0; i < numParticles; ++i) {
+        const double mass = 1.0 / (m_invSqrtMasses[i] * m_invSqrtMasses[i]);
+        center += mass * positions[i];
+        totalMass += mass;
+      }
+      if (totalMass > 0.0)
+        center /= totalMass;
+
+      std::vector<Eigen::VectorXd> rigidBody(6, Eigen::VectorXd::Zero(3 * numParticles));
+      for (unsigned int i = 0; i < numParticles; ++i) {
+        const double sqrtMass = 1.0 / m_invSqrtMasses[i];
+        const Eigen::Vector3d r = positions[i] - center;
+        for (unsigned int k = 0; k < 3; ++k) {
+          Eigen::Vector3d axis = Eigen::Vector3d::Zero();
+          axis[k] = 1.0;
+          const Eigen::Vector3d rotation = sqrtMass * axis.cross(r);
+          rigidBody[k][3*i+k] = sqrtMass;
+          for (unsigned int l = 0; l < 3; ++l)
+            rigidBody[3+k][3*i+l] = rotation[l];
+        }
+      }
+      // linear molecules only have 2 rotations
+      std::vector<Eigen::VectorXd> unused;
+      Orthonormalize(rigidBody, unused, 0);
+      m_rigidBody = rigidBody;
+    }
+
+    void OBNormalModes::Project(Eigen::VectorXd &v) const
+    {
+      for (unsigned int i = 0; i < m_rigidBody.size(); ++i)
+        v -= m_rigidBody[i].dot(v) * m_rigidBody[i];
+    }
+
+    void OBNormalModes::Multiply(const Eigen::VectorXd &v, Eigen::VectorXd &Hv)
+    {
+      const unsigned int numParticles = m_v.size();
+      for (unsigned int i = 0; i < numParticles; ++i)
+        m_v[i] = m_invSqrtMasses[i] * Eigen::Vector3d(v[3*i], v[3*i+1], v[3*i+2]);
+      if (m_analytical)
+        m_hessian.Multiply(m_v, m_Hv);
+      else {
+        // Central differences: the forward differences from
+        // OBFunction::ComputeHessianVectorProduct() have an error that is
+        // quadratic in v, the Rayleigh-Ritz procedure needs a product that is
+        // (nearly) linear.
+        m_function->ComputeHessianVectorProduct(m_v, m_Hv);
+        for (unsigned int i = 0; i < numParticles; ++i)
+          m_v[i] = -m_v[i];
+        m_function->ComputeHessianVectorProduct(m_v, m_Hv2);
+        for (unsigned int i = 0; i < numParticles; ++i)
+          m_Hv[i] = 0.5 * (m_Hv[i] - m_Hv2[i]);
+      }
+      Hv.resize(3 * numParticles);
+      for (unsigned int i = 0; i < numParticles; ++i)
+        for (unsigned int k = 0; k < 3; ++k)
+          Hv[3*i+k] = m_invSqrtMasses[i] * m_Hv[i][k];
+    }
+
+    bool OBNormalModes::Compute(unsigned int numModes)
+    {
+      m_eigenvalues.clear();
+      m_frequencies.clear();
+      m_modes.clear();
+      m_iterations = 0;
+
+      const unsigned int numParticles = m_function->NumParticles();
+      if (!numParticles)
+        return false;
+
+      // the finite difference products need the gradients
+      m_function->Compute(OBFunction::Gradients);
+      Setup();
+
+      const unsigned int numVibrations = 3 * numParticles - m_rigidBody.size();
+      if (!numModes || (numModes > numVibrations))
+        numModes = numVibrations;
+
+      bool dense = (m_method == Dense) || (numModes == numVibrations);
+      if (m_method == Auto)
+        dense = dense || (numParticles <= m_denseLimit);
+      // the LOBPCG subspace (3 blocks) has to fit
+      if (3 * (numModes + std::max(2u, numModes / 2)) >= numVibrations)
+        dense = true;
+
+      return dense ? ComputeDense(numModes) : ComputeIterative(numModes);
+    }
+
+    bool OBNormalModes::ComputeDense(unsigned int numModes)
+    {
+      const unsigned int numParticles = m_function->NumParticles();
+      const unsigned int n = 3 * numParticles;
+
+      Eigen::MatrixXd H = Eigen::MatrixXd::Zero(n, n);
+      if (m_analytical) {
+        for (unsigned int i = 0; i < numParticles; ++i) {
+          const std::vector<unsigned int> &columns = m_hessian.GetColumns(i);
+          const std::vector<Eigen::Matrix3d> &blocks = m_hessian.GetBlocks(i);
+          for (unsigned int b = 0; b < columns.size(); ++b) {
+            const unsigned int j = columns[b];
+            const double scale = m_invSqrtMasses[i] * m_invSqrtMasses[j];
+            for (unsigned int k = 0; k < 3; ++k)
+              for (unsigned int l = 0; l < 3; ++l) {
+                H(3*i+k, 3*j+l) = scale * blocks[b](k, l);
+                H(3*j+l, 3*i+k) = scale * blocks[b](k, l);
+              }
+          }
+        }
+      } else {
+        Eigen::VectorXd e = Eigen::VectorXd::Zero(n), He;
+        for (unsigned int c = 0; c < n; ++c) {
+          e[c] = 1.0;
+          Multiply(e, He);
+          H.col(c) = He;
+          e[c] = 0.0;
+        }
+        H = 0.5 * (H + H.transpose());
+      }
+
+      // P H P with P = I - R R^T
+      const unsigned int numRigid = m_rigidBody.size();
+      Eigen::MatrixXd R(n, numRigid);
+      for (unsigned int r = 0; r < numRigid; ++r)
+        R.col(r) = m_rigidBody[r];
+      const Eigen::MatrixXd HR = H * R;
+      const Eigen::MatrixXd RHR = R.transpose() * HR;
+      H = H - HR * R.transpose() - R * HR.transpose() + R * RHR * R.transpose();
+
+      Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(H);
+      const Eigen::VectorXd values = solver.eigenvalues();
+      const Eigen::MatrixXd vectors = solver.eigenvectors();
+      const std::vector<int> order = SortedEigenvalues(values);
+
+      // skip the (zero) translations and rotations
+      for (unsigned int i = 0; i < order.size() && m_eigenvalues.size() < numModes; ++i) {
+        const Eigen::VectorXd v = vectors.col(order[i]);
+        if ((R.transpose() * v).squaredNorm() > 0.5)
+          continue;
+        AddMode(values[order[i]], v);
+      }
+      return true;
+    }
+
+    //
+    // Knyazev, A. V. "Toward the optimal preconditioned eigensolver: locally
+    // optimal block preconditioned conjugate gradient method" SIAM J. Sci.
+    // Comput. 23, 517 (2001)
+    //
+    // The Rayleigh-Ritz procedure is applied to the subspace spanned by the
+    // current approximations X, the preconditioned residuals W and the
+    // previous search directions P. A Jacobi preconditioner is used if the
+    // Hessian is analytical. All vectors are kept orthogonal to the rigid
+    // body motions.
+    //
+    bool OBNormalModes::ComputeIterative(unsigned int numModes)
+    {
+      const unsigned int numParticles = m_function->NumParticles();
+      const unsigned int n = 3 * numParticles;
+      // a few extra vectors improve the convergence of the highest wanted mode
+      const unsigned int blockSize = numModes + std::max(2u, numModes / 2);
+
+      // Jacobi preconditioner & estimate for the norm of the Hessian
+      Eigen::VectorXd precond = Eigen::VectorXd::Ones(n);
+      double normH = 0.0;
+      if (m_analytical) {
+        Eigen::VectorXd diagonal(n);
+        for (unsigned int i = 0; i < numParticles; ++i) {
+          const Eigen::Matrix3d block = m_hessian.GetBlock(i, i);
+          for (unsigned int k = 0; k < 3; ++k) {
+            diagonal[3*i+k] = block(k, k) * m_invSqrtMasses[i] * m_invSqrtMasses[i];
+            normH = std::max(normH, fabs(diagonal[3*i+k]));
+          }
+        }
+        for (unsigned int c = 0; c < n; ++c)
+          precond[c] = 1.0 / std::max(fabs(diagonal[c]), 1.0e-3 * normH);
+      }
+
+      // deterministic start vectors
+      std::vector<Eigen::VectorXd> X(blockSize, Eigen::VectorXd(n)), AX;
+      for (unsigned int j = 0; j < blockSize; ++j) {
+        for (unsigned int c = 0; c < n; ++c)
+          X[j][c] = sin(0.7 * (c + 1) * (j + 1) + 0.3 * j) + ((c % blockSize) == j ? 1.0 : 0.0);
+        Project(X[j]);
+      }
+      Orthonormalize(X, AX, 0);
+      if (X.size() < blockSize)
+        return false;
+      AX.resize(blockSize);
+      for (unsigned int j = 0; j < blockSize; ++j)
+        Multiply(X[j], AX[j]);
+
+      std::vector<Eigen::VectorXd> P, AP;
+      Eigen::VectorXd lambda = Eigen::VectorXd::Zero(blockSize);
+      bool converged = false;
+      for (m_iterations = 0; m_iterations < m_maxIterations; ++m_iterations) {
+        // Rayleigh-Ritz for [X W P]
+        std::vector<Eigen::VectorXd> S = X, AS = AX;
+        if (m_iterations) {
+          // preconditioned residuals
+          unsigned int numConverged = 0;
+          std::vector<Eigen::VectorXd> W, unused;
+          for (unsigned int j = 0; j < blockSize; ++j) {
+            Eigen::VectorXd r = AX[j] - lambda[j] * X[j];
+            const double residual = r.norm();
+            if (residual <= m_tolerance * normH) {
+              if (j < numModes)
+                numConverged++;
+              continue;
+            }
+            for (unsigned int c = 0; c < n; ++c)
+              r[c] *= precond[c];
+            Project(r);
+            W.push_back(r);
+          }
+          if (numConverged == numModes) {
+            converged = true;
+            break;
+          }
+
+          const unsigned int numX = S.size();
+          S.insert(S.end(), W.begin(), W.end());
+          Orthonormalize(S, unused, numX);
+          for (unsigned int j = numX; j < S.size(); ++j) {
+            AS.push_back(Eigen::VectorXd());
+            Multiply(S[j], AS.back());
+          }
+
+          const unsigned int numXW = S.size();
+          S.insert(S.end(), P.begin(), P.end());
+          AS.insert(AS.end(), AP.begin(), AP.end());
+          // P becomes (nearly) linearly dependent near convergence
+          Orthonormalize(S, AS, numXW, 1.0e-3);
+        }
+
+        const unsigned int dim = S.size();
+        Eigen::MatrixXd G(dim, dim);
+        for (unsigned int a = 0; a < dim; ++a)
+          for (unsigned int b = a; b < dim; ++b)
+            G(a, b) = G(b, a) = 0.5 * (S[a].dot(AS[b]) + S[b].dot(AS[a]));
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(G);
+        const Eigen::VectorXd values = solver.eigenvalues();
+        const Eigen::MatrixXd vectors = solver.eigenvectors();
+        const std::vector<int> order = SortedEigenvalues(values);
+        for (unsigned int a = 0; a < dim; ++a)
+          normH = std::max(normH, fabs(values[a]));
+
+        // new approximations and search directions (the part outside X)
+        const unsigned int numX = X.size();
+        P.assign(blockSize, Eigen::VectorXd::Zero(n));
+        AP.assign(blockSize, Eigen::VectorXd::Zero(n));
+        for (unsigned int j = 0; j < blockSize; ++j) {
+          const int col = order[j];
+          lambda[j] = values[col];
+          for (unsigned int a = numX; a < dim; ++a) {
+            P[j] += vectors(a, col) * S[a];
+            AP[j] += vectors(a, col) * AS[a];
+          }
+          X[j] = P[j];
+          AX[j] = AP[j];
+          for (unsigned int a = 0; a < numX; ++a) {
+            X[j] += vectors(a, col) * S[a];
+            AX[j] += vectors(a, col) * AS[a];
+          }
+        }
+        if (dim == numX) {
+          P.clear();
+          AP.clear();
+        }
+      }
+
+      for (unsigned int j = 0; j < numModes; ++j)
+        AddMode(lambda[j], X[j]);
+      return converged;
+    }
+
+    void OBNormalModes::AddMode(double eigenvalue, const Eigen::VectorXd &v)
+    {
+      // energy unit in J/mol, amu in kg/mol and Angstrom^-2
+      const double energy = (m_function->GetUnit() == "kJ/mol") ? 1000.0 : 4184.0;
+      const double speedOfLight = 2.99792458e10; // cm/s
+      const double omega = sqrt(fabs(eigenvalue) * energy * 1.0e3 * 1.0e20);
+      const double wavenumber = omega / (2.0 * M_PI * speedOfLight);
+      m_eigenvalues.push_back(eigenvalue);
+      m_frequencies.push_back(eigenvalue < 0.0 ? -wavenumber : wavenumber);
+
+      // Cartesian displacements
+      const unsigned int numParticles = m_invSqrtMasses.size();
+      std::vector<Eigen::Vector3d> mode(numParticles);
+      double norm2 = 0.0;
+      for (unsigned int i = 0; i < numParticles; ++i) {
+        mode[i] = m_invSqrtMasses[i] * Eigen::Vector3d(v[3*i], v[3*i+1], v[3*i+2]);
+        norm2 += mode[i].squaredNorm();
+      }
+      if (norm2 > 0.0)
+        for (unsigned int i = 0; i < numParticles; ++i)
+          mode[i] /= sqrt(norm2);
+      m_modes.push_back(mode);
+    }
+
+    //
+    // S = R sum [ x / (exp(x) - 1) - ln(1 - exp(-x)) ]      x = h c nu / (k T)
+    //
+    double OBNormalModes::GetVibrationalEntropy(double temperature) const
+    {
+      const double R = (m_function->GetUnit() == "kJ/mol") ? 8.314472e-3 : 1.9872e-3;
+      const double hc_k = 1.4387752; // cm K
+      double entropy = 0.0;
+      for (unsigned int i = 0; i < m_frequencies.size(); ++i) {
+        if (m_frequencies[i] <= 0.0)
+          continue;
+        const double x = hc_k * m_frequencies[i] / temperature;
+        entropy += x / (exp(x) - 1.0) - log(1.0 - exp(-x));
+      }
+      return R * entropy;
+    }
+
+  }
+}
@@ -0,0 +1,156 @@
+/*********************************************************************
+Normal mode analysis
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFFS_NORMALMODES_H
+#define OBFFS_NORMALMODES_H
+
+#include <vector>
+#include <Eigen/Core>
+
+#include <OBHessian>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBNormalModes
+     * @brief Vibrational analysis using the mass-weighted Hessian.
+     *
+     * The modes are the eigenvectors of the mass-weighted Hessian
+     * M^-1/2 H M^-1/2 at the current positions, which should be a minimum
+     * (see OBMinimize). The masses are taken from OBFunction::GetMasses().
+     * The translations and rotations are projected out, so only the
+     * 3N-6 (3N-5 for linear molecules) vibrations are returned.
+     *
+     * For small systems the full matrix is diagonalized (O(N^3)). For larger
+     * systems only the lowest modes are computed using the locally optimal
+     * block preconditioned conjugate gradient method (LOBPCG), which only
+     * needs products with the sparse Hessian (see OBFunction::ComputeHessian()).
+     * The cost of each iteration scales with the number of interactions.
+     * Functions without analytical second derivatives use finite differences
+     * of the gradients (see OBFunction::ComputeHessianVectorProduct()).
+     *
+     * @code
+     * OBNormalModes modes(function);
+     * if (modes.Compute(20))
+     *   for (unsigned int i = 0; i < modes.NumModes(); ++i)
+     *     cout << modes.GetFrequencies()[i] << endl;
+     * @endcode
+     */
+    class OBNormalModes
+    {
+    public:
+      enum Method {
+        Auto, //!< Dense up to GetDenseLimit() particles, Iterative for larger systems
+        Dense, //!< diagonalize the full mass-weighted Hessian
+        Iterative //!< LOBPCG for the lowest modes
+      };
+      /**
+       * Constructor.
+       */
+      OBNormalModes(OBFunction *function);
+      /**
+       * Set the method (default Auto).
+       */
+      void SetMethod(Method method) { m_method = method; }
+      /**
+       * Set the largest number of particles for which Auto uses the dense
+       * method (default 150).
+       */
+      void SetDenseLimit(unsigned int numParticles) { m_denseLimit = numParticles; }
+      unsigned int GetDenseLimit() const { return m_denseLimit; }
+      /**
+       * Set the convergence criteria for the iterative method. A mode has
+       * converged when the norm of its residual is below @p tolerance times
+       * the norm of the mass-weighted Hessian.
+       */
+      void SetConvergence(double tolerance = 1e-5, int maxIterations = 1000)
+      {
+        m_tolerance = tolerance;
+        m_maxIterations = maxIterations;
+      }
+      /**
+       * Compute the @p numModes lowest modes at the current positions, 0
+       * computes all modes (always dense). The function's gradients are
+       * computed for the current positions, the positions are not changed.
+       *
+       * @return False if the iterative method did not converge (the modes
+       * are the best approximations found).
+       */
+      bool Compute(unsigned int numModes = 0);
+      /**
+       * @return The number of computed modes.
+       */
+      unsigned int NumModes() const { return m_eigenvalues.size(); }
+      /**
+       * @return The eigenvalues of the mass-weighted Hessian in ascending
+       * order (energy / (distance^2 amu)).
+       */
+      const std::vector<double>& GetEigenvalues() const { return m_eigenvalues; }
+      /**
+       * @return The frequencies in cm^-1, imaginary frequencies are negative.
+       * The function's energy unit (kcal/mol or kJ/mol, see
+       * OBFunction::GetUnit()) and Angstrom are assumed.
+       */
+      const std::vector<double>& GetFrequencies() const { return m_frequencies; }
+      /**
+       * @return The Cartesian displacements for @p mode (NumParticles()
+       * elements), normalized to 1.
+       */
+      const std::vector<Eigen::Vector3d>& GetMode(unsigned int mode) const { return m_modes[mode]; }
+      /**
+       * @return The harmonic vibrational entropy at @p temperature (K) for
+       * the computed modes in the function's energy unit per K. Imaginary
+       * frequencies are skipped. The lowest modes dominate the entropy, but
+       * with Compute(numModes) the contribution of the other modes is missing.
+       */
+      double GetVibrationalEntropy(double temperature = 298.15) const;
+      /**
+       * @return The number of iterations used by the last iterative Compute().
+       */
+      int GetIterations() const { return m_iterations; }
+
+    private:
+      void Setup();
+      void Project(Eigen::VectorXd &v) const;
+      void Multiply(const Eigen::VectorXd &v, Eigen::VectorXd &Hv);
+      bool ComputeDense(unsigned int numModes);
+      bool ComputeIterative(unsigned int numModes);
+      void AddMode(double eigenvalue, const Eigen::VectorXd &v);
+
+      OBFunction *m_function;
+      Method m_method;
+      unsigned int m_denseLimit;
+      double m_tolerance;
+      int m_maxIterations;
+      int m_iterations;
+      bool m_analytical; //!< m_hessian is used instead of OBFunction::ComputeHessianVectorProduct()
+      OBHessian m_hessian;
+      std::vector<double> m_invSqrtMasses;
+      std::vector<Eigen::VectorXd> m_rigidBody; //!< orthonormal translations & rotations (mass-weighted)
+      std::vector<Eigen::Vector3d> m_v, m_Hv, m_Hv2; //!< Multiply() buffers
+      std::vector<double> m_eigenvalues, m_frequencies;
+      std::vector<std::vector<Eigen::Vector3d> > m_modes;
+    };
+
+  }
+}
+
+#endif
@@ -28,6 +28,8 @@ namespace OpenBabel {
       };
 
       static Query MakeQuery(int column, const OBVariant &value);
+
+      virtual ~OBParameterDBTable() {}
       
       virtual unsigned int NumRows() const = 0;
       /**
@@ -55,6 +57,12 @@ namespace OpenBabel {
       virtual const std::vector<OBVariant>& FindRow(const std::vector<Query> &query, bool *swapped = 0) const = 0;
 
       virtual std::vector< std::vector<OBVariant> > FindRows(const std::vector<Query> &query, bool *swapped = 0) const = 0; //return all matches 
+      /**
+       * Find the first row where @p column matches each of the @p types (e.g.
+       * OBFFType::GetTypeNames()). The result is indexed by type ID and points
+       * to an empty row if a type is not found.
+       */
+      virtual std::vector<const std::vector<OBVariant>*> FindTypeRows(int column, const std::vector<std::string> &types) const = 0;
       
       virtual const std::vector<std::vector<OBVariant> >& GetAllRows() const = 0;
     };
@@ -62,6 +70,7 @@ namespace OpenBabel {
     class OBParameterDB
     {
     public:
+      virtual ~OBParameterDB() {}
       virtual unsigned int NumTables() const = 0;
       /**
        * Get the names for the tables in this database.
@@ -0,0 +1,106 @@
+/*********************************************************************
+Shared parameter databases
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBParameterDBRegistry>
+#include <OBParameterDB>
+
+#include <map>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    struct RegistryEntry
+    {
+      RegistryEntry() : database(0), refCount(0) {}
+      OBParameterDB *database;
+      unsigned int refCount;
+    };
+
+    typedef std::map<std::pair<std::string, std::string>, RegistryEntry> Registry;
+
+    // only used inside the obff_parameterdb_registry critical sections
+    static Registry& GetRegistry()
+    {
+      static Registry registry;
+      return registry;
+    }
+
+    const OBParameterDB* OBParameterDBRegistry::Acquire(const std::string &forceField,
+        const std::string &filename, Loader loader)
+    {
+      const OBParameterDB *database = 0;
+#ifdef _OPENMP
+      #pragma omp critical (obff_parameterdb_registry)
+#endif
+      {
+        Registry &registry = GetRegistry();
+        const std::pair<std::string, std::string> key(forceField, filename);
+        RegistryEntry &entry = registry[key];
+        if (!entry.database && loader)
+          entry.database = loader(filename);
+        if (entry.database) {
+          entry.refCount++;
+          database = entry.database;
+        } else
+          registry.erase(key);
+      }
+      return database;
+    }
+
+    void OBParameterDBRegistry::Release(const OBParameterDB *database)
+    {
+      if (!database)
+        return;
+      OBParameterDB *unused = 0;
+#ifdef _OPENMP
+      #pragma omp critical (obff_parameterdb_registry)
+#endif
+      {
+        Registry &registry = GetRegistry();
+        for (Registry::iterator i = registry.begin(); i != registry.end(); ++i) {
+          if (i->second.database != database)
+            continue;
+          if (--i->second.refCount == 0) {
+            unused = i->second.database;
+            registry.erase(i);
+          }
+          break;
+        }
+      }
+      delete unused;
+    }
+
+    unsigned int OBParameterDBRegistry::GetRefCount(const OBParameterDB *database)
+    {
+      unsigned int refCount = 0;
+#ifdef _OPENMP
+      #pragma omp critical (obff_parameterdb_registry)
+#endif
+      {
+        Registry &registry = GetRegistry();
+        for (Registry::iterator i = registry.begin(); i != registry.end(); ++i)
+          if (i->second.database == database)
+            refCount = i->second.refCount;
+      }
+      return refCount;
+    }
+
+  }
+}
@@ -0,0 +1,81 @@
+/*********************************************************************
+Shared parameter databases
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFFS_PARAMETERDBREGISTRY_H
+#define OBFFS_PARAMETERDBREGISTRY_H
+
+#include <string>
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    class OBParameterDB;
+
+    /**
+     * @class OBParameterDBRegistry
+     * @brief Process wide cache of parsed parameter databases.
+     *
+     * Parsing a parameter file is expensive compared to creating a function.
+     * The registry keeps one database for each force field and file name and
+     * hands out the same const instance to all functions that use it. The
+     * databases are reference counted, every Acquire() should be matched by
+     * a Release(). Both methods can be called from any thread.
+     *
+     * @code
+     * OBParameterDB* LoadGAFF(const std::string &filename)
+     * {
+     *   return new GAFFParameterDB(filename);
+     * }
+     *
+     * const OBParameterDB *db = OBParameterDBRegistry::Acquire("GAFF", filename, &LoadGAFF);
+     * function->SetParameterDB(db);
+     * ...
+     * OBParameterDBRegistry::Release(db);
+     * @endcode
+     */
+    class OBParameterDBRegistry
+    {
+    public:
+      /**
+       * Function to parse the database from @p filename.
+       */
+      typedef OBParameterDB* (*Loader)(const std::string &filename);
+      /**
+       * Get the database for @p forceField and @p filename. If there is no
+       * such database, @p loader is called to parse it. Other threads
+       * requesting the same database wait until it is loaded.
+       *
+       * @return The shared database, it should not be modified.
+       */
+      static const OBParameterDB* Acquire(const std::string &forceField, const std::string &filename, Loader loader);
+      /**
+       * Release a database returned by Acquire(). The database is deleted
+       * when it is no longer used.
+       */
+      static void Release(const OBParameterDB *database);
+      /**
+       * @return The number of references to @p database, 0 if it is not in
+       * the registry.
+       */
+      static unsigned int GetRefCount(const OBParameterDB *database);
+    };
+
+  }
+}
+
+#endif
@@ -0,0 +1,441 @@
+/*********************************************************************
+Rotor search
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBRotorSearch>
+#include <OBFunction>
+#include <OBFFType>
+#include <OBVectorMath>
+#include <OBLogFile>
+
+#include <openbabel/mol.h>
+
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <limits>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    namespace {
+      // Hash the seed and the conformer index into a xorshift32 state
+      // (finalizer from MurmurHash3), so each random conformer only depends
+      // on its index.
+      unsigned int RandomState(unsigned long seed, unsigned long index)
+      {
+        unsigned int x = static_cast<unsigned int>(seed) ^ (static_cast<unsigned int>(index) * 0x9e3779b9u);
+        x ^= x >> 16;
+        x *= 0x85ebca6bu;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35u;
+        x ^= x >> 16;
+        return x ? x : 1u;
+      }
+
+      unsigned int Xorshift32(unsigned int &x)
+      {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x;
+      }
+    }
+
+    OBRotorSearch::OBRotorSearch(OBFunction *function) : m_function(function), m_torsionStep(60.0),
+        m_clashDistance(1.5), m_numConformers(10), m_blockSize(64), m_seed(5489),
+        m_numComputed(0), m_numPruned(0)
+    {
+    }
+
+    bool OBRotorSearch::Setup(OBMol &mol)
+    {
+      return FindRotors(mol, m_function, m_rotors);
+    }
+
+    bool OBRotorSearch::FindRotors(OBMol &mol, OBFunction *function, std::vector<Rotor> &rotors)
+    {
+      rotors.clear();
+      OBFFType *type = function->GetOBFFType();
+      if (!type)
+        return false;
+
+      const unsigned int numAtoms = function->NumParticles();
+      std::vector<std::vector<unsigned int> > nbrs(numAtoms);
+      const std::vector<OBFFType::BondIdentifier> &bonds = type->GetBonds();
+      for (unsigned int i = 0; i < bonds.size(); ++i) {
+        nbrs[bonds[i].iA].push_back(bonds[i].iB);
+        nbrs[bonds[i].iB].push_back(bonds[i].iA);
+      }
+
+      std::set<std::pair<unsigned int, unsigned int> > done;
+      std::vector<bool> visited(numAtoms);
+      const std::vector<OBFFType::TorsionIdentifier> &torsions = type->GetTorsions();
+      for (unsigned int t = 0; t < torsions.size(); ++t) {
+        const unsigned int b = torsions[t].iB;
+        const unsigned int c = torsions[t].iC;
+        if (!done.insert(std::make_pair(std::min(b, c), std::max(b, c))).second)
+          continue;
+        OBBond *bond = mol.GetBond(b + 1, c + 1);
+        if (!bond || !bond->IsRotor())
+          continue;
+
+        // the atoms on the c side, b can only be reached through the b-c
+        // bond for non-ring bonds
+        Rotor rotor;
+        bool ring = false;
+        std::fill(visited.begin(), visited.end(), false);
+        visited[b] = visited[c] = true;
+        rotor.atoms.push_back(c);
+        for (unsigned int i = 0; (i < rotor.atoms.size()) && !ring; ++i) {
+          const std::vector<unsigned int> &atomNbrs = nbrs[rotor.atoms[i]];
+          for (unsigned int j = 0; j < atomNbrs.size(); ++j) {
+            if ((atomNbrs[j] == b) && (rotor.atoms[i] != c))
+              ring = true;
+            if (visited[atomNbrs[j]])
+              continue;
+            visited[atomNbrs[j]] = true;
+            rotor.atoms.push_back(atomNbrs[j]);
+          }
+        }
+        if (ring)
+          continue;
+
+        rotor.ref[0] = torsions[t].iA;
+        rotor.ref[1] = b;
+        rotor.ref[2] = c;
+        rotor.ref[3] = torsions[t].iD;
+        // the atoms on the b side, atoms in other fragments are not moved
+        std::vector<unsigned int> other(1, b);
+        for (unsigned int i = 0; i < other.size(); ++i) {
+          const std::vector<unsigned int> &atomNbrs = nbrs[other[i]];
+          for (unsigned int j = 0; j < atomNbrs.size(); ++j) {
+            if (visited[atomNbrs[j]])
+              continue;
+            visited[atomNbrs[j]] = true;
+            other.push_back(atomNbrs[j]);
+          }
+        }
+        if (other.size() < rotor.atoms.size()) {
+          // move the b side instead
+          rotor.atoms.swap(other);
+          std::swap(rotor.ref[0], rotor.ref[3]);
+          std::swap(rotor.ref[1], rotor.ref[2]);
+        }
+        std::sort(rotor.atoms.begin(), rotor.atoms.end());
+        rotors.push_back(rotor);
+      }
+
+      return true;
+    }
+
+    void OBRotorSearch::SetRotors(const std::vector<Rotor> &rotors)
+    {
+      m_rotors = rotors;
+    }
+
+    void OBRotorSearch::SetConformer(unsigned int index)
+    {
+      m_function->GetPositions() = m_conformers.at(index).positions;
+    }
+
+    int OBRotorSearch::NumThreads() const
+    {
+#ifdef _OPENMP
+      return (m_function->GetNumThreads() > 0) ? m_function->GetNumThreads() : omp_get_num_procs();
+#else
+      return 1;
+#endif
+    }
+
+    void OBRotorSearch::Prepare()
+    {
+      m_input = m_function->GetPositions();
+      m_conformers.clear();
+      m_numComputed = m_numPruned = 0;
+
+      const unsigned int numRotors = m_rotors.size();
+      const unsigned int numAtoms = m_input.size();
+      const unsigned int numSettings = std::max(1, static_cast<int>(360.0 / m_torsionStep - 1e-6) + 1);
+      m_numSettings.assign(numRotors, numSettings);
+      m_inputTorsions.resize(numRotors);
+      m_setTorsionAtoms.resize(numRotors);
+      m_strides.resize(numRotors);
+      unsigned long stride = 1;
+      for (int r = numRotors - 1; r >= 0; --r) {
+        const unsigned int *ref = m_rotors[r].ref;
+        m_inputTorsions[r] = DEG_TO_RAD * VectorTorsion(m_input[ref[0]], m_input[ref[1]], m_input[ref[2]], m_input[ref[3]]);
+        m_setTorsionAtoms[r].resize(m_rotors[r].atoms.size());
+        for (unsigned int i = 0; i < m_rotors[r].atoms.size(); ++i)
+          m_setTorsionAtoms[r][i] = m_rotors[r].atoms[i] + 1;
+        m_strides[r] = stride;
+        stride *= m_numSettings[r];
+      }
+
+      // The distance between two atoms only changes when a rotor moves one
+      // of them, check the pair after setting the last of these rotors. The
+      // c atom is on the axis and does not move.
+      m_clashPairs.assign(numRotors, std::vector<std::pair<unsigned int, unsigned int> >());
+      std::vector<std::vector<bool> > moved(numRotors, std::vector<bool>(numAtoms, false));
+      for (unsigned int r = 0; r < numRotors; ++r) {
+        for (unsigned int i = 0; i < m_rotors[r].atoms.size(); ++i)
+          moved[r][m_rotors[r].atoms[i]] = true;
+        moved[r][m_rotors[r].ref[2]] = false;
+      }
+      OBFFType *type = m_function->GetOBFFType();
+      for (unsigned int i = 0; i < numAtoms; ++i)
+        for (unsigned int j = i + 1; j < numAtoms; ++j) {
+          int level = -1;
+          for (unsigned int r = 0; r < numRotors; ++r)
+            if (moved[r][i] != moved[r][j])
+              level = r;
+          if (level < 0)
+            continue;
+          if (type && (type->GetRelation(i, j) & (OBFFType::OneTwo | OBFFType::OneThree)))
+            continue;
+          m_clashPairs[level].push_back(std::make_pair(i, j));
+        }
+    }
+
+    bool OBRotorSearch::SetLevel(Builder &builder, unsigned int level, unsigned int setting) const
+    {
+      std::vector<Eigen::Vector3d> &positions = builder.levels[level];
+      positions = level ? builder.levels[level - 1] : m_input;
+      builder.settings[level] = setting;
+
+      unsigned int ref[4];
+      for (unsigned int k = 0; k < 4; ++k)
+        ref[k] = m_rotors[level].ref[k] + 1;
+      SetTorsion(positions[0].data(), ref, m_inputTorsions[level] + DEG_TO_RAD * setting * m_torsionStep,
+          m_setTorsionAtoms[level]);
+
+      const double clash2 = m_clashDistance * m_clashDistance;
+      const std::vector<std::pair<unsigned int, unsigned int> > &pairs = m_clashPairs[level];
+      for (unsigned int i = 0; i < pairs.size(); ++i)
+        if ((positions[pairs[i].first] - positions[pairs[i].second]).squaredNorm() < clash2)
+          return false;
+      return true;
+    }
+
+    int OBRotorSearch::Build(Builder &builder, const std::vector<unsigned int> &settings) const
+    {
+      const unsigned int numRotors = m_rotors.size();
+      unsigned int level = 0;
+      while ((level < builder.numValid) && (builder.settings[level] == settings[level]))
+        ++level;
+
+      for (; level < numRotors; ++level)
+        if (!SetLevel(builder, level, settings[level])) {
+          builder.numValid = level;
+          return level;
+        }
+      builder.numValid = numRotors;
+
+      const std::vector<Eigen::Vector3d> &positions = numRotors ? builder.levels.back() : m_input;
+      builder.positions.insert(builder.positions.end(), positions.begin(), positions.end());
+      builder.conformerSettings.push_back(settings);
+      return -1;
+    }
+
+    void OBRotorSearch::GenerateSystematic(Builder &builder, unsigned long begin, unsigned long end) const
+    {
+      const unsigned int numRotors = m_rotors.size();
+      std::vector<unsigned int> settings(numRotors);
+      builder.numValid = 0;
+      unsigned long index = begin;
+      while (index < end) {
+        for (unsigned int r = 0; r < numRotors; ++r)
+          settings[r] = (index / m_strides[r]) % m_numSettings[r];
+        const int clash = Build(builder, settings);
+        if (clash < 0) {
+          ++index;
+          continue;
+        }
+        // skip all settings of the following rotors
+        const unsigned long next = (index / m_strides[clash] + 1) * m_strides[clash];
+        builder.numPruned += std::min(next, end) - index;
+        index = next;
+      }
+    }
+
+    void OBRotorSearch::GenerateRandom(Builder &builder, unsigned long begin, unsigned long end) const
+    {
+      const unsigned int numRotors = m_rotors.size();
+      std::vector<unsigned int> settings(numRotors);
+      builder.numValid = 0;
+      for (unsigned long index = begin; index < end; ++index) {
+        unsigned int state = RandomState(m_seed, index);
+        for (unsigned int r = 0; r < numRotors; ++r)
+          settings[r] = Xorshift32(state) % m_numSettings[r];
+        if (Build(builder, settings) >= 0)
+          builder.numPruned++;
+      }
+    }
+
+    void OBRotorSearch::ComputeBlock(std::vector<Builder> &builders)
+    {
+      std::vector<Eigen::Vector3d> positions;
+      std::vector<std::vector<unsigned int> > settings;
+      for (unsigned int t = 0; t < builders.size(); ++t) {
+        positions.insert(positions.end(), builders[t].positions.begin(), builders[t].positions.end());
+        settings.insert(settings.end(), builders[t].conformerSettings.begin(), builders[t].conformerSettings.end());
+        m_numPruned += builders[t].numPruned;
+        builders[t].positions.clear();
+        builders[t].conformerSettings.clear();
+        builders[t].numPruned = 0;
+      }
+      if (settings.empty())
+        return;
+
+      std::vector<double> values;
+      m_function->ComputeBatch(positions, values);
+      m_numComputed += values.size();
+
+      // keep the lowest conformers, equal values are ordered by their settings
+      const unsigned int numAtoms = m_input.size();
+      for (unsigned int k = 0; k < values.size(); ++k) {
+        unsigned int pos = 0;
+        bool duplicate = false;
+        for (; pos < m_conformers.size(); ++pos) {
+          if (m_conformers[pos].settings == settings[k]) {
+            duplicate = true;
+            break;
+          }
+          if ((values[k] < m_conformers[pos].value) ||
+              ((values[k] == m_conformers[pos].value) && (settings[k] < m_conformers[pos].settings)))
+            break;
+        }
+        if (duplicate || (pos >= m_numConformers))
+          continue;
+
+        Conformer conformer;
+        conformer.value = values[k];
+        conformer.settings = settings[k];
+        conformer.positions.assign(positions.begin() + k * numAtoms, positions.begin() + (k + 1) * numAtoms);
+        conformer.torsions.resize(m_rotors.size());
+        for (unsigned int r = 0; r < m_rotors.size(); ++r) {
+          double torsion = RAD_TO_DEG * m_inputTorsions[r] + settings[k][r] * m_torsionStep;
+          torsion -= 360.0 * floor((torsion + 180.0) / 360.0);
+          conformer.torsions[r] = torsion;
+        }
+        m_conformers.insert(m_conformers.begin() + pos, conformer);
+        if (m_conformers.size() > m_numConformers)
+          m_conformers.pop_back();
+      }
+    }
+
+    bool OBRotorSearch::SystematicSearch()
+    {
+      Prepare();
+
+      double numCombinations = 1.0;
+      for (unsigned int r = 0; r < m_numSettings.size(); ++r)
+        numCombinations *= m_numSettings[r];
+      OBLogFile *logfile = m_function->GetLogFile();
+      const double maxCombinations = std::min(281474976710656.0, // 2^48
+          static_cast<double>(std::numeric_limits<unsigned long>::max()));
+      if (numCombinations > maxCombinations) {
+        if (logfile->IsLow())
+          logfile->Write("SYSTEMATIC ROTOR SEARCH: too many combinations, use a random search\n");
+        return false;
+      }
+      const unsigned long total = static_cast<unsigned long>(numCombinations);
+
+      const int numThreads = NumThreads();
+      std::vector<Builder> builders(numThreads);
+      for (int t = 0; t < numThreads; ++t) {
+        builders[t].levels.resize(m_rotors.size());
+        builders[t].settings.resize(m_rotors.size());
+        builders[t].numPruned = 0;
+      }
+
+      // each thread generates the next m_blockSize combinations
+      const unsigned long blockSize = std::max(1u, m_blockSize);
+      for (unsigned long next = 0; next < total; next += numThreads * blockSize) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static, 1) num_threads(numThreads)
+#endif
+        for (int t = 0; t < numThreads; ++t) {
+          const unsigned long begin = next + t * blockSize;
+          if (begin < total)
+            GenerateSystematic(builders[t], begin, std::min(total, begin + blockSize));
+        }
+        ComputeBlock(builders);
+      }
+
+      if (logfile->IsLow()) {
+        char logbuf[128];
+        snprintf(logbuf, sizeof(logbuf), "SYSTEMATIC ROTOR SEARCH: %u rotors, %lu computed, %lu pruned",
+            static_cast<unsigned int>(m_rotors.size()), m_numComputed, m_numPruned);
+        logfile->Write(logbuf);
+        if (!m_conformers.empty()) {
+          snprintf(logbuf, sizeof(logbuf), ", lowest = %.5f %s", m_conformers[0].value, m_function->GetUnit().c_str());
+          logfile->Write(logbuf);
+        }
+        logfile->Write("\n");
+      }
+      return true;
+    }
+
+    void OBRotorSearch::RandomSearch(unsigned int numConformers)
+    {
+      Prepare();
+
+      const int numThreads = NumThreads();
+      std::vector<Builder> builders(numThreads);
+      for (int t = 0; t < numThreads; ++t) {
+        builders[t].levels.resize(m_rotors.size());
+        builders[t].settings.resize(m_rotors.size());
+        builders[t].numPruned = 0;
+      }
+
+      const unsigned long blockSize = std::max(1u, m_blockSize);
+      for (unsigned long next = 0; next < numConformers; next += numThreads * blockSize) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static, 1) num_threads(numThreads)
+#endif
+        for (int t = 0; t < numThreads; ++t) {
+          const unsigned long begin = next + t * blockSize;
+          if (begin < numConformers)
+            GenerateRandom(builders[t], begin, std::min(static_cast<unsigned long>(numConformers), begin + blockSize));
+        }
+        ComputeBlock(builders);
+      }
+
+      OBLogFile *logfile = m_function->GetLogFile();
+      if (logfile->IsLow()) {
+        char logbuf[128];
+        snprintf(logbuf, sizeof(logbuf), "RANDOM ROTOR SEARCH: %u rotors, %lu computed, %lu pruned",
+            static_cast<unsigned int>(m_rotors.size()), m_numComputed, m_numPruned);
+        logfile->Write(logbuf);
+        if (!m_conformers.empty()) {
+          snprintf(logbuf, sizeof(logbuf), ", lowest = %.5f %s", m_conformers[0].value, m_function->GetUnit().c_str());
+          logfile->Write(logbuf);
+        }
+        logfile->Write("\n");
+      }
+    }
+
+  }
+}
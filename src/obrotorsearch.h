@@ -0,0 +1,230 @@
+/*********************************************************************
+Rotor search
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFFS_ROTORSEARCH_H
+#define OBFFS_ROTORSEARCH_H
+
+#include <vector>
+#include <Eigen/Core>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBRotorSearch
+     * @brief Conformer search by setting the torsions of the rotatable bonds.
+     *
+     * The rotors are the single, non-ring bonds between two non-terminal
+     * heavy atoms (OBBond::IsRotor()) which are the central bond of a torsion
+     * from the function's OBFFType. Each rotor is set to the torsion of the
+     * input positions plus multiples of the torsion step (see
+     * SetTorsionStep()), the input conformer is always included.
+     *
+     * The rotors are set one at a time using SetTorsion(). A pair of atoms
+     * (not in a 1-2 or 1-3 relation) closer than the clash distance prunes the
+     * conformer as soon as the last rotor changing their distance is set, for
+     * the systematic search this skips all combinations of the remaining
+     * rotors. The other conformers are generated in blocks in parallel and
+     * their values are computed with OBFunction::ComputeBatch(), both using
+     * the function's threads (see OBFunction::SetNumThreads()). The lowest
+     * conformers are kept (see SetNumConformers()), the same conformers are
+     * computed for any number of threads.
+     *
+     * @code
+     * function->Setup(mol);
+     * OBRotorSearch search(function);
+     * search.Setup(mol);
+     * search.SystematicSearch();
+     * search.SetConformer(0); // the lowest conformer
+     * @endcode
+     */
+    class OBRotorSearch
+    {
+    public:
+      /**
+       * A rotatable bond.
+       */
+      struct Rotor
+      {
+        unsigned int ref[4]; //!< torsion atoms a-b-c-d (indexed from 0 to N-1), b-c is the rotatable bond
+        std::vector<unsigned int> atoms; //!< the atoms on the c side, moved when the torsion changes
+      };
+      /**
+       * A conformer found by the search.
+       */
+      struct Conformer
+      {
+        double value; //!< the function's value
+        std::vector<double> torsions; //!< the torsion for each rotor (degrees)
+        std::vector<Eigen::Vector3d> positions; //!< the positions
+        std::vector<unsigned int> settings; //!< the torsion step for each rotor
+      };
+      /**
+       * Constructor.
+       */
+      OBRotorSearch(OBFunction *function);
+      /**
+       * Find the rotors for @p mol (see FindRotors()). The function should be
+       * set up for @p mol, the function's positions at the start of a search
+       * are used as input conformer.
+       *
+       * @return False if the function has no OBFFType.
+       */
+      bool Setup(OBMol &mol);
+      /**
+       * Find the rotors for @p mol using the torsions and bonds from the
+       * function's OBFFType. The atoms moved by each rotor are on the smaller
+       * side of the bond, atoms which are not connected to the bond (e.g. in
+       * another fragment) are never moved.
+       *
+       * @return False if the function has no OBFFType.
+       */
+      static bool FindRotors(OBMol &mol, OBFunction *function, std::vector<Rotor> &rotors);
+      /**
+       * Set the rotors to use instead of the ones from Setup().
+       */
+      void SetRotors(const std::vector<Rotor> &rotors);
+      const std::vector<Rotor>& GetRotors() const { return m_rotors; }
+      /**
+       * Set the step between the torsion settings for each rotor (degrees,
+       * default 60).
+       */
+      void SetTorsionStep(double step) { m_torsionStep = step; }
+      double GetTorsionStep() const { return m_torsionStep; }
+      /**
+       * Set the clash distance (Angstrom, default 1.5), conformers with a
+       * closer pair of atoms are not computed.
+       */
+      void SetClashDistance(double distance) { m_clashDistance = distance; }
+      /**
+       * Set the number of conformers to keep (default 10).
+       */
+      void SetNumConformers(unsigned int numConformers) { m_numConformers = numConformers; }
+      /**
+       * Set the number of conformers generated by each thread in a block
+       * before their values are computed (default 64).
+       */
+      void SetBlockSize(unsigned int blockSize) { m_blockSize = blockSize; }
+      /**
+       * Set the seed for RandomSearch().
+       */
+      void SetSeed(unsigned long seed) { m_seed = seed; }
+      /**
+       * Try all combinations of the torsion settings.
+       *
+       * @return False if there are too many combinations to enumerate (more
+       * than 2^48 or the largest unsigned long, use RandomSearch()).
+       */
+      bool SystematicSearch();
+      /**
+       * Try @p numConformers random combinations of the torsion settings.
+       * The same combination found twice is only kept once.
+       */
+      void RandomSearch(unsigned int numConformers);
+      /**
+       * @return The lowest conformers from the last search in order of
+       * increasing value.
+       */
+      const std::vector<Conformer>& GetConformers() const { return m_conformers; }
+      /**
+       * Copy the positions of conformer @p index to the function.
+       */
+      void SetConformer(unsigned int index);
+      /**
+       * @return The number of conformers computed by the last search.
+       */
+      unsigned long GetNumComputed() const { return m_numComputed; }
+      /**
+       * @return The number of conformers pruned by the last search (for the
+       * systematic search, this includes the skipped combinations).
+       */
+      unsigned long GetNumPruned() const { return m_numPruned; }
+
+    protected:
+      /**
+       * A thread's state while generating conformers.
+       */
+      struct Builder
+      {
+        std::vector<std::vector<Eigen::Vector3d> > levels; //!< the positions after setting each rotor
+        std::vector<unsigned int> settings; //!< the torsion step used for each level
+        unsigned int numValid; //!< the number of levels without clash
+        std::vector<Eigen::Vector3d> positions; //!< the generated conformers
+        std::vector<std::vector<unsigned int> > conformerSettings;
+        unsigned long numPruned;
+      };
+      /**
+       * Prepare the torsions and clash pairs for the current rotors.
+       */
+      void Prepare();
+      /**
+       * Set rotor @p level to torsion step @p setting using the positions
+       * for the previous level.
+       *
+       * @return False if the rotor causes a clash.
+       */
+      bool SetLevel(Builder &builder, unsigned int level, unsigned int setting) const;
+      /**
+       * Set all rotors to @p settings, the levels with the same settings as
+       * the previous conformer are reused. The conformer is added to the
+       * builder's conformers if there is no clash.
+       *
+       * @return The level causing a clash or -1.
+       */
+      int Build(Builder &builder, const std::vector<unsigned int> &settings) const;
+      /**
+       * Generate the conformers with index [@p begin, @p end) of the
+       * systematic search.
+       */
+      void GenerateSystematic(Builder &builder, unsigned long begin, unsigned long end) const;
+      /**
+       * Generate the random conformers with index [@p begin, @p end).
+       */
+      void GenerateRandom(Builder &builder, unsigned long begin, unsigned long end) const;
+      /**
+       * Compute the conformers generated by the builders and keep the lowest.
+       */
+      void ComputeBlock(std::vector<Builder> &builders);
+      int NumThreads() const;
+
+      OBFunction *m_function;
+      std::vector<Rotor> m_rotors;
+      std::vector<Eigen::Vector3d> m_input; //!< the input conformer
+      double m_torsionStep;
+      double m_clashDistance;
+      unsigned int m_numConformers;
+      unsigned int m_blockSize;
+      unsigned long m_seed;
+      std::vector<double> m_inputTorsions; //!< the input torsion for each rotor (radians)
+      std::vector<unsigned int> m_numSettings; //!< the number of torsion steps
+      std::vector<unsigned long> m_strides; //!< systematic search index stride for each rotor
+      std::vector<std::vector<int> > m_setTorsionAtoms; //!< Rotor::atoms (indexed from 1 for SetTorsion())
+      std::vector<std::vector<std::pair<unsigned int, unsigned int> > > m_clashPairs; //!< pairs fixed after each level
+      std::vector<Conformer> m_conformers;
+      unsigned long m_numComputed, m_numPruned;
+    };
+
+  }
+}
+
+#endif
@@ -0,0 +1,305 @@
+/*********************************************************************
+Torsion space minimization
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <OBTorsionMinimize>
+#include <OBFunction>
+#include <OBVectorMath>
+#include <OBLogFile>
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+using namespace std;
+
+namespace OpenBabel {
+  namespace OBFFs {
+
+    OBTorsionMinimize::OBTorsionMinimize(OBFunction *function) : m_function(function), m_maxStep(30.0),
+        m_lbfgsHistory(5), m_step(0), m_numSteps(0), m_econv(1e-6), m_criteria(ConvergenceCriteria::Energy),
+        m_rmsGradient(0.01), m_maxGradient(0.05), m_maxDisplacement(1e-3), m_stopReason(StopReason::Running),
+        m_value(0.0)
+    {
+    }
+
+    bool OBTorsionMinimize::Setup(OBMol &mol)
+    {
+      return OBRotorSearch::FindRotors(mol, m_function, m_rotors);
+    }
+
+    std::vector<double> OBTorsionMinimize::GetTorsions() const
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      std::vector<double> torsions(m_rotors.size());
+      for (unsigned int r = 0; r < m_rotors.size(); ++r) {
+        const unsigned int *ref = m_rotors[r].ref;
+        torsions[r] = VectorTorsion(positions[ref[0]], positions[ref[1]], positions[ref[2]], positions[ref[3]]);
+      }
+      return torsions;
+    }
+
+    void OBTorsionMinimize::SetTorsions(const std::vector<double> &torsions)
+    {
+      m_setTorsionAtoms.resize(m_rotors.size());
+      std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      unsigned int ref[4];
+      for (unsigned int r = 0; r < m_rotors.size(); ++r) {
+        m_setTorsionAtoms[r].resize(m_rotors[r].atoms.size());
+        for (unsigned int i = 0; i < m_rotors[r].atoms.size(); ++i)
+          m_setTorsionAtoms[r][i] = m_rotors[r].atoms[i] + 1;
+        for (unsigned int k = 0; k < 4; ++k)
+          ref[k] = m_rotors[r].ref[k] + 1;
+        SetTorsion(positions[0].data(), ref, DEG_TO_RAD * torsions[r], m_setTorsionAtoms[r]);
+      }
+    }
+
+    //
+    // Rotating the atoms on the c side by dphi around u = (c - b) / |c - b|
+    // moves atom i by dphi u x (r_i - r_c), so
+    //
+    // dE/dphi = sum_i -F_i . (u x (r_i - r_c)) = -u . sum_i (r_i - r_c) x F_i
+    //
+    void OBTorsionMinimize::ComputeTorsionGradients(std::vector<double> &gradients) const
+    {
+      const std::vector<Eigen::Vector3d> &positions = m_function->GetPositions();
+      const std::vector<Eigen::Vector3d> &forces = m_function->GetGradients();
+      gradients.resize(m_rotors.size());
+      for (unsigned int r = 0; r < m_rotors.size(); ++r) {
+        const Eigen::Vector3d &c = positions[m_rotors[r].ref[2]];
+        const Eigen::Vector3d u = (c - positions[m_rotors[r].ref[1]]).normalized();
+        Eigen::Vector3d torque = Eigen::Vector3d::Zero();
+        const std::vector<unsigned int> &atoms = m_rotors[r].atoms;
+        for (unsigned int i = 0; i < atoms.size(); ++i)
+          torque += (positions[atoms[i]] - c).cross(forces[atoms[i]]);
+        gradients[r] = -u.dot(torque);
+      }
+    }
+
+    double OBTorsionMinimize::GetRMSGradient() const
+    {
+      if (!m_gradients.size())
+        return 0.0;
+      return sqrt(m_gradients.squaredNorm() / m_gradients.size());
+    }
+
+    double OBTorsionMinimize::GetMaxGradient() const
+    {
+      double max = 0.0;
+      for (int r = 0; r < m_gradients.size(); ++r)
+        max = std::max(max, fabs(m_gradients[r]));
+      return max;
+    }
+
+    bool OBTorsionMinimize::IsConverged(double valueChange, const Eigen::VectorXd &step) const
+    {
+      // all selected criteria have to be met
+      bool converged = (m_criteria != 0);
+      if (m_criteria & ConvergenceCriteria::Energy)
+        converged = fabs(valueChange) < m_econv;
+      if (converged && (m_criteria & ConvergenceCriteria::RMSGradient))
+        converged = GetRMSGradient() < m_rmsGradient;
+      if (converged && (m_criteria & ConvergenceCriteria::MaxGradient))
+        converged = GetMaxGradient() < m_maxGradient;
+      if (converged && (m_criteria & ConvergenceCriteria::MaxDisplacement))
+        for (int r = 0; r < step.size() && converged; ++r)
+          converged = RAD_TO_DEG * fabs(step[r]) < m_maxDisplacement;
+      return converged;
+    }
+
+    void OBTorsionMinimize::TakeStep(const std::vector<Eigen::Vector3d> &start, const Eigen::VectorXd &step)
+    {
+      m_function->GetPositions() = start;
+      std::vector<double> torsions = GetTorsions();
+      for (unsigned int r = 0; r < m_rotors.size(); ++r)
+        torsions[r] += RAD_TO_DEG * step[r];
+      SetTorsions(torsions);
+
+      m_function->Compute(OBFunction::Gradients);
+      m_value = m_function->GetValue();
+      std::vector<double> gradients;
+      ComputeTorsionGradients(gradients);
+      for (unsigned int r = 0; r < m_rotors.size(); ++r)
+        m_gradients[r] = gradients[r];
+    }
+
+    //
+    // Nocedal & Wright, Numerical Optimization, Algorithm 7.4 (two-loop recursion)
+    //
+    Eigen::VectorXd OBTorsionMinimize::Direction(const Eigen::VectorXd &g) const
+    {
+      Eigen::VectorXd q = g;
+      const int m = m_s.size();
+      std::vector<double> alpha(m);
+      for (int i = m - 1; i >= 0; --i) {
+        alpha[i] = m_rho[i] * m_s[i].dot(q);
+        q -= alpha[i] * m_y[i];
+      }
+      // H0 = (s . y) / (y . y) from the last pair, 1 rad^2 / energy otherwise
+      if (m)
+        q *= 1.0 / (m_rho[m - 1] * m_y[m - 1].dot(m_y[m - 1]));
+      for (int i = 0; i < m; ++i) {
+        const double beta = m_rho[i] * m_y[i].dot(q);
+        q += (alpha[i] - beta) * m_s[i];
+      }
+      return -q;
+    }
+
+    void OBTorsionMinimize::Initialize(int steps, double econv)
+    {
+      m_step = 0;
+      m_numSteps = steps;
+      m_econv = econv;
+      m_stopReason = StopReason::Running;
+      m_s.clear();
+      m_y.clear();
+      m_rho.clear();
+
+      m_function->Compute(OBFunction::Gradients);
+      m_value = m_function->GetValue();
+      std::vector<double> gradients;
+      ComputeTorsionGradients(gradients);
+      m_gradients.resize(m_rotors.size());
+      for (unsigned int r = 0; r < m_rotors.size(); ++r)
+        m_gradients[r] = gradients[r];
+
+      OBLogFile *logfile = m_function->GetLogFile();
+      if (logfile->IsLow()) {
+        char logbuf[128];
+        logfile->Write("\nT O R S I O N   M I N I M I Z A T I O N\n\n");
+        snprintf(logbuf, sizeof(logbuf), "ROTORS = %u    STEPS = %d\n\n",
+            static_cast<unsigned int>(m_rotors.size()), steps);
+        logfile->Write(logbuf);
+        logfile->Write("STEPS    ENERGY      MAX |dE/dphi|\n");
+        logfile->Write("---------------------------------\n");
+        snprintf(logbuf, sizeof(logbuf), " %4d    %10.5f\n", m_step, m_value);
+        logfile->Write(logbuf);
+      }
+    }
+
+    bool OBTorsionMinimize::TakeNSteps(int n)
+    {
+      if (m_stopReason != StopReason::Running)
+        return false;
+      const unsigned int numRotors = m_rotors.size();
+      if (!numRotors) {
+        m_stopReason = StopReason::Converged; // nothing to minimize
+        return false;
+      }
+
+      const double maxStep = DEG_TO_RAD * m_maxStep;
+      OBLogFile *logfile = m_function->GetLogFile();
+      for (int i = 0; i < n; ++i) {
+        if (m_step >= m_numSteps) {
+          m_stopReason = StopReason::MaxSteps;
+          return false;
+        }
+        m_step++;
+
+        Eigen::VectorXd direction = Direction(m_gradients);
+        double slope = direction.dot(m_gradients);
+        if (slope >= 0.0) {
+          // not a descent direction, restart with steepest descent
+          m_s.clear();
+          m_y.clear();
+          m_rho.clear();
+          direction = -m_gradients;
+          slope = direction.dot(m_gradients);
+        }
+        if (slope == 0.0) {
+          m_stopReason = StopReason::Converged; // stationary point
+          return false;
+        }
+
+        // backtracking line search (Armijo condition), no torsion changes
+        // more than the maximum step
+        double largest = 0.0;
+        for (unsigned int r = 0; r < numRotors; ++r)
+          largest = std::max(largest, fabs(direction[r]));
+        double alpha = std::min(1.0, maxStep / largest);
+
+        const std::vector<Eigen::Vector3d> start = m_function->GetPositions();
+        const double startValue = m_value;
+        const Eigen::VectorXd startGradients = m_gradients;
+        bool accepted = false;
+        for (int trial = 0; trial < 20; ++trial) {
+          TakeStep(start, alpha * direction);
+          if (m_value <= startValue + 1e-4 * alpha * slope) {
+            accepted = true;
+            break;
+          }
+          alpha *= 0.5;
+        }
+        if (!accepted) {
+          m_function->GetPositions() = start;
+          m_function->Compute(OBFunction::Gradients);
+          m_value = startValue;
+          m_gradients = startGradients;
+          if (m_s.empty()) {
+            m_stopReason = StopReason::LineSearchFailed;
+            return false;
+          }
+          // try again with steepest descent
+          m_s.clear();
+          m_y.clear();
+          m_rho.clear();
+          continue;
+        }
+
+        const Eigen::VectorXd s = alpha * direction;
+        const Eigen::VectorXd y = m_gradients - startGradients;
+        const double ys = y.dot(s);
+        if (ys > 1e-10) {
+          while (m_s.size() >= m_lbfgsHistory) {
+            m_s.erase(m_s.begin());
+            m_y.erase(m_y.begin());
+            m_rho.erase(m_rho.begin());
+          }
+          m_s.push_back(s);
+          m_y.push_back(y);
+          m_rho.push_back(1.0 / ys);
+        }
+
+        if (logfile->IsLow()) {
+          char logbuf[128];
+          snprintf(logbuf, sizeof(logbuf), " %4d    %10.5f    %10.5f\n", m_step, m_value, GetMaxGradient());
+          logfile->Write(logbuf);
+        }
+
+        if (IsConverged(m_value - startValue, s)) {
+          m_stopReason = StopReason::Converged;
+          if (logfile->IsLow())
+            logfile->Write("    TORSION MINIMIZATION HAS CONVERGED\n");
+          return false;
+        }
+        if (m_step == m_numSteps) {
+          m_stopReason = StopReason::MaxSteps;
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    void OBTorsionMinimize::Minimize(int steps, double econv)
+    {
+      Initialize(steps, econv);
+      while (TakeNSteps(10)) {}
+    }
+
+  }
+}
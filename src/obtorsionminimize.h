@@ -0,0 +1,209 @@
+/*********************************************************************
+Torsion space minimization
+
+Copyright (C) 2009 by Tim Vandermeersch
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.sourceforge.net/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OBFFS_TORSIONMINIMIZE_H
+#define OBFFS_TORSIONMINIMIZE_H
+
+#include <vector>
+#include <algorithm>
+#include <Eigen/Core>
+
+#include <OBRotorSearch>
+#include <OBMinimize>
+
+namespace OpenBabel {
+
+  class OBMol;
+
+  namespace OBFFs {
+
+    class OBFunction;
+
+    /**
+     * @class OBTorsionMinimize
+     * @brief Minimization with the torsions of the rotatable bonds as the
+     * only variables.
+     *
+     * The rotors are found as in OBRotorSearch (the central bonds of the
+     * OBFFType torsions accepted by OBBond::IsRotor()). The bond lengths,
+     * angles and the other torsions are not changed, so a molecule from a
+     * rotor search is refined using a few variables instead of 3N
+     * coordinates. The Cartesian gradients are mapped to the torsions using
+     * the torque around each bond:
+     *
+     *   dE/dphi = -u . sum_i (r_i - r_c) x F_i
+     *
+     * where u is the unit vector from b to c and the sum runs over the atoms
+     * moved by the rotor. The torsions are minimized using L-BFGS with a
+     * backtracking line search, each step takes one or more gradient
+     * evaluations of the function. The convergence tests and stop reasons
+     * are those of OBMinimize (ConvergenceCriteria and StopReason), with the
+     * gradients in energy / radian and the displacements in degrees.
+     *
+     * OBMinimize is not used for this: its methods and line searches work on
+     * the function's positions and gradients (a Vector3d per particle),
+     * while the variables here are a short Eigen::VectorXd of torsions which
+     * only change the positions through SetTorsions(). The L-BFGS two-loop
+     * recursion (see Direction()) is small enough to keep here.
+     *
+     * @code
+     * OBTorsionMinimize minimize(function);
+     * minimize.Setup(mol);
+     * minimize.Minimize(100, 1e-6);
+     * @endcode
+     */
+    class OBTorsionMinimize
+    {
+    public:
+      /**
+       * Constructor.
+       */
+      OBTorsionMinimize(OBFunction *function);
+      /**
+       * Find the rotors for @p mol (see OBRotorSearch::FindRotors()). The
+       * function should be set up for @p mol.
+       *
+       * @return False if the function has no OBFFType.
+       */
+      bool Setup(OBMol &mol);
+      /**
+       * Set the rotors to use instead of the ones from Setup().
+       */
+      void SetRotors(const std::vector<OBRotorSearch::Rotor> &rotors) { m_rotors = rotors; }
+      const std::vector<OBRotorSearch::Rotor>& GetRotors() const { return m_rotors; }
+      /**
+       * Set the largest change of a torsion in a single step (degrees,
+       * default 30).
+       */
+      void SetMaxStep(double maxStep) { m_maxStep = maxStep; }
+      /**
+       * Set the number of correction pairs stored by L-BFGS (default 5).
+       */
+      void SetLBFGSHistorySize(unsigned int m) { m_lbfgsHistory = std::max(m, 1u); }
+      unsigned int GetLBFGSHistorySize() const { return m_lbfgsHistory; }
+      /**
+       * Set the ConvergenceCriteria flags, all selected tests have to be met.
+       * The default is ConvergenceCriteria::Energy.
+       */
+      void SetConvergenceCriteria(int criteria) { m_criteria = criteria; }
+      int GetConvergenceCriteria() const { return m_criteria; }
+      /**
+       * Set the limits for ConvergenceCriteria::RMSGradient and
+       * ConvergenceCriteria::MaxGradient (energy / radian).
+       */
+      void SetGradientConvergence(double rms = 0.01, double max = 0.05)
+      {
+        m_rmsGradient = rms;
+        m_maxGradient = max;
+      }
+      /**
+       * Set the limit for ConvergenceCriteria::MaxDisplacement, the largest
+       * change of a torsion in the last step (degrees).
+       */
+      void SetDisplacementConvergence(double max = 1e-3) { m_maxDisplacement = max; }
+      /**
+       * @return The torsion for each rotor at the function's positions (degrees).
+       */
+      std::vector<double> GetTorsions() const;
+      /**
+       * Rotate the rotors to @p torsions (degrees).
+       */
+      void SetTorsions(const std::vector<double> &torsions);
+      /**
+       * Compute the derivative of the value with respect to each torsion
+       * (energy / radian) from the function's gradients, which have to be
+       * computed for the current positions.
+       */
+      void ComputeTorsionGradients(std::vector<double> &gradients) const;
+      /**
+       * Initialize the minimization and compute the gradients for the
+       * current positions.
+       *
+       * @param steps The number of steps.
+       * @param econv Energy convergence criteria.
+       */
+      void Initialize(int steps = 1000, double econv = 1e-6);
+      /**
+       * Take @p n steps of the minimization initialized with Initialize().
+       *
+       * @return False if convergence or the number of steps given by
+       * Initialize() has been reached.
+       */
+      bool TakeNSteps(int n);
+      /**
+       * Initialize() and take all steps.
+       */
+      void Minimize(int steps = 1000, double econv = 1e-6);
+      /**
+       * @return The number of steps taken since Initialize().
+       */
+      int GetCurrentStep() const { return m_step; }
+      /**
+       * @return The value for the current positions.
+       */
+      double GetValue() const { return m_value; }
+      /**
+       * @return The StopReason for the last run, StopReason::Running if the
+       * run has not stopped yet.
+       */
+      int GetStopReason() const { return m_stopReason; }
+      /**
+       * @return The RMS of the torsion gradients (energy / radian).
+       */
+      double GetRMSGradient() const;
+      /**
+       * @return The largest absolute torsion gradient (energy / radian).
+       */
+      double GetMaxGradient() const;
+
+    protected:
+      /**
+       * Rotate the rotors of @p start by @p step (radians) and compute the
+       * value and gradients.
+       */
+      void TakeStep(const std::vector<Eigen::Vector3d> &start, const Eigen::VectorXd &step);
+      /**
+       * @return The L-BFGS search direction for the gradients @p g.
+       */
+      Eigen::VectorXd Direction(const Eigen::VectorXd &g) const;
+      /**
+       * @return True if the selected ConvergenceCriteria are met after a step
+       * changing the value by @p valueChange and the torsions by @p step.
+       */
+      bool IsConverged(double valueChange, const Eigen::VectorXd &step) const;
+
+      OBFunction *m_function;
+      std::vector<OBRotorSearch::Rotor> m_rotors;
+      std::vector<std::vector<int> > m_setTorsionAtoms; //!< Rotor::atoms (indexed from 1 for SetTorsion())
+      double m_maxStep;
+      unsigned int m_lbfgsHistory;
+      int m_step, m_numSteps;
+      double m_econv;
+      int m_criteria; //!< ConvergenceCriteria flags
+      double m_rmsGradient, m_maxGradient, m_maxDisplacement; //!< Limits for the criteria
+      int m_stopReason;
+      double m_value;
+      Eigen::VectorXd m_gradients; //!< dE/dphi for the current positions
+      std::vector<Eigen::VectorXd> m_s, m_y; //!< L-BFGS steps & gradient changes
+      std::vector<double> m_rho; //!< 1 / (y . s)
+    };
+
+  }
+}
+
+#endif
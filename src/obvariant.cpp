@@ -88,6 +88,40 @@ namespace OBFFs {
     return !(*this == other);
   }
 
+  // FNV-1a
+  static unsigned long HashBytes(const unsigned char *bytes, std::size_t size, unsigned long hash)
+  {
+    for (std::size_t i = 0; i < size; ++i) {
+      hash ^= bytes[i];
+      hash *= 16777619UL;
+    }
+    return hash;
+  }
+
+  unsigned long OBVariant::Hash() const
+  {
+    unsigned long hash = 2166136261UL + m_type;
+    switch (m_type) {
+      case Int: {
+        const int value = static_cast< holder<int> * >(p_value) -> m_value;
+        return HashBytes(reinterpret_cast<const unsigned char*>(&value), sizeof(int), hash);
+      }
+      case Double: {
+        double value = static_cast< holder<double> * >(p_value) -> m_value;
+        if (value == 0.0)
+          value = 0.0; // -0.0 == 0.0
+        return HashBytes(reinterpret_cast<const unsigned char*>(&value), sizeof(double), hash);
+      }
+      case Bool:
+        return HashBytes(reinterpret_cast<const unsigned char*>(&static_cast< holder<bool> * >(p_value) -> m_value), sizeof(bool), hash);
+      case String: {
+        const std::string &value = static_cast< holder<std::string> * >(p_value) -> m_value;
+        return HashBytes(reinterpret_cast<const unsigned char*>(value.data()), value.size(), hash);
+      }
+    }
+    return hash;
+  }
+
 } // OBFFs
 } // OpenBabel
 
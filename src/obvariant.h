@@ -51,27 +51,27 @@ namespace OpenBabel {
 
       OBVariant(const OBVariant& rhs)
 	: m_name(rhs.m_name), m_type(rhs.m_type), p_value(rhs.p_value) {
-	++(p_value->references);
+	p_value->AddRef();
       }
 
       OBVariant & operator= (const OBVariant& rhs){
 	if (this == &rhs)
 	  return *this;
 	else {
-	  if (--(p_value->references)==0) { 
+	  rhs.p_value->AddRef();
+	  if (p_value->Release()) { 
 	    delete p_value;
 	  }
 	  m_name = rhs.m_name; 
 	  m_type = rhs.m_type;
 	  p_value = rhs.p_value;
-	  ++(p_value->references);
 	  return *this;
 	}
       }
       
       ~OBVariant() 
       {
-	if (--(p_value->references)==0) { 
+	if (p_value->Release()) { 
 	  delete p_value;
 	}
       }
@@ -86,12 +86,41 @@ namespace OpenBabel {
     
       bool operator==(const OBVariant &other) const;
       bool operator!=(const OBVariant &other) const;
+      /**
+       * @return A hash value for the type and value, variants that compare
+       * equal have the same hash value.
+       */
+      unsigned long Hash() const;
     
+      /**
+       * The values are shared between copies. Rows from a shared parameter
+       * database (see OBParameterDBRegistry) are copied from several threads,
+       * so the reference count is updated atomically.
+       */
       class placeholder 
       { 
       public:
 	placeholder() : references(1) {}
 	virtual ~placeholder() {} 
+	void AddRef()
+	{
+#ifdef _OPENMP
+	  #pragma omp atomic
+#endif
+	  ++references;
+	}
+	/**
+	 * @return True if this was the last reference.
+	 */
+	bool Release()
+	{
+	  unsigned int count;
+#ifdef _OPENMP
+	  #pragma omp atomic capture
+#endif
+	  count = --references;
+	  return count == 0;
+	}
 	unsigned int references;
       };
 
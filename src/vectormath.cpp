@@ -329,6 +329,190 @@ namespace OBFFs {
     return tor;  
   }
  
+  // [v]x, the matrix for the cross product v x w = [v]x w
+  static Eigen::Matrix3d CrossMatrix(const Eigen::Vector3d &v)
+  {
+    Eigen::Matrix3d m;
+    m(0,0) = 0.0;    m(0,1) = -v.z(); m(0,2) = v.y();
+    m(1,0) = v.z();  m(1,1) = 0.0;    m(1,2) = -v.x();
+    m(2,0) = -v.y(); m(2,1) = v.x();  m(2,2) = 0.0;
+    return m;
+  }
+
+  //
+  // w = cos(theta) = u.v       u = (a - b) / ra, v = (c - b) / rc
+  //
+  // dw/da = (v - w u) / ra = ga
+  // dw/dc = (u - w v) / rc = gc
+  //
+  // d2w/da2  = -(u ga^T + ga u^T + w (I - u u^T) / ra) / ra
+  // d2w/dadc = ((I - v v^T) / rc - u gc^T) / ra
+  //
+  // The derivatives for b follow from translation invariance. With
+  // theta = acos(w) and s = sin(theta):
+  //
+  // dtheta/dx      = -dw/dx / s
+  // d2theta/dx dy  = -d2w/dx dy / s - w / s^3 dw/dx dw/dy^T
+  //
+  OBAPI double VectorAngleHessian(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+      Eigen::Vector3d grad[3], Eigen::Matrix3d hess[9])
+  {
+    for (unsigned int i = 0; i < 3; ++i)
+      grad[i] = VZero;
+    for (unsigned int i = 0; i < 9; ++i)
+      hess[i] = Eigen::Matrix3d::Zero();
+
+    const Eigen::Vector3d ab = a - b;
+    const Eigen::Vector3d cb = c - b;
+    const double ra = ab.norm();
+    const double rc = cb.norm();
+    if (IsNearZero(ra) || IsNearZero(rc))
+      return 0.0;
+
+    const Eigen::Vector3d u = ab / ra;
+    const Eigen::Vector3d v = cb / rc;
+    double w = u.dot(v);
+    if (w > 1.0)
+      w = 1.0;
+    else if (w < -1.0)
+      w = -1.0;
+    const double theta = acos(w);
+    const double s = sqrt(1.0 - w * w);
+    // linear angle, the derivatives are undefined
+    if (s < 1.0e-8)
+      return theta;
+
+    const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d g[3];
+    g[0] = (v - w * u) / ra;
+    g[2] = (u - w * v) / rc;
+    g[1] = -g[0] - g[2];
+
+    Eigen::Matrix3d W[9];
+    W[0] = -(u * g[0].transpose() + g[0] * u.transpose() + w * (I - u * u.transpose()) / ra) / ra;
+    W[8] = -(v * g[2].transpose() + g[2] * v.transpose() + w * (I - v * v.transpose()) / rc) / rc;
+    W[2] = ((I - v * v.transpose()) / rc - u * g[2].transpose()) / ra;
+    W[6] = W[2].transpose();
+    W[1] = -W[0] - W[2];
+    W[7] = -W[6] - W[8];
+    W[3] = W[1].transpose();
+    W[5] = W[7].transpose();
+    W[4] = -W[3] - W[5];
+
+    const double s3 = s * s * s;
+    for (unsigned int i = 0; i < 3; ++i) {
+      grad[i] = -g[i] / s;
+      for (unsigned int j = 0; j < 3; ++j)
+        hess[3*i+j] = -W[3*i+j] / s - (w / s3) * g[i] * g[j].transpose();
+    }
+
+    return theta;
+  }
+
+  //
+  // phi = atan2(Y, X)      r1 = b - a, r2 = c - b, r3 = d - c
+  //
+  // X = (r1 x r2).(r2 x r3) = (r1.r2)(r2.r3) - (r1.r3)(r2.r2)
+  // Y = |r2| r1.(r2 x r3)
+  //
+  // The derivatives of X and Y with respect to r1, r2 and r3 are simple
+  // polynomials. They are combined using
+  //
+  // dphi = (X dY - Y dX) / (X^2 + Y^2)
+  //
+  // and mapped to the atoms (d/da = -d/dr1, d/db = d/dr1 - d/dr2, ...).
+  //
+  OBAPI double VectorTorsionHessian(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+      const Eigen::Vector3d &d, Eigen::Vector3d grad[4], Eigen::Matrix3d hess[16])
+  {
+    for (unsigned int i = 0; i < 4; ++i)
+      grad[i] = VZero;
+    for (unsigned int i = 0; i < 16; ++i)
+      hess[i] = Eigen::Matrix3d::Zero();
+
+    const Eigen::Vector3d r1 = b - a;
+    const Eigen::Vector3d r2 = c - b;
+    const Eigen::Vector3d r3 = d - c;
+    const double L = r2.norm();
+    if (IsNearZero(L))
+      return 0.0;
+
+    const double r12 = r1.dot(r2), r13 = r1.dot(r3), r22 = r2.dot(r2), r23 = r2.dot(r3);
+    const double T = r1.dot(r2.cross(r3));
+    const double X = r12 * r23 - r13 * r22;
+    const double Y = L * T;
+    const double R = X * X + Y * Y;
+    const double phi = atan2(Y, X);
+    // a-b-c or b-c-d is linear, the derivatives are undefined
+    if (R < 1.0e-12)
+      return phi;
+
+    const Eigen::Matrix3d I = Eigen::Matrix3d::Identity();
+    const Eigen::Matrix3d Z = Eigen::Matrix3d::Zero();
+
+    // first derivatives with respect to r1, r2, r3
+    Eigen::Vector3d X1[3], T1[3], L1[3], Y1[3];
+    X1[0] = r23 * r2 - r22 * r3;
+    X1[1] = r23 * r1 + r12 * r3 - 2.0 * r13 * r2;
+    X1[2] = r12 * r2 - r22 * r1;
+    T1[0] = r2.cross(r3);
+    T1[1] = r3.cross(r1);
+    T1[2] = r1.cross(r2);
+    L1[0] = VZero;
+    L1[1] = r2 / L;
+    L1[2] = VZero;
+    for (unsigned int k = 0; k < 3; ++k)
+      Y1[k] = L * T1[k] + T * L1[k];
+
+    // second derivatives with respect to r1, r2, r3 ([k][l] = d2/drk drl)
+    Eigen::Matrix3d X2[3][3], T2[3][3];
+    X2[0][0] = Z;
+    X2[0][1] = r2 * r3.transpose() + r23 * I - 2.0 * r3 * r2.transpose();
+    X2[0][2] = r2 * r2.transpose() - r22 * I;
+    X2[1][1] = r1 * r3.transpose() + r3 * r1.transpose() - 2.0 * r13 * I;
+    X2[1][2] = r1 * r2.transpose() + r12 * I - 2.0 * r2 * r1.transpose();
+    X2[2][2] = Z;
+    T2[0][0] = T2[1][1] = T2[2][2] = Z;
+    T2[0][1] = -CrossMatrix(r3);
+    T2[0][2] = CrossMatrix(r2);
+    T2[1][2] = -CrossMatrix(r1);
+    for (unsigned int k = 0; k < 3; ++k)
+      for (unsigned int l = 0; l < k; ++l) {
+        X2[k][l] = X2[l][k].transpose();
+        T2[k][l] = T2[l][k].transpose();
+      }
+
+    Eigen::Vector3d G[3];
+    for (unsigned int k = 0; k < 3; ++k)
+      G[k] = (X * Y1[k] - Y * X1[k]) / R;
+
+    Eigen::Matrix3d H[3][3];
+    const Eigen::Matrix3d L2 = (I - (r2 / L) * (r2 / L).transpose()) / L;
+    for (unsigned int k = 0; k < 3; ++k)
+      for (unsigned int l = 0; l < 3; ++l) {
+        Eigen::Matrix3d Y2 = L * T2[k][l] + L1[k] * T1[l].transpose() + T1[k] * L1[l].transpose();
+        if (k == 1 && l == 1)
+          Y2 += T * L2;
+        H[k][l] = (Y1[k] * X1[l].transpose() - X1[k] * Y1[l].transpose() + X * Y2 - Y * X2[k][l]) / R
+            - G[k] * (2.0 * X * X1[l] + 2.0 * Y * Y1[l]).transpose() / R;
+      }
+
+    // d/drk for each atom
+    const double C[4][3] = { {-1.0, 0.0, 0.0}, {1.0, -1.0, 0.0}, {0.0, 1.0, -1.0}, {0.0, 0.0, 1.0} };
+    for (unsigned int p = 0; p < 4; ++p) {
+      for (unsigned int k = 0; k < 3; ++k)
+        if (C[p][k] != 0.0)
+          grad[p] += C[p][k] * G[k];
+      for (unsigned int q = 0; q < 4; ++q)
+        for (unsigned int k = 0; k < 3; ++k)
+          for (unsigned int l = 0; l < 3; ++l)
+            if (C[p][k] != 0.0 && C[q][l] != 0.0)
+              hess[4*p+q] += (C[p][k] * C[q][l]) * H[k][l];
+    }
+
+    return phi;
+  }
+
   OBAPI double VectorOOP(const Eigen::Vector3d &a, const Eigen::Vector3d &b,
       const Eigen::Vector3d &c,const Eigen::Vector3d &d)
   {
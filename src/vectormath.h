@@ -143,6 +143,22 @@ namespace OBFFs {
   OBAPI double VectorOOPDerivative(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c, 
       const Eigen::Vector3d &d, Eigen::Vector3d &Fa, Eigen::Vector3d &Fb, Eigen::Vector3d &Fc, Eigen::Vector3d &Fd);
   
+  /*! Calculate the first and second derivatives of the angle a-b-c.
+   *  \param grad Return value for the derivatives of the angle with respect to a, b and c
+   *  \param hess Return value for the second derivatives, hess[3*i+j] is the block for atoms i and j
+   *  \return The angle abc in radians
+   */
+  OBAPI double VectorAngleHessian(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+      Eigen::Vector3d grad[3], Eigen::Matrix3d hess[9]);
+
+  /*! Calculate the first and second derivatives of the torsion angle a-b-c-d.
+   *  \param grad Return value for the derivatives of the angle with respect to a, b, c and d
+   *  \param hess Return value for the second derivatives, hess[4*i+j] is the block for atoms i and j
+   *  \return The torsion angle for atoms a-b-c-d in radians
+   */
+  OBAPI double VectorTorsionHessian(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+      const Eigen::Vector3d &d, Eigen::Vector3d grad[4], Eigen::Matrix3d hess[16]);
+
   OBAPI void SetTorsion(double *c, int ref[4], double setang, std::vector<int> atoms);
   OBAPI void SetTorsion(double *c, unsigned int ref[4], double setang, std::vector<int> atoms);
  
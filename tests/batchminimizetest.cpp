@@ -0,0 +1,85 @@
+#include <OBBatchMinimize>
+#include "obtest.h"
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+const unsigned int numMols = 5;
+
+std::vector<OBBatchMinimize::Result> minimize(const std::string &input, int threads)
+{
+  OBConversion conv;
+  conv.SetInAndOutFormats("sdf", "sdf");
+
+  OBBatchMinimize batch("GAFF");
+  batch.SetNumThreads(threads);
+  batch.SetBlockSize(2); // more than one block
+  batch.SetConvergence(200);
+
+  std::stringstream iss(input), oss;
+  OB_ASSERT( batch.Run(conv, &iss, &oss) );
+
+  // the output has the same molecules, in the same order
+  OBMol mol;
+  conv.SetInFormat("sdf");
+  for (unsigned int i = 0; i < numMols; ++i) {
+    OB_ASSERT( conv.Read(&mol, i ? 0 : &oss) );
+    OB_ASSERT( mol.GetTitle() == batch.GetResults()[i].title );
+    OB_ASSERT( mol.HasData("OBFF_ENERGY") );
+  }
+
+  return batch.GetResults();
+}
+
+int main()
+{
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInAndOutFormats("pdb", "sdf");
+
+  std::ifstream ifs;
+  ifs.open(TESTDATADIR "acetone.pdb");
+  OB_ASSERT( conv.Read(&mol, &ifs) );
+  ifs.close();
+
+  // multi-record input with slightly different copies of acetone
+  std::stringstream ss;
+  for (unsigned int i = 0; i < numMols; ++i) {
+    OBMol copy(mol);
+    std::stringstream title;
+    title << "acetone " << i;
+    copy.SetTitle(title.str());
+    copy.GetAtom(1)->SetVector(copy.GetAtom(1)->GetVector() + OpenBabel::vector3(0.05 * i, 0.0, 0.0));
+    conv.Write(&copy, &ss);
+  }
+
+  std::vector<OBBatchMinimize::Result> serial = minimize(ss.str(), 1);
+  std::vector<OBBatchMinimize::Result> parallel = minimize(ss.str(), 3);
+
+  OB_ASSERT( serial.size() == numMols );
+  OB_ASSERT( parallel.size() == numMols );
+  for (unsigned int i = 0; i < numMols; ++i) {
+    cout << parallel[i].title << ": " << parallel[i].initialValue << " -> " << parallel[i].value
+         << " (" << parallel[i].steps << " steps)" << endl;
+    OB_ASSERT( parallel[i].index == i );
+    OB_ASSERT( parallel[i].setup );
+    OB_ASSERT( parallel[i].value <= parallel[i].initialValue );
+    // each molecule is minimized by a single thread, the results do not
+    // depend on the number of threads
+    OB_ASSERT( parallel[i].steps == serial[i].steps );
+    OB_ASSERT( fabs(parallel[i].value - serial[i].value) < 1e-8 );
+  }
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <OBFunction>
+#include <OBMinimize>
+#include <OBDynamics>
+#include <OBLogFile>
+#include "obtest.h"
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <cmath>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+int main()
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OB_ASSERT( gaff_factory != 0);
+
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+
+  std::ifstream ifs;
+  ifs.open(TESTDATADIR "acetone.pdb");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+  ifs.close();
+
+  OBFunction *gaff_function = gaff_factory->NewInstance();
+  OB_REQUIRE( gaff_function != 0);
+  gaff_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  OB_REQUIRE( gaff_function->Setup(mol) );
+
+  OBMinimize minimize(gaff_function);
+  minimize.LBFGS(1000, 1e-8);
+  const std::vector<Eigen::Vector3d> minimum = gaff_function->GetPositions();
+
+  const char *names[4] = { "None", "Berendsen", "Langevin", "NoseHoover" };
+  for (int thermostat = OBDynamics::None; thermostat <= OBDynamics::NoseHoover; ++thermostat) {
+    gaff_function->GetPositions() = minimum;
+
+    OBDynamics dynamics(gaff_function);
+    dynamics.SetTimeStep(0.5);
+    dynamics.SetThermostat(static_cast<OBDynamics::Thermostat>(thermostat), 300.0, 50.0);
+    dynamics.Initialize(20000, 300.0);
+    OB_ASSERT( fabs(dynamics.GetTemperature() - 300.0) < 1e-6 );
+
+    // the energy including the thermostat contribution is conserved
+    const double initial = dynamics.GetConservedEnergy();
+    double maxDeviation = 0.0, sumT = 0.0;
+    int numT = 0;
+    while (dynamics.TakeNSteps(10)) {
+      maxDeviation = std::max(maxDeviation, fabs(dynamics.GetConservedEnergy() - initial));
+      if (dynamics.GetCurrentStep() > 5000) {
+        sumT += dynamics.GetTemperature();
+        numT++;
+      }
+    }
+    OB_ASSERT( dynamics.GetCurrentStep() == 20000 );
+
+    const double averageT = sumT / numT;
+    cout << names[thermostat] << ": max deviation = " << maxDeviation << ", <T> = " << averageT << endl;
+    OB_ASSERT( maxDeviation < 0.5 );
+    if (thermostat != OBDynamics::None)
+      OB_ASSERT( fabs(averageT - 300.0) < 30.0 );
+  }
+
+  // r-RESPA: the pair terms every 4th time step
+  gaff_function->GetPositions() = minimum;
+  OBDynamics respa(gaff_function);
+  respa.SetTimeStep(0.5);
+  respa.SetRESPA(4);
+  respa.Initialize(2500, 300.0);
+  const double initial = respa.GetConservedEnergy();
+  double maxDeviation = 0.0;
+  while (respa.TakeNSteps(10))
+    maxDeviation = std::max(maxDeviation, fabs(respa.GetConservedEnergy() - initial));
+  cout << "RESPA: max deviation = " << maxDeviation << endl;
+  OB_ASSERT( fabs(respa.GetTime() - 5000.0) < 1e-6 );
+  OB_ASSERT( maxDeviation < 1.0 );
+
+  // the forces after a step are the total forces
+  const std::vector<Eigen::Vector3d> forces = gaff_function->GetGradients();
+  gaff_function->Compute(OBFunction::Gradients);
+  for (unsigned int i = 0; i < forces.size(); ++i)
+    OB_ASSERT( (forces[i] - gaff_function->GetGradients()[i]).norm() < 1e-8 );
+
+  delete gaff_function;
+
+  return 0;
+}
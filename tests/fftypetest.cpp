@@ -0,0 +1,138 @@
+#include <OBFFType>
+#include "obtest.h"
+
+#include <openbabel/mol.h>
+
+#include <vector>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBAtom;
+using OpenBabel::OBAtomAtomIter;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+// OBFFType with the same type for all atoms, only the relations are tested
+class TestType : public OBFFType
+{
+  protected:
+    bool SetTypes(const OBMol &mol)
+    {
+      m_atoms.assign(mol.NumAtoms(), "c");
+      return true;
+    }
+    std::string MakeBondName(const OBMol &mol, unsigned int iA, unsigned int iB)
+    {
+      return "c-c";
+    }
+    std::string MakeAngleName(const OBMol &mol, unsigned int iA, unsigned int iB, unsigned int iC)
+    {
+      return "c-c-c";
+    }
+    std::string MakeStrBndName(const OBMol &mol, unsigned int iA, unsigned int iB, unsigned int iC)
+    {
+      return "c-c-c";
+    }
+    std::string MakeTorsionName(const OBMol &mol, unsigned int iA, unsigned int iB, unsigned int iC, unsigned int iD)
+    {
+      return "c-c-c-c";
+    }
+    std::string MakeOOPName(const OBMol &mol, unsigned int iA, unsigned int iB, unsigned int iC, unsigned int iD)
+    {
+      return "c-c-c-c";
+    }
+};
+
+// Ethylcyclopentane (atoms 1-7) and a separate cyclobutane (atoms 8-11)
+void makeMolecule(OBMol &mol)
+{
+  for (unsigned int i = 0; i < 11; ++i)
+    mol.NewAtom()->SetAtomicNum(6);
+  const int bonds[][2] = { {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 1}, {1, 6}, {6, 7},
+                           {8, 9}, {9, 10}, {10, 11}, {11, 8} };
+  for (unsigned int i = 0; i < sizeof(bonds) / sizeof(bonds[0]); ++i)
+    mol.AddBond(bonds[i][0], bonds[i][1], 1);
+}
+
+// Reference relation flags from the paths a-b, a-b-c and a-b-c-d with
+// distinct atoms
+unsigned int findRelation(OBMol &mol, unsigned int iA, unsigned int iD)
+{
+  OBAtom *a = mol.GetAtom(iA + 1);
+  OBAtom *target = mol.GetAtom(iD + 1);
+  unsigned int relation = 0;
+  for (OBAtomAtomIter b(a); b; ++b) {
+    if (&*b == target)
+      relation |= OBFFType::OneTwo;
+    for (OBAtomAtomIter c(&*b); c; ++c) {
+      if (&*c == a)
+        continue;
+      if (&*c == target)
+        relation |= OBFFType::OneThree;
+      for (OBAtomAtomIter d(&*c); d; ++d) {
+        if (&*d == a || &*d == &*b)
+          continue;
+        if (&*d == target)
+          relation |= OBFFType::OneFour;
+      }
+    }
+  }
+  return relation;
+}
+
+int main()
+{
+  OBMol mol;
+  makeMolecule(mol);
+
+  TestType type;
+  OB_REQUIRE( type.Setup(mol) );
+
+  const unsigned int numAtoms = mol.NumAtoms();
+  const std::vector<unsigned int> &offsets = type.GetExclusionOffsets();
+  const std::vector<unsigned int> &atoms = type.GetExclusionAtoms();
+  const std::vector<unsigned char> &flags = type.GetExclusionFlags();
+  OB_REQUIRE( offsets.size() == numAtoms + 1 );
+  OB_REQUIRE( offsets.back() == atoms.size() );
+  OB_REQUIRE( flags.size() == atoms.size() );
+
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    // the lists are sorted without duplicates
+    for (unsigned int k = offsets[i] + 1; k < offsets[i+1]; ++k)
+      OB_ASSERT( atoms[k-1] < atoms[k] );
+
+    unsigned int numRelated = 0;
+    for (unsigned int j = 0; j < numAtoms; ++j) {
+      const unsigned int relation = type.GetRelation(i, j);
+      OB_ASSERT( relation == findRelation(mol, i, j) );
+      OB_ASSERT( relation == type.GetRelation(j, i) );
+      OB_ASSERT( type.IsConnected(i, j) == mol.GetAtom(i + 1)->IsConnected(mol.GetAtom(j + 1)) );
+      OB_ASSERT( type.IsConnected(i, j) == ((relation & OBFFType::OneTwo) != 0) );
+      OB_ASSERT( type.IsOneThree(i, j) == ((relation & OBFFType::OneThree) != 0) );
+      OB_ASSERT( type.IsOneFour(i, j) == ((relation & OBFFType::OneFour) != 0) );
+      if (relation)
+        numRelated++;
+    }
+    // the CSR list contains exactly the related atoms
+    OB_ASSERT( offsets[i+1] - offsets[i] == numRelated );
+    for (unsigned int k = offsets[i]; k < offsets[i+1]; ++k)
+      OB_ASSERT( flags[k] == type.GetRelation(i, atoms[k]) );
+  }
+
+  // 5-ring: 1-3 in one direction and 1-4 in the other
+  OB_ASSERT( type.GetRelation(0, 2) == (OBFFType::OneThree | OBFFType::OneFour) );
+  OB_ASSERT( type.GetRelation(0, 1) == OBFFType::OneTwo );
+  // side chain
+  OB_ASSERT( type.GetRelation(6, 0) == OBFFType::OneThree );
+  OB_ASSERT( type.GetRelation(6, 1) == OBFFType::OneFour );
+  OB_ASSERT( type.GetRelation(6, 2) == 0 );
+  // 4-ring: bonded atoms are also 1-4, the opposite atoms are 1-3 twice
+  OB_ASSERT( type.GetRelation(7, 8) == (OBFFType::OneTwo | OBFFType::OneFour) );
+  OB_ASSERT( type.GetRelation(7, 9) == OBFFType::OneThree );
+  // no relations between the fragments or for out of range atoms
+  OB_ASSERT( type.GetRelation(0, 7) == 0 );
+  OB_ASSERT( type.GetRelation(numAtoms, 0) == 0 );
+
+  return 0;
+}
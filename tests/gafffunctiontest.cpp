@@ -1,11 +1,16 @@
 #include <OBFunction>
 #include <OBLogFile>
+#include <OBNbrList>
 #include "obtest.h"
 #include <GAFF>
 
 #include <openbabel/mol.h>
 #include <openbabel/obconversion.h>
 
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
 using OpenBabel::OBMol;
 using OpenBabel::OBConversion;
 
@@ -13,6 +18,152 @@ using namespace OpenBabel::OBFFs;
 
 using namespace std;
 
+// Compare the value and gradients of GAFF with @p options and @p reference,
+// if @p soa is true the SoA arrays are enabled for @p options
+void compare(OBMol &mol, const std::string &options, const std::string &reference, bool soa = false)
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OBFunction *function = gaff_factory->NewInstance();
+  OBFunction *reference_function = gaff_factory->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  reference_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetOptions(options);
+  reference_function->SetOptions(reference);
+  OB_REQUIRE( function->Setup(mol) );
+  OB_REQUIRE( reference_function->Setup(mol) );
+  if (soa) {
+    function->SetSoAEnabled(true);
+    OB_ASSERT( function->IsSoAEnabled() );
+  }
+
+  function->Compute();
+  reference_function->Compute();
+  const double scale = std::max(1.0, fabs(reference_function->GetValue()));
+  OB_ASSERT( fabs(function->GetValue() - reference_function->GetValue()) < 1e-10 * scale );
+
+  function->Compute(OBFunction::Gradients);
+  reference_function->Compute(OBFunction::Gradients);
+  OB_ASSERT( fabs(function->GetValue() - reference_function->GetValue()) < 1e-10 * scale );
+  for (unsigned int i = 0; i < function->NumParticles(); ++i)
+    OB_ASSERT( (function->GetGradients()[i] - reference_function->GetGradients()[i]).norm() < 1e-8 );
+
+  delete function;
+  delete reference_function;
+}
+
+// Move the atoms one at a time and compare ComputeIncremental() with a full
+// Compute() after each move, if @p soa is true the SoA arrays are enabled
+void compareIncremental(OBMol &mol, const std::string &options, bool soa = false)
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OBFunction *function = gaff_factory->NewInstance();
+  OBFunction *reference_function = gaff_factory->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  reference_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetOptions(options);
+  reference_function->SetOptions(options);
+  OB_REQUIRE( function->Setup(mol) );
+  OB_REQUIRE( reference_function->Setup(mol) );
+  if (soa) {
+    function->SetSoAEnabled(true);
+    OB_ASSERT( function->IsSoAEnabled() );
+  }
+
+  OBNbrList *nbrList = function->GetNbrList();
+  const unsigned int builds = nbrList ? nbrList->GetBuildCount() : 0;
+  std::vector<unsigned int> moved(1, 0);
+  function->ComputeIncremental(moved);
+  for (unsigned int k = 0; k < 2 * function->NumParticles(); ++k) {
+    const unsigned int i = k % function->NumParticles();
+    moved[0] = i;
+    // larger than half the skin, the neighbor list is rebuilt
+    function->GetPositions()[i] += Eigen::Vector3d(0.3 * (1 - 2 * (k % 2)), -0.2, 0.1 * (i % 3));
+    function->ComputeIncremental(moved);
+    reference_function->GetPositions() = function->GetPositions();
+    reference_function->Compute();
+    const double scale = std::max(1.0, fabs(reference_function->GetValue()));
+    OB_ASSERT( fabs(function->GetValue() - reference_function->GetValue()) < 1e-8 * scale );
+  }
+  if (nbrList)
+    OB_ASSERT( nbrList->GetBuildCount() > builds + 1 );
+
+  delete function;
+  delete reference_function;
+}
+
+// Move atoms into a clash with another atom and back many times, the
+// incremental value has to match a full Compute() afterwards (the clash
+// values are much larger than the total, a running sum would drift)
+void compareIncrementalDrift(OBMol &mol, const std::string &options)
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OBFunction *function = gaff_factory->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetOptions(options);
+  OB_REQUIRE( function->Setup(mol) );
+
+  const unsigned int numParticles = function->NumParticles();
+  std::vector<unsigned int> moved(1, 0);
+  function->ComputeIncremental(moved);
+  for (unsigned int k = 0; k < 5000; ++k) {
+    const unsigned int i = k % numParticles;
+    const unsigned int j = (k / numParticles + i + 1) % numParticles;
+    moved[0] = i;
+    const Eigen::Vector3d position = function->GetPositions()[i];
+    function->GetPositions()[i] = function->GetPositions()[j] + Eigen::Vector3d(0.3 + 0.01 * (k % 7), 0.0, 0.0);
+    function->ComputeIncremental(moved);
+    function->GetPositions()[i] = position + Eigen::Vector3d(0.001 * (int(k % 3) - 1), 0.0, 0.0);
+    function->ComputeIncremental(moved);
+  }
+  const double incremental = function->GetValue();
+  function->Compute();
+  const double scale = std::max(1.0, fabs(function->GetValue()));
+  OB_ASSERT( fabs(incremental - function->GetValue()) < 1e-12 * scale );
+
+  delete function;
+}
+
+// Compare ComputeBatch() for 3 conformers with a Compute() for each of them
+void compareBatch(OBMol &mol, const std::string &options)
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OBFunction *function = gaff_factory->NewInstance();
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  function->SetOptions(options);
+  OB_REQUIRE( function->Setup(mol) );
+
+  const std::vector<Eigen::Vector3d> original = function->GetPositions();
+  std::vector<Eigen::Vector3d> conformers;
+  for (unsigned int k = 0; k < 3; ++k)
+    for (unsigned int i = 0; i < original.size(); ++i)
+      conformers.push_back(original[i] + Eigen::Vector3d(0.02 * k * (i % 3), -0.03 * k * (i % 2), 0.01 * k));
+  std::vector<double> batchValues;
+  std::vector<Eigen::Vector3d> batchGradients;
+  function->ComputeBatch(conformers, batchValues, &batchGradients);
+  OB_REQUIRE( batchValues.size() == 3 );
+  for (unsigned int k = 0; k < 3; ++k) {
+    std::copy(conformers.begin() + k * original.size(), conformers.begin() + (k + 1) * original.size(),
+        function->GetPositions().begin());
+    function->Compute(OBFunction::Gradients);
+    const double scale = std::max(1.0, fabs(function->GetValue()));
+    OB_ASSERT( fabs(function->GetValue() - batchValues[k]) < 1e-10 * scale );
+    for (unsigned int i = 0; i < original.size(); ++i)
+      OB_ASSERT( (function->GetGradients()[i] - batchGradients[k * original.size() + i]).norm() < 1e-8 );
+  }
+
+  delete function;
+}
+
+// The non-bonded options for all pairs and each cut-off mode, the cut-offs
+// are shorter than the largest distance in acetone
+const unsigned int numNonBonded = 4;
+const char *nonBonded[numNonBonded] = {
+  "vdwterm = allpair\nelectroterm = allpair\n",
+  "vdwterm = rvdw\nrvdw = 3.0\nrvdwswitch = 2.0\nelectroterm = rele\nrele = 3.5\neledamping = shiftedforce\n",
+  "vdwterm = rvdw\nrvdw = 3.0\nrvdwswitch = 3.0\nelectroterm = rele\nrele = 2.5\neledamping = reactionfield\n",
+  "vdwterm = allpair\nelectroterm = rele\nrele = 3.0\neledamping = reactionfield\nepsilonrf = 4.0\n"
+};
+
 
 int main()
 {
@@ -57,5 +208,98 @@ int main()
   ss << "vdwterm = allpair";
   gaff_function->SetOptions(ss.str());
 
+  // the threaded computation should give the same energy & gradients
+  gaff_function->Setup(mol);
+  gaff_function->Compute(OBFunction::Gradients);
+  const double energy = gaff_function->GetValue();
+  const std::vector<Eigen::Vector3d> gradients = gaff_function->GetGradients();
+
+  gaff_function->SetOptions("threads = 4");
+  OB_ASSERT( gaff_function->GetNumThreads() == 4 );
+  gaff_function->Setup(mol);
+  gaff_function->Compute(OBFunction::Gradients);
+  OB_ASSERT( fabs(gaff_function->GetValue() - energy) < 1e-8 );
+  for (unsigned int i = 0; i < gradients.size(); ++i)
+    OB_ASSERT( (gaff_function->GetGradients()[i] - gradients[i]).norm() < 1e-8 );
+
+  // batch computation for 3 conformers
+  const std::vector<Eigen::Vector3d> original = gaff_function->GetPositions();
+  std::vector<Eigen::Vector3d> conformers;
+  for (unsigned int k = 0; k < 3; ++k)
+    for (unsigned int i = 0; i < original.size(); ++i)
+      conformers.push_back(original[i] + Eigen::Vector3d(0.02 * k * (i % 3), -0.03 * k * (i % 2), 0.01 * k));
+  std::vector<double> batchValues;
+  std::vector<Eigen::Vector3d> batchGradients;
+  gaff_function->ComputeBatch(conformers, batchValues, &batchGradients);
+  OB_ASSERT( batchValues.size() == 3 );
+  OB_ASSERT( batchGradients.size() == conformers.size() );
+  for (unsigned int k = 0; k < 3; ++k) {
+    std::copy(conformers.begin() + k * original.size(), conformers.begin() + (k + 1) * original.size(),
+        gaff_function->GetPositions().begin());
+    gaff_function->Compute(OBFunction::Gradients);
+    OB_ASSERT( fabs(gaff_function->GetValue() - batchValues[k]) < 1e-8 );
+    for (unsigned int i = 0; i < original.size(); ++i)
+      OB_ASSERT( (gaff_function->GetGradients()[i] - batchGradients[k * original.size() + i]).norm() < 1e-8 );
+  }
+  gaff_function->GetPositions() = original;
+
+  // incremental computation after moving one atom at a time
+  std::vector<unsigned int> moved(1, 0);
+  gaff_function->ComputeIncremental(moved);
+  for (unsigned int i = 0; i < original.size(); ++i) {
+    moved[0] = i;
+    gaff_function->GetPositions()[i] += Eigen::Vector3d(0.05, -0.03, 0.02 * (i % 3));
+    gaff_function->ComputeIncremental(moved);
+  }
+  const double incremental = gaff_function->GetValue();
+  gaff_function->Compute();
+  OB_ASSERT( fabs(gaff_function->GetValue() - incremental) < 1e-8 );
+  gaff_function->GetPositions() = original;
+
+  delete gaff_function;
+
+  OBMol acetone;
+  std::ifstream pdb;
+  pdb.open(TESTDATADIR "acetone.pdb");
+  conv.SetInFormat("pdb");
+  OB_REQUIRE( conv.Read(&acetone, &pdb) );
+  pdb.close();
+
+  // the fused term gives the same value and gradients as the separate terms,
+  // with the scalar pair loop and the SIMD kernels (if supported), threaded,
+  // for a batch of conformers and incrementally
+  for (unsigned int n = 0; n < numNonBonded; ++n) {
+    const std::string fused = std::string(nonBonded[n]) + "nonbonded = fused\n";
+    const std::string separate = std::string(nonBonded[n]) + "nonbonded = separate\nsimd = none\n";
+    compare(acetone, fused, separate);
+    compare(acetone, fused + "simd = none\n", separate);
+    compare(acetone, fused + "simd = none\n", separate, true);
+    compare(acetone, fused + "threads = 4\n", separate);
+    compare(acetone, fused + "simd = none\nthreads = 4\n", separate);
+    compareBatch(acetone, fused + "simd = none\n");
+    compareBatch(acetone, fused + "threads = 4\n");
+    compareIncremental(acetone, fused + "skin = 0.1\nsimd = none\n");
+    compareIncremental(acetone, fused + "skin = 0.1\n");
+  }
+
+  // the SoA copies give the same value and gradients, with the terms using
+  // the AoS positions and with the SIMD kernels (if supported)
+  for (unsigned int n = 0; n < numNonBonded; ++n) {
+    compare(acetone, std::string(nonBonded[n]) + "simd = none\n",
+        std::string(nonBonded[n]) + "simd = none\n", true);
+    compare(acetone, std::string(nonBonded[n]) + "simd = auto\n",
+        std::string(nonBonded[n]) + "simd = none\n");
+  }
+
+  // incremental computation with the cut-offs and a small skin (the
+  // neighbor list is rebuilt), with and without the SoA arrays
+  for (unsigned int n = 0; n < numNonBonded; ++n) {
+    compareIncremental(acetone, std::string(nonBonded[n]) + "skin = 0.1\nsimd = none\n");
+    compareIncremental(acetone, std::string(nonBonded[n]) + "skin = 0.1\nsimd = none\n", true);
+    compareIncremental(acetone, std::string(nonBonded[n]) + "skin = 0.1\nsimd = auto\n");
+  }
 
+  // no drift of the incremental value after many large changes
+  compareIncrementalDrift(acetone, std::string(nonBonded[0]) + "simd = none\n");
+  compareIncrementalDrift(acetone, std::string(nonBonded[0]) + "nonbonded = fused\nsimd = none\n");
 }
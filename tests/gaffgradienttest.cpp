@@ -1,4 +1,5 @@
 #include <OBFunction>
+#include <OBFunctionTerm>
 #include <OBLogFile>
 #include "obtest.h"
 #include <GAFF>
@@ -39,6 +40,57 @@ Eigen::Vector3d ValidateGradientError(const Eigen::Vector3d &numgrad, const Eige
   return Eigen::Vector3d(errx, erry, errz);
 }
 
+// Put every term in its own group so ValidateGradients() can check the terms
+// separately. The separate group gradients have to add up to the total.
+void ValidateTermGradients(OBFunction *function)
+{
+  const std::vector<OBFunctionTerm*> &terms = function->GetTerms();
+  for (unsigned int t = 0; t < terms.size(); ++t)
+    terms[t]->SetGroup(1u << t);
+
+  function->Compute(OBFunction::Gradients);
+  const std::vector<Eigen::Vector3d> total = function->GetGradients();
+  const double value = function->GetValue();
+
+  function->ComputeGroups(OBFunction::Gradients, TermGroup::All, true);
+  OB_ASSERT( fabs(function->GetGroupValue(TermGroup::All) - value) < 1e-8 );
+  for (unsigned int i = 0; i < total.size(); ++i) {
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    for (unsigned int t = 0; t < terms.size(); ++t)
+      sum += function->GetGroupGradients(1u << t)[i];
+    OB_ASSERT( (sum - total[i]).norm() < 1e-8 );
+    OB_ASSERT( (function->GetGradients()[i] - total[i]).norm() < 1e-8 );
+  }
+
+  // all terms are also in a shared group, they are still computed once and
+  // the shared buffer contains all gradients
+  const unsigned int shared = 1u << 30;
+  OB_REQUIRE( terms.size() < 30 );
+  for (unsigned int t = 0; t < terms.size(); ++t)
+    terms[t]->SetGroup((1u << t) | shared);
+  function->ComputeGroups(OBFunction::Gradients, TermGroup::All, true);
+  OB_ASSERT( fabs(function->GetGroupValue(TermGroup::All) - value) < 1e-8 );
+  OB_ASSERT( fabs(function->GetGroupValue(shared) - value) < 1e-8 );
+  for (unsigned int i = 0; i < total.size(); ++i) {
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    for (unsigned int t = 0; t < terms.size(); ++t)
+      sum += function->GetGroupGradients(1u << t)[i];
+    OB_ASSERT( (sum - total[i]).norm() < 1e-8 );
+    OB_ASSERT( (function->GetGroupGradients(shared)[i] - total[i]).norm() < 1e-8 );
+    OB_ASSERT( (function->GetGradients()[i] - total[i]).norm() < 1e-8 );
+  }
+
+  // only the shared group
+  function->ComputeGroups(OBFunction::Gradients, shared, true);
+  for (unsigned int i = 0; i < total.size(); ++i) {
+    OB_ASSERT( (function->GetGroupGradients(shared)[i] - total[i]).norm() < 1e-8 );
+    OB_ASSERT( (function->GetGradients()[i] - total[i]).norm() < 1e-8 );
+  }
+
+  for (unsigned int t = 0; t < terms.size(); ++t)
+    terms[t]->SetGroup(1u << t);
+}
+
 bool ValidateGradients(OBFunction *function)
 {
   Eigen::Vector3d numgrad, anagrad, err;
@@ -68,99 +120,22 @@ bool ValidateGradients(OBFunction *function)
         anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
     cout << _logbuf;
 
-    /*
-    // OBFF_EBOND
-    numgrad = NumericalDerivative(&*a, OBFF_EBOND);
-    ClearGradients();
-    E_Bond(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    bond    (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-      passed = false;
-
-    // OBFF_EANGLE
-    numgrad = NumericalDerivative(&*a, OBFF_EANGLE);
-    ClearGradients();
-    E_Angle(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    angle   (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-      passed = false;
-
-    // OBFF_ESTRBND
-    numgrad = NumericalDerivative(&*a, OBFF_ESTRBND);
-    ClearGradients();
-    E_StrBnd(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    strbnd  (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-      passed = false;
-
-    // OBFF_ETORSION
-    numgrad = NumericalDerivative(&*a, OBFF_ETORSION);
-    ClearGradients();
-    E_Torsion(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    torsion (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-      passed = false;
-
-    // OBFF_EOOP
-    numgrad = NumericalDerivative(&*a, OBFF_EOOP);
-    ClearGradients();
-    E_OOP(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    oop     (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    // disable OOP gradient validation for now -- some small errors, but nothing major
-    //      if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-    //        passed = false;
-
-    // OBFF_EVDW
-    numgrad = NumericalDerivative(&*a, OBFF_EVDW);
-    ClearGradients();
-    E_VDW(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    vdw     (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-      passed = false;
-
-    // OBFF_EELECTROSTATIC
-    numgrad = NumericalDerivative(&*a, OBFF_EELECTROSTATIC);
-    ClearGradients();
-    E_Electrostatic(); // compute
-    anagrad.Set(_gradientPtr[coordIdx], _gradientPtr[coordIdx+1], _gradientPtr[coordIdx+2]);
-    err = ValidateGradientError(numgrad, anagrad);
-
-    snprintf(_logbuf, BUFF_SIZE, "    electro (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n", numgrad.x(), numgrad.y(), numgrad.z(), 
-        anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
-    OBFFLog(_logbuf);
-    if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
-      passed = false;
-    */
+    // each term on its own (see ValidateTermGradients())
+    const std::vector<OBFunctionTerm*> &terms = function->GetTerms();
+    for (unsigned int t = 0; t < terms.size(); ++t) {
+      const unsigned int group = terms[t]->GetGroup();
+      numgrad = function->NumericalDerivative(i, group);
+      function->ComputeGroups(OBFunction::Gradients, group);
+      anagrad = function->GetGradients()[i];
+      err = ValidateGradientError(numgrad, anagrad);
+
+      snprintf(_logbuf, 1000, "    %-8.8s (%7.3f, %7.3f, %7.3f)  (%7.3f, %7.3f, %7.3f)  (%5.2f, %5.2f, %5.2f)\n",
+          terms[t]->GetName().c_str(), numgrad.x(), numgrad.y(), numgrad.z(),
+          anagrad.x(), anagrad.y(), anagrad.z(), err.x(), err.y(), err.z());
+      cout << _logbuf;
+      if (err.x() > 5.0 || err.y() > 5.0 || err.z() > 5.0)
+        passed = false;
+    }
   }
 
   return passed; // did we pass every single component?
@@ -188,10 +163,10 @@ int main()
 
   std::ifstream ifs;
   //ifs.open("hexane.xyz");
-  string filename = string(TESTDATADIR) + string("aceton.pdb");
+  string filename = string(TESTDATADIR) + string("acetone.pdb");
   ifs.open(filename.c_str());
   if (!ifs) {
-    cout << "could not open aceton.pdb" << endl;
+    cout << "could not open acetone.pdb" << endl;
     return -1;
   }
   conv.Read(&mol, &ifs);
@@ -218,6 +193,7 @@ int main()
   
   gaff_function->Setup(mol);
 
+  ValidateTermGradients(gaff_function);
   ValidateGradients(gaff_function);
 
   gaff_function->Compute();
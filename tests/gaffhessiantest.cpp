@@ -0,0 +1,262 @@
+#include <OBFunction>
+#include <OBFunctionTerm>
+#include <OBHessian>
+#include <OBLogFile>
+#include <OBMinimize>
+#include "obtest.h"
+#include "mockfunction.h"
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+// Compare the analytical Hessian with central differences of the gradients
+void ValidateHessian(OBFunction *function)
+{
+  OBHessian hessian;
+  function->Compute(OBFunction::Gradients);
+  OB_ASSERT( function->HasAnalyticalHessian() );
+  OB_ASSERT( function->ComputeHessian(hessian) );
+  OB_ASSERT( hessian.NumParticles() == function->NumParticles() );
+
+  const unsigned int numAtoms = function->NumParticles();
+  const double h = 1.0e-5;
+  std::vector<Eigen::Vector3d> &positions = function->GetPositions();
+  double maxError = 0.0, maxValue = 0.0;
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    for (unsigned int k = 0; k < 3; ++k) {
+      const Eigen::Vector3d orig = positions[i];
+      positions[i][k] = orig[k] + h;
+      function->Compute(OBFunction::Gradients);
+      const std::vector<Eigen::Vector3d> plus = function->GetGradients();
+      positions[i][k] = orig[k] - h;
+      function->Compute(OBFunction::Gradients);
+      const std::vector<Eigen::Vector3d> minus = function->GetGradients();
+      positions[i] = orig;
+
+      // the gradients are forces
+      for (unsigned int j = 0; j < numAtoms; ++j)
+        for (unsigned int l = 0; l < 3; ++l) {
+          const double numerical = -(plus[j][l] - minus[j][l]) / (2.0 * h);
+          const double analytical = hessian.GetBlock(j, i)(l, k);
+          maxError = std::max(maxError, fabs(numerical - analytical));
+          maxValue = std::max(maxValue, fabs(analytical));
+        }
+    }
+
+  cout << "max |H| = " << maxValue << ", max error = " << maxError << endl;
+  OB_ASSERT( maxError < 1.0e-4 * maxValue );
+
+  // the Hessian-vector product uses the same Hessian
+  function->Compute(OBFunction::Gradients);
+  std::vector<Eigen::Vector3d> v(numAtoms), Hv, Hv2;
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    v[i] = Eigen::Vector3d(sin(i + 1.0), cos(i + 2.0), sin(i + 3.0));
+  function->ComputeHessianVectorProduct(v, Hv);
+  hessian.Multiply(v, Hv2);
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    OB_ASSERT( (Hv[i] - Hv2[i]).norm() < 1.0e-8 * maxValue );
+}
+
+// Wraps a function, without terms ComputeHessianVectorProduct() uses finite
+// differences of the gradients instead of the sparse Hessian
+class FiniteDifferenceFunction : public MockFunction
+{
+  public:
+    FiniteDifferenceFunction(OBFunction *function) : MockFunction(function->NumParticles()), m_function(function)
+    {
+      m_positions = function->GetPositions();
+      GetLogFile()->SetLogLevel(OBLogFile::None);
+    }
+    void Compute(Computation computation = Value)
+    {
+      m_function->GetPositions() = m_positions;
+      m_function->Compute(computation);
+      if (computation == Gradients)
+        m_gradients = m_function->GetGradients();
+    }
+    double GetValue() const
+    {
+      return m_function->GetValue();
+    }
+    bool HasAnalyticalGradients() const
+    {
+      return true;
+    }
+  private:
+    OBFunction *m_function;
+};
+
+// Truncated Newton with the analytical Hessian-vector products and with
+// finite differences from a perturbed structure
+void TestTruncatedNewton(OBFunction *function)
+{
+  std::vector<Eigen::Vector3d> &positions = function->GetPositions();
+  const std::vector<Eigen::Vector3d> original = positions;
+  const unsigned int numAtoms = function->NumParticles();
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    positions[i] += 0.05 * Eigen::Vector3d(sin(i + 1.0), cos(i + 2.0), sin(2.0 * i + 3.0));
+  const std::vector<Eigen::Vector3d> perturbed = positions;
+
+  FiniteDifferenceFunction proxy(function);
+  OB_ASSERT( function->HasAnalyticalHessian() );
+  OB_ASSERT( !proxy.HasAnalyticalHessian() );
+
+  // both paths give the same products (up to the forward difference error)
+  function->Compute(OBFunction::Gradients);
+  proxy.Compute(OBFunction::Gradients);
+  std::vector<Eigen::Vector3d> v(numAtoms), Hv, Hv2;
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    v[i] = Eigen::Vector3d(cos(i + 1.0), sin(i + 2.0), cos(i + 3.0));
+  function->ComputeHessianVectorProduct(v, Hv);
+  proxy.ComputeHessianVectorProduct(v, Hv2);
+  double maxValue = 0.0, maxError = 0.0;
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    maxValue = std::max(maxValue, Hv[i].norm());
+    maxError = std::max(maxError, (Hv[i] - Hv2[i]).norm());
+  }
+  OB_ASSERT( maxError < 1.0e-3 * maxValue );
+  OB_ASSERT( (proxy.GetPositions()[0] - perturbed[0]).norm() == 0.0 );
+
+  // both converge to the same minimum
+  double energies[2];
+  std::vector<Eigen::Vector3d> minima[2];
+  for (int fd = 0; fd < 2; ++fd) {
+    OBFunction *minimized = fd ? static_cast<OBFunction*>(&proxy) : function;
+    minimized->GetPositions() = perturbed;
+    OBMinimize minimize(minimized);
+    minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+    minimize.SetGradientConvergence(1.0e-4, 1.0e-4);
+    minimize.TruncatedNewton(200);
+    cout << "truncated Newton (" << (fd ? "finite differences" : "analytical") << "): "
+         << minimize.GetCurrentStep() << " steps, E = " << minimized->GetValue() << endl;
+    OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+    OB_ASSERT( minimize.GetMaxGradient() < 1.0e-4 );
+    energies[fd] = minimized->GetValue();
+    minima[fd] = minimized->GetPositions();
+  }
+  // the methyl rotations are soft, the positions only agree roughly
+  OB_ASSERT( fabs(energies[0] - energies[1]) < 1.0e-5 * std::max(1.0, fabs(energies[0])) );
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    OB_ASSERT( (minima[0][i] - minima[1][i]).norm() < 1.0e-2 );
+
+  positions = original;
+}
+
+// E = |x_0 - c|^2, a term without analytical second derivatives which
+// counts its Compute() calls
+class RestraintTerm : public OBFunctionTerm
+{
+  public:
+    RestraintTerm(OBFunction *function) : OBFunctionTerm(function), m_value(0.0), m_numComputes(0)
+    {
+      m_center = function->GetPositions()[0] + Eigen::Vector3d(0.1, -0.2, 0.3);
+    }
+    std::string GetName() const { return "Restraint"; }
+    bool Setup() { return true; }
+    void Compute(OBFunction::Computation computation = OBFunction::Value)
+    {
+      const Eigen::Vector3d delta = m_function->GetPositions()[0] - m_center;
+      m_value = delta.squaredNorm();
+      if (computation == OBFunction::Gradients)
+        m_function->GetGradients()[0] -= 2.0 * delta;
+      ++m_numComputes;
+    }
+    double GetValue() const { return m_value; }
+    void SetValue(double value) { m_value = value; }
+    unsigned int GetNumComputes() const { return m_numComputes; }
+  private:
+    Eigen::Vector3d m_center;
+    double m_value;
+    unsigned int m_numComputes;
+};
+
+// The finite difference Hessian-vector product restores the value and the
+// term values of the function (the function is changed)
+void TestHessianVectorProductValues(OBFunction *function)
+{
+  const unsigned int numAtoms = function->NumParticles();
+  std::vector<Eigen::Vector3d> v(numAtoms), Hv;
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    v[i] = Eigen::Vector3d(sin(i + 2.0), cos(i + 1.0), sin(i + 4.0));
+
+  // a function without terms is computed again
+  FiniteDifferenceFunction proxy(function);
+  proxy.Compute(OBFunction::Gradients);
+  double value = proxy.GetValue();
+  proxy.ComputeHessianVectorProduct(v, Hv);
+  OB_ASSERT( fabs(proxy.GetValue() - value) < 1.0e-12 * std::max(1.0, fabs(value)) );
+
+  // the term values are set back without computing them again
+  RestraintTerm *restraint = new RestraintTerm(function);
+  function->AddTerm(restraint);
+  OB_ASSERT( !function->HasAnalyticalHessian() );
+  function->Compute(OBFunction::Gradients);
+  value = function->GetValue();
+  const std::vector<Eigen::Vector3d> gradients = function->GetGradients();
+  std::vector<double> termValues;
+  for (unsigned int t = 0; t < function->GetTerms().size(); ++t)
+    termValues.push_back(function->GetTerms()[t]->GetValue());
+  const unsigned int numComputes = restraint->GetNumComputes();
+
+  function->ComputeHessianVectorProduct(v, Hv);
+  OB_ASSERT( restraint->GetNumComputes() == numComputes + 1 );
+  OB_ASSERT( function->GetValue() == value );
+  for (unsigned int t = 0; t < function->GetTerms().size(); ++t)
+    OB_ASSERT( function->GetTerms()[t]->GetValue() == termValues[t] );
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    OB_ASSERT( function->GetGradients()[i] == gradients[i] );
+}
+
+int main()
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OB_ASSERT( gaff_factory != 0);
+
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+
+  std::ifstream ifs;
+  ifs.open(TESTDATADIR "acetone.pdb");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+  ifs.close();
+
+  // all pairs and short cut-offs, so some pairs are in the switching region
+  const char *vdwterm[2] = { "allpair", "rvdw" };
+  const char *electroterm[2] = { "allpair", "rele" };
+  for (unsigned int n = 0; n < 2; ++n) {
+    OBFunction *gaff_function = gaff_factory->NewInstance();
+    OB_ASSERT( gaff_function != 0);
+    gaff_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+
+    std::stringstream options;
+    options << "bonded = bond angle torsion oop" << std::endl;
+    options << "vdwterm = " << vdwterm[n] << std::endl;
+    options << "rvdw = 3.5" << std::endl;
+    options << "rvdwswitch = 2.5" << std::endl;
+    options << "electroterm = " << electroterm[n] << std::endl;
+    options << "rele = 3.5" << std::endl;
+    gaff_function->SetOptions(options.str());
+    OB_REQUIRE( gaff_function->Setup(mol) );
+
+    cout << "vdwterm = " << vdwterm[n] << ", electroterm = " << electroterm[n] << endl;
+    ValidateHessian(gaff_function);
+    TestTruncatedNewton(gaff_function);
+    TestHessianVectorProductValues(gaff_function);
+    delete gaff_function;
+  }
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include "obtest.h"
 
 #include "../src/forcefields/gaff/gaffparameter.h"
+#include <OBParameterDBRegistry>
 
 using namespace OpenBabel::OBFFs;
 
@@ -493,6 +494,162 @@ void testTorsionParameters(OBParameterDB *database)
 //   OB_ASSERT( row.at(2).AsDouble() == 0.500 );
 // }
 
+// Linear scan reference for FindRow/FindRows, returns the matching row
+// indexes (in order) and their swapped flags
+void linearScan(OBParameterDBTable *table, const std::vector<OBParameterDBTable::Query> &query,
+    std::vector<unsigned int> &matches, std::vector<bool> &swapped)
+{
+  unsigned int swapCount = 0;
+  for (unsigned int i = 0; i < query.size(); ++i)
+    if (query[i].swap)
+      swapCount++;
+
+  std::vector<OBParameterDBTable::Query> swapped_query = query;
+  for (unsigned int i = 0; i < query.size() && swapCount; ++i) {
+    if (query[i].swap) {
+      if (swapCount == 4) {
+        swapped_query[i  ].column = query[i+3].column;
+        swapped_query[i+1].column = query[i+2].column;
+        swapped_query[i+2].column = query[i+1].column;
+        swapped_query[i+3].column = query[i  ].column;
+      } else {
+        swapped_query[i].column = query[i+swapCount-1].column;
+        swapped_query[i+swapCount-1].column = query[i].column;
+      }
+      break;
+    }
+  }
+
+  const std::vector< std::vector<OBVariant> > &rows = table->GetAllRows();
+  for (unsigned int i = 0; i < rows.size(); ++i) {
+    bool match = true;
+    for (unsigned int j = 0; j < query.size(); ++j)
+      if (rows[i][query[j].column] != query[j].value)
+        match = false;
+    if (match) {
+      matches.push_back(i);
+      swapped.push_back(false);
+    }
+    if (!swapCount)
+      continue;
+    match = true;
+    for (unsigned int j = 0; j < swapped_query.size(); ++j)
+      if (rows[i][swapped_query[j].column] != swapped_query[j].value)
+        match = false;
+    if (match) {
+      matches.push_back(i);
+      swapped.push_back(true);
+    }
+  }
+}
+
+// Compare the indexed FindRow/FindRows with a linear scan
+void compareLookup(OBParameterDBTable *table, const std::vector<OBParameterDBTable::Query> &query)
+{
+  std::vector<unsigned int> matches;
+  std::vector<bool> swapped;
+  linearScan(table, query, matches, swapped);
+  const std::vector< std::vector<OBVariant> > &rows = table->GetAllRows();
+
+  // FindRow returns the first match and its swapped flag
+  bool swappedFlag = false;
+  const std::vector<OBVariant> &row = table->FindRow(query, &swappedFlag);
+  if (matches.empty())
+    OB_ASSERT( row.empty() );
+  else {
+    OB_ASSERT( &row == &rows[matches.front()] );
+    OB_ASSERT( swappedFlag == swapped.front() );
+  }
+
+  // FindRows returns all matches in the same order, the swapped flag is the
+  // flag of the last match
+  swappedFlag = false;
+  std::vector< std::vector<OBVariant> > found = table->FindRows(query, &swappedFlag);
+  OB_REQUIRE( found.size() == matches.size() );
+  for (unsigned int i = 0; i < matches.size(); ++i)
+    OB_ASSERT( found[i] == rows[matches[i]] );
+  if (!matches.empty())
+    OB_ASSERT( swappedFlag == swapped.back() );
+}
+
+// The hash indexes give the same rows as a linear scan for queries built
+// from every row, in the original and in reverse order
+void testIndexedLookup(OBParameterDB *database)
+{
+  std::vector<OBParameterDBTable::Query> query;
+
+  OBParameterDBTable *bonds = database->GetTable("Bond Harmonic");
+  const std::vector< std::vector<OBVariant> > &bondRows = bonds->GetAllRows();
+  for (unsigned int i = 0; i < bondRows.size(); ++i) {
+    // name column
+    query.clear();
+    query.push_back( OBParameterDBTable::Query(0, bondRows[i][0]) );
+    compareLookup(bonds, query);
+    // types, original and reversed
+    query.clear();
+    query.push_back( OBParameterDBTable::Query(1, bondRows[i][1], true) );
+    query.push_back( OBParameterDBTable::Query(2, bondRows[i][2], true) );
+    compareLookup(bonds, query);
+    query.clear();
+    query.push_back( OBParameterDBTable::Query(1, bondRows[i][2], true) );
+    query.push_back( OBParameterDBTable::Query(2, bondRows[i][1], true) );
+    compareLookup(bonds, query);
+    // the non-swapped column is hashed too
+    query.push_back( OBParameterDBTable::Query(3, bondRows[i][3]) );
+    compareLookup(bonds, query);
+  }
+
+  OBParameterDBTable *torsions = database->GetTable("Torsion Harmonic");
+  const std::vector< std::vector<OBVariant> > &torsionRows = torsions->GetAllRows();
+  for (unsigned int i = 0; i < torsionRows.size(); ++i) {
+    // 4 swapped columns, original and reversed
+    query.clear();
+    for (int j = 1; j <= 4; ++j)
+      query.push_back( OBParameterDBTable::Query(j, torsionRows[i][j], true) );
+    compareLookup(torsions, query);
+    query.clear();
+    for (int j = 4; j >= 1; --j)
+      query.push_back( OBParameterDBTable::Query(5 - j, torsionRows[i][j], true) );
+    compareLookup(torsions, query);
+    // a single column matches many rows
+    query.clear();
+    query.push_back( OBParameterDBTable::Query(2, torsionRows[i][2]) );
+    compareLookup(torsions, query);
+    // columns in a different order than the index key
+    query.clear();
+    query.push_back( OBParameterDBTable::Query(3, torsionRows[i][3]) );
+    query.push_back( OBParameterDBTable::Query(2, torsionRows[i][2]) );
+    compareLookup(torsions, query);
+  }
+
+  // no match
+  query.clear();
+  query.push_back( OBParameterDBTable::Query(1, OBVariant("xx"), true) );
+  query.push_back( OBParameterDBTable::Query(2, OBVariant("c"), true) );
+  compareLookup(bonds, query);
+  // the same column twice is not indexed
+  query.clear();
+  query.push_back( OBParameterDBTable::Query(1, OBVariant("c")) );
+  query.push_back( OBParameterDBTable::Query(1, OBVariant("c")) );
+  compareLookup(bonds, query);
+}
+
+void testRegistry()
+{
+  const std::string filename = string(TESTDATADIR) + string("../data/gaff.dat");
+  const OBParameterDB *db1 = OBParameterDBRegistry::Acquire("GAFF", filename, &GAFFParameterDB::Load);
+  const OBParameterDB *db2 = OBParameterDBRegistry::Acquire("GAFF", filename, &GAFFParameterDB::Load);
+  OB_ASSERT( db1 != 0 );
+  OB_ASSERT( db1 == db2 ); // parsed once
+  OB_ASSERT( OBParameterDBRegistry::GetRefCount(db1) == 2 );
+  OB_ASSERT( db1->GetTable("Bond Harmonic") != 0 );
+
+  OBParameterDBRegistry::Release(db2);
+  OB_ASSERT( OBParameterDBRegistry::GetRefCount(db1) == 1 );
+  OBParameterDBRegistry::Release(db1);
+  OB_ASSERT( OBParameterDBRegistry::GetRefCount(db1) == 0 );
+}
+
 int main()
 {
   std::cout << string(TESTDATADIR) + string("../data/gaff.dat") << std::endl;
@@ -503,10 +660,12 @@ int main()
   // testAngleParameters(database);
   // testStretchBendParameters(database);
   testTorsionParameters(database);
+  testIndexedLookup(database);
   // testOutOfPlaneParameters(database);
   // testVanDerWaalsParameters(database);
   // testChargeParameters(database);
   // testBondEmpiricalRules(database);
   // testStrBndEmpiricalRules(database);
   // testPartialBondChargeIncrements(database);
+  testRegistry();
 }
@@ -0,0 +1,578 @@
+#include <OBMinimize>
+#include <OBFunction>
+
+#include "obtest.h"
+#include "mockfunction.h"
+
+#include <cmath>
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+// E = sum_i kx (x_i - x0_i)^2 + ky (y_i - y0_i)^2 + kz (z_i - z0_i)^2, an
+// anisotropic quadratic with its minimum at the (x0_i, y0_i, z0_i)
+class QuadraticFunction : public MockFunction
+{
+  public:
+    QuadraticFunction(unsigned int numParticles) : MockFunction(numParticles), m_value(0.0)
+    {
+      for (unsigned int i = 0; i < numParticles; ++i)
+        m_minimum.push_back(Eigen::Vector3d(0.5 * i, 1.0 - 0.25 * i, -1.0));
+    }
+    void Compute(Computation computation = Value)
+    {
+      const double k[3] = { 1.0, 4.0, 9.0 };
+      m_value = 0.0;
+      for (unsigned int i = 0; i < m_positions.size(); ++i) {
+        const Eigen::Vector3d delta = m_positions[i] - m_minimum[i];
+        for (int c = 0; c < 3; ++c) {
+          m_value += k[c] * delta[c] * delta[c];
+          if (computation == Gradients)
+            m_gradients[i][c] = -2.0 * k[c] * delta[c];
+        }
+      }
+    }
+    double GetValue() const
+    {
+      return m_value;
+    }
+    bool HasAnalyticalGradients() const
+    {
+      return true;
+    }
+    const std::vector<Eigen::Vector3d>& GetMinimum() const
+    {
+      return m_minimum;
+    }
+  private:
+    std::vector<Eigen::Vector3d> m_minimum;
+    double m_value;
+};
+
+// E = sum_i sum_c -x_ic^2 + x_ic^4 / 4, concave for |x| < sqrt(2/3) with the
+// minima at x = +/- sqrt(2)
+class DoubleWellFunction : public MockFunction
+{
+  public:
+    DoubleWellFunction(unsigned int numParticles) : MockFunction(numParticles), m_value(0.0)
+    {
+    }
+    void Compute(Computation computation = Value)
+    {
+      m_value = 0.0;
+      for (unsigned int i = 0; i < m_positions.size(); ++i)
+        for (int c = 0; c < 3; ++c) {
+          const double x = m_positions[i][c];
+          m_value += -x * x + 0.25 * x * x * x * x;
+          if (computation == Gradients)
+            m_gradients[i][c] = 2.0 * x - x * x * x;
+        }
+    }
+    double GetValue() const
+    {
+      return m_value;
+    }
+    bool HasAnalyticalGradients() const
+    {
+      return true;
+    }
+  private:
+    double m_value;
+};
+
+// The quadratic with the forces pointing uphill, no line search can find a
+// lower energy along them
+class UphillFunction : public QuadraticFunction
+{
+  public:
+    UphillFunction(unsigned int numParticles) : QuadraticFunction(numParticles)
+    {
+    }
+    void Compute(Computation computation = Value)
+    {
+      QuadraticFunction::Compute(computation);
+      if (computation == Gradients)
+        for (unsigned int i = 0; i < m_gradients.size(); ++i)
+          m_gradients[i] = -m_gradients[i];
+    }
+};
+
+// E = -1e-6 sum_i (x_i + y_i + z_i) with the forces (1, 1, 1): the energy
+// decreases along the forces but never enough for the sufficient decrease
+// condition, a line search stops at its evaluation limit
+class ShallowFunction : public MockFunction
+{
+  public:
+    ShallowFunction(unsigned int numParticles) : MockFunction(numParticles), m_value(0.0)
+    {
+    }
+    void Compute(Computation computation = Value)
+    {
+      m_value = 0.0;
+      for (unsigned int i = 0; i < m_positions.size(); ++i) {
+        m_value -= 1.0e-6 * m_positions[i].sum();
+        if (computation == Gradients)
+          m_gradients[i] = Eigen::Vector3d::Ones();
+      }
+    }
+    double GetValue() const
+    {
+      return m_value;
+    }
+    bool HasAnalyticalGradients() const
+    {
+      return true;
+    }
+  private:
+    double m_value;
+};
+
+double maxDistance(const std::vector<Eigen::Vector3d> &a, const std::vector<Eigen::Vector3d> &b)
+{
+  double max = 0.0;
+  for (unsigned int i = 0; i < a.size(); ++i)
+    max = std::max(max, (a[i] - b[i]).norm());
+  return max;
+}
+
+void testLBFGS()
+{
+  // converges to the minimum of a quadratic
+  QuadraticFunction function(4);
+  OBMinimize minimize(&function);
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-6, 1e-6);
+  minimize.LBFGS(200);
+  OB_ASSERT( minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetMaxGradient() < 1e-6 );
+  OB_ASSERT( maxDistance(function.GetPositions(), function.GetMinimum()) < 1e-6 );
+  OB_ASSERT( minimize.GetLBFGSNumCorrections() == minimize.GetLBFGSHistorySize() );
+}
+
+void testLBFGSHistorySize()
+{
+  QuadraticFunction function(4);
+  OBMinimize minimize(&function);
+  minimize.SetLBFGSHistorySize(0);
+  OB_ASSERT( minimize.GetLBFGSHistorySize() == 1 );
+  minimize.SetLBFGSHistorySize(3);
+  OB_ASSERT( minimize.GetLBFGSHistorySize() == 3 );
+
+  // every step on a convex function adds a pair until the history is full
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-6, 1e-6);
+  minimize.LBFGSInitialize(200);
+  OB_ASSERT( minimize.GetLBFGSNumCorrections() == 0 );
+  for (unsigned int step = 1; step <= 6; ++step) {
+    OB_REQUIRE( minimize.LBFGSTakeNSteps(1) );
+    OB_ASSERT( minimize.GetLBFGSNumCorrections() == std::min(step, 3u) );
+  }
+
+  // a short history still converges
+  while (minimize.LBFGSTakeNSteps(10)) {}
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( maxDistance(function.GetPositions(), function.GetMinimum()) < 1e-6 );
+}
+
+void testLBFGSCurvatureSkip()
+{
+  // the first step stays in the concave region where s.y < 0, the pair is
+  // not stored and the next step is steepest descent again
+  DoubleWellFunction function(2);
+  for (unsigned int i = 0; i < 2; ++i)
+    function.GetPositions()[i] = Eigen::Vector3d(0.01, 0.01, 0.01);
+  OBMinimize minimize(&function);
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-6, 1e-6);
+  minimize.LBFGSInitialize(200);
+  const double start = function.GetValue();
+  OB_REQUIRE( minimize.LBFGSTakeNSteps(1) );
+  OB_ASSERT( function.GetValue() < start );
+  OB_ASSERT( fabs(function.GetPositions()[0].x()) < sqrt(2.0 / 3.0) );
+  OB_ASSERT( minimize.GetLBFGSNumCorrections() == 0 );
+
+  // once in the convex region the pairs are stored and the run converges
+  while (minimize.LBFGSTakeNSteps(10)) {}
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetLBFGSNumCorrections() > 0 );
+  for (unsigned int i = 0; i < 2; ++i)
+    for (int c = 0; c < 3; ++c)
+      OB_ASSERT( fabs(function.GetPositions()[i][c] - sqrt(2.0)) < 1e-6 );
+}
+
+void testFIRE()
+{
+  // a perturbed double well minimum, the energy may go up after an
+  // overshoot but has to go down over each block of steps
+  DoubleWellFunction function(3);
+  for (unsigned int i = 0; i < 3; ++i)
+    function.GetPositions()[i] = Eigen::Vector3d(sqrt(2.0) + 0.4, sqrt(2.0) - 0.3 * i, -sqrt(2.0) + 0.2);
+  OBMinimize minimize(&function);
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-5, 1e-5);
+  minimize.FIREInitialize(2000);
+  double last = function.GetValue();
+  std::vector<Eigen::Vector3d> previous = function.GetPositions();
+  bool running = true;
+  while (running) {
+    for (int i = 0; i < 20 && running; ++i) {
+      running = minimize.FIRETakeNSteps(1);
+      // no atom moves more than 0.2 Angstrom in a step
+      OB_ASSERT( maxDistance(function.GetPositions(), previous) < 0.2 + 1e-10 );
+      previous = function.GetPositions();
+    }
+    OB_ASSERT( function.GetValue() < last );
+    last = function.GetValue();
+  }
+  OB_ASSERT( minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetMaxGradient() < 1e-5 );
+  OB_ASSERT( fabs(function.GetValue() + 9.0) < 1e-8 );
+
+  // far from the minimum of a quadratic the step limit applies, the run
+  // stops after the given number of steps
+  QuadraticFunction quadratic(4);
+  for (unsigned int i = 0; i < 4; ++i)
+    quadratic.GetPositions()[i] = Eigen::Vector3d(10.0, -10.0, 5.0 * i);
+  OBMinimize fire(&quadratic);
+  fire.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  fire.SetGradientConvergence(1e-5, 1e-5);
+  fire.FIREInitialize(10);
+  const double start = quadratic.GetValue();
+  while (fire.FIRETakeNSteps(3)) {}
+  OB_ASSERT( fire.GetCurrentStep() == 10 );
+  OB_ASSERT( fire.GetStopReason() == StopReason::MaxSteps );
+  OB_ASSERT( !fire.HasConverged() );
+  OB_ASSERT( quadratic.GetValue() < start );
+
+  // and converges when given enough steps
+  fire.FIRE(2000);
+  OB_ASSERT( fire.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( maxDistance(quadratic.GetPositions(), quadratic.GetMinimum()) < 1e-5 );
+}
+
+void testFIREUphill()
+{
+  // without mixing and time step increase the FIRE steps are simple
+  // dynamics, follow x along the stiff z axis of a quadratic:
+  // - the first step from rest is not an uphill step
+  // - an uphill step goes back half the last move, taken with the time step
+  //   before the decrease
+  QuadraticFunction function(1);
+  function.GetPositions()[0] = function.GetMinimum()[0] + Eigen::Vector3d(0.0, 0.0, 0.1);
+  OBMinimize minimize(&function);
+  minimize.SetFIREParameters(0.1, 0.1, 0.0, 1000);
+  minimize.SetConvergenceCriteria(0);
+  minimize.FIREInitialize(30);
+
+  const double k = 9.0;
+  double x = 0.1, v = 0.0, dt = 0.1, lastDt = 0.0;
+  unsigned int uphill = 0;
+  for (int step = 0; step < 30; ++step) {
+    const double F = -2.0 * k * x;
+    if (F * v < 0.0) {
+      x -= 0.5 * lastDt * v;
+      v = 0.0;
+      dt *= 0.5;
+      ++uphill;
+    }
+    v += dt * F;
+    x += dt * v;
+    lastDt = dt;
+
+    minimize.FIRETakeNSteps(1);
+    OB_ASSERT( fabs(function.GetPositions()[0].z() - function.GetMinimum()[0].z() - x) < 1e-12 );
+  }
+  OB_ASSERT( uphill > 1 );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::MaxSteps );
+}
+
+// Run L-BFGS with the convergence @p criteria on a quadratic
+void runLBFGS(OBMinimize &minimize, int criteria, double econv = 1e-6)
+{
+  minimize.SetConvergenceCriteria(criteria);
+  minimize.LBFGSInitialize(200, econv);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Running );
+  while (minimize.LBFGSTakeNSteps(1))
+    OB_ASSERT( minimize.GetStopReason() == StopReason::Running );
+}
+
+void testConvergenceCriteria()
+{
+  QuadraticFunction function(4);
+  OBMinimize minimize(&function);
+  OB_ASSERT( minimize.GetConvergenceCriteria() == ConvergenceCriteria::Energy );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Running );
+
+  // energy change between the last two steps
+  runLBFGS(minimize, ConvergenceCriteria::Energy, 1e-8);
+  OB_ASSERT( minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( function.GetValue() < 1e-6 );
+
+  // the gradient criteria, restarting far from the minimum
+  minimize.SetGradientConvergence(1e-4, 1.0);
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  runLBFGS(minimize, ConvergenceCriteria::RMSGradient);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetRMSGradient() < 1e-4 );
+
+  minimize.SetGradientConvergence(1.0, 1e-4);
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  runLBFGS(minimize, ConvergenceCriteria::MaxGradient);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetMaxGradient() < 1e-4 );
+
+  // the last step moved no atom more than the limit
+  minimize.SetDisplacementConvergence(1e-6);
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxDisplacement);
+  minimize.LBFGSInitialize(200);
+  std::vector<Eigen::Vector3d> previous = function.GetPositions();
+  while (minimize.LBFGSTakeNSteps(1)) {
+    OB_ASSERT( maxDistance(function.GetPositions(), previous) >= 1e-6 );
+    previous = function.GetPositions();
+  }
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( maxDistance(function.GetPositions(), previous) < 1e-6 );
+
+  // all selected criteria have to be met
+  minimize.SetGradientConvergence(1e-5, 1e-5);
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  runLBFGS(minimize, ConvergenceCriteria::Energy | ConvergenceCriteria::RMSGradient |
+      ConvergenceCriteria::MaxGradient, 1e-2);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetRMSGradient() < 1e-5 );
+  OB_ASSERT( minimize.GetMaxGradient() < 1e-5 );
+
+  // without criteria the run only stops after the given number of steps
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  minimize.SetConvergenceCriteria(0);
+  minimize.LBFGSInitialize(5);
+  while (minimize.LBFGSTakeNSteps(2)) {}
+  OB_ASSERT( !minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::MaxSteps );
+  OB_ASSERT( minimize.GetCurrentStep() == 5 );
+}
+
+void testStallDetection()
+{
+  // the energy decrease over 4 steps is always below 1000
+  QuadraticFunction function(4);
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  OBMinimize minimize(&function);
+  minimize.SetConvergenceCriteria(0);
+  minimize.SetStallDetection(4, 1000.0);
+  minimize.LBFGSInitialize(200);
+  while (minimize.LBFGSTakeNSteps(1)) {}
+  OB_ASSERT( !minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Stalled );
+  OB_ASSERT( minimize.GetCurrentStep() == 4 );
+
+  // a small minimum decrease does not stop the run before it converges
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-6, 1e-6);
+  minimize.SetStallDetection(4, 1e-12);
+  minimize.LBFGS(200);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+}
+
+void testLineSearchFailed()
+{
+  // no lower energy along the forces, the positions are not changed and the
+  // unchanged energy is not reported as converged
+  UphillFunction function(4);
+  function.GetPositions().assign(4, Eigen::Vector3d(2.0, 2.0, 2.0));
+  const std::vector<Eigen::Vector3d> start = function.GetPositions();
+  OBMinimize minimize(&function);
+
+  minimize.LBFGS(100);
+  OB_ASSERT( !minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::LineSearchFailed );
+  OB_ASSERT( minimize.GetCurrentStep() == 1 );
+  OB_ASSERT( maxDistance(function.GetPositions(), start) == 0.0 );
+
+  minimize.TruncatedNewton(100);
+  OB_ASSERT( !minimize.HasConverged() );
+  OB_ASSERT( minimize.GetStopReason() == StopReason::LineSearchFailed );
+  OB_ASSERT( minimize.GetCurrentStep() == 1 );
+  OB_ASSERT( maxDistance(function.GetPositions(), start) == 0.0 );
+}
+
+double dot(const std::vector<Eigen::Vector3d> &a, const std::vector<Eigen::Vector3d> &b)
+{
+  double sum = 0.0;
+  for (unsigned int i = 0; i < a.size(); ++i)
+    sum += a[i].dot(b[i]);
+  return sum;
+}
+
+// A More-Thuente line search along the forces has to return a step that
+// satisfies the strong Wolfe conditions with the value and gradients
+// computed for it
+void checkStrongWolfe(OBFunction &function, double step, double gtol)
+{
+  OBMinimize minimize(&function);
+  function.Compute(OBFunction::Gradients);
+  const std::vector<Eigen::Vector3d> start = function.GetPositions();
+  std::vector<Eigen::Vector3d> direction = function.GetGradients();
+  const double f0 = function.GetValue();
+  const double g0 = -dot(function.GetGradients(), direction);
+
+  const double alpha = minimize.MoreThuenteLineSearch(direction, step, gtol);
+  OB_REQUIRE( alpha > 0.0 );
+  for (unsigned int i = 0; i < start.size(); ++i)
+    OB_ASSERT( (function.GetPositions()[i] - start[i] - alpha * direction[i]).norm() < 1e-12 );
+  const double f = function.GetValue();
+  const double g = -dot(function.GetGradients(), direction);
+  OB_ASSERT( f <= f0 + 1e-4 * alpha * g0 );
+  OB_ASSERT( fabs(g) <= -gtol * g0 );
+
+  // the value and gradients left in the function are those of the step
+  const std::vector<Eigen::Vector3d> gradients = function.GetGradients();
+  function.Compute(OBFunction::Gradients);
+  OB_ASSERT( function.GetValue() == f );
+  OB_ASSERT( maxDistance(function.GetGradients(), gradients) == 0.0 );
+  function.GetPositions() = start;
+}
+
+void testMoreThuente()
+{
+  // the minimum along the forces is within the 0.3 Angstrom trust radius,
+  // first steps that are too short (extrapolation), too long (bracketing)
+  // and estimated (0.0)
+  QuadraticFunction quadratic(4);
+  for (unsigned int i = 0; i < 4; ++i)
+    quadratic.GetPositions()[i] = quadratic.GetMinimum()[i] + Eigen::Vector3d(0.1, -0.1, 0.1);
+  DoubleWellFunction doubleWell(2);
+  doubleWell.GetPositions()[0] = Eigen::Vector3d(1.3, 1.6, -1.25);
+  doubleWell.GetPositions()[1] = Eigen::Vector3d(-1.5, 1.35, 1.3);
+  const double steps[] = { 1e-4, 0.01, 0.1, 0.0 };
+  const double gtols[] = { 0.1, 0.9 };
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 2; ++j) {
+      checkStrongWolfe(quadratic, steps[i], gtols[j]);
+      checkStrongWolfe(doubleWell, steps[i], gtols[j]);
+    }
+
+  // no step along an uphill direction
+  OBMinimize minimize(&quadratic);
+  quadratic.Compute(OBFunction::Gradients);
+  const std::vector<Eigen::Vector3d> start = quadratic.GetPositions();
+  std::vector<Eigen::Vector3d> direction = quadratic.GetGradients();
+  for (unsigned int i = 0; i < direction.size(); ++i)
+    direction[i] = -direction[i];
+  OB_ASSERT( minimize.MoreThuenteLineSearch(direction) == 0.0 );
+  OB_ASSERT( maxDistance(quadratic.GetPositions(), start) == 0.0 );
+
+  // no lower energy along the direction, the start point is restored
+  UphillFunction uphill(4);
+  OBMinimize uphillMinimize(&uphill);
+  uphill.Compute(OBFunction::Gradients);
+  direction = uphill.GetGradients();
+  OB_ASSERT( uphillMinimize.MoreThuenteLineSearch(direction) == 0.0 );
+  OB_ASSERT( maxDistance(uphill.GetPositions(), std::vector<Eigen::Vector3d>(4, Eigen::Vector3d::Zero())) == 0.0 );
+
+  // the evaluation limit is reached with the last point being the lowest,
+  // the returned step is the one of the positions and the computed value
+  ShallowFunction shallow(4);
+  OBMinimize shallowMinimize(&shallow);
+  shallow.Compute(OBFunction::Gradients);
+  direction = shallow.GetGradients();
+  const double alpha = shallowMinimize.MoreThuenteLineSearch(direction, 0.1);
+  OB_REQUIRE( alpha > 0.0 );
+  for (unsigned int i = 0; i < direction.size(); ++i)
+    OB_ASSERT( (shallow.GetPositions()[i] - alpha * direction[i]).norm() < 1e-15 );
+  OB_ASSERT( fabs(shallow.GetValue() + 1.0e-6 * 12.0 * alpha) < 1e-18 );
+}
+
+void testSteepestDescentAndConjugateGradients()
+{
+  for (int cg = 0; cg < 2; ++cg) {
+    QuadraticFunction quadratic(4);
+    OBMinimize minimize(&quadratic);
+    OB_ASSERT( minimize.GetLineSearchType() == LineSearchType::MoreThuente );
+    minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+    minimize.SetGradientConvergence(1e-5, 1e-5);
+    if (cg)
+      minimize.ConjugateGradients(2000);
+    else
+      minimize.SteepestDescent(2000);
+    OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+    OB_ASSERT( maxDistance(quadratic.GetPositions(), quadratic.GetMinimum()) < 1e-5 );
+
+    DoubleWellFunction doubleWell(2);
+    doubleWell.GetPositions()[0] = Eigen::Vector3d(0.5, 2.5, -0.2);
+    doubleWell.GetPositions()[1] = Eigen::Vector3d(-1.0, 0.3, 3.0);
+    OBMinimize minimize2(&doubleWell);
+    minimize2.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+    minimize2.SetGradientConvergence(1e-5, 1e-5);
+    if (cg)
+      minimize2.ConjugateGradients(2000);
+    else
+      minimize2.SteepestDescent(2000);
+    OB_ASSERT( minimize2.GetStopReason() == StopReason::Converged );
+    OB_ASSERT( fabs(doubleWell.GetValue() + 6.0) < 1e-8 );
+
+    // a failed line search is not convergence
+    UphillFunction uphill(4);
+    OBMinimize minimize3(&uphill);
+    if (cg) {
+      minimize3.ConjugateGradientsInitialize(100);
+      minimize3.ConjugateGradientsTakeNSteps(100);
+    } else
+      minimize3.SteepestDescent(100);
+    OB_ASSERT( !minimize3.HasConverged() );
+    OB_ASSERT( minimize3.GetStopReason() == StopReason::LineSearchFailed );
+    OB_ASSERT( maxDistance(uphill.GetPositions(), std::vector<Eigen::Vector3d>(4, Eigen::Vector3d::Zero())) == 0.0 );
+  }
+}
+
+void testTruncatedNewton()
+{
+  // the functions have no terms, the Hessian-vector products are finite
+  // differences of the gradients
+  QuadraticFunction quadratic(4);
+  OB_ASSERT( !quadratic.HasAnalyticalHessian() );
+  OBMinimize minimize(&quadratic);
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-6, 1e-6);
+  minimize.TruncatedNewton(200);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetMaxGradient() < 1e-6 );
+  OB_ASSERT( maxDistance(quadratic.GetPositions(), quadratic.GetMinimum()) < 1e-6 );
+  // Newton steps, only limited by the 0.3 Angstrom trust radius
+  OB_ASSERT( minimize.GetCurrentStep() < 20 );
+
+  // negative curvature at the start (steepest descent steps)
+  DoubleWellFunction doubleWell(2);
+  doubleWell.GetPositions()[0] = Eigen::Vector3d(0.1, -0.2, 0.3);
+  doubleWell.GetPositions()[1] = Eigen::Vector3d(2.0, -0.5, 1.0);
+  OBMinimize minimize2(&doubleWell);
+  minimize2.SetConvergenceCriteria(ConvergenceCriteria::MaxGradient);
+  minimize2.SetGradientConvergence(1e-6, 1e-6);
+  minimize2.TruncatedNewton(200);
+  OB_ASSERT( minimize2.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize2.GetMaxGradient() < 1e-6 );
+  OB_ASSERT( fabs(doubleWell.GetValue() + 6.0) < 1e-10 );
+}
+
+int main()
+{
+  testLBFGS();
+  testLBFGSHistorySize();
+  testLBFGSCurvatureSkip();
+  testFIRE();
+  testFIREUphill();
+  testConvergenceCriteria();
+  testStallDetection();
+  testLineSearchFailed();
+  testMoreThuente();
+  testSteepestDescentAndConjugateGradients();
+  testTruncatedNewton();
+
+  return 0;
+}
@@ -28,6 +28,8 @@
 #include "obtest.h"
 #include "mockfunction.h"
 
+#include <algorithm>
+
 using namespace OpenBabel::OBFFs;
 
 unsigned int test(OBFunction *function, int n, double r)
@@ -43,6 +45,53 @@ unsigned int test(OBFunction *function, int n, double r)
   return count;
 }
 
+bool verletContains(OBNbrList *nbrList, unsigned int i, unsigned int j)
+{
+  const std::vector<unsigned int> &nbrs = nbrList->GetVerletNbrs(i < j ? i : j);
+  return std::binary_search(nbrs.begin(), nbrs.end(), i < j ? j : i);
+}
+
+unsigned int countMissing(OBFunction *function, OBNbrList *nbrList, double r)
+{
+  unsigned int missing = 0;
+  for (unsigned int i = 0; i < function->NumParticles(); ++i)
+    for (unsigned int j = i + 1; j < function->NumParticles(); ++j) {
+      double r2 = ( function->GetPositions()[i] - function->GetPositions()[j] ).squaredNorm();
+      if (r2 <= r * r && !verletContains(nbrList, i, j))
+        missing++;
+    }
+  return missing;
+}
+
+void testVerlet(OBFunction *function, unsigned int correct4)
+{
+  // rcut + skin = 4.0
+  OBNbrList *nbrList = new OBNbrList(function, 3.0, false, 1, 1.0);
+  OB_ASSERT(nbrList->GetBuildCount() == 1);
+
+  unsigned int count = 0;
+  for (unsigned int i = 0; i < function->NumParticles(); ++i)
+    count += nbrList->GetVerletNbrs(i).size();
+  OB_ASSERT(correct4 == count);
+
+  // move all atoms less than skin / 2: no rebuild and no pairs within rcut missing
+  std::vector<Eigen::Vector3d> original = function->GetPositions();
+  for (unsigned int i = 0; i < function->NumParticles(); ++i)
+    function->GetPositions()[i] += Eigen::Vector3d(0.15 * (i % 3), 0.05 * (i % 5), -0.05 * (i % 7));
+  OB_ASSERT(!nbrList->Update());
+  OB_ASSERT(nbrList->GetBuildCount() == 1);
+  OB_ASSERT(countMissing(function, nbrList, 3.0) == 0);
+
+  // move one atom more than skin / 2: rebuild
+  function->GetPositions()[555] += Eigen::Vector3d(0.6, 0.0, 0.0);
+  OB_ASSERT(nbrList->Update());
+  OB_ASSERT(nbrList->GetBuildCount() == 2);
+  OB_ASSERT(countMissing(function, nbrList, 4.0) == 0);
+
+  function->GetPositions() = original;
+  delete nbrList;
+}
+
 
 
 int main()
@@ -57,6 +106,7 @@ int main()
       }
 
   // compute the correct number of pairs
+  unsigned int correct4 = 0;
   unsigned int correct5 = 0;
   unsigned int correct10 = 0;
   for (unsigned int i = 0; i < 1000; ++i) {
@@ -66,6 +116,8 @@ int main()
       
       double r2 = ( function->GetPositions()[i] - function->GetPositions()[j] ).squaredNorm();
 
+      if (r2 <= 16.0)
+        correct4++;
       if (r2 <= 25.0)
         correct5++;
       if (r2 <= 100.0)
@@ -93,6 +145,8 @@ int main()
   count = test(function, 3, 10.);
   OB_ASSERT(correct10 == count);
 
+  testVerlet(function, correct4);
+
   delete function;
 }
 
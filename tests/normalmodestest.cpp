@@ -0,0 +1,85 @@
+#include <OBFunction>
+#include <OBMinimize>
+#include <OBNormalModes>
+#include <OBLogFile>
+#include "obtest.h"
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <cmath>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+int main()
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OB_ASSERT( gaff_factory != 0);
+
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+
+  std::ifstream ifs;
+  ifs.open(TESTDATADIR "acetone.pdb");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+  ifs.close();
+
+  OBFunction *gaff_function = gaff_factory->NewInstance();
+  OB_REQUIRE( gaff_function != 0);
+  gaff_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  OB_REQUIRE( gaff_function->Setup(mol) );
+  OB_ASSERT( gaff_function->GetMasses().size() == mol.NumAtoms() );
+
+  // the modes are only meaningful at a minimum
+  OBMinimize minimize(gaff_function);
+  minimize.LBFGSInitialize(5000, 1e-10);
+  while (minimize.LBFGSTakeNSteps(100))
+    ;
+
+  // acetone is not linear: 3N-6 modes
+  OBNormalModes dense(gaff_function);
+  dense.SetMethod(OBNormalModes::Dense);
+  OB_REQUIRE( dense.Compute() );
+  OB_REQUIRE( dense.NumModes() == 3 * mol.NumAtoms() - 6 );
+
+  const std::vector<double> &frequencies = dense.GetFrequencies();
+  for (unsigned int i = 0; i < frequencies.size(); ++i) {
+    cout << "mode " << i << ": " << frequencies[i] << " cm^-1" << endl;
+    if (i)
+      OB_ASSERT( frequencies[i] >= frequencies[i-1] );
+  }
+  // no imaginary frequencies, C-H stretches near 3000 cm^-1
+  OB_ASSERT( frequencies.front() > 0.0 );
+  OB_ASSERT( frequencies.back() > 2500.0 && frequencies.back() < 3500.0 );
+  OB_ASSERT( dense.GetVibrationalEntropy() > 0.0 );
+
+  // the modes are normalized
+  for (unsigned int i = 0; i < dense.NumModes(); ++i) {
+    double norm2 = 0.0;
+    for (unsigned int j = 0; j < mol.NumAtoms(); ++j)
+      norm2 += dense.GetMode(i)[j].squaredNorm();
+    OB_ASSERT( fabs(norm2 - 1.0) < 1e-8 );
+  }
+
+  // the lowest modes from LOBPCG
+  OBNormalModes iterative(gaff_function);
+  iterative.SetMethod(OBNormalModes::Iterative);
+  iterative.SetConvergence(1e-7);
+  OB_ASSERT( iterative.Compute(4) );
+  OB_REQUIRE( iterative.NumModes() == 4 );
+  cout << "iterations: " << iterative.GetIterations() << endl;
+  for (unsigned int i = 0; i < 4; ++i)
+    OB_ASSERT( fabs(iterative.GetFrequencies()[i] - frequencies[i]) < 1e-2 * frequencies[i] );
+
+  delete gaff_function;
+
+  return 0;
+}
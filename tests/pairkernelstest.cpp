@@ -0,0 +1,237 @@
+#include "obtest.h"
+
+#include <src/forceterms/pairkernels.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace OpenBabel::OBFFs;
+
+const unsigned int numAtoms = 61; // 1830 pairs, leaves a remainder for all vector widths
+
+struct System
+{
+  std::vector<double> x, y, z;
+  std::vector<unsigned int> index;
+  std::vector<double> A, B, qq;
+};
+
+double random(double min, double max)
+{
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+void setupSystem(System &system)
+{
+  // jittered lattice, no overlapping atoms
+  for (unsigned int i = 0; i < numAtoms; ++i) {
+    system.x.push_back(1.5 * (i % 4) + random(-0.3, 0.3));
+    system.y.push_back(1.5 * ((i / 4) % 4) + random(-0.3, 0.3));
+    system.z.push_back(1.5 * (i / 16) + random(-0.3, 0.3));
+  }
+
+  for (unsigned int i = 0; i < numAtoms; ++i)
+    for (unsigned int j = i + 1; j < numAtoms; ++j) {
+      system.index.push_back(i);
+      system.index.push_back(j);
+      const double epsilon = random(0.01, 0.2);
+      const double sigma6 = pow(random(2.5, 3.5), 6.0);
+      system.B.push_back(4.0 * epsilon * sigma6);
+      system.A.push_back(system.B.back() * sigma6);
+      system.qq.push_back(332.0716 * random(-0.8, 0.8) * random(-0.8, 0.8));
+    }
+}
+
+bool isClose(double value, double reference, double scale)
+{
+  return fabs(value - reference) <= 1e-10 * scale;
+}
+
+bool isClose(const std::vector<double> &values, const std::vector<double> &reference)
+{
+  double scale = 0.0;
+  for (unsigned int i = 0; i < reference.size(); ++i)
+    scale = std::max(scale, fabs(reference[i]));
+  for (unsigned int i = 0; i < reference.size(); ++i)
+    if (!isClose(values[i], reference[i], scale))
+      return false;
+  return true;
+}
+
+template<typename Args, typename Kernel>
+void compare(const System &system, const Args &args, Kernel scalar, Kernel kernel)
+{
+  std::vector<double> g[6];
+  for (int k = 0; k < 6; ++k)
+    g[k].resize(numAtoms, 0.0);
+
+  PairKernels::Coordinates coords;
+  coords.x = &system.x[0];
+  coords.y = &system.y[0];
+  coords.z = &system.z[0];
+  coords.gstride = 1;
+
+  coords.gx = coords.gy = coords.gz = 0;
+  const double valueRef = scalar(args, coords);
+  const double value = kernel(args, coords);
+  OB_ASSERT(isClose(value, valueRef, fabs(valueRef)));
+
+  coords.gx = &g[0][0];
+  coords.gy = &g[1][0];
+  coords.gz = &g[2][0];
+  OB_ASSERT(isClose(scalar(args, coords), valueRef, fabs(valueRef)));
+  coords.gx = &g[3][0];
+  coords.gy = &g[4][0];
+  coords.gz = &g[5][0];
+  OB_ASSERT(isClose(kernel(args, coords), valueRef, fabs(valueRef)));
+
+  for (int k = 0; k < 3; ++k)
+    OB_ASSERT(isClose(g[k+3], g[k]));
+}
+
+void testLJ6_12(const System &system, PairKernels::InstructionSet set)
+{
+  PairKernels::LJ6_12Args args;
+  args.numPairs = system.A.size();
+  args.index = &system.index[0];
+  args.A = &system.A[0];
+  args.B = &system.B[0];
+
+  PairKernels::LJ6_12Kernel scalar = PairKernels::GetLJ6_12Kernel(PairKernels::Scalar);
+  PairKernels::LJ6_12Kernel kernel = PairKernels::GetLJ6_12Kernel(set);
+
+  // all pairs
+  args.rc2 = args.rs2 = std::numeric_limits<double>::max();
+  args.switchDenom = args.shiftA = args.shiftB = 0.0;
+  compare(system, args, scalar, kernel);
+
+  // switched between 4 and 5
+  args.rc2 = 25.0;
+  args.rs2 = 16.0;
+  args.switchDenom = 1.0 / (9.0 * 9.0 * 9.0);
+  compare(system, args, scalar, kernel);
+
+  // shifted at 5
+  args.rs2 = std::numeric_limits<double>::max();
+  args.switchDenom = 0.0;
+  args.shiftB = 1.0 / (25.0 * 25.0 * 25.0);
+  args.shiftA = args.shiftB * args.shiftB;
+  compare(system, args, scalar, kernel);
+}
+
+void testCoulomb(const System &system, PairKernels::InstructionSet set)
+{
+  PairKernels::CoulombArgs args;
+  args.numPairs = system.qq.size();
+  args.index = &system.index[0];
+  args.qq = &system.qq[0];
+
+  PairKernels::CoulombKernel scalar = PairKernels::GetCoulombKernel(PairKernels::Scalar);
+  PairKernels::CoulombKernel kernel = PairKernels::GetCoulombKernel(set);
+
+  // all pairs
+  args.rc2 = std::numeric_limits<double>::max();
+  args.k1 = args.k2 = args.c = 0.0;
+  compare(system, args, scalar, kernel);
+
+  // shifted force at 5
+  args.rc2 = 25.0;
+  args.k1 = 1.0 / 25.0;
+  args.c = 2.0 / 5.0;
+  compare(system, args, scalar, kernel);
+
+  // reaction field at 5
+  args.k1 = 0.0;
+  args.k2 = (78.5 - 1.0) / ((2.0 * 78.5 + 1.0) * 125.0);
+  args.c = 1.0 / 5.0 + args.k2 * 25.0;
+  compare(system, args, scalar, kernel);
+}
+
+// Energy and force of a single pair at distance r (along x), the force is
+// the gradient of atom 0 (i.e. -dE/dr)
+double computePair(PairKernels::CoulombKernel kernel, PairKernels::CoulombArgs args, double r, double &force)
+{
+  const unsigned int index[2] = { 0, 1 };
+  const double qq = 332.0716 * 0.5 * -0.4;
+  const double x[2] = { r, 0.0 }, y[2] = { 0.0, 0.0 }, z[2] = { 0.0, 0.0 };
+  double gx[2] = { 0.0, 0.0 }, gy[2] = { 0.0, 0.0 }, gz[2] = { 0.0, 0.0 };
+  args.numPairs = 1;
+  args.index = index;
+  args.qq = &qq;
+
+  PairKernels::Coordinates coords;
+  coords.x = x;
+  coords.y = y;
+  coords.z = z;
+  coords.gx = gx;
+  coords.gy = gy;
+  coords.gz = gz;
+  coords.gstride = 1;
+  const double value = kernel(args, coords);
+  force = gx[0];
+  return value;
+}
+
+// The cut-off forms against the closed form expressions and central differences
+void testCoulombCutOff(PairKernels::InstructionSet set)
+{
+  PairKernels::CoulombKernel kernel = PairKernels::GetCoulombKernel(set);
+  const double qq = 332.0716 * 0.5 * -0.4;
+  const double rc = 5.0, h = 1e-6;
+  PairKernels::CoulombArgs args;
+  args.rc2 = rc * rc;
+
+  for (int mode = 0; mode < 3; ++mode) {
+    // shifted force, reaction field and reaction field with eps_rf = infinity
+    const double epsilonRF = (mode == 1) ? 78.5 : 1e30;
+    args.k1 = (mode == 0) ? 1.0 / (rc * rc) : 0.0;
+    args.k2 = (mode == 0) ? 0.0 : (epsilonRF - 1.0) / ((2.0 * epsilonRF + 1.0) * rc * rc * rc);
+    args.c = (mode == 0) ? 2.0 / rc : 1.0 / rc + args.k2 * rc * rc;
+
+    double force, plus, minus;
+    for (double r = 1.0; r < rc - h; r += 0.37) {
+      const double value = computePair(kernel, args, r, force);
+      const double expected = qq * (1.0 / r + args.k1 * r + args.k2 * r * r - args.c);
+      const double dE = qq * (-1.0 / (r * r) + args.k1 + 2.0 * args.k2 * r);
+      OB_ASSERT( fabs(value - expected) < 1e-10 * fabs(qq) );
+      OB_ASSERT( fabs(force + dE) < 1e-10 * fabs(qq) );
+      const double numerical = (computePair(kernel, args, r + h, plus) - computePair(kernel, args, r - h, minus)) / (2.0 * h);
+      OB_ASSERT( fabs(force + numerical) < 1e-6 * fabs(qq) );
+    }
+
+    // the energy goes to 0 at rc, the force too except for a finite eps_rf
+    const double value = computePair(kernel, args, rc - 1e-9, force);
+    OB_ASSERT( fabs(value) < 1e-8 * fabs(qq) );
+    if (mode == 1)
+      OB_ASSERT( fabs(force + qq * (-1.0 / (rc * rc) + 2.0 * args.k2 * rc)) < 1e-8 * fabs(qq) );
+    else
+      OB_ASSERT( fabs(force) < 1e-8 * fabs(qq) );
+    // no contribution beyond rc
+    OB_ASSERT( computePair(kernel, args, rc + 1e-9, force) == 0.0 );
+    OB_ASSERT( force == 0.0 );
+  }
+}
+
+int main()
+{
+  srand(42);
+  System system;
+  setupSystem(system);
+
+  testCoulombCutOff(PairKernels::Scalar);
+
+  PairKernels::InstructionSet sets[] = { PairKernels::SSE2, PairKernels::AVX2, PairKernels::AVX512 };
+  for (int i = 0; i < 3; ++i) {
+    if (!PairKernels::IsSupported(sets[i])) {
+      std::cout << "Skipping " << PairKernels::GetName(sets[i]) << std::endl;
+      continue;
+    }
+    std::cout << "Testing " << PairKernels::GetName(sets[i]) << std::endl;
+    testLJ6_12(system, sets[i]);
+    testCoulomb(system, sets[i]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,181 @@
+#include <OBFunction>
+#include <OBRotorSearch>
+#include <OBVectorMath>
+#include <OBLogFile>
+#include "obtest.h"
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <cmath>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBAtom;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+// True if no pair of atoms (not in a 1-2 or 1-3 relation) is closer than
+// @p distance
+bool isClashFree(OBFFType *type, const std::vector<Eigen::Vector3d> &positions, double distance)
+{
+  for (unsigned int i = 0; i < positions.size(); ++i)
+    for (unsigned int j = i + 1; j < positions.size(); ++j) {
+      if (type->GetRelation(i, j) & (OBFFType::OneTwo | OBFFType::OneThree))
+        continue;
+      if ((positions[i] - positions[j]).norm() < distance)
+        return false;
+    }
+  return true;
+}
+
+// Hexane has 3 rotors, the syn-pentane conformers (g+g- or g-g+ for two
+// neighboring rotors) are pruned. A clash found before the last rotor is set
+// skips the settings of the following rotors.
+void testPruning(OBFunction *function, OBMol &hexane)
+{
+  OB_REQUIRE( function->Setup(hexane) );
+  const std::vector<Eigen::Vector3d> input = function->GetPositions();
+  OBRotorSearch search(function);
+  OB_REQUIRE( search.Setup(hexane) );
+  OB_REQUIRE( search.GetRotors().size() == 3 );
+  search.SetTorsionStep(120.0);
+  search.SetNumConformers(27);
+
+  // all combinations without pruning
+  search.SetClashDistance(0.0);
+  OB_REQUIRE( search.SystematicSearch() );
+  OB_ASSERT( search.GetNumComputed() == 27 );
+  OB_ASSERT( search.GetNumPruned() == 0 );
+  OB_REQUIRE( search.GetConformers().size() == 27 );
+  std::vector<OBRotorSearch::Conformer> expected;
+  for (unsigned int i = 0; i < search.GetConformers().size(); ++i)
+    if (isClashFree(function->GetOBFFType(), search.GetConformers()[i].positions, 1.5))
+      expected.push_back(search.GetConformers()[i]);
+  OB_ASSERT( expected.size() == 17 );
+
+  // the pruned search computes the other conformers, also with more threads
+  // and blocks ending in the middle of the skipped settings
+  search.SetClashDistance(1.5);
+  for (int threads = 1; threads <= 4; threads += 3) {
+    function->GetPositions() = input;
+    function->SetNumThreads(threads);
+    search.SetBlockSize((threads == 1) ? 64 : 2);
+    OB_REQUIRE( search.SystematicSearch() );
+    OB_ASSERT( search.GetNumComputed() == expected.size() );
+    OB_ASSERT( search.GetNumPruned() == 27 - expected.size() );
+    OB_REQUIRE( search.GetConformers().size() == expected.size() );
+    for (unsigned int i = 0; i < expected.size(); ++i) {
+      OB_ASSERT( search.GetConformers()[i].settings == expected[i].settings );
+      OB_ASSERT( fabs(search.GetConformers()[i].value - expected[i].value) < 1e-8 );
+    }
+  }
+  function->SetNumThreads(1);
+}
+
+// The rotors only move the atoms connected to the rotatable bond, not the
+// atoms of another fragment
+void testFragments(OBFunction *function, OBMol &hexane)
+{
+  OB_REQUIRE( function->Setup(hexane) );
+  std::vector<OBRotorSearch::Rotor> expected;
+  OB_REQUIRE( OBRotorSearch::FindRotors(hexane, function, expected) );
+
+  // a methane far away, it makes one side of the C2-C3 rotor larger than
+  // half the atoms
+  OBMol methane;
+  methane.BeginModify();
+  OBAtom *carbon = methane.NewAtom();
+  carbon->SetAtomicNum(6);
+  carbon->SetVector(10.0, 0.0, 0.0);
+  const double offsets[4][3] = { {1.0, 1.0, 1.0}, {1.0, -1.0, -1.0}, {-1.0, 1.0, -1.0}, {-1.0, -1.0, 1.0} };
+  for (unsigned int k = 0; k < 4; ++k) {
+    OBAtom *hydrogen = methane.NewAtom();
+    hydrogen->SetAtomicNum(1);
+    hydrogen->SetVector(10.0 + 0.6293 * offsets[k][0], 0.6293 * offsets[k][1], 0.6293 * offsets[k][2]);
+    methane.AddBond(carbon->GetIdx(), hydrogen->GetIdx(), 1);
+  }
+  methane.EndModify();
+
+  OBMol mol(hexane);
+  mol += methane;
+  OB_REQUIRE( function->Setup(mol) );
+  std::vector<OBRotorSearch::Rotor> rotors;
+  OB_REQUIRE( OBRotorSearch::FindRotors(mol, function, rotors) );
+  OB_REQUIRE( rotors.size() == expected.size() );
+  for (unsigned int r = 0; r < rotors.size(); ++r) {
+    OB_ASSERT( rotors[r].atoms == expected[r].atoms );
+    for (unsigned int i = 0; i < rotors[r].atoms.size(); ++i)
+      OB_ASSERT( rotors[r].atoms[i] < hexane.NumAtoms() );
+  }
+}
+
+int main()
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OB_ASSERT( gaff_factory != 0);
+
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("xyz");
+
+  std::ifstream ifs;
+  ifs.open(TESTDATADIR "butane.xyz");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+  ifs.close();
+
+  OBFunction *gaff_function = gaff_factory->NewInstance();
+  OB_REQUIRE( gaff_function != 0);
+  gaff_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  OB_REQUIRE( gaff_function->Setup(mol) );
+  const std::vector<Eigen::Vector3d> input = gaff_function->GetPositions();
+
+  // the central C-C bond is the only rotor, the input is gauche
+  OBRotorSearch search(gaff_function);
+  OB_REQUIRE( search.Setup(mol) );
+  OB_REQUIRE( search.GetRotors().size() == 1 );
+  const unsigned int *ref = search.GetRotors()[0].ref;
+  OB_ASSERT( std::min(ref[1], ref[2]) == 1 && std::max(ref[1], ref[2]) == 2 );
+
+  search.SetTorsionStep(120.0);
+  OB_REQUIRE( search.SystematicSearch() );
+  OB_ASSERT( search.GetNumComputed() == 3 );
+  OB_REQUIRE( search.GetConformers().size() == 3 );
+  const std::vector<OBRotorSearch::Conformer> conformers = search.GetConformers();
+
+  // anti is the lowest conformer, the two gauche conformers have the same value
+  const std::vector<Eigen::Vector3d> &anti = conformers[0].positions;
+  OB_ASSERT( fabs(fabs(VectorTorsion(anti[0], anti[1], anti[2], anti[3])) - 180.0) < 0.01 );
+  OB_ASSERT( fabs(conformers[1].value - conformers[2].value) < 0.01 );
+  OB_ASSERT( conformers[0].value < conformers[1].value );
+  for (unsigned int i = 0; i < conformers.size(); ++i) {
+    search.SetConformer(i);
+    gaff_function->Compute();
+    OB_ASSERT( fabs(gaff_function->GetValue() - conformers[i].value) < 1e-8 );
+  }
+
+  // the random search finds the same conformers, also with more threads
+  gaff_function->GetPositions() = input;
+  gaff_function->SetNumThreads(4);
+  search.RandomSearch(50);
+  OB_REQUIRE( search.GetConformers().size() == 3 );
+  for (unsigned int i = 0; i < conformers.size(); ++i)
+    OB_ASSERT( fabs(search.GetConformers()[i].value - conformers[i].value) < 1e-8 );
+  delete gaff_function;
+
+  OBMol hexane;
+  ifs.open(TESTDATADIR "hexane.xyz");
+  OB_REQUIRE( conv.Read(&hexane, &ifs) );
+  ifs.close();
+
+  OBFunction *function = gaff_factory->NewInstance();
+  OB_REQUIRE( function != 0);
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  testPruning(function, hexane);
+  testFragments(function, hexane);
+  delete function;
+}
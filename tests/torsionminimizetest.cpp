@@ -0,0 +1,166 @@
+#include <OBFunction>
+#include <OBTorsionMinimize>
+#include <OBMinimize>
+#include <OBVectorMath>
+#include <OBLogFile>
+#include "obtest.h"
+#include <GAFF>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <cmath>
+
+using OpenBabel::OBMol;
+using OpenBabel::OBConversion;
+
+using namespace OpenBabel::OBFFs;
+
+using namespace std;
+
+// Compare the torsional gradients at the function's positions with central
+// differences of the value for each rotor, the positions are not changed
+void checkTorsionGradients(OBFunction *function, OBTorsionMinimize &minimize)
+{
+  const std::vector<Eigen::Vector3d> input = function->GetPositions();
+  function->Compute(OBFunction::Gradients);
+  std::vector<double> gradients;
+  minimize.ComputeTorsionGradients(gradients);
+  OB_REQUIRE( gradients.size() == minimize.GetRotors().size() );
+
+  const double h = 0.01; // degrees
+  const std::vector<double> torsions = minimize.GetTorsions();
+  for (unsigned int r = 0; r < torsions.size(); ++r) {
+    std::vector<double> changed = torsions;
+    changed[r] = torsions[r] + h;
+    minimize.SetTorsions(changed);
+    function->Compute();
+    const double plus = function->GetValue();
+    function->GetPositions() = input;
+    changed[r] = torsions[r] - h;
+    minimize.SetTorsions(changed);
+    function->Compute();
+    const double minus = function->GetValue();
+    function->GetPositions() = input;
+    const double numerical = (plus - minus) / (2.0 * h * DEG_TO_RAD);
+    OB_ASSERT( fabs(gradients[r] - numerical) < 1e-4 * std::max(1.0, fabs(numerical)) );
+  }
+}
+
+// Hexane (3 rotors) away from a stationary point, setting the torsions does
+// not change the torsions of the other rotors
+void testHexane(OBFunction *function, OBMol &hexane)
+{
+  OB_REQUIRE( function->Setup(hexane) );
+  OBTorsionMinimize minimize(function);
+  OB_REQUIRE( minimize.Setup(hexane) );
+  OB_REQUIRE( minimize.GetRotors().size() == 3 );
+
+  std::vector<double> torsions = minimize.GetTorsions();
+  torsions[0] += 50.0;
+  torsions[1] -= 75.0;
+  torsions[2] += 160.0;
+  minimize.SetTorsions(torsions);
+  const std::vector<double> changed = minimize.GetTorsions();
+  for (unsigned int r = 0; r < 3; ++r) {
+    const double diff = fabs(changed[r] - torsions[r]);
+    OB_ASSERT( std::min(diff, 360.0 - diff) < 1e-6 );
+  }
+  checkTorsionGradients(function, minimize);
+
+  // the minimization ends at a stationary point, the gradient criteria are
+  // met by the torsion gradients
+  function->Compute();
+  const double inputValue = function->GetValue();
+  const std::vector<Eigen::Vector3d> start = function->GetPositions();
+  minimize.SetConvergenceCriteria(ConvergenceCriteria::RMSGradient | ConvergenceCriteria::MaxGradient);
+  minimize.SetGradientConvergence(1e-4, 1e-4);
+  minimize.Minimize(200);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( minimize.GetValue() < inputValue );
+  OB_ASSERT( minimize.GetMaxGradient() < 1e-4 );
+  OB_ASSERT( minimize.GetRMSGradient() <= minimize.GetMaxGradient() );
+  function->Compute(OBFunction::Gradients);
+  std::vector<double> gradients;
+  minimize.ComputeTorsionGradients(gradients);
+  for (unsigned int r = 0; r < gradients.size(); ++r)
+    OB_ASSERT( fabs(gradients[r]) < 1e-4 );
+  const double value = minimize.GetValue();
+
+  // the same minimum with a single L-BFGS correction pair
+  function->GetPositions() = start;
+  minimize.SetLBFGSHistorySize(1);
+  OB_ASSERT( minimize.GetLBFGSHistorySize() == 1 );
+  minimize.Minimize(500);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  OB_ASSERT( fabs(minimize.GetValue() - value) < 1e-6 );
+
+  // the number of steps is reached before convergence
+  function->GetPositions() = start;
+  minimize.Minimize(2);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::MaxSteps );
+  OB_ASSERT( minimize.GetCurrentStep() == 2 );
+}
+
+int main()
+{
+  OBFunctionFactory *gaff_factory = OBFunctionFactory::GetFactory("GAFF");
+  OB_ASSERT( gaff_factory != 0);
+
+  OBMol mol;
+  OBConversion conv;
+  conv.SetInFormat("xyz");
+
+  std::ifstream ifs;
+  ifs.open(TESTDATADIR "butane.xyz");
+  OB_REQUIRE( conv.Read(&mol, &ifs) );
+  ifs.close();
+
+  OBFunction *gaff_function = gaff_factory->NewInstance();
+  OB_REQUIRE( gaff_function != 0);
+  gaff_function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  OB_REQUIRE( gaff_function->Setup(mol) );
+  const std::vector<Eigen::Vector3d> input = gaff_function->GetPositions();
+
+  OBTorsionMinimize minimize(gaff_function);
+  OB_REQUIRE( minimize.Setup(mol) );
+  OB_REQUIRE( minimize.GetRotors().size() == 1 );
+
+  // the torsional gradient matches the numerical derivative
+  checkTorsionGradients(gaff_function, minimize);
+  gaff_function->Compute();
+  const double inputValue = gaff_function->GetValue();
+
+  // the minimization only changes the torsion and ends at a stationary point
+  minimize.Minimize(100, 1e-8);
+  OB_ASSERT( minimize.GetStopReason() == StopReason::Converged );
+  gaff_function->Compute(OBFunction::Gradients);
+  OB_ASSERT( fabs(gaff_function->GetValue() - minimize.GetValue()) < 1e-8 );
+  OB_ASSERT( minimize.GetValue() < inputValue );
+  std::vector<double> gradients;
+  minimize.ComputeTorsionGradients(gradients);
+  OB_ASSERT( fabs(gradients[0]) < 0.01 );
+
+  const std::vector<Eigen::Vector3d> &positions = gaff_function->GetPositions();
+  const std::vector<unsigned int> &atoms = minimize.GetRotors()[0].atoms;
+  std::vector<bool> moved(positions.size(), false);
+  for (unsigned int i = 0; i < atoms.size(); ++i)
+    moved[atoms[i]] = true;
+  for (unsigned int i = 0; i < positions.size(); ++i)
+    for (unsigned int j = i + 1; j < positions.size(); ++j)
+      if (moved[i] == moved[j])
+        OB_ASSERT( fabs((positions[i] - positions[j]).norm() - (input[i] - input[j]).norm()) < 1e-8 );
+  delete gaff_function;
+
+  OBMol hexane;
+  ifs.open(TESTDATADIR "hexane.xyz");
+  OB_REQUIRE( conv.Read(&hexane, &ifs) );
+  ifs.close();
+
+  OBFunction *function = gaff_factory->NewInstance();
+  OB_REQUIRE( function != 0);
+  function->GetLogFile()->SetLogLevel(OBLogFile::None);
+  testHexane(function, hexane);
+  delete function;
+}
@@ -38,4 +38,10 @@ int main()
   OB_ASSERT( var5.AsBool() == false );
   OB_ASSERT( var5.AsString() == "3.678" );
 
+  // equal variants have the same hash, the name is ignored
+  OB_ASSERT( var1.Hash() == OBVariant(3).Hash() );
+  OB_ASSERT( var5.Hash() == OBVariant("3.678").Hash() );
+  OB_ASSERT( OBVariant(0.0).Hash() == OBVariant(-0.0).Hash() );
+  OB_ASSERT( var1.Hash() != OBVariant(4).Hash() );
+
 }
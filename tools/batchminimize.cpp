@@ -0,0 +1,84 @@
+#include <OBFunction>
+#include <OBBatchMinimize>
+
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+using OpenBabel::OBConversion;
+using OpenBabel::OBFormat;
+
+using namespace OpenBabel::OBFFs;
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 4) {
+    cout << "Usage: " << argv[0] << " <function> <filename in> <filename out> [threads] [steps] [filename options]" << endl;
+    cout << "  threads = 0 uses all cores (default 0)" << endl;
+    return -1;
+  }
+
+  if (!OBFunctionFactory::GetFactory(argv[1])) {
+    cout << "ERROR: could not find " << argv[1] << " function" << endl;
+    return -1;
+  }
+
+  OBConversion conv;
+  OBFormat *format_in = conv.FormatFromExt(argv[2]);
+  if (!format_in || !conv.SetInFormat(format_in)) {
+    cout << "ERROR: could not find format for file " << argv[2] << endl;
+    return -1;
+  }
+  OBFormat *format_out = conv.FormatFromExt(argv[3]);
+  if (!format_out || !conv.SetOutFormat(format_out)) {
+    cout << "ERROR: could not find format for file " << argv[3] << endl;
+    return -1;
+  }
+
+  OBBatchMinimize batch(argv[1]);
+  batch.SetNumThreads((argc > 4) ? atoi(argv[4]) : 0);
+  if (argc > 5)
+    batch.SetConvergence(atoi(argv[5]));
+
+  // read options file
+  if (argc > 6) {
+    std::ifstream cifs;
+    cifs.open(argv[6]);
+    std::stringstream options;
+    std::string line;
+    while (std::getline(cifs, line))
+      options << line << std::endl;
+    batch.SetOptions(options.str());
+  }
+
+  std::ifstream ifs;
+  ifs.open(argv[2]);
+  std::ofstream ofs;
+  ofs.open(argv[3]);
+  batch.Run(conv, &ifs, &ofs);
+  ofs.close();
+  ifs.close();
+
+  const std::vector<OBBatchMinimize::Result> &results = batch.GetResults();
+  unsigned int numConverged = 0;
+  cout << "# index  initial E     final E   steps  status  title" << endl;
+  for (unsigned int i = 0; i < results.size(); ++i) {
+    const OBBatchMinimize::Result &result = results[i];
+    if (!result.setup) {
+      cout << result.index << "  setup failed  " << result.title << endl;
+      continue;
+    }
+    if (result.converged)
+      numConverged++;
+    cout << result.index << "  " << result.initialValue << "  " << result.value << "  " << result.steps
+         << "  " << (result.converged ? "converged" : "not converged") << "  " << result.title << endl;
+  }
+  cout << "# " << numConverged << " of " << results.size() << " molecules converged" << endl;
+
+  return 0;
+}